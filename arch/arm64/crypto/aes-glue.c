@@ -279,7 +279,8 @@ static struct skcipher_alg aes_algs[] = { {
 		.cra_name		= "__ecb(aes)",
 		.cra_driver_name	= "__ecb-aes-" MODE,
 		.cra_priority		= PRIO,
-		.cra_flags		= CRYPTO_ALG_INTERNAL,
+		.cra_flags		= CRYPTO_ALG_INTERNAL |
+					  CRYPTO_ALG_SIMD_BATCH,
 		.cra_blocksize		= AES_BLOCK_SIZE,
 		.cra_ctxsize		= sizeof(struct crypto_aes_ctx),
 		.cra_alignmask		= 7,
@@ -295,7 +296,8 @@ static struct skcipher_alg aes_algs[] = { {
 		.cra_name		= "__cbc(aes)",
 		.cra_driver_name	= "__cbc-aes-" MODE,
 		.cra_priority		= PRIO,
-		.cra_flags		= CRYPTO_ALG_INTERNAL,
+		.cra_flags		= CRYPTO_ALG_INTERNAL |
+					  CRYPTO_ALG_SIMD_BATCH,
 		.cra_blocksize		= AES_BLOCK_SIZE,
 		.cra_ctxsize		= sizeof(struct crypto_aes_ctx),
 		.cra_alignmask		= 7,
@@ -312,7 +314,8 @@ static struct skcipher_alg aes_algs[] = { {
 		.cra_name		= "__ctr(aes)",
 		.cra_driver_name	= "__ctr-aes-" MODE,
 		.cra_priority		= PRIO,
-		.cra_flags		= CRYPTO_ALG_INTERNAL,
+		.cra_flags		= CRYPTO_ALG_INTERNAL |
+					  CRYPTO_ALG_SIMD_BATCH,
 		.cra_blocksize		= 1,
 		.cra_ctxsize		= sizeof(struct crypto_aes_ctx),
 		.cra_alignmask		= 7,
@@ -330,7 +333,8 @@ static struct skcipher_alg aes_algs[] = { {
 		.cra_name		= "__xts(aes)",
 		.cra_driver_name	= "__xts-aes-" MODE,
 		.cra_priority		= PRIO,
-		.cra_flags		= CRYPTO_ALG_INTERNAL,
+		.cra_flags		= CRYPTO_ALG_INTERNAL |
+					  CRYPTO_ALG_SIMD_BATCH,
 		.cra_blocksize		= AES_BLOCK_SIZE,
 		.cra_ctxsize		= sizeof(struct crypto_aes_xts_ctx),
 		.cra_alignmask		= 7,
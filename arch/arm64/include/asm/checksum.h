@@ -29,6 +29,16 @@ static inline __sum16 csum_fold(__wsum csum)
 #define do_csum do_csum
 unsigned int do_csum(const unsigned char *buff, unsigned int len);
 
+#define csum_partial_copy_nocheck csum_partial_copy_nocheck
+__wsum csum_partial_copy_nocheck(const void *src, void *dst, int len,
+				 __wsum sum);
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+unsigned int do_csum_neon(const unsigned char *buff, unsigned int len);
+unsigned int do_csum_copy_neon(const unsigned char *src, unsigned char *dst,
+			       unsigned int len);
+#endif
+
 static inline __sum16 ip_fast_csum(const void *iph, unsigned int ihl)
 {
 	__uint128_t tmp;
@@ -17,3 +17,7 @@
 
 void kernel_neon_begin_partial(u32 num_regs);
 void kernel_neon_end(void);
+
+void kernel_neon_batch_begin(void);
+void kernel_neon_batch_end(void);
+unsigned int kernel_neon_batch_depth(void);
@@ -0,0 +1,41 @@
+#ifndef __ASM_SIMD_H
+#define __ASM_SIMD_H
+
+#include <linux/hardirq.h>
+#include <linux/types.h>
+#include <asm/neon.h>
+
+/*
+ * may_use_simd - whether it is allowable at this time to issue SIMD
+ *                instructions or access the SIMD register file
+ */
+static __must_check inline bool may_use_simd(void)
+{
+	return !in_interrupt();
+}
+
+/*
+ * simd_batch_begin - open a section in which consecutive SIMD users share
+ *                    one save and restore of the register file
+ *
+ * Returns false, and opens nothing, where SIMD can't be used right now.
+ */
+static inline bool simd_batch_begin(void)
+{
+	if (!may_use_simd())
+		return false;
+	kernel_neon_batch_begin();
+	return true;
+}
+
+static inline void simd_batch_end(void)
+{
+	kernel_neon_batch_end();
+}
+
+static inline unsigned int simd_batch_depth(void)
+{
+	return kernel_neon_batch_depth();
+}
+
+#endif /* __ASM_SIMD_H */
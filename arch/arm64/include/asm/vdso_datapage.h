@@ -39,6 +39,8 @@ struct vdso_data {
 	__u32 tz_dsttime;
 	__u32 use_syscall;
 	__u32 hrtimer_res;
+	__u64 btm_sec;		/* Monotonic to boot time */
+	__u64 btm_nsec;
 };
 
 #endif /* !__ASSEMBLY__ */
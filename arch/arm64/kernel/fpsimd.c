@@ -285,6 +285,22 @@ void fpsimd_put(void)
 static DEFINE_PER_CPU(struct fpsimd_partial_state, hardirq_fpsimdstate);
 static DEFINE_PER_CPU(struct fpsimd_partial_state, softirq_fpsimdstate);
 
+/*
+ * Nesting depth of kernel_neon_batch_begin() in task, softirq and hardirq
+ * context of this cpu. While a batch is open in a context, the state that
+ * kernel_neon_begin() would save there already has been, and the
+ * kernel_neon_begin()/kernel_neon_end() pairs inside it only have to
+ * keep preemption disabled.
+ */
+static DEFINE_PER_CPU(unsigned int [3], neon_batch_depth);
+
+static unsigned int *this_cpu_neon_batch_depth(void)
+{
+	unsigned int ctx = in_irq() ? 2 : in_interrupt() ? 1 : 0;
+
+	return this_cpu_ptr(&neon_batch_depth[ctx]);
+}
+
 /*
  * Kernel-side NEON support functions
  */
@@ -296,6 +312,8 @@ void kernel_neon_begin_partial(u32 num_regs)
 		struct fpsimd_partial_state *s = this_cpu_ptr(
 			in_irq() ? &hardirq_fpsimdstate : &softirq_fpsimdstate);
 
+		if (*this_cpu_neon_batch_depth())
+			return;
 		BUG_ON(num_regs > 32);
 		fpsimd_save_partial_state(s, roundup(num_regs, 2));
 	} else {
@@ -306,6 +324,8 @@ void kernel_neon_begin_partial(u32 num_regs)
 		 * registers.
 		 */
 		preempt_disable();
+		if (*this_cpu_neon_batch_depth())
+			return;
 		if (current->mm &&
 		    !test_and_set_thread_flag(TIF_FOREIGN_FPSTATE))
 			fpsimd_save_state(&current->thread.fpsimd_state);
@@ -321,6 +341,9 @@ void kernel_neon_end(void)
 	if (in_interrupt()) {
 		struct fpsimd_partial_state *s = this_cpu_ptr(
 			in_irq() ? &hardirq_fpsimdstate : &softirq_fpsimdstate);
+
+		if (*this_cpu_neon_batch_depth())
+			return;
 		fpsimd_load_partial_state(s);
 	} else {
 		preempt_enable();
@@ -328,6 +351,42 @@ void kernel_neon_end(void)
 }
 EXPORT_SYMBOL(kernel_neon_end);
 
+/*
+ * Open a NEON section that spans several kernel_neon_begin()/
+ * kernel_neon_end() pairs, so the FPSIMD state is saved and restored
+ * once for all of them rather than around each. Preemption stays
+ * disabled until the matching kernel_neon_batch_end(), so the caller
+ * has to close the batch now and then to let the scheduler in.
+ */
+void kernel_neon_batch_begin(void)
+{
+	if (!system_supports_fpsimd())
+		return;
+	kernel_neon_begin_partial(32);
+	(*this_cpu_neon_batch_depth())++;
+}
+EXPORT_SYMBOL(kernel_neon_batch_begin);
+
+void kernel_neon_batch_end(void)
+{
+	if (!system_supports_fpsimd())
+		return;
+	WARN_ON(!*this_cpu_neon_batch_depth());
+	(*this_cpu_neon_batch_depth())--;
+	kernel_neon_end();
+}
+EXPORT_SYMBOL(kernel_neon_batch_end);
+
+/*
+ * Number of kernel_neon_batch_begin() sections open in the current
+ * context, each of which holds one level of preempt count in task context.
+ */
+unsigned int kernel_neon_batch_depth(void)
+{
+	return *this_cpu_neon_batch_depth();
+}
+EXPORT_SYMBOL(kernel_neon_batch_depth);
+
 #endif /* CONFIG_KERNEL_MODE_NEON */
 
 #ifdef CONFIG_CPU_PM
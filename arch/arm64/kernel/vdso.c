@@ -1,5 +1,6 @@
 /*
- * VDSO implementation for AArch64 and vector page setup for AArch32.
+ * VDSO implementation for AArch64, and vector page and compat VDSO setup
+ * for AArch32.
  *
  * Copyright (C) 2012 ARM Limited
  *
@@ -84,6 +85,97 @@ static int __init alloc_vectors_page(void)
 }
 arch_initcall(alloc_vectors_page);
 
+#ifdef CONFIG_COMPAT_VDSO
+/*
+ * The AArch32 vDSO, laid out like the AArch64 one: the shared data page
+ * followed by the code pages.
+ */
+extern char vdso32_start[], vdso32_end[];
+static unsigned long vdso32_pages __ro_after_init;
+
+static struct vm_special_mapping vdso32_spec[2] __ro_after_init = {
+	{
+		.name	= "[vvar]",
+	},
+	{
+		.name	= "[vdso]",
+	},
+};
+
+static int __init vdso32_init(void)
+{
+	struct page **vdso_pagelist;
+	unsigned long pages, pfn;
+	int i;
+
+	if (memcmp(vdso32_start, "\177ELF", 4)) {
+		pr_err("compat vDSO is not a valid ELF object!\n");
+		return -EINVAL;
+	}
+
+	pages = (vdso32_end - vdso32_start) >> PAGE_SHIFT;
+	pr_info("vdso32: %ld pages (%ld code @ %p, %ld data @ %p)\n",
+		pages + 1, pages, vdso32_start, 1L, vdso_data);
+
+	/* Allocate the vDSO pagelist, plus a page for the data. */
+	vdso_pagelist = kcalloc(pages + 1, sizeof(struct page *), GFP_KERNEL);
+	if (vdso_pagelist == NULL)
+		return -ENOMEM;
+
+	/* The data page is shared with the AArch64 vDSO. */
+	vdso_pagelist[0] = phys_to_page(__pa_symbol(vdso_data));
+
+	pfn = sym_to_pfn(vdso32_start);
+	for (i = 0; i < pages; i++)
+		vdso_pagelist[i + 1] = pfn_to_page(pfn + i);
+
+	vdso32_spec[0].pages = &vdso_pagelist[0];
+	vdso32_spec[1].pages = &vdso_pagelist[1];
+	vdso32_pages = pages;
+
+	return 0;
+}
+arch_initcall(vdso32_init);
+
+static int aarch32_setup_vdso(struct mm_struct *mm)
+{
+	unsigned long vdso_base, vdso_text_len = vdso32_pages << PAGE_SHIFT;
+	void *ret;
+
+	/* Without an image the task simply keeps using syscalls */
+	if (!vdso32_pages)
+		return 0;
+
+	vdso_base = get_unmapped_area(NULL, 0, vdso_text_len + PAGE_SIZE,
+				      0, 0);
+	if (IS_ERR_VALUE(vdso_base))
+		return vdso_base;
+
+	ret = _install_special_mapping(mm, vdso_base, PAGE_SIZE,
+				       VM_READ|VM_MAYREAD,
+				       &vdso32_spec[0]);
+	if (IS_ERR(ret))
+		return PTR_ERR(ret);
+
+	vdso_base += PAGE_SIZE;
+	ret = _install_special_mapping(mm, vdso_base, vdso_text_len,
+				       VM_READ|VM_EXEC|
+				       VM_MAYREAD|VM_MAYWRITE|VM_MAYEXEC,
+				       &vdso32_spec[1]);
+	if (IS_ERR(ret))
+		return PTR_ERR(ret);
+
+	/* Handed to userspace as AT_SYSINFO_EHDR */
+	mm->context.vdso = (void *)vdso_base;
+	return 0;
+}
+#else
+static int aarch32_setup_vdso(struct mm_struct *mm)
+{
+	return 0;
+}
+#endif /* CONFIG_COMPAT_VDSO */
+
 int aarch32_setup_vectors_page(struct linux_binprm *bprm, int uses_interp)
 {
 	struct mm_struct *mm = current->mm;
@@ -97,12 +189,18 @@ int aarch32_setup_vectors_page(struct linux_binprm *bprm, int uses_interp)
 
 	if (down_write_killable(&mm->mmap_sem))
 		return -EINTR;
+#ifdef CONFIG_COMPAT_VDSO
+	current->mm->context.vdso = NULL;
+#else
 	current->mm->context.vdso = (void *)addr;
+#endif
 
 	/* Map vectors page at the high address. */
 	ret = _install_special_mapping(mm, addr, PAGE_SIZE,
 				       VM_READ|VM_EXEC|VM_MAYREAD|VM_MAYEXEC,
 				       &spec);
+	if (!IS_ERR(ret))
+		ret = ERR_PTR(aarch32_setup_vdso(mm));
 
 	up_write(&mm->mmap_sem);
 
@@ -206,6 +304,7 @@ up_fail:
 void update_vsyscall(struct timekeeper *tk)
 {
 	u32 use_syscall = !tk->tkr_mono.clock->archdata.vdso_direct;
+	struct timespec btm = ktime_to_timespec(tk->offs_boot);
 
 	++vdso_data->tb_seq_count;
 	smp_wmb();
@@ -216,6 +315,8 @@ void update_vsyscall(struct timekeeper *tk)
 							tk->tkr_mono.shift;
 	vdso_data->wtm_clock_sec		= tk->wall_to_monotonic.tv_sec;
 	vdso_data->wtm_clock_nsec		= tk->wall_to_monotonic.tv_nsec;
+	vdso_data->btm_sec			= btm.tv_sec;
+	vdso_data->btm_nsec			= btm.tv_nsec;
 
 	/* Read without the seqlock held by clock_getres() */
 	WRITE_ONCE(vdso_data->hrtimer_res, hrtimer_resolution);
@@ -0,0 +1,232 @@
+/*
+ * Time functions of the AArch32 compat vDSO.
+ *
+ * This is built by the AArch32 compiler, so apart from the layout of the
+ * data page it shares with the AArch64 vDSO, and the compat syscall
+ * numbers, it cannot use the kernel headers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+typedef unsigned int __u32;
+typedef unsigned long long __u64;
+typedef __u32 u32;
+typedef __u64 u64;
+
+#include <asm/unistd32.h>
+#include <asm/vdso_datapage.h>
+
+#define notrace			__attribute__((no_instrument_function))
+
+#define NSEC_PER_SEC		1000000000UL
+#define NSEC_PER_USEC		1000UL
+
+#define CLOCK_REALTIME		0
+#define CLOCK_MONOTONIC		1
+#define CLOCK_REALTIME_COARSE	5
+#define CLOCK_MONOTONIC_COARSE	6
+#define CLOCK_BOOTTIME		7
+
+/* The AArch32 user ABI types */
+struct vdso_timespec {
+	long tv_sec;
+	long tv_nsec;
+};
+
+struct vdso_timeval {
+	long tv_sec;
+	long tv_usec;
+};
+
+struct vdso_timezone {
+	int tz_minuteswest;
+	int tz_dsttime;
+};
+
+#define READ_ONCE(x)		(*(const volatile typeof(x) *)&(x))
+#define smp_rmb()		asm volatile("dmb ish" : : : "memory")
+
+extern const struct vdso_data *__get_datapage(void);
+
+static notrace u32 vdso_read_begin(const struct vdso_data *vdata)
+{
+	u32 seq;
+
+	while ((seq = READ_ONCE(vdata->tb_seq_count)) & 1)
+		;
+
+	smp_rmb(); /* Pairs with the second smp_wmb in update_vsyscall */
+	return seq;
+}
+
+static notrace int vdso_read_retry(const struct vdso_data *vdata, u32 start)
+{
+	smp_rmb(); /* Pairs with the first smp_wmb in update_vsyscall */
+	return READ_ONCE(vdata->tb_seq_count) != start;
+}
+
+static notrace void vdso_set_ts(struct vdso_timespec *ts, u64 sec, u64 nsec)
+{
+	/* Only ever a few seconds' worth, and keep gcc from dividing */
+	while (nsec >= NSEC_PER_SEC) {
+		asm("" : "+r" (nsec));
+		nsec -= NSEC_PER_SEC;
+		sec++;
+	}
+	ts->tv_sec = sec;
+	ts->tv_nsec = nsec;
+}
+
+static notrace u64 get_ns(const struct vdso_data *vdata)
+{
+	u64 cycle_now;
+
+	/* CNTVCT, not to be read ahead of the sequence count */
+	asm volatile("isb\n\tmrrc p15, 1, %Q0, %R0, c14"
+		     : "=r" (cycle_now) : : "memory");
+
+	return ((cycle_now - vdata->cs_cycle_last) * vdata->cs_mono_mult +
+		vdata->xtime_clock_nsec) >> vdata->cs_shift;
+}
+
+static notrace int do_hres(const struct vdso_data *vdata, int clkid,
+			   struct vdso_timespec *ts)
+{
+	u64 sec, nsec;
+	u32 seq;
+
+	do {
+		seq = vdso_read_begin(vdata);
+
+		/* The counter is not usable from userspace */
+		if (vdata->use_syscall)
+			return -1;
+
+		sec = vdata->xtime_clock_sec;
+		nsec = get_ns(vdata);
+
+		if (clkid != CLOCK_REALTIME) {
+			sec += vdata->wtm_clock_sec;
+			nsec += vdata->wtm_clock_nsec;
+		}
+		if (clkid == CLOCK_BOOTTIME) {
+			sec += vdata->btm_sec;
+			nsec += vdata->btm_nsec;
+		}
+	} while (vdso_read_retry(vdata, seq));
+
+	vdso_set_ts(ts, sec, nsec);
+	return 0;
+}
+
+static notrace void do_coarse(const struct vdso_data *vdata, int clkid,
+			      struct vdso_timespec *ts)
+{
+	u64 sec, nsec;
+	u32 seq;
+
+	do {
+		seq = vdso_read_begin(vdata);
+
+		sec = vdata->xtime_coarse_sec;
+		nsec = vdata->xtime_coarse_nsec;
+
+		if (clkid == CLOCK_MONOTONIC_COARSE) {
+			sec += vdata->wtm_clock_sec;
+			nsec += vdata->wtm_clock_nsec;
+		}
+	} while (vdso_read_retry(vdata, seq));
+
+	vdso_set_ts(ts, sec, nsec);
+}
+
+static notrace long clock_gettime_fallback(int _clkid,
+					   struct vdso_timespec *_ts)
+{
+	register struct vdso_timespec *ts asm("r1") = _ts;
+	register int clkid asm("r0") = _clkid;
+	register long ret asm ("r0");
+	register long nr asm("r7") = __NR_clock_gettime;
+
+	asm volatile(
+	"	swi #0\n"
+	: "=r" (ret)
+	: "r" (clkid), "r" (ts), "r" (nr)
+	: "memory");
+
+	return ret;
+}
+
+static notrace long gettimeofday_fallback(struct vdso_timeval *_tv,
+					  struct vdso_timezone *_tz)
+{
+	register struct vdso_timezone *tz asm("r1") = _tz;
+	register struct vdso_timeval *tv asm("r0") = _tv;
+	register long ret asm ("r0");
+	register long nr asm("r7") = __NR_gettimeofday;
+
+	asm volatile(
+	"	swi #0\n"
+	: "=r" (ret)
+	: "r" (tv), "r" (tz), "r" (nr)
+	: "memory");
+
+	return ret;
+}
+
+notrace int __vdso_clock_gettime(int clkid, struct vdso_timespec *ts)
+{
+	const struct vdso_data *vdata = __get_datapage();
+
+	switch (clkid) {
+	case CLOCK_REALTIME_COARSE:
+	case CLOCK_MONOTONIC_COARSE:
+		do_coarse(vdata, clkid, ts);
+		return 0;
+	case CLOCK_REALTIME:
+	case CLOCK_MONOTONIC:
+	case CLOCK_BOOTTIME:
+		if (!do_hres(vdata, clkid, ts))
+			return 0;
+		break;
+	}
+
+	return clock_gettime_fallback(clkid, ts);
+}
+
+notrace int __vdso_gettimeofday(struct vdso_timeval *tv,
+				struct vdso_timezone *tz)
+{
+	const struct vdso_data *vdata = __get_datapage();
+	struct vdso_timespec ts;
+
+	if (do_hres(vdata, CLOCK_REALTIME, &ts))
+		return gettimeofday_fallback(tv, tz);
+
+	if (tv) {
+		tv->tv_sec = ts.tv_sec;
+		tv->tv_usec = ts.tv_nsec / NSEC_PER_USEC;
+	}
+	if (tz) {
+		tz->tz_minuteswest = vdata->tz_minuteswest;
+		tz->tz_dsttime = vdata->tz_dsttime;
+	}
+
+	return 0;
+}
+
+/* Avoid unresolved references emitted by GCC */
+
+void __aeabi_unwind_cpp_pr0(void)
+{
+}
+
+void __aeabi_unwind_cpp_pr1(void)
+{
+}
+
+void __aeabi_unwind_cpp_pr2(void)
+{
+}
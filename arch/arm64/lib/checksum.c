@@ -12,8 +12,40 @@
  */
 
 #include <linux/compiler.h>
+#include <linux/init.h>
+#include <linux/jump_label.h>
 #include <linux/module.h>
+#include <linux/string.h>
 #include <asm/checksum.h>
+#include <asm/neon.h>
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+/*
+ * Below this many bytes, saving and restoring the NEON registers costs
+ * more than the wider accumulation wins back.
+ */
+#define CSUM_NEON_MIN_LEN	256
+
+static DEFINE_STATIC_KEY_FALSE(csum_use_neon);
+
+static int __init csum_neon_init(void)
+{
+	if (cpu_has_neon())
+		static_branch_enable(&csum_use_neon);
+	return 0;
+}
+arch_initcall(csum_neon_init);
+
+static inline bool csum_want_neon(unsigned int len)
+{
+	return static_branch_likely(&csum_use_neon) && len >= CSUM_NEON_MIN_LEN;
+}
+#else
+static inline bool csum_want_neon(unsigned int len)
+{
+	return false;
+}
+#endif
 
 static inline unsigned short from64to16(unsigned long x)
 {
@@ -45,7 +77,7 @@ static inline unsigned short from64to16(unsigned long x)
  * Do a 64-bit checksum on an arbitrary memory area.
  * Returns a 16bit checksum.
  */
-unsigned int do_csum(const unsigned char *buff, unsigned len)
+static unsigned int do_csum_scalar(const unsigned char *buff, unsigned len)
 {
 	unsigned odd, count;
 	unsigned long result = 0;
@@ -141,4 +173,45 @@ unsigned int do_csum(const unsigned char *buff, unsigned len)
 		result = ((result >> 8) & 0xff) | ((result & 0xff) << 8);
 
 	return result;
-}
\ No newline at end of file
+}
+
+unsigned int do_csum(const unsigned char *buff, unsigned len)
+{
+	unsigned int result;
+
+	if (!csum_want_neon(len))
+		return do_csum_scalar(buff, len);
+
+	kernel_neon_begin();
+	result = do_csum_neon(buff, len);
+	kernel_neon_end();
+
+	return result;
+}
+
+/*
+ * Like csum_partial_copy(), but reads the source only once when the
+ * copy is long enough to go through NEON.
+ */
+__wsum csum_partial_copy_nocheck(const void *src, void *dst, int len,
+				 __wsum wsum)
+{
+	unsigned int sum = (__force unsigned int)wsum;
+	unsigned int result;
+
+	if (!csum_want_neon(len)) {
+		memcpy(dst, src, len);
+		return csum_partial(dst, len, wsum);
+	}
+
+	kernel_neon_begin();
+	result = do_csum_copy_neon(src, dst, len);
+	kernel_neon_end();
+
+	/* add in old sum, and carry.. */
+	result += sum;
+	if (sum > result)
+		result += 1;
+	return (__force __wsum)result;
+}
+EXPORT_SYMBOL(csum_partial_copy_nocheck);
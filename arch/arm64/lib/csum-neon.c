@@ -0,0 +1,111 @@
+/*
+ * arch/arm64/lib/csum-neon.c
+ *
+ * NEON versions of do_csum() and of a copy that checksums on the way.
+ * Both must be called between kernel_neon_begin() and kernel_neon_end().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/string.h>
+#include <asm/checksum.h>
+#include <asm/neon-intrinsics.h>
+
+/*
+ * Each UADALP adds two 32-bit words into a 64-bit lane, so the four
+ * accumulators cannot overflow for any length that fits an unsigned int.
+ */
+static __always_inline unsigned int __csum_neon(const unsigned char *src,
+						unsigned char *dst,
+						unsigned int len)
+{
+	uint64x2_t acc0 = vdupq_n_u64(0), acc1 = vdupq_n_u64(0);
+	uint64x2_t acc2 = vdupq_n_u64(0), acc3 = vdupq_n_u64(0);
+	unsigned int odd = 1 & (unsigned long)src;
+	unsigned long result = 0;
+
+	/* Pair the bytes up as if the buffer started on an even address */
+	if (odd) {
+		if (dst)
+			*dst++ = *src;
+		result = *src++ << 8;
+		len--;
+	}
+
+	/* Unaligned loads are cheap, so there is no alignment head to do */
+	while (len >= 64) {
+		uint32x4_t v0 = vld1q_u32((const u32 *)(src +  0));
+		uint32x4_t v1 = vld1q_u32((const u32 *)(src + 16));
+		uint32x4_t v2 = vld1q_u32((const u32 *)(src + 32));
+		uint32x4_t v3 = vld1q_u32((const u32 *)(src + 48));
+
+		if (dst) {
+			vst1q_u32((u32 *)(dst +  0), v0);
+			vst1q_u32((u32 *)(dst + 16), v1);
+			vst1q_u32((u32 *)(dst + 32), v2);
+			vst1q_u32((u32 *)(dst + 48), v3);
+			dst += 64;
+		}
+
+		acc0 = vpadalq_u32(acc0, v0);
+		acc1 = vpadalq_u32(acc1, v1);
+		acc2 = vpadalq_u32(acc2, v2);
+		acc3 = vpadalq_u32(acc3, v3);
+
+		src += 64;
+		len -= 64;
+	}
+
+	while (len >= 16) {
+		uint32x4_t v0 = vld1q_u32((const u32 *)src);
+
+		if (dst) {
+			vst1q_u32((u32 *)dst, v0);
+			dst += 16;
+		}
+		acc0 = vpadalq_u32(acc0, v0);
+
+		src += 16;
+		len -= 16;
+	}
+
+	/* Zero padding keeps the tail's bytes in the right halves */
+	if (len) {
+		u32 tail[4] = { 0 };
+
+		memcpy(tail, src, len);
+		if (dst)
+			memcpy(dst, src, len);
+		acc1 = vpadalq_u32(acc1, vld1q_u32(tail));
+	}
+
+	acc0 = vaddq_u64(vaddq_u64(acc0, acc1), vaddq_u64(acc2, acc3));
+	result += vgetq_lane_u64(acc0, 0) & 0xffffffff;
+	result += vgetq_lane_u64(acc0, 0) >> 32;
+	result += vgetq_lane_u64(acc0, 1) & 0xffffffff;
+	result += vgetq_lane_u64(acc0, 1) >> 32;
+
+	/* At most 35 bits from here, so two folds of each size will do */
+	result = (result & 0xffffffff) + (result >> 32);
+	result = (result & 0xffffffff) + (result >> 32);
+	result = (result & 0xffff) + (result >> 16);
+	result = (result & 0xffff) + (result >> 16);
+
+	if (odd)
+		result = ((result >> 8) & 0xff) | ((result & 0xff) << 8);
+
+	return result;
+}
+
+unsigned int do_csum_neon(const unsigned char *buff, unsigned int len)
+{
+	return __csum_neon(buff, NULL, len);
+}
+
+unsigned int do_csum_copy_neon(const unsigned char *src, unsigned char *dst,
+			       unsigned int len)
+{
+	return __csum_neon(src, dst, len);
+}
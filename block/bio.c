@@ -28,8 +28,10 @@
 #include <linux/mempool.h>
 #include <linux/workqueue.h>
 #include <linux/cgroup.h>
+#include <linux/blk-cgroup.h>
 
 #include <trace/events/block.h>
+#include "blk-wbt.h"
 
 /*
  * Test patch to inline a certain number of bi_io_vec's inside the bio
@@ -296,6 +298,9 @@ void bio_reset(struct bio *bio)
 {
 	unsigned long flags = bio->bi_flags & (~0UL << BIO_RESET_BITS);
 
+	/* a reused bio hasn't been charged to writeback throttling yet */
+	flags &= ~(1UL << BIO_WBT);
+
 	__bio_free(bio);
 
 	memset(bio, 0, BIO_RESET_BYTES);
@@ -1860,6 +1865,9 @@ again:
 	if (!bio_remaining_done(bio))
 		return;
 
+	blk_iolatency_bio_endio(bio);
+	wbt_bio_endio(bio);
+
 	/*
 	 * Need to have a real endio function for chained bios, otherwise
 	 * various corner cases will break (like stacking block devices that
@@ -40,6 +40,7 @@
 
 #include "blk.h"
 #include "blk-mq.h"
+#include "blk-wbt.h"
 
 #include <linux/math64.h>
 
@@ -1973,6 +1974,8 @@ generic_make_request_checks(struct bio *bio)
 	if (!blkcg_bio_issue_check(q, bio))
 		return false;
 
+	wbt_bio_issue(q, bio);
+
 	trace_block_bio_queue(q, bio);
 	return true;
 
@@ -0,0 +1,499 @@
+/*
+ * Latency target based IO controller
+ *
+ * Each cgroup can be given a completion latency target per device.  The
+ * mean latency of every group with a target is checked once per window.
+ * If a group misses its target, every group with a looser target (or none
+ * at all) has the number of bios it may have in flight on the device
+ * halved.  While all targets are met, the limits are raised again step by
+ * step until they are gone.
+ *
+ * Bios are accounted in blkcg_bio_issue_check() and bio_endio(), so this
+ * works for both legacy and blk-mq queues as well as for bio based
+ * drivers.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+#include <linux/blk-cgroup.h>
+#include <linux/ktime.h>
+#include "blk.h"
+
+/* Latencies are averaged and compared against the targets over this window */
+#define IOLAT_WIN_NSEC		(100 * NSEC_PER_MSEC)
+
+/* Windows with fewer samples than this don't count */
+#define IOLAT_MIN_SAMPLES	4
+
+/* Depth limits are raised in steps of 1/IOLAT_SCALE_UP_DIV of nr_requests */
+#define IOLAT_SCALE_UP_DIV	8
+
+#define IOLAT_UNLIMITED		UINT_MAX
+
+static struct blkcg_policy blkcg_policy_iolatency;
+
+struct iolatency_data {
+	struct request_queue *queue;
+
+	spinlock_t lock;
+	struct list_head groups;	/* iolat_grp's of this queue */
+	unsigned int nr_targets;	/* groups with a latency target */
+	u64 last_miss;			/* ns, last time a target was missed */
+	u64 last_scale_down;		/* ns */
+};
+
+struct iolat_grp {
+	/* must be the first member */
+	struct blkg_policy_data pd;
+
+	struct iolatency_data *iol;
+	struct list_head node;
+
+	u64 target;			/* ns, 0 if none */
+
+	unsigned int max_depth;		/* bios allowed in flight */
+	atomic_t inflight;
+	wait_queue_head_t wait;
+
+	u64 win_start;
+	atomic64_t lat_sum;
+	atomic_t nr_samples;
+
+	/* stats */
+	u64 last_mean;
+	u64 nr_missed;
+	u64 nr_scaled_down;
+	atomic64_t nr_throttled;
+	atomic64_t throttled_ns;
+};
+
+static inline struct iolat_grp *pd_to_ig(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct iolat_grp, pd) : NULL;
+}
+
+static inline struct iolat_grp *blkg_to_ig(struct blkcg_gq *blkg)
+{
+	return pd_to_ig(blkg_to_pd(blkg, &blkcg_policy_iolatency));
+}
+
+static inline struct blkcg_gq *ig_to_blkg(struct iolat_grp *ig)
+{
+	return pd_to_blkg(&ig->pd);
+}
+
+static bool atomic_inc_below(atomic_t *v, unsigned int below)
+{
+	unsigned int cur = atomic_read(v);
+
+	for (;;) {
+		unsigned int old;
+
+		if (cur >= below)
+			return false;
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			break;
+		cur = old;
+	}
+
+	return true;
+}
+
+/*
+ * Halve the depth of every group that has a looser target than @target.
+ * Called with iol->lock held.
+ */
+static void iolat_scale_down(struct iolatency_data *iol, u64 target, u64 now)
+{
+	unsigned int nr_requests = max_t(unsigned int,
+					 iol->queue->nr_requests, 2);
+	struct iolat_grp *ig;
+
+	iol->last_miss = now;
+	if (now - iol->last_scale_down < IOLAT_WIN_NSEC)
+		return;
+	iol->last_scale_down = now;
+
+	list_for_each_entry(ig, &iol->groups, node) {
+		unsigned int depth = ig->max_depth;
+
+		if (ig->target && ig->target <= target)
+			continue;
+
+		if (depth == IOLAT_UNLIMITED)
+			depth = nr_requests;
+		depth = max(depth / 2, 1U);
+		if (depth != ig->max_depth) {
+			WRITE_ONCE(ig->max_depth, depth);
+			ig->nr_scaled_down++;
+		}
+	}
+}
+
+/*
+ * All targets have been met for a while, give some depth back.  Called
+ * with iol->lock held.
+ */
+static void iolat_scale_up(struct iolatency_data *iol)
+{
+	unsigned int nr_requests = max_t(unsigned int,
+					 iol->queue->nr_requests, 2);
+	unsigned int step = max(nr_requests / IOLAT_SCALE_UP_DIV, 1U);
+	struct iolat_grp *ig;
+
+	list_for_each_entry(ig, &iol->groups, node) {
+		unsigned int depth = ig->max_depth;
+
+		if (depth == IOLAT_UNLIMITED)
+			continue;
+
+		depth += step;
+		if (depth >= nr_requests)
+			depth = IOLAT_UNLIMITED;
+		WRITE_ONCE(ig->max_depth, depth);
+		wake_up_all(&ig->wait);
+	}
+}
+
+static void iolat_window_end(struct iolat_grp *ig, u64 now)
+{
+	struct iolatency_data *iol = ig->iol;
+	unsigned long flags;
+	unsigned int nr;
+	u64 sum;
+
+	spin_lock_irqsave(&iol->lock, flags);
+
+	if (now - ig->win_start < IOLAT_WIN_NSEC)
+		goto out_unlock;
+	ig->win_start = now;
+
+	nr = atomic_xchg(&ig->nr_samples, 0);
+	sum = atomic64_xchg(&ig->lat_sum, 0);
+
+	if (ig->target && nr >= IOLAT_MIN_SAMPLES) {
+		ig->last_mean = div_u64(sum, nr);
+		if (ig->last_mean > ig->target) {
+			ig->nr_missed++;
+			iolat_scale_down(iol, ig->target, now);
+			goto out_unlock;
+		}
+	}
+
+	if (now - iol->last_miss >= 2 * IOLAT_WIN_NSEC)
+		iolat_scale_up(iol);
+
+out_unlock:
+	spin_unlock_irqrestore(&iol->lock, flags);
+}
+
+/*
+ * Called from blkcg_bio_issue_check() under rcu_read_lock().  Take a
+ * reference on @blkg for the bio if its latency has to be tracked, in which
+ * case blk_iolatency_throttle() must be called once out of the RCU section.
+ */
+bool blk_iolatency_track(struct request_queue *q, struct blkcg_gq *blkg,
+			 struct bio *bio)
+{
+	struct iolatency_data *iol = q->iolat;
+
+	if (!iol || !READ_ONCE(iol->nr_targets))
+		return false;
+	if (!blkg || !blkg->parent || bio->bi_iolat_blkg)
+		return false;
+
+	blkg_get(blkg);
+	bio->bi_iolat_blkg = blkg;
+	return true;
+}
+
+/*
+ * Wait until the bio's group is below its depth limit and count the bio
+ * as in flight.  Nested submissions, reclaim and high priority metadata
+ * are never made to wait.
+ */
+void blk_iolatency_throttle(struct bio *bio)
+{
+	struct iolat_grp *ig = blkg_to_ig(bio->bi_iolat_blkg);
+	u64 start;
+
+	if (likely(atomic_inc_below(&ig->inflight,
+				    READ_ONCE(ig->max_depth))))
+		goto out;
+
+	if (current->bio_list || (current->flags & PF_MEMALLOC) ||
+	    (bio->bi_opf & (REQ_META | REQ_PRIO)) ||
+	    in_atomic() || irqs_disabled() || fatal_signal_pending(current)) {
+		atomic_inc(&ig->inflight);
+		goto out;
+	}
+
+	start = ktime_get_ns();
+	wait_event(ig->wait, atomic_inc_below(&ig->inflight,
+					      READ_ONCE(ig->max_depth)));
+	atomic64_inc(&ig->nr_throttled);
+	atomic64_add(ktime_get_ns() - start, &ig->throttled_ns);
+out:
+	bio->bi_iolat_start = ktime_get_ns();
+}
+
+void blk_iolatency_done_bio(struct bio *bio)
+{
+	struct blkcg_gq *blkg = bio->bi_iolat_blkg;
+	struct iolat_grp *ig = blkg_to_ig(blkg);
+	u64 now = ktime_get_ns();
+
+	bio->bi_iolat_blkg = NULL;
+
+	if (atomic_dec_return(&ig->inflight) < READ_ONCE(ig->max_depth) &&
+	    waitqueue_active(&ig->wait))
+		wake_up(&ig->wait);
+
+	if (bio_op(bio) != REQ_OP_DISCARD && bio->bi_iolat_start) {
+		atomic64_add(now - bio->bi_iolat_start, &ig->lat_sum);
+		atomic_inc(&ig->nr_samples);
+	}
+
+	if (now - READ_ONCE(ig->win_start) >= IOLAT_WIN_NSEC)
+		iolat_window_end(ig, now);
+
+	blkg_put(blkg);
+}
+
+static struct blkg_policy_data *iolatency_pd_alloc(gfp_t gfp, int node)
+{
+	struct iolat_grp *ig;
+
+	ig = kzalloc_node(sizeof(*ig), gfp, node);
+	if (!ig)
+		return NULL;
+
+	INIT_LIST_HEAD(&ig->node);
+	ig->max_depth = IOLAT_UNLIMITED;
+	atomic_set(&ig->inflight, 0);
+	init_waitqueue_head(&ig->wait);
+	atomic64_set(&ig->lat_sum, 0);
+	atomic_set(&ig->nr_samples, 0);
+	atomic64_set(&ig->nr_throttled, 0);
+	atomic64_set(&ig->throttled_ns, 0);
+
+	return &ig->pd;
+}
+
+static void iolatency_pd_init(struct blkg_policy_data *pd)
+{
+	struct iolat_grp *ig = pd_to_ig(pd);
+	struct blkcg_gq *blkg = ig_to_blkg(ig);
+	struct iolatency_data *iol = blkg->q->iolat;
+
+	ig->iol = iol;
+	ig->win_start = ktime_get_ns();
+
+	/* the root group is never throttled */
+	if (!blkg->parent)
+		return;
+
+	/* called under queue_lock, irqs are already off */
+	spin_lock(&iol->lock);
+	list_add(&ig->node, &iol->groups);
+	spin_unlock(&iol->lock);
+}
+
+static void iolatency_pd_offline(struct blkg_policy_data *pd)
+{
+	struct iolat_grp *ig = pd_to_ig(pd);
+	struct iolatency_data *iol = ig->iol;
+
+	spin_lock(&iol->lock);
+	list_del_init(&ig->node);
+	if (ig->target) {
+		ig->target = 0;
+		iol->nr_targets--;
+	}
+	ig->max_depth = IOLAT_UNLIMITED;
+	spin_unlock(&iol->lock);
+
+	wake_up_all(&ig->wait);
+}
+
+static void iolatency_pd_free(struct blkg_policy_data *pd)
+{
+	kfree(pd_to_ig(pd));
+}
+
+static u64 iolat_prfill_target(struct seq_file *sf,
+			       struct blkg_policy_data *pd, int off)
+{
+	struct iolat_grp *ig = pd_to_ig(pd);
+
+	if (!ig->target)
+		return 0;
+	return __blkg_prfill_u64(sf, pd, div_u64(ig->target, NSEC_PER_USEC));
+}
+
+static int iolat_print_target(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), iolat_prfill_target,
+			  &blkcg_policy_iolatency, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static ssize_t iolat_set_target(struct kernfs_open_file *of,
+				char *buf, size_t nbytes, loff_t off)
+{
+	struct blkcg *blkcg = css_to_blkcg(of_css(of));
+	struct iolatency_data *iol;
+	struct blkg_conf_ctx ctx;
+	struct iolat_grp *ig;
+	u64 v;
+	int ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iolatency, buf, &ctx);
+	if (ret)
+		return ret;
+
+	ret = -EINVAL;
+	if (sscanf(ctx.body, "%llu", &v) != 1)
+		goto out_finish;
+	if (!ctx.blkg->parent)
+		goto out_finish;
+
+	ig = blkg_to_ig(ctx.blkg);
+	iol = ig->iol;
+	v *= NSEC_PER_USEC;
+
+	spin_lock(&iol->lock);
+	if (ig->target && !v)
+		iol->nr_targets--;
+	else if (!ig->target && v)
+		iol->nr_targets++;
+	ig->target = v;
+
+	/* without any target left, nobody should stay throttled */
+	if (!iol->nr_targets) {
+		list_for_each_entry(ig, &iol->groups, node) {
+			ig->max_depth = IOLAT_UNLIMITED;
+			wake_up_all(&ig->wait);
+		}
+	}
+	spin_unlock(&iol->lock);
+
+	ret = 0;
+out_finish:
+	blkg_conf_finish(&ctx);
+	return ret ?: nbytes;
+}
+
+static u64 iolat_prfill_stat(struct seq_file *sf,
+			     struct blkg_policy_data *pd, int off)
+{
+	struct iolat_grp *ig = pd_to_ig(pd);
+	const char *dname = blkg_dev_name(pd->blkg);
+	unsigned int depth = READ_ONCE(ig->max_depth);
+	char buf[16] = "max";
+
+	if (!dname || !pd->blkg->parent)
+		return 0;
+
+	if (depth != IOLAT_UNLIMITED)
+		snprintf(buf, sizeof(buf), "%u", depth);
+
+	seq_printf(sf, "%s target=%llu mean_lat=%llu depth=%s inflight=%d missed=%llu scaled_down=%llu throttled=%lld throttled_us=%lld\n",
+		   dname, div_u64(ig->target, NSEC_PER_USEC),
+		   div_u64(ig->last_mean, NSEC_PER_USEC), buf,
+		   atomic_read(&ig->inflight), ig->nr_missed,
+		   ig->nr_scaled_down,
+		   (s64)atomic64_read(&ig->nr_throttled),
+		   (s64)div_u64(atomic64_read(&ig->throttled_ns),
+				NSEC_PER_USEC));
+	return 0;
+}
+
+static int iolat_print_stat(struct seq_file *sf, void *v)
+{
+	blkcg_print_blkgs(sf, css_to_blkcg(seq_css(sf)), iolat_prfill_stat,
+			  &blkcg_policy_iolatency, seq_cft(sf)->private, false);
+	return 0;
+}
+
+static struct cftype iolatency_legacy_files[] = {
+	{
+		.name = "latency.target_device",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = iolat_print_target,
+		.write = iolat_set_target,
+	},
+	{
+		.name = "latency.stat",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = iolat_print_stat,
+	},
+	{ }	/* terminate */
+};
+
+static struct cftype iolatency_files[] = {
+	{
+		.name = "latency",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = iolat_print_target,
+		.write = iolat_set_target,
+	},
+	{
+		.name = "latency.stat",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = iolat_print_stat,
+	},
+	{ }	/* terminate */
+};
+
+static struct blkcg_policy blkcg_policy_iolatency = {
+	.dfl_cftypes		= iolatency_files,
+	.legacy_cftypes		= iolatency_legacy_files,
+
+	.pd_alloc_fn		= iolatency_pd_alloc,
+	.pd_init_fn		= iolatency_pd_init,
+	.pd_offline_fn		= iolatency_pd_offline,
+	.pd_free_fn		= iolatency_pd_free,
+};
+
+int blk_iolatency_init(struct request_queue *q)
+{
+	struct iolatency_data *iol;
+	int ret;
+
+	iol = kzalloc_node(sizeof(*iol), GFP_KERNEL, q->node);
+	if (!iol)
+		return -ENOMEM;
+
+	iol->queue = q;
+	spin_lock_init(&iol->lock);
+	INIT_LIST_HEAD(&iol->groups);
+
+	q->iolat = iol;
+
+	/* activate policy */
+	ret = blkcg_activate_policy(q, &blkcg_policy_iolatency);
+	if (ret) {
+		q->iolat = NULL;
+		kfree(iol);
+	}
+	return ret;
+}
+
+void blk_iolatency_exit(struct request_queue *q)
+{
+	BUG_ON(!q->iolat);
+	blkcg_deactivate_policy(q, &blkcg_policy_iolatency);
+	kfree(q->iolat);
+	q->iolat = NULL;
+}
+
+static int __init iolatency_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_iolatency);
+}
+
+module_init(iolatency_init);
@@ -13,6 +13,7 @@
 
 #include "blk.h"
 #include "blk-mq.h"
+#include "blk-wbt.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -394,6 +395,52 @@ static ssize_t queue_dax_show(struct request_queue *q, char *page)
 	return queue_var_show(blk_queue_dax(q), page);
 }
 
+#ifdef CONFIG_BLK_WBT
+static ssize_t queue_wb_lat_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	return sprintf(page, "%llu\n",
+		       div_u64(q->rq_wb->min_lat_nsec, NSEC_PER_USEC));
+}
+
+static ssize_t queue_wb_lat_store(struct request_queue *q, const char *page,
+				  size_t count)
+{
+	ssize_t ret;
+	s64 val;
+
+	ret = kstrtoll(page, 10, &val);
+	if (ret < 0)
+		return ret;
+	if (val < -1)
+		return -EINVAL;
+
+	if (!q->rq_wb) {
+		if (!q->mq_ops && !q->request_fn)
+			return -EINVAL;
+		ret = wbt_init(q);
+		if (ret)
+			return ret;
+	}
+
+	wbt_set_min_lat(q, val < 0 ? -1 : val * NSEC_PER_USEC);
+	return count;
+}
+
+static struct queue_sysfs_entry queue_wb_lat_entry = {
+	.attr = {.name = "wbt_lat_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_wb_lat_show,
+	.store = queue_wb_lat_store,
+};
+
+static struct queue_sysfs_entry queue_wb_stat_entry = {
+	.attr = {.name = "wbt_stat", .mode = S_IRUGO },
+	.show = wbt_stat_show,
+};
+#endif
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -563,6 +610,10 @@ static struct attribute *default_attrs[] = {
 	&queue_poll_entry.attr,
 	&queue_wc_entry.attr,
 	&queue_dax_entry.attr,
+#ifdef CONFIG_BLK_WBT
+	&queue_wb_lat_entry.attr,
+	&queue_wb_stat_entry.attr,
+#endif
 	NULL,
 };
 
@@ -639,6 +690,7 @@ static void blk_release_queue(struct kobject *kobj)
 
 	bdi_exit(&q->backing_dev_info);
 	blkcg_exit_queue(q);
+	wbt_exit(q);
 
 	if (q->elevator) {
 		spin_lock_irq(q->queue_lock);
@@ -716,6 +768,10 @@ int blk_register_queue(struct gendisk *disk)
 	if (q->mq_ops)
 		blk_mq_register_dev(dev, q);
 
+	/* bio based drivers throttle at their own backing queues */
+	if (q->mq_ops || q->request_fn)
+		wbt_init(q);
+
 	if (!q->request_fn)
 		return 0;
 
@@ -0,0 +1,319 @@
+/*
+ * Writeback throttling
+ *
+ * Buffered writeback can fill the device queue with large writes and
+ * starve the reads issued on the same queue.  Count throttled writes
+ * while in flight and cap them per writeback class, then scale the cap
+ * from the minimum read latency seen over a monitoring window: while
+ * reads complete above the target the depth is halved, once they meet
+ * it again (or no reads are issued) it is doubled back up to the
+ * default.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/backing-dev.h>
+#include <linux/swap.h>
+#include <linux/sched.h>
+
+#include "blk-wbt.h"
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/wbt.h>
+
+#define RWB_DEF_DEPTH		16
+#define RWB_WINDOW_NSEC		(100 * NSEC_PER_MSEC)
+#define RWB_MIN_READ_SAMPLES	1
+
+/* default read latency targets */
+#define RWB_NONROT_LAT_NSEC	(2 * NSEC_PER_MSEC)
+#define RWB_ROT_LAT_NSEC	(75 * NSEC_PER_MSEC)
+
+static bool atomic_inc_below(atomic_t *v, unsigned int below)
+{
+	unsigned int cur = atomic_read(v);
+
+	for (;;) {
+		unsigned int old;
+
+		if (cur >= below)
+			return false;
+		old = atomic_cmpxchg(v, cur, cur + 1);
+		if (old == cur)
+			break;
+		cur = old;
+	}
+
+	return true;
+}
+
+/* called with rwb->lock held or before rwb is published */
+static void rwb_calc_limits(struct rq_wb *rwb)
+{
+	unsigned int depth;
+
+	depth = min_t(unsigned long, rwb->queue->nr_requests, RWB_DEF_DEPTH);
+	rwb->queue_depth = max(depth, 1U);
+
+	rwb->max_depth = 1 + ((rwb->queue_depth - 1) >> rwb->scale_step);
+	rwb->wb_normal = (rwb->max_depth + 1) / 2;
+	rwb->wb_background = (rwb->max_depth + 3) / 4;
+}
+
+static void rwb_wake_all(struct rq_wb *rwb)
+{
+	if (waitqueue_active(&rwb->wait))
+		wake_up_all(&rwb->wait);
+}
+
+static void scale_down(struct rq_wb *rwb)
+{
+	/* already down to a single background write */
+	if (rwb->max_depth == 1)
+		return;
+
+	rwb->scale_step++;
+	rwb->nr_scale_down++;
+	rwb_calc_limits(rwb);
+	trace_wbt_step(&rwb->queue->backing_dev_info, "scale down", rwb);
+}
+
+static void scale_up(struct rq_wb *rwb)
+{
+	if (!rwb->scale_step)
+		return;
+
+	rwb->scale_step--;
+	rwb->nr_scale_up++;
+	rwb_calc_limits(rwb);
+	trace_wbt_step(&rwb->queue->backing_dev_info, "scale up", rwb);
+	rwb_wake_all(rwb);
+}
+
+static void rwb_window_end(struct rq_wb *rwb, u64 now)
+{
+	unsigned int nr_reads, nr_writes;
+	unsigned long flags;
+	u64 read_min;
+
+	spin_lock_irqsave(&rwb->lock, flags);
+
+	/* somebody else already closed this window */
+	if (now - rwb->win_start < rwb->win_nsec) {
+		spin_unlock_irqrestore(&rwb->lock, flags);
+		return;
+	}
+
+	nr_reads = atomic_xchg(&rwb->nr_reads, 0);
+	nr_writes = atomic_xchg(&rwb->nr_writes, 0);
+	read_min = atomic64_xchg(&rwb->read_lat_min, U64_MAX);
+	rwb->win_start = now;
+
+	trace_wbt_stat(&rwb->queue->backing_dev_info, nr_reads,
+		       nr_reads ? read_min : 0, nr_writes);
+
+	if (nr_reads >= RWB_MIN_READ_SAMPLES) {
+		rwb->last_read_min = read_min;
+		if (read_min > rwb->min_lat_nsec)
+			scale_down(rwb);
+		else
+			scale_up(rwb);
+	} else if (nr_writes) {
+		/* writes only, nobody to protect */
+		scale_up(rwb);
+	}
+
+	spin_unlock_irqrestore(&rwb->lock, flags);
+}
+
+static bool wbt_should_throttle(struct bio *bio)
+{
+	switch (bio_op(bio)) {
+	case REQ_OP_WRITE:
+		/* O_DIRECT writes are submitted with just REQ_SYNC */
+		if ((bio->bi_opf & (REQ_SYNC | REQ_NOIDLE)) == REQ_SYNC)
+			return false;
+		return bio->bi_iter.bi_size != 0;
+	case REQ_OP_DISCARD:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static unsigned int wbt_limit(struct rq_wb *rwb, struct bio *bio)
+{
+	if (bio_op(bio) == REQ_OP_DISCARD)
+		return READ_ONCE(rwb->wb_background);
+
+	/* reclaim and metadata writes get the whole budget */
+	if ((bio->bi_opf & (REQ_META | REQ_PRIO)) || current_is_kswapd())
+		return READ_ONCE(rwb->max_depth);
+
+	/* background writeback does not set REQ_SYNC */
+	if (!(bio->bi_opf & REQ_SYNC))
+		return READ_ONCE(rwb->wb_background);
+
+	return READ_ONCE(rwb->wb_normal);
+}
+
+/*
+ * Called for every bio entering @q.  Reads are stamped for latency
+ * accounting, throttled writes wait until there is room below the limit
+ * of their class.  Nested submissions and callers that cannot sleep are
+ * accounted but never made to wait.
+ */
+void wbt_bio_issue(struct request_queue *q, struct bio *bio)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	unsigned int limit;
+	u64 start;
+
+	if (!rwb || !READ_ONCE(rwb->min_lat_nsec))
+		return;
+
+	/* split remainders are resubmitted, account them only once */
+	if (bio_flagged(bio, BIO_WBT))
+		return;
+
+	if (bio_op(bio) == REQ_OP_READ) {
+		bio->bi_wbt_issue = ktime_get_ns();
+		bio_set_flag(bio, BIO_WBT);
+		return;
+	}
+
+	if (!wbt_should_throttle(bio))
+		return;
+
+	bio_set_flag(bio, BIO_WBT);
+
+	limit = wbt_limit(rwb, bio);
+	if (likely(atomic_inc_below(&rwb->inflight, limit)))
+		return;
+
+	if (current->bio_list || (current->flags & PF_MEMALLOC) ||
+	    in_atomic() || irqs_disabled() || fatal_signal_pending(current)) {
+		atomic_inc(&rwb->inflight);
+		return;
+	}
+
+	start = ktime_get_ns();
+	wait_event(rwb->wait,
+		   atomic_inc_below(&rwb->inflight, wbt_limit(rwb, bio)));
+	atomic64_inc(&rwb->nr_throttled);
+	atomic64_add(ktime_get_ns() - start, &rwb->throttled_ns);
+}
+
+void wbt_bio_done(struct bio *bio)
+{
+	struct rq_wb *rwb = bdev_get_queue(bio->bi_bdev)->rq_wb;
+	u64 now = ktime_get_ns();
+
+	bio_clear_flag(bio, BIO_WBT);
+
+	if (bio_op(bio) == REQ_OP_READ) {
+		u64 lat = now - bio->bi_wbt_issue;
+		u64 old = atomic64_read(&rwb->read_lat_min);
+
+		while (lat < old) {
+			u64 cur = atomic64_cmpxchg(&rwb->read_lat_min,
+						   old, lat);
+			if (cur == old)
+				break;
+			old = cur;
+		}
+		atomic_inc(&rwb->nr_reads);
+	} else {
+		atomic_inc(&rwb->nr_writes);
+		atomic_dec(&rwb->inflight);
+		rwb_wake_all(rwb);
+	}
+
+	if (now - READ_ONCE(rwb->win_start) >= rwb->win_nsec)
+		rwb_window_end(rwb, now);
+}
+
+u64 wbt_default_latency_nsec(struct request_queue *q)
+{
+	return blk_queue_nonrot(q) ? RWB_NONROT_LAT_NSEC : RWB_ROT_LAT_NSEC;
+}
+
+/*
+ * Set the read latency target of @q, a negative value restores the
+ * default and 0 disables throttling.  Writes already accounted keep
+ * being completed against the counters.
+ */
+void wbt_set_min_lat(struct request_queue *q, s64 lat_nsec)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	unsigned long flags;
+
+	if (!rwb)
+		return;
+
+	spin_lock_irqsave(&rwb->lock, flags);
+	rwb->min_lat_nsec = lat_nsec < 0 ? wbt_default_latency_nsec(q) :
+					   lat_nsec;
+	rwb->scale_step = 0;
+	rwb_calc_limits(rwb);
+	spin_unlock_irqrestore(&rwb->lock, flags);
+
+	rwb_wake_all(rwb);
+}
+
+ssize_t wbt_stat_show(struct request_queue *q, char *page)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (!rwb)
+		return sprintf(page, "disabled\n");
+
+	return sprintf(page,
+		       "step %d depth %u/%u/%u inflight %d read_min_us %llu "
+		       "throttled %lld throttled_ms %lld "
+		       "scale_down %lu scale_up %lu\n",
+		       rwb->scale_step, rwb->max_depth, rwb->wb_normal,
+		       rwb->wb_background, atomic_read(&rwb->inflight),
+		       (unsigned long long)div_u64(rwb->last_read_min,
+						   NSEC_PER_USEC),
+		       (long long)atomic64_read(&rwb->nr_throttled),
+		       (long long)div_u64(atomic64_read(&rwb->throttled_ns),
+					  NSEC_PER_MSEC),
+		       rwb->nr_scale_down, rwb->nr_scale_up);
+}
+
+int wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	if (q->rq_wb)
+		return 0;
+
+	rwb = kzalloc_node(sizeof(*rwb), GFP_KERNEL, q->node);
+	if (!rwb)
+		return -ENOMEM;
+
+	rwb->queue = q;
+	rwb->win_nsec = RWB_WINDOW_NSEC;
+	rwb->min_lat_nsec = wbt_default_latency_nsec(q);
+	spin_lock_init(&rwb->lock);
+	init_waitqueue_head(&rwb->wait);
+	atomic_set(&rwb->inflight, 0);
+	atomic_set(&rwb->nr_reads, 0);
+	atomic_set(&rwb->nr_writes, 0);
+	atomic64_set(&rwb->read_lat_min, U64_MAX);
+	atomic64_set(&rwb->nr_throttled, 0);
+	atomic64_set(&rwb->throttled_ns, 0);
+	rwb->win_start = ktime_get_ns();
+	rwb_calc_limits(rwb);
+
+	q->rq_wb = rwb;
+	return 0;
+}
+
+void wbt_exit(struct request_queue *q)
+{
+	kfree(q->rq_wb);
+	q->rq_wb = NULL;
+}
@@ -0,0 +1,79 @@
+#ifndef BLK_WBT_H
+#define BLK_WBT_H
+
+#include <linux/kernel.h>
+#include <linux/atomic.h>
+#include <linux/wait.h>
+#include <linux/spinlock.h>
+#include <linux/bio.h>
+
+/*
+ * Writeback throttling state of a request queue.  Buffered writes are
+ * counted while in flight and limited to a depth that is scaled down
+ * while reads on the same queue complete slower than min_lat_nsec.
+ */
+struct rq_wb {
+	struct request_queue *queue;
+
+	u64 min_lat_nsec;		/* read latency target, 0: disabled */
+	u64 win_nsec;			/* monitoring window */
+
+	spinlock_t lock;
+	int scale_step;			/* 0: default depth, >0: scaled down */
+	unsigned int queue_depth;	/* default depth */
+	unsigned int max_depth;		/* kswapd, metadata */
+	unsigned int wb_normal;		/* sync writeback */
+	unsigned int wb_background;	/* background writeback, discard */
+
+	atomic_t inflight;
+	wait_queue_head_t wait;
+
+	/* current window */
+	u64 win_start;
+	atomic_t nr_reads;
+	atomic64_t read_lat_min;
+	atomic_t nr_writes;
+
+	/* stats */
+	u64 last_read_min;
+	unsigned long nr_scale_down;
+	unsigned long nr_scale_up;
+	atomic64_t nr_throttled;
+	atomic64_t throttled_ns;
+};
+
+#ifdef CONFIG_BLK_WBT
+
+int wbt_init(struct request_queue *q);
+void wbt_exit(struct request_queue *q);
+void wbt_set_min_lat(struct request_queue *q, s64 lat_nsec);
+u64 wbt_default_latency_nsec(struct request_queue *q);
+void wbt_bio_issue(struct request_queue *q, struct bio *bio);
+void wbt_bio_done(struct bio *bio);
+ssize_t wbt_stat_show(struct request_queue *q, char *page);
+
+static inline void wbt_bio_endio(struct bio *bio)
+{
+	if (bio_flagged(bio, BIO_WBT))
+		wbt_bio_done(bio);
+}
+
+#else
+
+static inline int wbt_init(struct request_queue *q)
+{
+	return -EINVAL;
+}
+static inline void wbt_exit(struct request_queue *q)
+{
+}
+static inline void wbt_bio_issue(struct request_queue *q, struct bio *bio)
+{
+}
+static inline void wbt_bio_endio(struct bio *bio)
+{
+}
+
+#endif /* CONFIG_BLK_WBT */
+
+#endif
@@ -58,6 +58,16 @@ static int simd_skcipher_setkey(struct crypto_skcipher *tfm, const u8 *key,
 	return err;
 }
 
+/*
+ * in_atomic() without the preempt count held by open simd_batch_begin()
+ * sections: a request issued from a batch goes to the same place it would
+ * have gone without one.
+ */
+static bool simd_skcipher_in_atomic(void)
+{
+	return preempt_count() > simd_batch_depth();
+}
+
 static int simd_skcipher_encrypt(struct skcipher_request *req)
 {
 	struct crypto_skcipher *tfm = crypto_skcipher_reqtfm(req);
@@ -69,7 +79,8 @@ static int simd_skcipher_encrypt(struct skcipher_request *req)
 	*subreq = *req;
 
 	if (!may_use_simd() ||
-	    (in_atomic() && cryptd_skcipher_queued(ctx->cryptd_tfm)))
+	    (simd_skcipher_in_atomic() &&
+	     cryptd_skcipher_queued(ctx->cryptd_tfm)))
 		child = &ctx->cryptd_tfm->base;
 	else
 		child = cryptd_skcipher_child(ctx->cryptd_tfm);
@@ -90,7 +101,8 @@ static int simd_skcipher_decrypt(struct skcipher_request *req)
 	*subreq = *req;
 
 	if (!may_use_simd() ||
-	    (in_atomic() && cryptd_skcipher_queued(ctx->cryptd_tfm)))
+	    (simd_skcipher_in_atomic() &&
+	     cryptd_skcipher_queued(ctx->cryptd_tfm)))
 		child = &ctx->cryptd_tfm->base;
 	else
 		child = cryptd_skcipher_child(ctx->cryptd_tfm);
@@ -169,7 +181,8 @@ struct simd_skcipher_alg *simd_skcipher_create_compat(const char *algname,
 		     drvname) >= CRYPTO_MAX_ALG_NAME)
 		goto out_free_salg;
 
-	alg->base.cra_flags = CRYPTO_ALG_ASYNC;
+	alg->base.cra_flags = CRYPTO_ALG_ASYNC |
+			      (ialg->base.cra_flags & CRYPTO_ALG_SIMD_BATCH);
 	alg->base.cra_priority = ialg->base.cra_priority;
 	alg->base.cra_blocksize = ialg->base.cra_blocksize;
 	alg->base.cra_alignmask = ialg->base.cra_alignmask;
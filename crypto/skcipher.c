@@ -15,8 +15,10 @@
  */
 
 #include <crypto/internal/aead.h>
+#include <crypto/internal/simd.h>
 #include <crypto/internal/skcipher.h>
 #include <crypto/scatterwalk.h>
+#include <crypto/skcipher_batch.h>
 #include <linux/bug.h>
 #include <linux/cryptouser.h>
 #include <linux/list.h>
@@ -566,6 +568,76 @@ int skcipher_walk_aead_decrypt(struct skcipher_walk *walk,
 }
 EXPORT_SYMBOL_GPL(skcipher_walk_aead_decrypt);
 
+static unsigned int skcipher_crypt_batch(struct skcipher_request **reqs,
+					 unsigned int nreqs, int *err,
+					 int (*crypt)(struct skcipher_request *))
+{
+	struct crypto_skcipher *tfm;
+	unsigned int i;
+
+	*err = 0;
+	if (!nreqs)
+		return 0;
+
+	/*
+	 * Where SIMD can't be used right now (softirq on arm64) every request
+	 * goes to a fallback anyway, so the section would only cost a
+	 * register save.
+	 */
+	tfm = crypto_skcipher_reqtfm(reqs[0]);
+	if (!(crypto_skcipher_tfm(tfm)->__crt_alg->cra_flags &
+	      CRYPTO_ALG_SIMD_BATCH) || !simd_batch_begin()) {
+		for (i = 0; i < nreqs; i++) {
+			*err = crypt(reqs[i]);
+			if (*err)
+				break;
+		}
+		return i;
+	}
+
+	for (i = 0; i < nreqs; i++) {
+		struct skcipher_request *req = reqs[i];
+		u32 may_sleep = req->base.flags & CRYPTO_TFM_REQ_MAY_SLEEP;
+
+		if (i && need_resched()) {
+			simd_batch_end();
+			if (may_sleep)
+				cond_resched();
+			simd_batch_begin();
+		}
+
+		/*
+		 * Preemption is off inside the section. A request handed on
+		 * to an async fallback keeps running without MAY_SLEEP, which
+		 * only costs it atomic allocations.
+		 */
+		req->base.flags &= ~CRYPTO_TFM_REQ_MAY_SLEEP;
+		*err = crypt(req);
+		if (*err == -EINPROGRESS || *err == -EBUSY)
+			break;
+		req->base.flags |= may_sleep;
+		if (*err)
+			break;
+	}
+	simd_batch_end();
+
+	return i;
+}
+
+unsigned int crypto_skcipher_encrypt_batch(struct skcipher_request **reqs,
+					   unsigned int nreqs, int *err)
+{
+	return skcipher_crypt_batch(reqs, nreqs, err, crypto_skcipher_encrypt);
+}
+EXPORT_SYMBOL_GPL(crypto_skcipher_encrypt_batch);
+
+unsigned int crypto_skcipher_decrypt_batch(struct skcipher_request **reqs,
+					   unsigned int nreqs, int *err)
+{
+	return skcipher_crypt_batch(reqs, nreqs, err, crypto_skcipher_decrypt);
+}
+EXPORT_SYMBOL_GPL(crypto_skcipher_decrypt_batch);
+
 static unsigned int crypto_skcipher_extsize(struct crypto_alg *alg)
 {
 	if (alg->cra_type == &crypto_blkcipher_type)
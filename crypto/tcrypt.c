@@ -1623,6 +1623,13 @@ static int do_test(const char *alg, u32 type, u32 mask, int m)
 				  0, speed_template_32);
 		break;
 
+	case 220:
+		test_cipher_speed("xchacha12", ENCRYPT, sec, NULL, 0,
+				  speed_template_32);
+		test_cipher_speed("xchacha20", ENCRYPT, sec, NULL, 0,
+				  speed_template_32);
+		break;
+
 	case 300:
 		if (alg) {
 			test_hash_speed(alg, sec, generic_hash_speed_template);
@@ -1731,6 +1738,10 @@ static int do_test(const char *alg, u32 type, u32 mask, int m)
 		test_hash_speed("sha3-512", sec, generic_hash_speed_template);
 		if (mode > 300 && mode < 400) break;
 
+	case 326:
+		test_hash_speed("nhpoly1305", sec, nhpoly1305_speed_template);
+		if (mode > 300 && mode < 400) break;
+
 	case 399:
 		break;
 
@@ -129,6 +129,19 @@ static struct hash_speed hash_speed_template_16[] = {
 	{  .blen = 0,	.plen = 0,	.klen = 0, }
 };
 
+/* NHPOLY1305_KEY_SIZE: Poly1305 key plus NH_KEY_BYTES */
+static struct hash_speed nhpoly1305_speed_template[] = {
+	{ .blen = 16,	.plen = 16,	.klen = 1088, },
+	{ .blen = 64,	.plen = 64,	.klen = 1088, },
+	{ .blen = 256,	.plen = 256,	.klen = 1088, },
+	{ .blen = 1024,	.plen = 1024,	.klen = 1088, },
+	{ .blen = 4096,	.plen = 1024,	.klen = 1088, },
+	{ .blen = 4096,	.plen = 4096,	.klen = 1088, },
+
+	/* End marker */
+	{  .blen = 0,	.plen = 0,	.klen = 0, }
+};
+
 static struct hash_speed poly1305_speed_template[] = {
 	{ .blen = 96,	.plen = 16, },
 	{ .blen = 96,	.plen = 32, },
@@ -269,11 +269,35 @@ out:
 	return events;
 }
 
+static int dma_buf_sync_direction(u64 flags,
+				  enum dma_data_direction *direction)
+{
+	if (flags & ~DMA_BUF_SYNC_VALID_FLAGS_MASK)
+		return -EINVAL;
+
+	switch (flags & DMA_BUF_SYNC_RW) {
+	case DMA_BUF_SYNC_READ:
+		*direction = DMA_FROM_DEVICE;
+		break;
+	case DMA_BUF_SYNC_WRITE:
+		*direction = DMA_TO_DEVICE;
+		break;
+	case DMA_BUF_SYNC_RW:
+		*direction = DMA_BIDIRECTIONAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static long dma_buf_ioctl(struct file *file,
 			  unsigned int cmd, unsigned long arg)
 {
 	struct dma_buf *dmabuf;
 	struct dma_buf_sync sync;
+	struct dma_buf_sync_partial sync_partial;
 	enum dma_data_direction direction;
 	int ret;
 
@@ -284,28 +308,34 @@ static long dma_buf_ioctl(struct file *file,
 		if (copy_from_user(&sync, (void __user *) arg, sizeof(sync)))
 			return -EFAULT;
 
-		if (sync.flags & ~DMA_BUF_SYNC_VALID_FLAGS_MASK)
-			return -EINVAL;
-
-		switch (sync.flags & DMA_BUF_SYNC_RW) {
-		case DMA_BUF_SYNC_READ:
-			direction = DMA_FROM_DEVICE;
-			break;
-		case DMA_BUF_SYNC_WRITE:
-			direction = DMA_TO_DEVICE;
-			break;
-		case DMA_BUF_SYNC_RW:
-			direction = DMA_BIDIRECTIONAL;
-			break;
-		default:
-			return -EINVAL;
-		}
+		ret = dma_buf_sync_direction(sync.flags, &direction);
+		if (ret)
+			return ret;
 
 		if (sync.flags & DMA_BUF_SYNC_END)
 			ret = dma_buf_end_cpu_access(dmabuf, direction);
 		else
 			ret = dma_buf_begin_cpu_access(dmabuf, direction);
 
+		return ret;
+	case DMA_BUF_IOCTL_SYNC_PARTIAL:
+		if (copy_from_user(&sync_partial, (void __user *) arg,
+				   sizeof(sync_partial)))
+			return -EFAULT;
+
+		ret = dma_buf_sync_direction(sync_partial.flags, &direction);
+		if (ret)
+			return ret;
+
+		if (sync_partial.flags & DMA_BUF_SYNC_END)
+			ret = dma_buf_end_cpu_access_partial(dmabuf, direction,
+							     sync_partial.offset,
+							     sync_partial.len);
+		else
+			ret = dma_buf_begin_cpu_access_partial(dmabuf, direction,
+							       sync_partial.offset,
+							       sync_partial.len);
+
 		return ret;
 	default:
 		return -ENOTTY;
@@ -712,6 +742,76 @@ int dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 }
 EXPORT_SYMBOL_GPL(dma_buf_end_cpu_access);
 
+static bool dma_buf_range_valid(struct dma_buf *dmabuf, unsigned int offset,
+				unsigned int len)
+{
+	return len && offset < dmabuf->size && len <= dmabuf->size - offset;
+}
+
+/**
+ * dma_buf_begin_cpu_access_partial - Like dma_buf_begin_cpu_access(), for
+ * a range of the buffer only. Exporters without begin_cpu_access_partial
+ * prepare the whole buffer.
+ * @dmabuf:	[in]	buffer to prepare cpu access for.
+ * @direction:	[in]	direction of the cpu access.
+ * @offset:	[in]	start of the range in bytes.
+ * @len:	[in]	length of the range in bytes.
+ *
+ * Can return negative error values, returns 0 on success.
+ */
+int dma_buf_begin_cpu_access_partial(struct dma_buf *dmabuf,
+				     enum dma_data_direction direction,
+				     unsigned int offset, unsigned int len)
+{
+	int ret = 0;
+
+	if (WARN_ON(!dmabuf))
+		return -EINVAL;
+
+	if (!dma_buf_range_valid(dmabuf, offset, len))
+		return -EINVAL;
+
+	if (!dmabuf->ops->begin_cpu_access_partial)
+		return dma_buf_begin_cpu_access(dmabuf, direction);
+
+	ret = dmabuf->ops->begin_cpu_access_partial(dmabuf, direction,
+						    offset, len);
+	if (ret == 0)
+		ret = __dma_buf_begin_cpu_access(dmabuf, direction);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(dma_buf_begin_cpu_access_partial);
+
+/**
+ * dma_buf_end_cpu_access_partial - Like dma_buf_end_cpu_access(), for a
+ * range of the buffer only. Exporters without end_cpu_access_partial
+ * complete the access to the whole buffer.
+ * @dmabuf:	[in]	buffer to complete cpu access for.
+ * @direction:	[in]	direction of the cpu access.
+ * @offset:	[in]	start of the range in bytes.
+ * @len:	[in]	length of the range in bytes.
+ *
+ * Can return negative error values, returns 0 on success.
+ */
+int dma_buf_end_cpu_access_partial(struct dma_buf *dmabuf,
+				   enum dma_data_direction direction,
+				   unsigned int offset, unsigned int len)
+{
+	if (WARN_ON(!dmabuf))
+		return -EINVAL;
+
+	if (!dma_buf_range_valid(dmabuf, offset, len))
+		return -EINVAL;
+
+	if (!dmabuf->ops->end_cpu_access_partial)
+		return dma_buf_end_cpu_access(dmabuf, direction);
+
+	return dmabuf->ops->end_cpu_access_partial(dmabuf, direction,
+						   offset, len);
+}
+EXPORT_SYMBOL_GPL(dma_buf_end_cpu_access_partial);
+
 /**
  * dma_buf_kmap_atomic - Map a page of the buffer object into kernel address
  * space. The same restrictions as for kmap_atomic and friends apply.
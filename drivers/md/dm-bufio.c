@@ -16,6 +16,8 @@
 #include <linux/shrinker.h>
 #include <linux/module.h>
 #include <linux/rbtree.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
 #include <linux/stacktrace.h>
 
 #define DM_MSG_PREFIX "bufio"
@@ -70,9 +72,15 @@
 #define LIST_DIRTY	1
 #define LIST_SIZE	2
 
+/*
+ * The buffer index is split into this many trees by block number, so that
+ * lockless lookups in one tree are not disturbed by inserts into another.
+ */
+#define DM_BUFIO_TREES			16
+
 /*
  * Linking of buffers:
- *	All buffers are linked to cache_hash with their hash_list field.
+ *	All buffers are linked to one of buffer_trees with their node field.
  *
  *	Clean buffers that are not being written (B_WRITING not set)
  *	are linked to lru[LIST_CLEAN] with their lru_list field.
@@ -84,7 +92,18 @@
  *	context), so some clean-not-writing buffers can be held on
  *	dirty_lru too.  They are later added to lru in the process
  *	context.
+ *
+ *	The trees and the lists are only modified with the client lock
+ *	held.  Lookups of cached clean buffers (dm_bufio_read/dm_bufio_get)
+ *	walk the trees under RCU and take a hold with an atomic increment.
+ *	Such hits don't reorder the LRU; they set b->referenced and the
+ *	buffer gets a second chance when the LRU is next walked.
  */
+struct buffer_tree {
+	struct rb_root root;
+	seqcount_t seq;
+} ____cacheline_aligned_in_smp;
+
 struct dm_bufio_client {
 	struct mutex lock;
 
@@ -107,8 +126,9 @@ struct dm_bufio_client {
 
 	unsigned minimum_buffers;
 
-	struct rb_root buffer_tree;
+	struct buffer_tree buffer_trees[DM_BUFIO_TREES];
 	wait_queue_head_t free_buffer_wait;
+	atomic_t free_seq;
 
 	int async_write_error;
 
@@ -122,6 +142,7 @@ struct dm_bufio_client {
 #define B_READING	0
 #define B_WRITING	1
 #define B_DIRTY		2
+#define B_MOVING	3	/* temporarily linked elsewhere by release_move */
 
 /*
  * Describes how the block was allocated:
@@ -143,14 +164,16 @@ struct dm_buffer {
 	void *data;
 	enum data_mode data_mode;
 	unsigned char list_mode;		/* LIST_* */
+	unsigned char referenced;		/* lockless hit since last LRU walk */
 	unsigned accessed;
-	unsigned hold_count;
+	atomic_t hold_count;			/* -1: claimed or not linked */
 	int read_error;
 	int write_error;
 	unsigned long state;
 	unsigned long last_accessed;
 	struct dm_bufio_client *c;
 	struct list_head write_list;
+	struct rcu_head rcu;
 	struct bio bio;
 	struct bio_vec bio_vec[DM_BUFIO_INLINE_VECS];
 #ifdef CONFIG_DM_DEBUG_BLOCK_STACK_TRACING
@@ -264,11 +287,17 @@ static void buffer_record_stack(struct dm_buffer *b)
 #endif
 
 /*----------------------------------------------------------------
- * A red/black tree acts as an index for all the buffers.
+ * Red/black trees act as an index for all the buffers.
  *--------------------------------------------------------------*/
+static struct buffer_tree *buffer_tree(struct dm_bufio_client *c,
+				       sector_t block)
+{
+	return &c->buffer_trees[block & (DM_BUFIO_TREES - 1)];
+}
+
 static struct dm_buffer *__find(struct dm_bufio_client *c, sector_t block)
 {
-	struct rb_node *n = c->buffer_tree.rb_node;
+	struct rb_node *n = buffer_tree(c, block)->root.rb_node;
 	struct dm_buffer *b;
 
 	while (n) {
@@ -283,9 +312,41 @@ static struct dm_buffer *__find(struct dm_bufio_client *c, sector_t block)
 	return NULL;
 }
 
+/*
+ * Lockless version of __find, called under rcu_read_lock().  It may return
+ * a buffer that is concurrently being unlinked or relinked; the caller must
+ * take a hold and recheck the block number.
+ */
+static struct dm_buffer *find_rcu(struct dm_bufio_client *c, sector_t block)
+{
+	struct buffer_tree *tree = buffer_tree(c, block);
+	struct rb_node *n;
+	struct dm_buffer *b;
+	unsigned seq;
+
+	do {
+		seq = read_seqcount_begin(&tree->seq);
+		n = rcu_dereference_raw(tree->root.rb_node);
+
+		while (n) {
+			b = container_of(n, struct dm_buffer, node);
+
+			if (READ_ONCE(b->block) == block)
+				return b;
+
+			n = (READ_ONCE(b->block) < block) ?
+				rcu_dereference_raw(n->rb_left) :
+				rcu_dereference_raw(n->rb_right);
+		}
+	} while (read_seqcount_retry(&tree->seq, seq));
+
+	return NULL;
+}
+
 static void __insert(struct dm_bufio_client *c, struct dm_buffer *b)
 {
-	struct rb_node **new = &c->buffer_tree.rb_node, *parent = NULL;
+	struct buffer_tree *tree = buffer_tree(c, b->block);
+	struct rb_node **new = &tree->root.rb_node, *parent = NULL;
 	struct dm_buffer *found;
 
 	while (*new) {
@@ -301,13 +362,27 @@ static void __insert(struct dm_bufio_client *c, struct dm_buffer *b)
 			&((*new)->rb_left) : &((*new)->rb_right);
 	}
 
-	rb_link_node(&b->node, parent, new);
-	rb_insert_color(&b->node, &c->buffer_tree);
+	/*
+	 * c->lock is a mutex; don't let find_rcu() spin on an odd count
+	 * while we are preempted inside the write section.
+	 */
+	preempt_disable();
+	write_seqcount_begin(&tree->seq);
+	rb_link_node_rcu(&b->node, parent, new);
+	rb_insert_color(&b->node, &tree->root);
+	write_seqcount_end(&tree->seq);
+	preempt_enable();
 }
 
 static void __remove(struct dm_bufio_client *c, struct dm_buffer *b)
 {
-	rb_erase(&b->node, &c->buffer_tree);
+	struct buffer_tree *tree = buffer_tree(c, b->block);
+
+	preempt_disable();
+	write_seqcount_begin(&tree->seq);
+	rb_erase(&b->node, &tree->root);
+	write_seqcount_end(&tree->seq);
+	preempt_enable();
 }
 
 /*----------------------------------------------------------------*/
@@ -469,6 +544,7 @@ static struct dm_buffer *alloc_buffer(struct dm_bufio_client *c, gfp_t gfp_mask)
 		return NULL;
 
 	b->c = c;
+	atomic_set(&b->hold_count, -1);
 
 	b->data = alloc_buffer_data(c, gfp_mask, &b->data_mode);
 	if (!b->data) {
@@ -483,14 +559,15 @@ static struct dm_buffer *alloc_buffer(struct dm_bufio_client *c, gfp_t gfp_mask)
 }
 
 /*
- * Free buffer and its data.
+ * Free buffer and its data.  The dm_buffer itself may still be looked at
+ * by find_rcu, so it goes through RCU.
  */
 static void free_buffer(struct dm_buffer *b)
 {
 	struct dm_bufio_client *c = b->c;
 
 	free_buffer_data(c, b->data, b->data_mode);
-	kfree(b);
+	kfree_rcu(b, rcu);
 }
 
 /*
@@ -534,6 +611,7 @@ static void __relink_lru(struct dm_buffer *b, int dirty)
 	struct dm_bufio_client *c = b->c;
 
 	b->accessed = 1;
+	b->referenced = 0;
 
 	BUG_ON(!c->n_buffers[b->list_mode]);
 
@@ -544,6 +622,43 @@ static void __relink_lru(struct dm_buffer *b, int dirty)
 	b->last_accessed = jiffies;
 }
 
+/*
+ * Give a buffer that was hit by a lockless lookup since the last LRU walk
+ * a second chance: move it to the head of its queue.  Returns true if the
+ * buffer was moved; the caller must be iterating with a _safe iterator.
+ */
+static bool __lru_second_chance(struct dm_buffer *b)
+{
+	if (likely(!READ_ONCE(b->referenced)))
+		return false;
+
+	__relink_lru(b, b->list_mode);
+	return true;
+}
+
+/*
+ * Claim an unheld buffer for eviction.  Once claimed, lockless lookups
+ * can't take a hold on it any more.
+ */
+static bool __claim_buffer(struct dm_buffer *b)
+{
+	return atomic_cmpxchg(&b->hold_count, 0, -1) == 0;
+}
+
+/*
+ * Wake up threads waiting in __wait_for_free_buffer.  Holds are dropped
+ * without c->lock, so this bumps free_seq for the waiter to recheck after
+ * it queued itself.
+ */
+static void wake_free_buffer_waiters(struct dm_bufio_client *c)
+{
+	atomic_inc(&c->free_seq);
+	smp_mb__after_atomic();
+
+	if (waitqueue_active(&c->free_buffer_wait))
+		wake_up(&c->free_buffer_wait);
+}
+
 /*----------------------------------------------------------------
  * Submit I/O on the buffer.
  *
@@ -760,7 +875,7 @@ static void __flush_write_list(struct list_head *write_list)
  */
 static void __make_buffer_clean(struct dm_buffer *b)
 {
-	BUG_ON(b->hold_count);
+	BUG_ON(atomic_read(&b->hold_count) != -1);
 
 	if (!b->state)	/* fast case */
 		return;
@@ -776,13 +891,16 @@ static void __make_buffer_clean(struct dm_buffer *b)
  */
 static struct dm_buffer *__get_unclaimed_buffer(struct dm_bufio_client *c)
 {
-	struct dm_buffer *b;
+	struct dm_buffer *b, *tmp;
 
-	list_for_each_entry_reverse(b, &c->lru[LIST_CLEAN], lru_list) {
+	list_for_each_entry_safe_reverse(b, tmp, &c->lru[LIST_CLEAN], lru_list) {
 		BUG_ON(test_bit(B_WRITING, &b->state));
 		BUG_ON(test_bit(B_DIRTY, &b->state));
 
-		if (!b->hold_count) {
+		if (__lru_second_chance(b))
+			continue;
+
+		if (__claim_buffer(b)) {
 			__make_buffer_clean(b);
 			__unlink_buffer(b);
 			return b;
@@ -793,7 +911,7 @@ static struct dm_buffer *__get_unclaimed_buffer(struct dm_bufio_client *c)
 	list_for_each_entry_reverse(b, &c->lru[LIST_DIRTY], lru_list) {
 		BUG_ON(test_bit(B_READING, &b->state));
 
-		if (!b->hold_count) {
+		if (__claim_buffer(b)) {
 			__make_buffer_clean(b);
 			__unlink_buffer(b);
 			return b;
@@ -806,12 +924,13 @@ static struct dm_buffer *__get_unclaimed_buffer(struct dm_bufio_client *c)
 
 /*
  * Wait until some other threads free some buffer or release hold count on
- * some buffer.
+ * some buffer.  free_seq is the value of c->free_seq sampled before the
+ * caller looked for a free buffer; if it changed since, don't sleep.
  *
  * This function is entered with c->lock held, drops it and regains it
  * before exiting.
  */
-static void __wait_for_free_buffer(struct dm_bufio_client *c)
+static void __wait_for_free_buffer(struct dm_bufio_client *c, int free_seq)
 {
 	DECLARE_WAITQUEUE(wait, current);
 
@@ -819,7 +938,9 @@ static void __wait_for_free_buffer(struct dm_bufio_client *c)
 	set_task_state(current, TASK_UNINTERRUPTIBLE);
 	dm_bufio_unlock(c);
 
-	io_schedule();
+	if (atomic_read(&c->free_seq) == free_seq)
+		io_schedule();
+	__set_current_state(TASK_RUNNING);
 
 	remove_wait_queue(&c->free_buffer_wait, &wait);
 
@@ -858,6 +979,8 @@ static struct dm_buffer *__alloc_buffer_wait_no_callback(struct dm_bufio_client
 	 * be allocated.
 	 */
 	while (1) {
+		int free_seq = atomic_read(&c->free_seq);
+
 		if (dm_bufio_cache_size_latch != 1) {
 			b = alloc_buffer(c, GFP_NOWAIT | __GFP_NORETRY | __GFP_NOMEMALLOC | __GFP_NOWARN);
 			if (b)
@@ -889,7 +1012,7 @@ static struct dm_buffer *__alloc_buffer_wait_no_callback(struct dm_bufio_client
 		if (b)
 			return b;
 
-		__wait_for_free_buffer(c);
+		__wait_for_free_buffer(c, free_seq);
 	}
 }
 
@@ -920,7 +1043,7 @@ static void __free_buffer_wake(struct dm_buffer *b)
 		c->need_reserved_buffers--;
 	}
 
-	wake_up(&c->free_buffer_wait);
+	wake_free_buffer_waiters(c);
 }
 
 static void __write_dirty_buffers_async(struct dm_bufio_client *c, int no_wait,
@@ -992,19 +1115,28 @@ static struct dm_buffer *__bufio_new(struct dm_bufio_client *c, sector_t block,
 
 	__check_watermark(c, write_list);
 
+	/*
+	 * The buffer stays claimed (hold_count == -1) until its block and
+	 * state are published, so a lockless lookup still holding a stale
+	 * pointer to it can't take a hold and see the old block number.
+	 */
 	b = new_b;
-	b->hold_count = 1;
+	BUG_ON(atomic_read(&b->hold_count) != -1);
 	b->read_error = 0;
 	b->write_error = 0;
-	__link_buffer(b, block, LIST_CLEAN);
+	b->referenced = 0;
 
 	if (nf == NF_FRESH) {
 		b->state = 0;
-		return b;
+	} else {
+		b->state = 1 << B_READING;
+		*need_submit = 1;
 	}
+	__link_buffer(b, block, LIST_CLEAN);
 
-	b->state = 1 << B_READING;
-	*need_submit = 1;
+	/* pairs with the barrier implied by bufio_get_lockless's inc */
+	smp_wmb();
+	atomic_set(&b->hold_count, 1);
 
 	return b;
 
@@ -1021,7 +1153,7 @@ found_buffer:
 	if (nf == NF_GET && unlikely(test_bit(B_READING, &b->state)))
 		return NULL;
 
-	b->hold_count++;
+	atomic_inc(&b->hold_count);
 	__relink_lru(b, test_bit(B_DIRTY, &b->state) ||
 		     test_bit(B_WRITING, &b->state));
 	return b;
@@ -1046,6 +1178,53 @@ static void read_endio(struct bio *bio)
 	wake_up_bit(&b->state, B_READING);
 }
 
+/*
+ * Look up a cached, idle buffer and take a hold on it without c->lock.
+ * Anything else (misses, buffers under I/O, dirty buffers or buffers being
+ * moved) returns NULL and is left to __bufio_new.
+ */
+static struct dm_buffer *bufio_get_lockless(struct dm_bufio_client *c,
+					    sector_t block)
+{
+	struct dm_buffer *b;
+
+	rcu_read_lock();
+	b = find_rcu(c, block);
+	if (b && !atomic_inc_unless_negative(&b->hold_count))
+		b = NULL;
+	rcu_read_unlock();
+
+	if (!b)
+		return NULL;
+
+	/*
+	 * The buffer may have been evicted and reused, or relinked by
+	 * dm_bufio_release_move, since find_rcu saw it.  A successful
+	 * atomic_inc_unless_negative is fully ordered, so the block and
+	 * state published before __bufio_new set hold_count are visible.
+	 * release_move changes b->block before it clears B_MOVING, so
+	 * check in the opposite order.
+	 */
+	if (unlikely(READ_ONCE(b->state))) {
+		dm_bufio_release(b);
+		return NULL;
+	}
+	smp_rmb();
+	if (unlikely(READ_ONCE(b->block) != block)) {
+		dm_bufio_release(b);
+		return NULL;
+	}
+
+	if (!READ_ONCE(b->referenced))
+		WRITE_ONCE(b->referenced, 1);
+	if (!READ_ONCE(b->accessed))
+		WRITE_ONCE(b->accessed, 1);
+	if (READ_ONCE(b->last_accessed) != jiffies)
+		WRITE_ONCE(b->last_accessed, jiffies);
+
+	return b;
+}
+
 /*
  * A common routine for dm_bufio_new and dm_bufio_read.  Operation of these
  * functions is similar except that dm_bufio_new doesn't read the
@@ -1060,10 +1239,16 @@ static void *new_read(struct dm_bufio_client *c, sector_t block,
 
 	LIST_HEAD(write_list);
 
+	if (nf != NF_FRESH) {
+		b = bufio_get_lockless(c, block);
+		if (b)
+			goto found;
+	}
+
 	dm_bufio_lock(c);
 	b = __bufio_new(c, block, nf, &need_submit, &write_list);
 #ifdef CONFIG_DM_DEBUG_BLOCK_STACK_TRACING
-	if (b && b->hold_count == 1)
+	if (b && atomic_read(&b->hold_count) == 1)
 		buffer_record_stack(b);
 #endif
 	dm_bufio_unlock(c);
@@ -1078,6 +1263,7 @@ static void *new_read(struct dm_bufio_client *c, sector_t block,
 
 	wait_on_bit_io(&b->state, B_READING, TASK_UNINTERRUPTIBLE);
 
+found:
 	if (b->read_error) {
 		int error = b->read_error;
 
@@ -1166,23 +1352,32 @@ void dm_bufio_release(struct dm_buffer *b)
 {
 	struct dm_bufio_client *c = b->c;
 
-	dm_bufio_lock(c);
+	BUG_ON(atomic_read(&b->hold_count) <= 0);
+
+	/*
+	 * Only a buffer with errors may have to be freed when the last hold
+	 * goes away; everything else can drop the hold without the lock.
+	 */
+	if (likely(!READ_ONCE(b->read_error) && !READ_ONCE(b->write_error))) {
+		if (atomic_dec_and_test(&b->hold_count))
+			wake_free_buffer_waiters(c);
+		return;
+	}
 
-	BUG_ON(!b->hold_count);
+	dm_bufio_lock(c);
 
-	b->hold_count--;
-	if (!b->hold_count) {
-		wake_up(&c->free_buffer_wait);
+	if (atomic_dec_and_test(&b->hold_count)) {
+		wake_free_buffer_waiters(c);
 
 		/*
 		 * If there were errors on the buffer, and the buffer is not
 		 * to be written, free the buffer. There is no point in caching
 		 * invalid buffer.
 		 */
-		if ((b->read_error || b->write_error) &&
-		    !test_bit(B_READING, &b->state) &&
+		if (!test_bit(B_READING, &b->state) &&
 		    !test_bit(B_WRITING, &b->state) &&
-		    !test_bit(B_DIRTY, &b->state)) {
+		    !test_bit(B_DIRTY, &b->state) &&
+		    __claim_buffer(b)) {
 			__unlink_buffer(b);
 			__free_buffer_wake(b);
 		}
@@ -1253,12 +1448,12 @@ again:
 		if (test_bit(B_WRITING, &b->state)) {
 			if (buffers_processed < c->n_buffers[LIST_DIRTY]) {
 				dropped_lock = 1;
-				b->hold_count++;
+				atomic_inc(&b->hold_count);
 				dm_bufio_unlock(c);
 				wait_on_bit_io(&b->state, B_WRITING,
 					       TASK_UNINTERRUPTIBLE);
 				dm_bufio_lock(c);
-				b->hold_count--;
+				atomic_dec(&b->hold_count);
 			} else
 				wait_on_bit_io(&b->state, B_WRITING,
 					       TASK_UNINTERRUPTIBLE);
@@ -1287,7 +1482,7 @@ again:
 		if (dropped_lock)
 			goto again;
 	}
-	wake_up(&c->free_buffer_wait);
+	wake_free_buffer_waiters(c);
 	dm_bufio_unlock(c);
 
 	a = xchg(&c->async_write_error, 0);
@@ -1339,16 +1534,18 @@ void dm_bufio_release_move(struct dm_buffer *b, sector_t new_block)
 {
 	struct dm_bufio_client *c = b->c;
 	struct dm_buffer *new;
+	int free_seq;
 
 	BUG_ON(dm_bufio_in_request());
 
 	dm_bufio_lock(c);
 
 retry:
+	free_seq = atomic_read(&c->free_seq);
 	new = __find(c, new_block);
 	if (new) {
-		if (new->hold_count) {
-			__wait_for_free_buffer(c);
+		if (!__claim_buffer(new)) {
+			__wait_for_free_buffer(c, free_seq);
 			goto retry;
 		}
 
@@ -1361,16 +1558,23 @@ retry:
 		__free_buffer_wake(new);
 	}
 
-	BUG_ON(!b->hold_count);
+	BUG_ON(atomic_read(&b->hold_count) <= 0);
 	BUG_ON(test_bit(B_READING, &b->state));
 
 	__write_dirty_buffer(b, NULL);
-	if (b->hold_count == 1) {
+	/*
+	 * Claiming our own hold keeps lockless lookups off the buffer while
+	 * it is relinked; they fall back to taking c->lock.
+	 */
+	if (atomic_cmpxchg(&b->hold_count, 1, -1) == 1) {
 		wait_on_bit_io(&b->state, B_WRITING,
 			       TASK_UNINTERRUPTIBLE);
 		set_bit(B_DIRTY, &b->state);
 		__unlink_buffer(b);
 		__link_buffer(b, new_block, LIST_DIRTY);
+		/* publish the new block before lockless lookups can hold it */
+		smp_wmb();
+		atomic_set(&b->hold_count, 1);
 	} else {
 		sector_t old_block;
 		wait_on_bit_lock_io(&b->state, B_WRITING,
@@ -1380,8 +1584,10 @@ retry:
 		 * sees "new_block" as a block number.
 		 * After the write, link the buffer back to old_block.
 		 * All this must be done in bufio lock, so that block number
-		 * change isn't visible to other threads.
+		 * change isn't visible to other threads.  B_MOVING hides
+		 * the buffer from lockless lookups meanwhile.
 		 */
+		set_bit(B_MOVING, &b->state);
 		old_block = b->block;
 		__unlink_buffer(b);
 		__link_buffer(b, new_block, b->list_mode);
@@ -1390,6 +1596,8 @@ retry:
 			       TASK_UNINTERRUPTIBLE);
 		__unlink_buffer(b);
 		__link_buffer(b, old_block, b->list_mode);
+		smp_mb__before_atomic();
+		clear_bit(B_MOVING, &b->state);
 	}
 
 	dm_bufio_unlock(c);
@@ -1410,7 +1618,7 @@ void dm_bufio_forget(struct dm_bufio_client *c, sector_t block)
 	dm_bufio_lock(c);
 
 	b = __find(c, block);
-	if (b && likely(!b->hold_count) && likely(!b->state)) {
+	if (b && likely(!b->state) && __claim_buffer(b)) {
 		__unlink_buffer(b);
 		__free_buffer_wake(b);
 	}
@@ -1484,11 +1692,13 @@ static void drop_buffers(struct dm_bufio_client *c)
 		list_for_each_entry(b, &c->lru[i], lru_list) {
 			WARN_ON(!warned);
 			warned = true;
-			DMERR("leaked buffer %llx, hold count %u, list %d",
-			      (unsigned long long)b->block, b->hold_count, i);
+			DMERR("leaked buffer %llx, hold count %d, list %d",
+			      (unsigned long long)b->block,
+			      atomic_read(&b->hold_count), i);
 #ifdef CONFIG_DM_DEBUG_BLOCK_STACK_TRACING
 			print_stack_trace(&b->stack_trace, 1);
-			b->hold_count = 0; /* mark unclaimed to avoid BUG_ON below */
+			/* mark unclaimed to avoid BUG_ON below */
+			atomic_set(&b->hold_count, 0);
 #endif
 		}
 
@@ -1520,7 +1730,7 @@ static bool __try_evict_buffer(struct dm_buffer *b, gfp_t gfp)
 			return false;
 	}
 
-	if (b->hold_count)
+	if (!__claim_buffer(b))
 		return false;
 
 	__make_buffer_clean(b);
@@ -1548,6 +1758,8 @@ static unsigned long __scan(struct dm_bufio_client *c, unsigned long nr_to_scan,
 
 	for (l = 0; l < LIST_SIZE; l++) {
 		list_for_each_entry_safe_reverse(b, tmp, &c->lru[l], lru_list) {
+			if (__lru_second_chance(b))
+				continue;
 			if (__try_evict_buffer(b, gfp_mask))
 				freed++;
 			if (!--nr_to_scan || ((count - freed) <= retain_target))
@@ -1606,7 +1818,10 @@ struct dm_bufio_client *dm_bufio_client_create(struct block_device *bdev, unsign
 		r = -ENOMEM;
 		goto bad_client;
 	}
-	c->buffer_tree = RB_ROOT;
+	for (i = 0; i < DM_BUFIO_TREES; i++) {
+		c->buffer_trees[i].root = RB_ROOT;
+		seqcount_init(&c->buffer_trees[i].seq);
+	}
 
 	c->bdev = bdev;
 	c->block_size = block_size;
@@ -1632,6 +1847,7 @@ struct dm_bufio_client *dm_bufio_client_create(struct block_device *bdev, unsign
 	c->minimum_buffers = DM_BUFIO_MIN_BUFFERS;
 
 	init_waitqueue_head(&c->free_buffer_wait);
+	atomic_set(&c->free_seq, 0);
 	c->async_write_error = 0;
 
 	c->dm_io = dm_io_client_create();
@@ -1724,7 +1940,8 @@ void dm_bufio_client_destroy(struct dm_bufio_client *c)
 
 	mutex_unlock(&dm_bufio_clients_lock);
 
-	BUG_ON(!RB_EMPTY_ROOT(&c->buffer_tree));
+	for (i = 0; i < DM_BUFIO_TREES; i++)
+		BUG_ON(!RB_EMPTY_ROOT(&c->buffer_trees[i].root));
 	BUG_ON(c->need_reserved_buffers);
 
 	while (!list_empty(&c->reserved_buffers)) {
@@ -1782,6 +1999,9 @@ static void __evict_old_buffers(struct dm_bufio_client *c, unsigned long age_hz)
 		if (count <= retain_target)
 			break;
 
+		if (__lru_second_chance(b))
+			continue;
+
 		if (!older_than(b, age_hz))
 			break;
 
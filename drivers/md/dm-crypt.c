@@ -32,6 +32,7 @@
 #include <crypto/md5.h>
 #include <crypto/algapi.h>
 #include <crypto/skcipher.h>
+#include <crypto/skcipher_batch.h>
 #include <crypto/fmp.h>
 
 #include <linux/device-mapper.h>
@@ -986,7 +987,10 @@ static u8 *iv_of_dmreq(struct crypt_config *cc,
 		crypto_skcipher_alignmask(any_tfm(cc)) + 1);
 }
 
-static int crypt_convert_block(struct crypt_config *cc,
+/*
+ * Set up @req for the next sector of @ctx and advance past it.
+ */
+static int crypt_prepare_block(struct crypt_config *cc,
 			       struct convert_context *ctx,
 			       struct skcipher_request *req)
 {
@@ -1027,37 +1031,51 @@ static int crypt_convert_block(struct crypt_config *cc,
 	skcipher_request_set_crypt(req, &dmreq->sg_in, &dmreq->sg_out,
 				   cc->sector_size, iv);
 
-	if (bio_data_dir(ctx->bio_in) == WRITE)
-		r = crypto_skcipher_encrypt(req);
-	else
-		r = crypto_skcipher_decrypt(req);
+	return 0;
+}
+
+/*
+ * Finish a request that was processed synchronously.
+ */
+static int crypt_finish_block(struct crypt_config *cc,
+			      struct skcipher_request *req)
+{
+	struct dm_crypt_request *dmreq = dmreq_of_req(cc, req);
 
-	if (!r && cc->iv_gen_ops && cc->iv_gen_ops->post)
-		r = cc->iv_gen_ops->post(cc, iv, dmreq);
+	if (cc->iv_gen_ops && cc->iv_gen_ops->post)
+		return cc->iv_gen_ops->post(cc, iv_of_dmreq(cc, dmreq), dmreq);
 
-	return r;
+	return 0;
 }
 
 static void kcryptd_async_done(struct crypto_async_request *async_req,
 			       int error);
 
-static void crypt_alloc_req(struct crypt_config *cc,
-			    struct convert_context *ctx)
+static struct skcipher_request *crypt_alloc_req(struct crypt_config *cc,
+						struct convert_context *ctx,
+						gfp_t gfp_mask)
 {
 	unsigned key_index = ctx->cc_sector & (cc->tfms_count - 1);
+	struct skcipher_request *req = ctx->req;
 
-	if (!ctx->req)
-		ctx->req = mempool_alloc(cc->req_pool, GFP_NOIO);
+	if (!req) {
+		req = mempool_alloc(cc->req_pool, gfp_mask);
+		if (!req)
+			return NULL;
+	}
+	ctx->req = NULL;
 
-	skcipher_request_set_tfm(ctx->req, cc->tfms[key_index]);
+	skcipher_request_set_tfm(req, cc->tfms[key_index]);
 
 	/*
 	 * Use REQ_MAY_BACKLOG so a cipher driver internally backlogs
 	 * requests if driver request queue is full.
 	 */
-	skcipher_request_set_callback(ctx->req,
+	skcipher_request_set_callback(req,
 	    CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
-	    kcryptd_async_done, dmreq_of_req(cc, ctx->req));
+	    kcryptd_async_done, dmreq_of_req(cc, req));
+
+	return req;
 }
 
 static void crypt_free_req(struct crypt_config *cc,
@@ -1070,24 +1088,52 @@ static void crypt_free_req(struct crypt_config *cc,
 }
 
 /*
- * Encrypt / decrypt data from one bio to another one (can be the same one)
+ * Drop a request that is done with or was never submitted, keeping one
+ * around in ctx->req for the next sector.
  */
-static int crypt_convert(struct crypt_config *cc,
-			 struct convert_context *ctx)
+static void crypt_put_req(struct crypt_config *cc,
+			  struct convert_context *ctx,
+			  struct skcipher_request *req)
 {
-	unsigned int sector_step = cc->sector_size >> SECTOR_SHIFT;
-	int r;
-
-	atomic_set(&ctx->cc_pending, 1);
+	struct dm_crypt_io *io = container_of(ctx, struct dm_crypt_io, ctx);
 
-	while (ctx->iter_in.bi_size && ctx->iter_out.bi_size) {
+	atomic_dec(&ctx->cc_pending);
+	if (!ctx->req)
+		ctx->req = req;
+	else
+		crypt_free_req(cc, req, io->base_bio);
+}
 
-		crypt_alloc_req(cc, ctx);
-		atomic_inc(&ctx->cc_pending);
+/*
+ * Submit a batch of prepared requests, so that a SIMD cipher saves and
+ * restores the FPU state once for all of them.
+ */
+static int crypt_convert_batch(struct crypt_config *cc,
+			       struct convert_context *ctx,
+			       struct skcipher_request **reqs,
+			       unsigned int nreqs)
+{
+	unsigned int i = 0, done;
+	int r = 0, err;
 
-		r = crypt_convert_block(cc, ctx, ctx->req);
+	while (i < nreqs) {
+		if (bio_data_dir(ctx->bio_in) == WRITE)
+			done = crypto_skcipher_encrypt_batch(reqs + i,
+							     nreqs - i, &err);
+		else
+			done = crypto_skcipher_decrypt_batch(reqs + i,
+							     nreqs - i, &err);
+
+		/* These requests were already processed (synchronously). */
+		for (; done; done--, i++) {
+			if (!r)
+				r = crypt_finish_block(cc, reqs[i]);
+			crypt_put_req(cc, ctx, reqs[i]);
+		}
+		if (r || i == nreqs)
+			break;
 
-		switch (r) {
+		switch (err) {
 		/*
 		 * The request was queued by a crypto driver
 		 * but the driver request queue is full, let's wait.
@@ -1101,23 +1147,68 @@ static int crypt_convert(struct crypt_config *cc,
 		 * completion function kcryptd_async_done() will be called.
 		 */
 		case -EINPROGRESS:
-			ctx->req = NULL;
-			ctx->cc_sector += sector_step;
+			i++;
 			continue;
+		}
+
+		/* There was an error while processing the request. */
+		r = err;
+		break;
+	}
+
+	/* Drop the failed request and those never submitted after it */
+	for (; i < nreqs; i++)
+		crypt_put_req(cc, ctx, reqs[i]);
+
+	return r;
+}
+
+/*
+ * Encrypt / decrypt data from one bio to another one (can be the same one)
+ */
+static int crypt_convert(struct crypt_config *cc,
+			 struct convert_context *ctx)
+{
+	unsigned int sector_step = cc->sector_size >> SECTOR_SHIFT;
+	struct skcipher_request *reqs[SKCIPHER_BATCH_MAX];
+	unsigned int nreqs;
+	int r;
+
+	atomic_set(&ctx->cc_pending, 1);
+
+	while (ctx->iter_in.bi_size && ctx->iter_out.bi_size) {
+
 		/*
-		 * The request was already processed (synchronously).
+		 * Only the first request of a batch may wait for the mempool,
+		 * the others might otherwise wait for requests that are held
+		 * by the batches of other bios.
 		 */
-		case 0:
-			atomic_dec(&ctx->cc_pending);
+		for (nreqs = 0; nreqs < SKCIPHER_BATCH_MAX &&
+		     ctx->iter_in.bi_size && ctx->iter_out.bi_size; nreqs++) {
+			struct skcipher_request *req;
+
+			req = crypt_alloc_req(cc, ctx,
+					      nreqs ? GFP_NOWAIT : GFP_NOIO);
+			if (!req)
+				break;
+			atomic_inc(&ctx->cc_pending);
+
+			r = crypt_prepare_block(cc, ctx, req);
+			if (r) {
+				crypt_put_req(cc, ctx, req);
+				while (nreqs)
+					crypt_put_req(cc, ctx, reqs[--nreqs]);
+				return r;
+			}
+
+			reqs[nreqs] = req;
 			ctx->cc_sector += sector_step;
-			cond_resched();
-			continue;
+		}
 
-		/* There was an error while processing the request. */
-		default:
-			atomic_dec(&ctx->cc_pending);
+		r = crypt_convert_batch(cc, ctx, reqs, nreqs);
+		if (r)
 			return r;
-		}
+		cond_resched();
 	}
 
 	return 0;
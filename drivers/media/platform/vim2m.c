@@ -17,6 +17,7 @@
  * License, or (at your option) any later version
  */
 #include <linux/module.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/fs.h>
 #include <linux/timer.h>
@@ -41,6 +42,15 @@ static unsigned debug;
 module_param(debug, uint, 0644);
 MODULE_PARM_DESC(debug, "activates debug info");
 
+static unsigned int batch = 1;
+module_param(batch, uint, 0444);
+MODULE_PARM_DESC(batch, "most instances to run in one simulated transaction");
+
+static unsigned int batch_latency_us;
+module_param(batch_latency_us, uint, 0444);
+MODULE_PARM_DESC(batch_latency_us,
+		 "queueing time after which an instance is run first (0 = off)");
+
 #define MIN_W 32
 #define MIN_H 32
 #define MAX_W 640
@@ -148,6 +158,12 @@ struct vim2m_dev {
 	struct timer_list	timer;
 
 	struct v4l2_m2m_dev	*m2m_dev;
+
+	/* Instances of the batch being run, if batching */
+	struct vim2m_ctx	*batch[V4L2_M2M_MAX_BATCH];
+	unsigned int		batch_len;
+
+	struct dentry		*debugfs;
 };
 
 struct vim2m_ctx {
@@ -388,12 +404,100 @@ static void device_run(void *priv)
 	schedule_irq(dev, ctx->transtime);
 }
 
+/* device_run_batch() - starts the device on several instances at once
+ *
+ * This simulates a device that takes a buffer pair from each instance of
+ * the batch per transaction, and takes as long as the slowest of them.
+ */
+static void device_run_batch(struct v4l2_m2m_ctx **m2m_ctxs, unsigned int num)
+{
+	struct vim2m_dev *dev = ((struct vim2m_ctx *)m2m_ctxs[0]->priv)->dev;
+	struct vim2m_ctx *ctx;
+	u32 transtime = 0;
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		ctx = m2m_ctxs[i]->priv;
+		dev->batch[i] = ctx;
+		device_process(ctx, v4l2_m2m_next_src_buf(ctx->fh.m2m_ctx),
+			       v4l2_m2m_next_dst_buf(ctx->fh.m2m_ctx));
+		transtime = max(transtime, ctx->transtime);
+	}
+	dev->batch_len = num;
+
+	schedule_irq(dev, transtime);
+}
+
+/*
+ * Return the buffers just processed for the instance, and whether its
+ * transaction is over.
+ */
+static bool device_done(struct vim2m_dev *vim2m_dev, struct vim2m_ctx *ctx)
+{
+	struct vb2_v4l2_buffer *src_vb, *dst_vb;
+	unsigned long flags;
+
+	src_vb = v4l2_m2m_src_buf_remove(ctx->fh.m2m_ctx);
+	dst_vb = v4l2_m2m_dst_buf_remove(ctx->fh.m2m_ctx);
+
+	ctx->num_processed++;
+
+	spin_lock_irqsave(&vim2m_dev->irqlock, flags);
+	v4l2_m2m_buf_done(src_vb, VB2_BUF_STATE_DONE);
+	v4l2_m2m_buf_done(dst_vb, VB2_BUF_STATE_DONE);
+	spin_unlock_irqrestore(&vim2m_dev->irqlock, flags);
+
+	if (ctx->num_processed == ctx->translen || ctx->aborting) {
+		dprintk(ctx->dev, "Finishing transaction\n");
+		ctx->num_processed = 0;
+		return true;
+	}
+
+	return false;
+}
+
+static void device_isr_batch(struct vim2m_dev *vim2m_dev)
+{
+	struct vim2m_ctx *done[V4L2_M2M_MAX_BATCH];
+	unsigned int i, num = 0, num_done = 0;
+	u32 transtime = 0;
+
+	for (i = 0; i < vim2m_dev->batch_len; i++) {
+		struct vim2m_ctx *ctx = vim2m_dev->batch[i];
+
+		if (device_done(vim2m_dev, ctx))
+			done[num_done++] = ctx;
+		else
+			vim2m_dev->batch[num++] = ctx;
+	}
+	vim2m_dev->batch_len = num;
+
+	/* Carry on with the instances that want more buffers processed */
+	for (i = 0; i < num; i++) {
+		struct vim2m_ctx *ctx = vim2m_dev->batch[i];
+
+		device_process(ctx, v4l2_m2m_next_src_buf(ctx->fh.m2m_ctx),
+			       v4l2_m2m_next_dst_buf(ctx->fh.m2m_ctx));
+		transtime = max(transtime, ctx->transtime);
+	}
+	if (num)
+		schedule_irq(vim2m_dev, transtime);
+
+	/* The last of these may start the next batch right away */
+	for (i = 0; i < num_done; i++)
+		v4l2_m2m_job_finish(vim2m_dev->m2m_dev,
+				    done[i]->fh.m2m_ctx);
+}
+
 static void device_isr(unsigned long priv)
 {
 	struct vim2m_dev *vim2m_dev = (struct vim2m_dev *)priv;
 	struct vim2m_ctx *curr_ctx;
-	struct vb2_v4l2_buffer *src_vb, *dst_vb;
-	unsigned long flags;
+
+	if (vim2m_dev->batch_len) {
+		device_isr_batch(vim2m_dev);
+		return;
+	}
 
 	curr_ctx = v4l2_m2m_get_curr_priv(vim2m_dev->m2m_dev);
 
@@ -402,24 +506,10 @@ static void device_isr(unsigned long priv)
 		return;
 	}
 
-	src_vb = v4l2_m2m_src_buf_remove(curr_ctx->fh.m2m_ctx);
-	dst_vb = v4l2_m2m_dst_buf_remove(curr_ctx->fh.m2m_ctx);
-
-	curr_ctx->num_processed++;
-
-	spin_lock_irqsave(&vim2m_dev->irqlock, flags);
-	v4l2_m2m_buf_done(src_vb, VB2_BUF_STATE_DONE);
-	v4l2_m2m_buf_done(dst_vb, VB2_BUF_STATE_DONE);
-	spin_unlock_irqrestore(&vim2m_dev->irqlock, flags);
-
-	if (curr_ctx->num_processed == curr_ctx->translen
-	    || curr_ctx->aborting) {
-		dprintk(curr_ctx->dev, "Finishing transaction\n");
-		curr_ctx->num_processed = 0;
+	if (device_done(vim2m_dev, curr_ctx))
 		v4l2_m2m_job_finish(vim2m_dev->m2m_dev, curr_ctx->fh.m2m_ctx);
-	} else {
+	else
 		device_run(curr_ctx);
-	}
 }
 
 /*
@@ -931,6 +1021,7 @@ static int vim2m_open(struct file *file)
 		kfree(ctx);
 		goto open_unlock;
 	}
+	v4l2_m2m_ctx_set_max_latency(ctx->fh.m2m_ctx, batch_latency_us);
 
 	v4l2_fh_add(&ctx->fh);
 	atomic_inc(&dev->num_inst);
@@ -983,6 +1074,7 @@ static struct video_device vim2m_videodev = {
 
 static struct v4l2_m2m_ops m2m_ops = {
 	.device_run	= device_run,
+	.device_run_batch = device_run_batch,
 	.job_ready	= job_ready,
 	.job_abort	= job_abort,
 };
@@ -1031,6 +1123,12 @@ static int vim2m_probe(struct platform_device *pdev)
 		ret = PTR_ERR(dev->m2m_dev);
 		goto err_m2m;
 	}
+	if (batch > 1)
+		v4l2_m2m_set_batch(dev->m2m_dev, batch);
+
+	dev->debugfs = debugfs_create_dir(MEM2MEM_NAME, NULL);
+	if (!IS_ERR_OR_NULL(dev->debugfs))
+		v4l2_m2m_debugfs_create(dev->m2m_dev, dev->debugfs);
 
 	return 0;
 
@@ -1049,6 +1147,7 @@ static int vim2m_remove(struct platform_device *pdev)
 
 	v4l2_info(&dev->v4l2_dev, "Removing " MEM2MEM_NAME);
 	v4l2_m2m_release(dev->m2m_dev);
+	debugfs_remove_recursive(dev->debugfs);
 	del_timer_sync(&dev->timer);
 	video_unregister_device(&dev->vfd);
 	v4l2_device_unregister(&dev->v4l2_dev);
@@ -13,8 +13,10 @@
  * Free Software Foundation; either version 2 of the License, or (at your
  * option) any later version.
  */
+#include <linux/debugfs.h>
 #include <linux/module.h>
 #include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 
 #include <media/videobuf2-v4l2.h>
@@ -53,17 +55,26 @@ module_param(debug, bool, 0644);
 
 /**
  * struct v4l2_m2m_dev - per-device context
- * @curr_ctx:		currently running instance
+ * @curr_ctx:		currently running instance, the first one of a batch
+ * @num_running:	number of instances currently running
+ * @max_batch:		most instances to run at once
  * @job_queue:		instances queued to run
- * @job_spinlock:	protects job_queue
+ * @ctx_list:		all instances, for the debugfs report
+ * @job_spinlock:	protects job_queue, ctx_list and the above
+ * @debugfs:		debugfs file reporting queueing latency
  * @m2m_ops:		driver callbacks
  */
 struct v4l2_m2m_dev {
 	struct v4l2_m2m_ctx	*curr_ctx;
+	unsigned int		num_running;
+	unsigned int		max_batch;
 
 	struct list_head	job_queue;
+	struct list_head	ctx_list;
 	spinlock_t		job_spinlock;
 
+	struct dentry		*debugfs;
+
 	const struct v4l2_m2m_ops *m2m_ops;
 };
 
@@ -144,14 +155,40 @@ void *v4l2_m2m_get_curr_priv(struct v4l2_m2m_dev *m2m_dev)
 }
 EXPORT_SYMBOL(v4l2_m2m_get_curr_priv);
 
+/* Must be called with job_spinlock held */
+static void v4l2_m2m_start_job(struct v4l2_m2m_ctx *m2m_ctx, ktime_t now)
+{
+	u64 wait = ktime_to_ns(ktime_sub(now, m2m_ctx->queued_at));
+
+	m2m_ctx->job_flags |= TRANS_RUNNING;
+	m2m_ctx->jobs++;
+	m2m_ctx->wait_total_ns += wait;
+	if (wait > m2m_ctx->wait_max_ns)
+		m2m_ctx->wait_max_ns = wait;
+}
+
+static bool v4l2_m2m_overdue(struct v4l2_m2m_ctx *m2m_ctx, ktime_t now)
+{
+	return m2m_ctx->max_latency_ns &&
+	       ktime_to_ns(ktime_sub(now, m2m_ctx->queued_at)) >=
+	       m2m_ctx->max_latency_ns;
+}
+
 /**
- * v4l2_m2m_try_run() - select next job to perform and run it if possible
+ * v4l2_m2m_try_run() - select next jobs to perform and run them if possible
  *
- * Get next transaction (if present) from the waiting jobs list and run it.
+ * Get the next transactions (if present) from the waiting jobs list and run
+ * them: one, or up to max_batch of them if the driver can take a batch.
+ * Contexts past their latency limit go first, the rest in queue order, and
+ * since a finished context is requeued at the tail, each gets its turn.
  */
 static void v4l2_m2m_try_run(struct v4l2_m2m_dev *m2m_dev)
 {
+	struct v4l2_m2m_ctx *m2m_ctxs[V4L2_M2M_MAX_BATCH];
+	struct v4l2_m2m_ctx *m2m_ctx;
+	unsigned int max_jobs, num = 0;
 	unsigned long flags;
+	ktime_t now;
 
 	spin_lock_irqsave(&m2m_dev->job_spinlock, flags);
 	if (NULL != m2m_dev->curr_ctx) {
@@ -166,12 +203,38 @@ static void v4l2_m2m_try_run(struct v4l2_m2m_dev *m2m_dev)
 		return;
 	}
 
-	m2m_dev->curr_ctx = list_first_entry(&m2m_dev->job_queue,
-				   struct v4l2_m2m_ctx, queue);
-	m2m_dev->curr_ctx->job_flags |= TRANS_RUNNING;
+	max_jobs = m2m_dev->m2m_ops->device_run_batch ? m2m_dev->max_batch : 1;
+	now = ktime_get();
+
+	list_for_each_entry(m2m_ctx, &m2m_dev->job_queue, queue) {
+		if (num == max_jobs)
+			break;
+		if (!v4l2_m2m_overdue(m2m_ctx, now))
+			continue;
+		v4l2_m2m_start_job(m2m_ctx, now);
+		m2m_ctxs[num++] = m2m_ctx;
+	}
+
+	list_for_each_entry(m2m_ctx, &m2m_dev->job_queue, queue) {
+		if (num == max_jobs)
+			break;
+		if (m2m_ctx->job_flags & TRANS_RUNNING)
+			continue;
+		v4l2_m2m_start_job(m2m_ctx, now);
+		m2m_ctxs[num++] = m2m_ctx;
+	}
+
+	m2m_dev->curr_ctx = m2m_ctxs[0];
+	m2m_dev->num_running = num;
 	spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags);
 
-	m2m_dev->m2m_ops->device_run(m2m_dev->curr_ctx->priv);
+	if (max_jobs == 1) {
+		m2m_dev->m2m_ops->device_run(m2m_dev->curr_ctx->priv);
+		return;
+	}
+
+	dprintk("Running a batch of %u jobs\n", num);
+	m2m_dev->m2m_ops->device_run_batch(m2m_ctxs, num);
 }
 
 void v4l2_m2m_try_schedule(struct v4l2_m2m_ctx *m2m_ctx)
@@ -235,6 +298,7 @@ void v4l2_m2m_try_schedule(struct v4l2_m2m_ctx *m2m_ctx)
 
 	list_add_tail(&m2m_ctx->queue, &m2m_dev->job_queue);
 	m2m_ctx->job_flags |= TRANS_QUEUED;
+	m2m_ctx->queued_at = ktime_get();
 
 	spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags_job);
 
@@ -277,23 +341,45 @@ static void v4l2_m2m_cancel_job(struct v4l2_m2m_ctx *m2m_ctx)
 	}
 }
 
+/*
+ * Take a running instance off the job queue and out of its batch. Called
+ * with job_spinlock held.
+ */
+static void v4l2_m2m_job_done(struct v4l2_m2m_dev *m2m_dev,
+			      struct v4l2_m2m_ctx *m2m_ctx)
+{
+	struct v4l2_m2m_ctx *ctx;
+
+	list_del(&m2m_ctx->queue);
+	m2m_ctx->job_flags &= ~(TRANS_QUEUED | TRANS_RUNNING);
+	wake_up(&m2m_ctx->finished);
+
+	/* The device is free once the whole batch has finished */
+	if (--m2m_dev->num_running == 0) {
+		m2m_dev->curr_ctx = NULL;
+	} else if (m2m_dev->curr_ctx == m2m_ctx) {
+		list_for_each_entry(ctx, &m2m_dev->job_queue, queue) {
+			if (ctx->job_flags & TRANS_RUNNING) {
+				m2m_dev->curr_ctx = ctx;
+				break;
+			}
+		}
+	}
+}
+
 void v4l2_m2m_job_finish(struct v4l2_m2m_dev *m2m_dev,
 			 struct v4l2_m2m_ctx *m2m_ctx)
 {
 	unsigned long flags;
 
 	spin_lock_irqsave(&m2m_dev->job_spinlock, flags);
-	if (!m2m_dev->curr_ctx || m2m_dev->curr_ctx != m2m_ctx) {
+	if (!m2m_dev->curr_ctx || !(m2m_ctx->job_flags & TRANS_RUNNING)) {
 		spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags);
 		dprintk("Called by an instance not currently running\n");
 		return;
 	}
 
-	list_del(&m2m_dev->curr_ctx->queue);
-	m2m_dev->curr_ctx->job_flags &= ~(TRANS_QUEUED | TRANS_RUNNING);
-	wake_up(&m2m_dev->curr_ctx->finished);
-	m2m_dev->curr_ctx = NULL;
-
+	v4l2_m2m_job_done(m2m_dev, m2m_ctx);
 	spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags);
 
 	/* This instance might have more buffers ready, but since we do not
@@ -440,7 +526,9 @@ int v4l2_m2m_streamoff(struct file *file, struct v4l2_m2m_ctx *m2m_ctx,
 	m2m_dev = m2m_ctx->m2m_dev;
 	spin_lock_irqsave(&m2m_dev->job_spinlock, flags_job);
 	/* We should not be scheduled anymore, since we're dropping a queue. */
-	if (m2m_ctx->job_flags & TRANS_QUEUED)
+	if (m2m_ctx->job_flags & TRANS_RUNNING)
+		v4l2_m2m_job_done(m2m_dev, m2m_ctx);
+	else if (m2m_ctx->job_flags & TRANS_QUEUED)
 		list_del(&m2m_ctx->queue);
 	m2m_ctx->job_flags = 0;
 
@@ -451,10 +539,6 @@ int v4l2_m2m_streamoff(struct file *file, struct v4l2_m2m_ctx *m2m_ctx,
 	q_ctx->num_rdy = 0;
 	spin_unlock_irqrestore(&q_ctx->rdy_spinlock, flags);
 
-	if (m2m_dev->curr_ctx == m2m_ctx) {
-		m2m_dev->curr_ctx = NULL;
-		wake_up(&m2m_ctx->finished);
-	}
 	spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags_job);
 
 	return 0;
@@ -569,8 +653,10 @@ struct v4l2_m2m_dev *v4l2_m2m_init(const struct v4l2_m2m_ops *m2m_ops)
 		return ERR_PTR(-ENOMEM);
 
 	m2m_dev->curr_ctx = NULL;
+	m2m_dev->max_batch = 1;
 	m2m_dev->m2m_ops = m2m_ops;
 	INIT_LIST_HEAD(&m2m_dev->job_queue);
+	INIT_LIST_HEAD(&m2m_dev->ctx_list);
 	spin_lock_init(&m2m_dev->job_spinlock);
 
 	return m2m_dev;
@@ -579,16 +665,86 @@ EXPORT_SYMBOL_GPL(v4l2_m2m_init);
 
 void v4l2_m2m_release(struct v4l2_m2m_dev *m2m_dev)
 {
+	debugfs_remove(m2m_dev->debugfs);
 	kfree(m2m_dev);
 }
 EXPORT_SYMBOL_GPL(v4l2_m2m_release);
 
+void v4l2_m2m_set_batch(struct v4l2_m2m_dev *m2m_dev, unsigned int max_jobs)
+{
+	unsigned long flags;
+
+	if (WARN_ON(max_jobs > 1 && !m2m_dev->m2m_ops->device_run_batch))
+		return;
+
+	spin_lock_irqsave(&m2m_dev->job_spinlock, flags);
+	m2m_dev->max_batch = clamp_t(unsigned int, max_jobs, 1,
+				     V4L2_M2M_MAX_BATCH);
+	spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags);
+}
+EXPORT_SYMBOL_GPL(v4l2_m2m_set_batch);
+
+void v4l2_m2m_ctx_set_max_latency(struct v4l2_m2m_ctx *m2m_ctx,
+				  u32 latency_us)
+{
+	struct v4l2_m2m_dev *m2m_dev = m2m_ctx->m2m_dev;
+	unsigned long flags;
+
+	spin_lock_irqsave(&m2m_dev->job_spinlock, flags);
+	m2m_ctx->max_latency_ns = (u64)latency_us * NSEC_PER_USEC;
+	spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags);
+}
+EXPORT_SYMBOL_GPL(v4l2_m2m_ctx_set_max_latency);
+
+static int v4l2_m2m_jobs_show(struct seq_file *s, void *unused)
+{
+	struct v4l2_m2m_dev *m2m_dev = s->private;
+	struct v4l2_m2m_ctx *m2m_ctx;
+	unsigned long flags;
+
+	seq_printf(s, "max batch: %u\n", m2m_dev->max_batch);
+	seq_puts(s, "context          jobs       avg_wait_us  max_wait_us  limit_us\n");
+
+	spin_lock_irqsave(&m2m_dev->job_spinlock, flags);
+	list_for_each_entry(m2m_ctx, &m2m_dev->ctx_list, ctx_list)
+		seq_printf(s, "%-16p %-10llu %-12llu %-12llu %llu\n",
+			   m2m_ctx->priv, m2m_ctx->jobs,
+			   m2m_ctx->jobs ? div64_u64(m2m_ctx->wait_total_ns,
+				   m2m_ctx->jobs * NSEC_PER_USEC) : 0,
+			   div_u64(m2m_ctx->wait_max_ns, NSEC_PER_USEC),
+			   div_u64(m2m_ctx->max_latency_ns, NSEC_PER_USEC));
+	spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags);
+
+	return 0;
+}
+
+static int v4l2_m2m_jobs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, v4l2_m2m_jobs_show, inode->i_private);
+}
+
+static const struct file_operations v4l2_m2m_jobs_fops = {
+	.open		= v4l2_m2m_jobs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void v4l2_m2m_debugfs_create(struct v4l2_m2m_dev *m2m_dev,
+			     struct dentry *parent)
+{
+	m2m_dev->debugfs = debugfs_create_file("jobs", 0444, parent, m2m_dev,
+					       &v4l2_m2m_jobs_fops);
+}
+EXPORT_SYMBOL_GPL(v4l2_m2m_debugfs_create);
+
 struct v4l2_m2m_ctx *v4l2_m2m_ctx_init(struct v4l2_m2m_dev *m2m_dev,
 		void *drv_priv,
 		int (*queue_init)(void *priv, struct vb2_queue *src_vq, struct vb2_queue *dst_vq))
 {
 	struct v4l2_m2m_ctx *m2m_ctx;
 	struct v4l2_m2m_queue_ctx *out_q_ctx, *cap_q_ctx;
+	unsigned long flags;
 	int ret;
 
 	m2m_ctx = kzalloc(sizeof *m2m_ctx, GFP_KERNEL);
@@ -621,6 +777,10 @@ struct v4l2_m2m_ctx *v4l2_m2m_ctx_init(struct v4l2_m2m_dev *m2m_dev,
 	if (out_q_ctx->q.lock == cap_q_ctx->q.lock)
 		m2m_ctx->q_lock = out_q_ctx->q.lock;
 
+	spin_lock_irqsave(&m2m_dev->job_spinlock, flags);
+	list_add_tail(&m2m_ctx->ctx_list, &m2m_dev->ctx_list);
+	spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags);
+
 	return m2m_ctx;
 err:
 	kfree(m2m_ctx);
@@ -630,9 +790,16 @@ EXPORT_SYMBOL_GPL(v4l2_m2m_ctx_init);
 
 void v4l2_m2m_ctx_release(struct v4l2_m2m_ctx *m2m_ctx)
 {
+	struct v4l2_m2m_dev *m2m_dev = m2m_ctx->m2m_dev;
+	unsigned long flags;
+
 	/* wait until the current context is dequeued from job_queue */
 	v4l2_m2m_cancel_job(m2m_ctx);
 
+	spin_lock_irqsave(&m2m_dev->job_spinlock, flags);
+	list_del(&m2m_ctx->ctx_list);
+	spin_unlock_irqrestore(&m2m_dev->job_spinlock, flags);
+
 	vb2_queue_release(&m2m_ctx->cap_q_ctx.q);
 	vb2_queue_release(&m2m_ctx->out_q_ctx.q);
 
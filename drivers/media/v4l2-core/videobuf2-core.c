@@ -14,13 +14,17 @@
  * the Free Software Foundation.
  */
 
+#include <linux/atomic.h>
+#include <linux/debugfs.h>
 #include <linux/err.h>
+#include <linux/fs.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/mm.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/sched.h>
+#include <linux/seq_file.h>
 #include <linux/freezer.h>
 #include <linux/kthread.h>
 
@@ -291,6 +295,180 @@ static void __vb2_buf_dmabuf_put(struct vb2_buffer *vb)
 		__vb2_plane_dmabuf_put(vb, &vb->planes[plane]);
 }
 
+/*
+ * Camera and codec pipelines recirculate a handful of dma-bufs, but not
+ * necessarily through the same buffer index every time. Rather than
+ * detaching a dma-buf as soon as its slot is given another one, keep the
+ * attachment (and whatever device mapping the allocator hangs off it) on
+ * the queue and hand it back when the same dma-buf is queued again.
+ *
+ * The cache holds no more entries than the queue has buffers, and drops
+ * dma-bufs that userspace has closed whenever a buffer is dequeued.
+ */
+#define VB2_DMABUF_CACHE_MAX(q)	min_t(unsigned int, (q)->num_buffers, \
+				      VB2_MAX_FRAME)
+
+struct vb2_dmabuf_cache_entry {
+	struct list_head	list;
+	struct dma_buf		*dbuf;
+	struct device		*dev;
+	unsigned int		length;
+	void			*mem_priv;
+};
+
+static atomic_long_t vb2_dmabuf_cache_hits;
+static atomic_long_t vb2_dmabuf_cache_misses;
+static atomic_long_t vb2_dmabuf_cache_evictions;
+
+static void __vb2_dmabuf_cache_evict(struct vb2_queue *q,
+				     struct vb2_dmabuf_cache_entry *e)
+{
+	list_del(&e->list);
+	q->dmabuf_cache_count--;
+	q->mem_ops->detach_dmabuf(e->mem_priv);
+	dma_buf_put(e->dbuf);
+	kfree(e);
+	atomic_long_inc(&vb2_dmabuf_cache_evictions);
+}
+
+/*
+ * Drop entries whose dma-buf nobody but the cache refers to any more:
+ * userspace has closed it, so it can never be queued again.
+ */
+static void __vb2_dmabuf_cache_prune(struct vb2_queue *q)
+{
+	struct vb2_dmabuf_cache_entry *e, *tmp;
+
+	list_for_each_entry_safe(e, tmp, &q->dmabuf_cache, list)
+		if (file_count(e->dbuf->file) == 1)
+			__vb2_dmabuf_cache_evict(q, e);
+}
+
+/**
+ * __vb2_dmabuf_cache_flush() - detach all dma-bufs kept on the queue
+ */
+static void __vb2_dmabuf_cache_flush(struct vb2_queue *q)
+{
+	struct vb2_dmabuf_cache_entry *e, *tmp;
+
+	list_for_each_entry_safe(e, tmp, &q->dmabuf_cache, list)
+		__vb2_dmabuf_cache_evict(q, e);
+}
+
+/**
+ * __vb2_dmabuf_cache_get() - take a kept attachment of @dbuf off the queue
+ *
+ * Returns the allocator private structure of the attachment, or NULL if
+ * there is none matching @dev and @length. The reference the cache held
+ * on @dbuf is handed over to the caller along with it.
+ */
+static void *__vb2_dmabuf_cache_get(struct vb2_queue *q, struct dma_buf *dbuf,
+				    struct device *dev, unsigned int length)
+{
+	struct vb2_dmabuf_cache_entry *e;
+	void *mem_priv;
+
+	list_for_each_entry(e, &q->dmabuf_cache, list) {
+		if (e->dbuf != dbuf || e->dev != dev || e->length != length)
+			continue;
+
+		list_del(&e->list);
+		q->dmabuf_cache_count--;
+		mem_priv = e->mem_priv;
+		kfree(e);
+		atomic_long_inc(&vb2_dmabuf_cache_hits);
+		return mem_priv;
+	}
+
+	atomic_long_inc(&vb2_dmabuf_cache_misses);
+	return NULL;
+}
+
+/**
+ * __vb2_plane_dmabuf_park() - release a DMABUF plane, keeping its
+ * attachment on the queue for reuse
+ */
+static void __vb2_plane_dmabuf_park(struct vb2_buffer *vb, struct vb2_plane *p,
+				    struct device *dev)
+{
+	struct vb2_queue *q = vb->vb2_queue;
+	struct vb2_dmabuf_cache_entry *e;
+
+	if (!p->mem_priv)
+		return;
+
+	e = kmalloc(sizeof(*e), GFP_KERNEL);
+	if (!e) {
+		__vb2_plane_dmabuf_put(vb, p);
+		return;
+	}
+
+	if (p->dbuf_mapped)
+		call_void_memop(vb, unmap_dmabuf, p->mem_priv);
+
+	__vb2_dmabuf_cache_prune(q);
+	if (q->dmabuf_cache_count >= VB2_DMABUF_CACHE_MAX(q))
+		__vb2_dmabuf_cache_evict(q, list_last_entry(&q->dmabuf_cache,
+					struct vb2_dmabuf_cache_entry, list));
+
+	e->dbuf = p->dbuf;
+	e->dev = dev;
+	e->length = p->length;
+	e->mem_priv = p->mem_priv;
+	list_add(&e->list, &q->dmabuf_cache);
+	q->dmabuf_cache_count++;
+#ifdef CONFIG_VIDEO_ADV_DEBUG
+	/* Keep this buffer's attach/detach counts balanced */
+	vb->cnt_mem_detach_dmabuf++;
+#endif
+
+	p->mem_priv = NULL;
+	p->dbuf = NULL;
+	p->dbuf_mapped = 0;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static int vb2_dmabuf_cache_show(struct seq_file *s, void *unused)
+{
+	seq_printf(s, "hits: %ld\nmisses: %ld\nevictions: %ld\n",
+		   atomic_long_read(&vb2_dmabuf_cache_hits),
+		   atomic_long_read(&vb2_dmabuf_cache_misses),
+		   atomic_long_read(&vb2_dmabuf_cache_evictions));
+	return 0;
+}
+
+static int vb2_dmabuf_cache_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, vb2_dmabuf_cache_show, NULL);
+}
+
+static const struct file_operations vb2_dmabuf_cache_fops = {
+	.open		= vb2_dmabuf_cache_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static struct dentry *vb2_debugfs_root;
+
+static int __init vb2_core_init(void)
+{
+	vb2_debugfs_root = debugfs_create_dir("videobuf2", NULL);
+	if (!IS_ERR_OR_NULL(vb2_debugfs_root))
+		debugfs_create_file("dmabuf_cache", 0444, vb2_debugfs_root,
+				    NULL, &vb2_dmabuf_cache_fops);
+	return 0;
+}
+
+static void __exit vb2_core_exit(void)
+{
+	debugfs_remove_recursive(vb2_debugfs_root);
+}
+
+module_init(vb2_core_init);
+module_exit(vb2_core_exit);
+#endif
+
 /**
  * __setup_offsets() - setup unique offsets ("cookies") for every plane in
  * the buffer.
@@ -460,6 +638,7 @@ static int __vb2_queue_free(struct vb2_queue *q, unsigned int buffers)
 
 	/* Release video buffer memory */
 	__vb2_free_mem(q, buffers);
+	__vb2_dmabuf_cache_flush(q);
 
 #ifdef CONFIG_VIDEO_ADV_DEBUG
 	/*
@@ -1126,6 +1305,7 @@ static int __qbuf_dmabuf(struct vb2_buffer *vb, const void *pb)
 		return ret;
 
 	for (plane = 0; plane < vb->num_planes; ++plane) {
+		struct device *dev = q->alloc_devs[plane] ? : q->dev;
 		struct dma_buf *dbuf = dma_buf_get(planes[plane].m.fd);
 
 		if (IS_ERR_OR_NULL(dbuf)) {
@@ -1163,17 +1343,26 @@ static int __qbuf_dmabuf(struct vb2_buffer *vb, const void *pb)
 			call_void_vb_qop(vb, buf_cleanup, vb);
 		}
 
-		/* Release previously acquired memory if present */
-		__vb2_plane_dmabuf_put(vb, &vb->planes[plane]);
+		/* Keep previously acquired memory around for reuse */
+		__vb2_plane_dmabuf_park(vb, &vb->planes[plane], dev);
 		vb->planes[plane].bytesused = 0;
 		vb->planes[plane].length = 0;
 		vb->planes[plane].m.fd = 0;
 		vb->planes[plane].data_offset = 0;
 
-		/* Acquire each plane's memory */
-		mem_priv = call_ptr_memop(vb, attach_dmabuf,
-				q->alloc_devs[plane] ? : q->dev,
-				dbuf, planes[plane].length, dma_dir);
+		/* Acquire each plane's memory, attaching only if not kept */
+		mem_priv = __vb2_dmabuf_cache_get(q, dbuf, dev,
+						  planes[plane].length);
+		if (mem_priv) {
+			/* The kept entry already holds a reference */
+			dma_buf_put(dbuf);
+#ifdef CONFIG_VIDEO_ADV_DEBUG
+			vb->cnt_mem_attach_dmabuf++;
+#endif
+		} else {
+			mem_priv = call_ptr_memop(vb, attach_dmabuf, dev, dbuf,
+						  planes[plane].length, dma_dir);
+		}
 		if (IS_ERR(mem_priv)) {
 			dprintk(1, "failed to attach dmabuf\n");
 			ret = PTR_ERR(mem_priv);
@@ -1593,13 +1782,15 @@ static void __vb2_dqbuf(struct vb2_buffer *vb)
 	vb->state = VB2_BUF_STATE_DEQUEUED;
 
 	/* unmap DMABUF buffer */
-	if (q->memory == VB2_MEMORY_DMABUF)
+	if (q->memory == VB2_MEMORY_DMABUF) {
 		for (i = 0; i < vb->num_planes; ++i) {
 			if (!vb->planes[i].dbuf_mapped)
 				continue;
 			call_void_memop(vb, unmap_dmabuf, vb->planes[i].mem_priv);
 			vb->planes[i].dbuf_mapped = 0;
 		}
+		__vb2_dmabuf_cache_prune(q);
+	}
 }
 
 int vb2_core_dqbuf(struct vb2_queue *q, unsigned int *pindex, void *pb,
@@ -2029,6 +2220,7 @@ int vb2_core_queue_init(struct vb2_queue *q)
 
 	INIT_LIST_HEAD(&q->queued_list);
 	INIT_LIST_HEAD(&q->done_list);
+	INIT_LIST_HEAD(&q->dmabuf_cache);
 	spin_lock_init(&q->done_lock);
 	mutex_init(&q->mmap_lock);
 	init_waitqueue_head(&q->done_wq);
@@ -45,6 +45,7 @@ struct vb2_ion_buf {
 	atomic_t			ref;
 	bool				cached;
 	bool				ion;
+	bool				pinned;
 	struct vb2_ion_cookie		cookie;
 };
 
@@ -239,6 +240,22 @@ static int vb2_ion_mmap(void *buf_priv, struct vm_area_struct *vma)
 	return ret;
 }
 
+/*
+ * ION does cache maintenance in map_dma_buf only for cached buffers whose
+ * user mappings are faulted in and tracked for dirty pages. Any other ION
+ * buffer may stay mapped from one QBUF to the next, so only the first QBUF
+ * after attaching pays for dma_buf_map_attachment().
+ */
+static bool vb2_ion_keep_mapped(struct vb2_ion_buf *buf)
+{
+	int needsync = ion_cached_needsync_dmabuf(buf->dma_buf);
+
+	if (needsync < 0)
+		return false;
+
+	return needsync || !ion_cached_dmabuf(buf->dma_buf);
+}
+
 static int vb2_ion_map_dmabuf(void *mem_priv)
 {
 	struct vb2_ion_buf *buf = mem_priv;
@@ -248,16 +265,23 @@ static int vb2_ion_map_dmabuf(void *mem_priv)
 		return -EINVAL;
 	}
 
-	if (WARN_ON(buf->cookie.sgt)) {
+	if (WARN_ON(buf->pinned)) {
 		pr_err("dmabuf buffer is already pinned\n");
 		return 0;
 	}
 
+	/* still mapped from the previous QBUF */
+	if (buf->cookie.sgt) {
+		buf->pinned = true;
+		return 0;
+	}
+
 	/* get the associated scatterlist for this buffer */
 	buf->cookie.sgt = dma_buf_map_attachment(buf->attachment,
 						buf->direction);
 	if (IS_ERR_OR_NULL(buf->cookie.sgt)) {
 		pr_err("Error getting dmabuf scatterlist\n");
+		buf->cookie.sgt = NULL;
 		return -EINVAL;
 	}
 
@@ -266,8 +290,10 @@ static int vb2_ion_map_dmabuf(void *mem_priv)
 	 * and map but the buffer in it is not accessible because it just has
 	 * metadata of dma-buf array.
 	 */
-	if (dmabuf_container_get_count(buf->dma_buf) > 0)
+	if (dmabuf_container_get_count(buf->dma_buf) > 0) {
+		buf->pinned = true;
 		return 0;
+	}
 
 	buf->cookie.offset = 0;
 	buf->cookie.paddr = sg_phys(buf->cookie.sgt->sgl) + buf->cookie.offset;
@@ -281,10 +307,12 @@ static int vb2_ion_map_dmabuf(void *mem_priv)
 					&buf->cookie.ioaddr);
 			dma_buf_unmap_attachment(buf->attachment,
 					buf->cookie.sgt, buf->direction);
+			buf->cookie.sgt = NULL;
 			return (int)buf->cookie.ioaddr;
 		}
 	}
 
+	buf->pinned = true;
 	return 0;
 }
 
@@ -297,11 +325,15 @@ static void vb2_ion_unmap_dmabuf(void *mem_priv)
 		return;
 	}
 
-	if (WARN_ON(!buf->cookie.sgt)) {
+	if (WARN_ON(!buf->pinned)) {
 		pr_err("dmabuf buffer is already unpinned\n");
 		return;
 	}
 
+	buf->pinned = false;
+	if (vb2_ion_keep_mapped(buf))
+		return;
+
 	dma_buf_unmap_attachment(buf->attachment,
 			buf->cookie.sgt, buf->direction);
 
@@ -311,6 +343,12 @@ static void vb2_ion_unmap_dmabuf(void *mem_priv)
 static void vb2_ion_detach_dmabuf(void *mem_priv)
 {
 	struct vb2_ion_buf *buf = mem_priv;
+
+	/* drop a mapping kept across QBUF by vb2_ion_unmap_dmabuf() */
+	if (buf->cookie.sgt)
+		dma_buf_unmap_attachment(buf->attachment,
+				buf->cookie.sgt, buf->direction);
+
 	if (buf->cookie.ioaddr) {
 		ion_iovmm_unmap(buf->attachment, buf->cookie.ioaddr);
 		buf->cookie.ioaddr = 0;
@@ -1140,6 +1140,41 @@ static void ion_buffer_sync_for_device(struct ion_buffer *buffer,
 				       struct device *dev,
 				       enum dma_data_direction direction);
 
+/*
+ * Cache maintenance of len bytes from offset of a buffer in the linear
+ * mapping: cleaning (or invalidating for DMA_FROM_DEVICE) for the device,
+ * or invalidating for the cpu after the device wrote to it.
+ */
+static void ion_buffer_sync_range(struct ion_buffer *buffer, off_t offset,
+				  size_t len, enum dma_data_direction dir,
+				  bool for_device)
+{
+	struct scatterlist *sg;
+	int i;
+
+	for_each_sg(buffer->sg_table->sgl, sg, buffer->sg_table->nents, i) {
+		size_t len_to_sync;
+		void *vaddr;
+
+		if (offset >= sg->length) {
+			offset -= sg->length;
+			continue;
+		}
+
+		len_to_sync = min_t(size_t, sg->length - offset, len);
+		vaddr = phys_to_virt(sg_phys(sg)) + offset;
+		if (for_device)
+			__dma_map_area(vaddr, len_to_sync, dir);
+		else
+			__dma_unmap_area(vaddr, len_to_sync, dir);
+
+		len -= len_to_sync;
+		if (len == 0)
+			break;
+		offset = 0;
+	}
+}
+
 static struct sg_table *ion_map_dma_buf(struct dma_buf_attachment *attachment,
 					enum dma_data_direction direction)
 {
@@ -1414,6 +1449,61 @@ static int ion_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 	return 0;
 }
 
+/*
+ * The whole-buffer versions above leave cache maintenance to ION_IOC_SYNC,
+ * but a caller naming the range it touches gets it done for just that
+ * range, which for a header or a histogram is a few lines out of megabytes.
+ */
+static bool ion_buffer_sync_partial(struct ion_buffer *buffer)
+{
+	return ion_buffer_cached(buffer) &&
+	       !ion_buffer_fault_user_mappings(buffer);
+}
+
+static int ion_dma_buf_begin_cpu_access_partial(struct dma_buf *dmabuf,
+					enum dma_data_direction direction,
+					unsigned int offset, unsigned int len)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+	int ret;
+
+	ret = ion_dma_buf_begin_cpu_access(dmabuf, direction);
+	if (ret)
+		return ret;
+
+	/* Only stale lines to drop if the device may have written */
+	if (!ion_buffer_sync_partial(buffer) || direction == DMA_TO_DEVICE)
+		return 0;
+
+	trace_ion_sync_start(_RET_IP_, buffer->dev->dev.this_device,
+			     direction, len, buffer->vaddr, offset, false);
+	ion_buffer_sync_range(buffer, offset, len, direction, false);
+	trace_ion_sync_end(_RET_IP_, buffer->dev->dev.this_device,
+			   direction, len, buffer->vaddr, offset, false);
+
+	return 0;
+}
+
+static int ion_dma_buf_end_cpu_access_partial(struct dma_buf *dmabuf,
+					enum dma_data_direction direction,
+					unsigned int offset, unsigned int len)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+
+	/* Only dirty lines to write back if the cpu may have written */
+	if (ion_buffer_sync_partial(buffer) && direction != DMA_FROM_DEVICE) {
+		trace_ion_sync_start(_RET_IP_, buffer->dev->dev.this_device,
+				     direction, len, buffer->vaddr, offset,
+				     false);
+		ion_buffer_sync_range(buffer, offset, len, DMA_TO_DEVICE, true);
+		trace_ion_sync_end(_RET_IP_, buffer->dev->dev.this_device,
+				   direction, len, buffer->vaddr, offset,
+				   false);
+	}
+
+	return ion_dma_buf_end_cpu_access(dmabuf, direction);
+}
+
 static void ion_dma_buf_set_privflag(struct dma_buf *dmabuf)
 {
 	struct ion_buffer *buffer = dmabuf->priv;
@@ -1444,6 +1534,8 @@ static struct dma_buf_ops dma_buf_ops = {
 	.release = ion_dma_buf_release,
 	.begin_cpu_access = ion_dma_buf_begin_cpu_access,
 	.end_cpu_access = ion_dma_buf_end_cpu_access,
+	.begin_cpu_access_partial = ion_dma_buf_begin_cpu_access_partial,
+	.end_cpu_access_partial = ion_dma_buf_end_cpu_access_partial,
 	.kmap_atomic = ion_dma_buf_kmap,
 	.kunmap_atomic = ion_dma_buf_kunmap,
 	.kmap = ion_dma_buf_kmap,
@@ -1597,6 +1689,17 @@ int ion_cached_needsync_dmabuf(struct dma_buf *dmabuf)
 }
 EXPORT_SYMBOL(ion_cached_needsync_dmabuf);
 
+int ion_cached_dmabuf(struct dma_buf *dmabuf)
+{
+	struct ion_buffer *buffer = dmabuf->priv;
+
+	if (dmabuf->ops != &dma_buf_ops)
+		return -EINVAL;
+
+	return ion_buffer_cached(buffer) ? 1 : 0;
+}
+EXPORT_SYMBOL(ion_cached_dmabuf);
+
 bool ion_may_hwrender_dmabuf(struct dma_buf *dmabuf)
 {
 	struct ion_buffer *buffer = dmabuf->priv;
@@ -1682,10 +1785,6 @@ int ion_sync_partial_for_device(struct ion_client *client, int fd,
 {
 	struct dma_buf *dmabuf;
 	struct ion_buffer *buffer;
-	struct scatterlist *sg, *sgl;
-	size_t remained = len;
-	int nelems;
-	int i;
 
 	dmabuf = dma_buf_get(fd);
 	if (IS_ERR(dmabuf))
@@ -1710,31 +1809,7 @@ int ion_sync_partial_for_device(struct ion_client *client, int fd,
 				DMA_BIDIRECTIONAL, buffer->size,
 				buffer->vaddr, 0, false);
 
-	sgl = buffer->sg_table->sgl;
-	nelems = buffer->sg_table->nents;
-
-	for_each_sg(sgl, sg, nelems, i) {
-		size_t len_to_flush;
-		if (offset >= sg->length) {
-			offset -= sg->length;
-			continue;
-		}
-
-		len_to_flush = sg->length - offset;
-		if (remained < len_to_flush) {
-			len_to_flush = remained;
-			remained = 0;
-		} else {
-			remained -= len_to_flush;
-		}
-
-		__dma_map_area(phys_to_virt(sg_phys(sg)) + offset,
-				len_to_flush, DMA_TO_DEVICE);
-
-		if (remained == 0)
-			break;
-		offset = 0;
-	}
+	ion_buffer_sync_range(buffer, offset, len, DMA_TO_DEVICE, true);
 
 	trace_ion_sync_end(_RET_IP_, buffer->dev->dev.this_device,
 				DMA_BIDIRECTIONAL, buffer->size,
@@ -192,6 +192,16 @@ struct ion_handle *ion_import_dma_buf_fd(struct ion_client *client, int fd);
  */
 int ion_cached_needsync_dmabuf(struct dma_buf *dmabuf);
 
+/**
+ * ion_cached_dmabuf() - check if a dmabuf is cached
+ * @dmabuf: a pointer to dma_buf
+ *
+ * Given a dma-buf that is exported by ION, check if the buffer is allocated
+ * with ION_FLAG_CACHED. If the flag is set the function returns 1. If it is
+ * unset, 0. If the given dmabuf is not exported by ION, -error is returned.
+ */
+int ion_cached_dmabuf(struct dma_buf *dmabuf);
+
 /**
  * ion_may_hwrender_dmabuf() - check if a dmabuf set ION_FLAG_MAY_HWRENDER
  * @dmabuf: a pointer to dma_buf
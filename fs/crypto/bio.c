@@ -23,27 +23,48 @@
 #include <linux/module.h>
 #include <linux/bio.h>
 #include <linux/namei.h>
+#include <crypto/skcipher_batch.h>
 #include "fscrypt_private.h"
 
+static void fscrypt_decrypt_bio_pages(struct page **pages, unsigned int n,
+				      bool done)
+{
+	int errs[SKCIPHER_BATCH_MAX];
+	unsigned int i;
+
+	fscrypt_decrypt_pages(pages[0]->mapping->host, pages, n, errs);
+
+	for (i = 0; i < n; i++) {
+		if (errs[i]) {
+			WARN_ON_ONCE(1);
+			SetPageError(pages[i]);
+		} else if (done) {
+			SetPageUptodate(pages[i]);
+		}
+		if (done)
+			unlock_page(pages[i]);
+	}
+}
+
 static void __fscrypt_decrypt_bio(struct bio *bio, bool done)
 {
+	struct page *pages[SKCIPHER_BATCH_MAX];
+	unsigned int n = 0;
 	struct bio_vec *bv;
 	int i;
 
 	bio_for_each_segment_all(bv, bio, i) {
 		struct page *page = bv->bv_page;
-		int ret = fscrypt_decrypt_page(page->mapping->host, page,
-				PAGE_SIZE, 0, page->index);
 
-		if (ret) {
-			WARN_ON_ONCE(1);
-			SetPageError(page);
-		} else if (done) {
-			SetPageUptodate(page);
+		if (n == SKCIPHER_BATCH_MAX ||
+		    (n && page->mapping->host != pages[0]->mapping->host)) {
+			fscrypt_decrypt_bio_pages(pages, n, done);
+			n = 0;
 		}
-		if (done)
-			unlock_page(page);
+		pages[n++] = page;
 	}
+	if (n)
+		fscrypt_decrypt_bio_pages(pages, n, done);
 }
 
 void fscrypt_decrypt_bio(struct bio *bio)
@@ -28,6 +28,7 @@
 #include <linux/namei.h>
 #include <crypto/aes.h>
 #include <crypto/skcipher.h>
+#include <crypto/skcipher_batch.h>
 #include "fscrypt_private.h"
 #ifdef CONFIG_FS_CRYPTO_SEC_EXTENSION
 #include "crypto_sec.h"
@@ -202,6 +203,78 @@ int fscrypt_do_page_crypto(const struct inode *inode, fscrypt_direction_t rw,
 	return 0;
 }
 
+struct fscrypt_page_batch {
+	struct skcipher_request *reqs[SKCIPHER_BATCH_MAX];
+	union fscrypt_iv ivs[SKCIPHER_BATCH_MAX];
+	struct scatterlist sgs[SKCIPHER_BATCH_MAX];
+};
+
+/**
+ * fscrypt_decrypt_pages() - Decrypts whole pagecache pages in-place
+ * @inode:  The inode the pages belong to.
+ * @pages:  The locked pages to decrypt, at most SKCIPHER_BATCH_MAX.
+ * @npages: Number of pages.
+ * @errs:   Filled in with the result for each page.
+ *
+ * Does fscrypt_decrypt_page() on each page at its index, but submits the
+ * requests together so that a SIMD cipher saves and restores the FPU state
+ * once for the batch.
+ */
+void fscrypt_decrypt_pages(const struct inode *inode, struct page **pages,
+			   unsigned int npages, int *errs)
+{
+	struct fscrypt_info *ci = inode->i_crypt_info;
+	struct fscrypt_page_batch *b;
+	DECLARE_CRYPTO_WAIT(wait);
+	unsigned int i, n = 0, done;
+	int err;
+
+	b = kmalloc(sizeof(*b), GFP_NOFS);
+	if (!b)
+		goto single;
+
+	for (; n < npages; n++) {
+		struct skcipher_request *req;
+
+		req = skcipher_request_alloc(ci->ci_ctfm, GFP_NOFS);
+		if (!req)
+			break;
+		skcipher_request_set_callback(
+			req, CRYPTO_TFM_REQ_MAY_BACKLOG | CRYPTO_TFM_REQ_MAY_SLEEP,
+			crypto_req_done, &wait);
+
+		fscrypt_generate_iv(&b->ivs[n], pages[n]->index, ci);
+		sg_init_table(&b->sgs[n], 1);
+		sg_set_page(&b->sgs[n], pages[n], PAGE_SIZE, 0);
+		skcipher_request_set_crypt(req, &b->sgs[n], &b->sgs[n],
+					   PAGE_SIZE, &b->ivs[n]);
+		b->reqs[n] = req;
+	}
+
+	/* Wait for any request that went async, then go on with the rest */
+	for (i = 0; i < n; ) {
+		done = crypto_skcipher_decrypt_batch(b->reqs + i, n - i, &err);
+		while (done--)
+			errs[i++] = 0;
+		if (i < n)
+			errs[i++] = crypto_wait_req(err, &wait);
+	}
+
+	for (i = 0; i < n; i++) {
+		skcipher_request_free(b->reqs[i]);
+		if (errs[i])
+			fscrypt_err(inode->i_sb,
+				    "decryption failed for inode %lu, block %lu: %d",
+				    inode->i_ino, pages[i]->index, errs[i]);
+	}
+	kfree(b);
+
+single:
+	for (; n < npages; n++)
+		errs[n] = fscrypt_decrypt_page(inode, pages[n], PAGE_SIZE, 0,
+					       pages[n]->index);
+}
+
 struct page *fscrypt_alloc_bounce_page(struct fscrypt_ctx *ctx,
 				       gfp_t gfp_flags)
 {
@@ -20,6 +20,7 @@
 
 #include <asm/elf.h>
 #include <linux/uaccess.h>
+#include <linux/pte_share.h>
 #include <asm/tlbflush.h>
 #include "internal.h"
 
@@ -1113,6 +1114,14 @@ out:
 	if (pmd_trans_unstable(pmd))
 		return 0;
 
+	/* Clearing the bits must not affect the other holders */
+	if (pte_table_shared(pmd)) {
+		int err = pte_table_unshare(vma, pmd, addr);
+
+		if (err)
+			return err;
+	}
+
 	pte = pte_offset_map_lock(vma->vm_mm, pmd, addr, &ptl);
 	for (; addr != end; pte++, addr += PAGE_SIZE) {
 		ptent = *pte;
@@ -1254,7 +1263,9 @@ static ssize_t clear_refs_write(struct file *file, const char __user *buf,
 			}
 			mmu_notifier_invalidate_range_start(mm, 0, -1);
 		}
-		walk_page_range(0, mm->highest_vm_end, &clear_refs_walk);
+		rv = walk_page_range(0, mm->highest_vm_end, &clear_refs_walk);
+		if (rv)
+			count = rv;
 		if (type == CLEAR_REFS_SOFT_DIRTY)
 			mmu_notifier_invalidate_range_end(mm, 0, -1);
 		flush_tlb_mm(mm);
@@ -707,6 +707,7 @@
 #define INIT_CALLS_LEVEL(level)						\
 		VMLINUX_SYMBOL(__initcall##level##_start) = .;		\
 		KEEP(*(.initcall##level##.init))			\
+		VMLINUX_SYMBOL(__initcall##level##s_start) = .;		\
 		KEEP(*(.initcall##level##s.init))			\
 
 #ifdef CONFIG_DEFERRED_INITCALLS
@@ -719,6 +720,19 @@
 #define DEFERRED_INITCALLS(level)
 #endif
 
+#ifdef CONFIG_PARALLEL_INITCALLS
+#define PARALLEL_INITCALLS						\
+		VMLINUX_SYMBOL(__initcall_serial_start) = .;		\
+		KEEP(*(.initcall_serial.init))				\
+		VMLINUX_SYMBOL(__initcall_serial_end) = .;		\
+		. = ALIGN(8);						\
+		VMLINUX_SYMBOL(__initcall_deps_start) = .;		\
+		KEEP(*(.initcall_deps.init))				\
+		VMLINUX_SYMBOL(__initcall_deps_end) = .;
+#else
+#define PARALLEL_INITCALLS
+#endif
+
 #define INIT_CALLS							\
 		VMLINUX_SYMBOL(__initcall_start) = .;			\
 		KEEP(*(.initcallearly.init))				\
@@ -732,6 +746,7 @@
 		INIT_CALLS_LEVEL(6)					\
 		INIT_CALLS_LEVEL(7)					\
 		VMLINUX_SYMBOL(__initcall_end) = .;			\
+		PARALLEL_INITCALLS					\
 		DEFERRED_INITCALLS(0)
 
 #define CON_INITCALL							\
@@ -5,6 +5,8 @@
 #ifndef _CRYPTO_INTERNAL_SIMD_H
 #define _CRYPTO_INTERNAL_SIMD_H
 
+#include <linux/types.h>
+
 struct simd_skcipher_alg;
 
 struct simd_skcipher_alg *simd_skcipher_create_compat(const char *algname,
@@ -14,4 +16,26 @@ struct simd_skcipher_alg *simd_skcipher_create(const char *algname,
 					       const char *basename);
 void simd_skcipher_free(struct simd_skcipher_alg *alg);
 
+/*
+ * Sections that let several SIMD cipher calls share one save and restore
+ * of the register file; see crypto_skcipher_encrypt_batch().
+ */
+#ifdef CONFIG_CRYPTO_SIMD_BATCH
+#include <asm/simd.h>
+#else
+static inline bool simd_batch_begin(void)
+{
+	return false;
+}
+
+static inline void simd_batch_end(void)
+{
+}
+
+static inline unsigned int simd_batch_depth(void)
+{
+	return 0;
+}
+#endif
+
 #endif /* _CRYPTO_INTERNAL_SIMD_H */
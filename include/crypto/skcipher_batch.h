@@ -0,0 +1,57 @@
+/*
+ * Batched submission of symmetric key cipher requests.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#ifndef _CRYPTO_SKCIPHER_BATCH_H
+#define _CRYPTO_SKCIPHER_BATCH_H
+
+struct skcipher_request;
+
+/*
+ * Number of requests worth gathering into one batch; the SIMD state save
+ * and restore is already negligible beyond that.
+ */
+#define SKCIPHER_BATCH_MAX	16
+
+/**
+ * crypto_skcipher_encrypt_batch() - encrypt several independent requests
+ * @reqs: requests to encrypt, all for the same algorithm
+ * @nreqs: number of entries in @reqs
+ * @err: return value of the request that ended the batch early
+ *
+ * Submit the requests in order, as crypto_skcipher_encrypt() would. If the
+ * algorithm sets CRYPTO_ALG_SIMD_BATCH they all run within a single
+ * kernel-mode SIMD section, which is closed and reopened whenever a
+ * reschedule is pending. Requests in the batch are not allowed to sleep,
+ * whatever their CRYPTO_TFM_REQ_MAY_SLEEP flag says.
+ *
+ * Processing stops at the first request that does not complete
+ * synchronously with success: @reqs[ret] then was submitted and returned
+ * *@err (it may still be in progress on -EINPROGRESS or -EBUSY), and the
+ * requests after it have not been submitted.
+ *
+ * Return: the number of requests that completed successfully
+ */
+unsigned int crypto_skcipher_encrypt_batch(struct skcipher_request **reqs,
+					   unsigned int nreqs, int *err);
+
+/**
+ * crypto_skcipher_decrypt_batch() - decrypt several independent requests
+ * @reqs: requests to decrypt, all for the same algorithm
+ * @nreqs: number of entries in @reqs
+ * @err: return value of the request that ended the batch early
+ *
+ * The decryption counterpart of crypto_skcipher_encrypt_batch().
+ *
+ * Return: the number of requests that completed successfully
+ */
+unsigned int crypto_skcipher_decrypt_batch(struct skcipher_request **reqs,
+					   unsigned int nreqs, int *err);
+
+#endif	/* _CRYPTO_SKCIPHER_BATCH_H */
@@ -682,12 +682,32 @@ static inline bool blk_throtl_bio(struct request_queue *q, struct blkcg_gq *blkg
 				  struct bio *bio) { return false; }
 #endif
 
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+extern bool blk_iolatency_track(struct request_queue *q,
+				struct blkcg_gq *blkg, struct bio *bio);
+extern void blk_iolatency_throttle(struct bio *bio);
+extern void blk_iolatency_done_bio(struct bio *bio);
+
+static inline void blk_iolatency_bio_endio(struct bio *bio)
+{
+	if (bio->bi_iolat_blkg)
+		blk_iolatency_done_bio(bio);
+}
+#else
+static inline bool blk_iolatency_track(struct request_queue *q,
+				       struct blkcg_gq *blkg,
+				       struct bio *bio) { return false; }
+static inline void blk_iolatency_throttle(struct bio *bio) { }
+static inline void blk_iolatency_bio_endio(struct bio *bio) { }
+#endif
+
 static inline bool blkcg_bio_issue_check(struct request_queue *q,
 					 struct bio *bio)
 {
 	struct blkcg *blkcg;
 	struct blkcg_gq *blkg;
 	bool throtl = false;
+	bool iolat = false;
 
 	rcu_read_lock();
 	blkcg = bio_blkcg(bio);
@@ -708,9 +728,14 @@ static inline bool blkcg_bio_issue_check(struct request_queue *q,
 		blkg_rwstat_add(&blkg->stat_bytes, bio_op(bio), bio->bi_opf,
 				bio->bi_iter.bi_size);
 		blkg_rwstat_add(&blkg->stat_ios, bio_op(bio), bio->bi_opf, 1);
+		iolat = blk_iolatency_track(q, blkg, bio);
 	}
 
 	rcu_read_unlock();
+
+	/* may sleep, so outside of the RCU read section */
+	if (iolat)
+		blk_iolatency_throttle(bio);
 	return !throtl;
 }
 
@@ -769,6 +794,7 @@ static inline struct request_list *blk_rq_rl(struct request *rq) { return &rq->q
 
 static inline bool blkcg_bio_issue_check(struct request_queue *q,
 					 struct bio *bio) { return true; }
+static inline void blk_iolatency_bio_endio(struct bio *bio) { }
 
 #define blk_queue_for_each_rl(rl, q)	\
 	for ((rl) = &(q)->root_rl; (rl); (rl) = NULL)
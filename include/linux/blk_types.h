@@ -61,6 +61,14 @@ struct bio {
 	 */
 	struct io_context	*bi_ioc;
 	struct cgroup_subsys_state *bi_css;
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+	/* blkg charged by blk-iolatency and issue time, see bio_endio() */
+	struct blkcg_gq		*bi_iolat_blkg;
+	u64			bi_iolat_start;
+#endif
+#endif
+#ifdef CONFIG_BLK_WBT
+	u64			bi_wbt_issue;	/* read issue time, see blk-wbt.c */
 #endif
 	union {
 #if defined(CONFIG_BLK_DEV_INTEGRITY)
@@ -139,6 +147,7 @@ struct bio {
 /* XXX Be carefull not to touch BIO_RESET_BITS */
 #define BIO_JOURNAL    10       /* bio contains journal data */
 #endif
+#define BIO_WBT		11	/* accounted by writeback throttling, cleared by bio_reset() */
 
 /*
  * Flags starting here get preserved by bio_reset() - this includes
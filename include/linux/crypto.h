@@ -117,6 +117,13 @@
  */
 #define CRYPTO_NOLOAD			0x00008000
 
+/*
+ * Set if the algorithm does its work in kernel-mode SIMD sections, so that
+ * crypto_skcipher_encrypt_batch() and friends may run several requests
+ * within a single one.
+ */
+#define CRYPTO_ALG_SIMD_BATCH		0x00010000
+
 /*
  * Transform masks and values (for crt_flags).
  */
@@ -68,13 +68,31 @@ static inline bool try_to_freeze(void)
 extern bool freeze_task(struct task_struct *p);
 extern bool set_freezable(void);
 
+/*
+ * A task sleeping in the refrigerator is parked on its freezer cgroup, so
+ * that thawing the cgroup only has to wake the tasks that are actually
+ * frozen instead of walking every task in it.
+ */
+struct freezer_parked {
+	struct list_head		node;
+	struct task_struct		*task;
+	struct cgroup_subsys_state	*css;
+	bool				frozen;	/* counted in nr_frozen */
+};
+
 #ifdef CONFIG_CGROUP_FREEZER
 extern bool cgroup_freezing(struct task_struct *task);
+extern void cgroup_freezer_park(struct freezer_parked *fp);
+extern void cgroup_freezer_frozen(struct freezer_parked *fp);
+extern void cgroup_freezer_unpark(struct freezer_parked *fp);
 #else /* !CONFIG_CGROUP_FREEZER */
 static inline bool cgroup_freezing(struct task_struct *task)
 {
 	return false;
 }
+static inline void cgroup_freezer_park(struct freezer_parked *fp) { }
+static inline void cgroup_freezer_frozen(struct freezer_parked *fp) { }
+static inline void cgroup_freezer_unpark(struct freezer_parked *fp) { }
 #endif /* !CONFIG_CGROUP_FREEZER */
 
 /*
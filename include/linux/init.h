@@ -230,6 +230,35 @@ extern bool initcall_debug;
 	__attribute__((__section__(".deferred_initcall" #id ".init"))) = fn
 #endif
 
+/*
+ * With CONFIG_PARALLEL_INITCALLS and "initcall_workers=" on the command
+ * line, the initcalls of a level may run concurrently.  An initcall that
+ * must not overlap with any other one is marked with initcall_serial(); one
+ * that needs another initcall of the same level to have finished first is
+ * marked with initcall_depends() naming that function, whose name must be
+ * unique among the initcalls of the level.
+ */
+#ifdef CONFIG_PARALLEL_INITCALLS
+struct initcall_dep {
+	initcall_t fn;
+	const char *dep;
+};
+
+#define initcall_serial(fn)					\
+	static initcall_t __initcall_serial_##fn __used		\
+	__section(.initcall_serial.init) = fn
+
+#define initcall_depends(fn, dep)				\
+	static const char __initcall_dep_name_##fn##_##dep[]	\
+		__initconst __aligned(1) = #dep;		\
+	static struct initcall_dep __initcall_dep_##fn##_##dep	\
+	__used __section(.initcall_deps.init)			\
+		= { fn, __initcall_dep_name_##fn##_##dep }
+#else
+#define initcall_serial(fn)
+#define initcall_depends(fn, dep)
+#endif
+
 struct obs_kernel_param {
 	const char *str;
 	int (*setup_func)(char *);
@@ -295,6 +324,8 @@ void __init parse_early_options(char *cmdline);
 
 #define __setup_param(str, unique_id, fn)	/* nothing */
 #define __setup(str, func) 			/* nothing */
+#define initcall_serial(fn)
+#define initcall_depends(fn, dep)
 #endif
 
 /* Data marked not to be saved by software suspend */
@@ -346,6 +346,16 @@ irq_calc_affinity_vectors(int maxvec, const struct irq_affinity *affd)
 
 #endif /* CONFIG_SMP */
 
+#ifdef CONFIG_IRQ_BALANCE
+extern int irq_set_balance_cpus(unsigned int irq, const struct cpumask *mask);
+#else
+static inline int
+irq_set_balance_cpus(unsigned int irq, const struct cpumask *mask)
+{
+	return 0;
+}
+#endif
+
 /*
  * Special lockdep variants of irq disabling/enabling.
  * These should be used for locking constructs that
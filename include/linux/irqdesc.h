@@ -15,6 +15,30 @@ struct irq_desc;
 struct irq_domain;
 struct pt_regs;
 
+/**
+ * struct irq_balance_stat - per irq state of the in-kernel affinity balancer
+ * @time:	handler time in ns, accumulated while the balancer runs
+ * @last_time:	@time at the previous sample
+ * @delta:	handler time spent during the last sample interval
+ * @last_count:	interrupt count at the previous sample
+ * @rate:	interrupts per second during the last sample interval
+ * @load:	handler and softirq share of the target cpu, 0..1024
+ * @cur:	cpu the interrupt was delivered to during the last interval
+ * @cpu:	cpu the balancer last moved the interrupt to, or -1
+ * @moved:	jiffies of the last move
+ */
+struct irq_balance_stat {
+	u64			time;
+	u64			last_time;
+	u64			delta;
+	unsigned int		last_count;
+	unsigned int		rate;
+	unsigned int		load;
+	int			cur;
+	int			cpu;
+	unsigned long		moved;
+};
+
 /**
  * struct irq_desc - interrupt descriptor
  * @irq_common_data:	per irq and chip data passed down to chip functions
@@ -35,6 +59,8 @@ struct pt_regs;
  * @affinity_hint:	hint to user space for preferred irq affinity
  * @affinity_notify:	context for notification of affinity changes
  * @pending_mask:	pending rebalanced interrupts
+ * @balance:		state of the in-kernel affinity balancer
+ * @balance_mask:	cpus the balancer must keep the interrupt on, if any
  * @threads_oneshot:	bitfield to handle shared oneshot threads
  * @threads_active:	number of irqaction threads currently running
  * @wait_for_threads:	wait queue for sync_irq to wait for threaded handlers
@@ -76,6 +102,10 @@ struct irq_desc {
 #ifdef CONFIG_GENERIC_PENDING_IRQ
 	cpumask_var_t		pending_mask;
 #endif
+#ifdef CONFIG_IRQ_BALANCE
+	struct irq_balance_stat	balance;
+	cpumask_var_t		balance_mask;
+#endif
 #endif
 	unsigned long		threads_oneshot;
 	atomic_t		threads_active;
@@ -1869,12 +1869,18 @@ static inline bool pgtable_page_ctor(struct page *page)
 {
 	if (!ptlock_init(page))
 		return false;
+#ifdef CONFIG_FORK_SHARE_PTE
+	page->pte_share = NULL;
+#endif
 	inc_zone_page_state(page, NR_PAGETABLE);
 	return true;
 }
 
 static inline void pgtable_page_dtor(struct page *page)
 {
+#ifdef CONFIG_FORK_SHARE_PTE
+	VM_BUG_ON_PAGE(page->pte_share, page);
+#endif
 	pte_lock_deinit(page);
 	dec_zone_page_state(page, NR_PAGETABLE);
 }
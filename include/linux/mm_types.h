@@ -23,6 +23,7 @@
 
 struct address_space;
 struct mem_cgroup;
+struct pte_share;
 
 #define USE_SPLIT_PTE_PTLOCKS	(NR_CPUS >= CONFIG_SPLIT_PTLOCK_CPUS)
 #define USE_SPLIT_PMD_PTLOCKS	(USE_SPLIT_PTE_PTLOCKS && \
@@ -182,6 +183,12 @@ struct page {
 						 */
 			pgtable_t pmd_huge_pte; /* protected by page->ptl */
 		};
+#endif
+#ifdef CONFIG_FORK_SHARE_PTE
+		struct {
+			unsigned long __pad_share; /* as for pmd_huge_pte */
+			struct pte_share *pte_share; /* see mm/pte_share.c */
+		};
 #endif
 	};
 
@@ -382,6 +389,9 @@ struct vm_area_struct {
 	seqcount_t vm_sequence;
 	atomic_t vm_ref_count;		/* see vma_get(), vma_put() */
 #endif
+#ifdef CONFIG_KSM
+	unsigned long ksm_merge_seqnr;	/* ksmd full scan of last merge + 1 */
+#endif
 };
 
 struct core_thread {
@@ -547,6 +557,10 @@ struct mm_struct {
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 	atomic_long_t hugetlb_usage;
+#endif
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	/* hash of the private futexes, see futex_private_hash_alloc() */
+	struct futex_hash *futex_hash;
 #endif
 	struct work_struct async_put_work;
 };
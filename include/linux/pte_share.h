@@ -0,0 +1,124 @@
+#ifndef _LINUX_PTE_SHARE_H
+#define _LINUX_PTE_SHARE_H
+
+#include <linux/mm.h>
+
+struct mmu_gather;
+
+#ifdef CONFIG_FORK_SHARE_PTE
+
+extern unsigned long sysctl_fork_share_pte_kb;
+
+/*
+ * Attached to a PTE table page while it is mapped by more than one mm.
+ * All fields are protected by the table's ptl.
+ */
+struct pte_share {
+	unsigned int holders;
+	/* rss every holder was charged for this table when it was shared */
+	long charged[NR_MM_COUNTERS];
+	/* the mms mapping the table, as struct pte_share_holder */
+	struct list_head mms;
+	/* an empty table for each holder but the last, linked by page->lru */
+	struct list_head spare;
+};
+
+struct pte_share_holder {
+	struct list_head list;
+	struct mm_struct *mm;
+};
+
+static inline bool pte_table_shared(pmd_t *pmd)
+{
+	pmd_t pmdval = READ_ONCE(*pmd);
+
+	if (pmd_none(pmdval) || pmd_bad(pmdval))
+		return false;
+	return READ_ONCE(pmd_page(pmdval)->pte_share) != NULL;
+}
+
+/* @ptep must be mapped and its ptl held */
+static inline bool pte_table_shared_ptep(pte_t *ptep)
+{
+	return virt_to_page(ptep)->pte_share != NULL;
+}
+
+/*
+ * True if @pmd no longer maps the table @ptep points into, e.g. because
+ * the table was unshared after @ptep was looked up without mmap_sem.
+ */
+static inline bool pte_table_stale(pmd_t *pmd, pte_t *ptep)
+{
+	pmd_t pmdval = READ_ONCE(*pmd);
+
+	return pmd_none(pmdval) || pmd_bad(pmdval) ||
+	       pmd_page(pmdval) != virt_to_page(ptep);
+}
+
+extern int pte_table_share(struct mm_struct *dst_mm,
+			   struct mm_struct *src_mm, pmd_t *dst_pmd,
+			   pmd_t *src_pmd, struct vm_area_struct *vma,
+			   unsigned long addr, unsigned long end);
+extern int pte_table_unshare(struct vm_area_struct *vma, pmd_t *pmd,
+			     unsigned long addr);
+extern int pte_table_unshare_range(struct vm_area_struct *vma,
+				   unsigned long start, unsigned long end);
+extern bool pte_table_zap_shared(struct mmu_gather *tlb,
+				 struct vm_area_struct *vma, pmd_t *pmd,
+				 unsigned long addr, unsigned long end);
+extern void pte_table_flush_holders(struct mm_struct *mm, pte_t *ptep,
+				    unsigned long addr);
+
+#else /* CONFIG_FORK_SHARE_PTE */
+
+static inline bool pte_table_shared(pmd_t *pmd)
+{
+	return false;
+}
+
+static inline bool pte_table_shared_ptep(pte_t *ptep)
+{
+	return false;
+}
+
+static inline bool pte_table_stale(pmd_t *pmd, pte_t *ptep)
+{
+	return false;
+}
+
+static inline int pte_table_share(struct mm_struct *dst_mm,
+				  struct mm_struct *src_mm, pmd_t *dst_pmd,
+				  pmd_t *src_pmd, struct vm_area_struct *vma,
+				  unsigned long addr, unsigned long end)
+{
+	return -EINVAL;
+}
+
+static inline int pte_table_unshare(struct vm_area_struct *vma, pmd_t *pmd,
+				    unsigned long addr)
+{
+	return 0;
+}
+
+static inline int pte_table_unshare_range(struct vm_area_struct *vma,
+					  unsigned long start,
+					  unsigned long end)
+{
+	return 0;
+}
+
+static inline bool pte_table_zap_shared(struct mmu_gather *tlb,
+					struct vm_area_struct *vma, pmd_t *pmd,
+					unsigned long addr, unsigned long end)
+{
+	return false;
+}
+
+static inline void pte_table_flush_holders(struct mm_struct *mm, pte_t *ptep,
+					   unsigned long addr)
+{
+}
+
+#endif /* CONFIG_FORK_SHARE_PTE */
+
+#endif /* _LINUX_PTE_SHARE_H */
@@ -20,6 +20,7 @@
 #endif
 
 struct rw_semaphore;
+struct rwsem_stat_class;
 
 #ifdef CONFIG_RWSEM_GENERIC_SPINLOCK
 #include <linux/rwsem-spinlock.h> /* use a generic implementation */
@@ -37,6 +38,11 @@ struct rw_semaphore {
 	 * if the owner is running on the cpu.
 	 */
 	struct task_struct *owner;
+	/*
+	 * Set by a starving waiter at the head of the queue to stop
+	 * optimistic spinners from stealing the lock from it.
+	 */
+	bool handoff;
 #endif
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map	dep_map;
@@ -45,6 +51,10 @@ struct rw_semaphore {
 	/* count for waiters preempt to queue in wait list */
 	long m_count;
 #endif
+#ifdef CONFIG_RWSEM_STAT
+	/* contention statistics class, NULL for static initializers */
+	struct rwsem_stat_class *stat_class;
+#endif
 };
 
 extern struct rw_semaphore *rwsem_down_read_failed(struct rw_semaphore *sem);
@@ -74,7 +84,8 @@ static inline int rwsem_is_locked(struct rw_semaphore *sem)
 #endif
 
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
-#define __RWSEM_OPT_INIT(lockname) , .osq = OSQ_LOCK_UNLOCKED, .owner = NULL
+#define __RWSEM_OPT_INIT(lockname) , .osq = OSQ_LOCK_UNLOCKED, .owner = NULL, \
+				   .handoff = false
 #else
 #define __RWSEM_OPT_INIT(lockname)
 #endif
@@ -922,7 +922,8 @@ struct user_struct {
 	struct hlist_node uidhash_node;
 	kuid_t uid;
 
-#if defined(CONFIG_PERF_EVENTS) || defined(CONFIG_BPF_SYSCALL)
+#if defined(CONFIG_PERF_EVENTS) || defined(CONFIG_BPF_SYSCALL) || \
+    defined(CONFIG_IO_URING)
 	atomic_long_t locked_vm;
 #endif
 };
@@ -1040,6 +1041,13 @@ struct wake_q_head {
 #define DEFINE_WAKE_Q(name)					\
 	struct wake_q_head name = { WAKE_Q_TAIL, &name.first, 0 }
 
+static inline void wake_q_init(struct wake_q_head *head)
+{
+	head->first = WAKE_Q_TAIL;
+	head->lastp = &head->first;
+	head->count = 0;
+}
+
 extern void wake_q_add(struct wake_q_head *head,
 		       struct task_struct *task);
 extern void wake_up_q(struct wake_q_head *head);
@@ -1966,6 +1974,12 @@ struct task_struct {
 					 * credentials (COW) */
 	const struct cred __rcu *cred;	/* effective (overridable) subjective task
 					 * credentials (COW) */
+#ifdef CONFIG_SECURITY_DEFEX
+/* last credentials DEFEX allowed, see task_defex_enforce() */
+	u32 defex_ids[8];
+	const void *defex_exe;
+	unsigned int defex_gen;
+#endif
 	char comm[TASK_COMM_LEN]; /* executable name excluding path
 				     - access with [gs]et_task_comm (which lock
 				       it with task_lock())
@@ -16,6 +16,7 @@ struct iattr;
 struct inode;
 struct iocb;
 struct io_event;
+struct io_uring_params;
 struct iovec;
 struct itimerspec;
 struct itimerval;
@@ -930,5 +931,12 @@ asmlinkage long sys_pkey_free(int pkey);
 asmlinkage long sys_pidfd_send_signal(int pidfd, int sig,
 				       siginfo_t __user *info,
 				       unsigned int flags);
+asmlinkage long sys_io_uring_setup(u32 entries,
+				   struct io_uring_params __user *p);
+asmlinkage long sys_io_uring_enter(unsigned int fd, u32 to_submit,
+				   u32 min_complete, u32 flags,
+				   const sigset_t __user *sig, size_t sigsz);
+asmlinkage long sys_io_uring_register(unsigned int fd, unsigned int op,
+				      void __user *arg, unsigned int nr_args);
 
 #endif
@@ -49,6 +49,10 @@ struct timer_list {
  * the timer will be serviced when the CPU eventually wakes up with a
  * subsequent non-deferrable timer.
  *
+ * A pinned timer is always expired by the CPU it was queued on. Other
+ * timers may be expired by another CPU on behalf of an idle one, so their
+ * callbacks must not rely on running on a particular CPU.
+ *
  * An irqsafe timer is executed with IRQ disabled and it's safe to wait for
  * the completion of the running instance from IRQ handlers, for example,
  * by calling del_timer_sync().
@@ -17,8 +17,11 @@
 #ifndef _MEDIA_V4L2_MEM2MEM_H
 #define _MEDIA_V4L2_MEM2MEM_H
 
+#include <linux/ktime.h>
 #include <media/videobuf2-v4l2.h>
 
+struct v4l2_m2m_ctx;
+
 /**
  * struct v4l2_m2m_ops - mem-to-mem device driver callbacks
  * @device_run:	required. Begin the actual job (transaction) inside this
@@ -40,6 +43,13 @@
  *		v4l2_m2m_job_finish() (as if the transaction ended normally).
  *		This function does not have to (and will usually not) wait
  *		until the device enters a state when it can be stopped.
+ * @device_run_batch: optional. Begin the jobs of the @num instances in
+ *		@m2m_ctxs at once, for devices that can process several
+ *		frames, possibly from different instances, in one go. Only
+ *		used after batching has been enabled with v4l2_m2m_set_batch(),
+ *		and then instead of @device_run. v4l2_m2m_job_finish() has to
+ *		be called for each of the instances, and no new jobs are
+ *		started until all of them have finished.
  * @lock:	optional. Define a driver's own lock callback, instead of using
  *		&v4l2_m2m_ctx->q_lock.
  * @unlock:	optional. Define a driver's own unlock callback, instead of
@@ -47,6 +57,8 @@
  */
 struct v4l2_m2m_ops {
 	void (*device_run)(void *priv);
+	void (*device_run_batch)(struct v4l2_m2m_ctx **m2m_ctxs,
+				 unsigned int num);
 	int (*job_ready)(void *priv);
 	void (*job_abort)(void *priv);
 	void (*lock)(void *priv);
@@ -54,6 +66,7 @@ struct v4l2_m2m_ops {
 };
 
 struct v4l2_m2m_dev;
+struct dentry;
 
 /**
  * struct v4l2_m2m_queue_ctx - represents a queue for buffers ready to be
@@ -90,6 +103,13 @@ struct v4l2_m2m_queue_ctx {
  *		%TRANS_QUEUED, %TRANS_RUNNING and %TRANS_ABORT.
  * @finished: Wait queue used to signalize when a job queue finished.
  * @priv: Instance private data
+ * @ctx_list: entry in the list of all contexts of the m2m device
+ * @queued_at: when the context was last put on the job queue
+ * @max_latency_ns: how long the context may wait on the job queue before
+ *		it takes precedence over the others, or 0 for no limit
+ * @jobs: number of jobs run for the context
+ * @wait_total_ns: time the context spent on the job queue, in total
+ * @wait_max_ns: longest time the context spent on the job queue
  */
 struct v4l2_m2m_ctx {
 	/* optional cap/out vb2 queues lock */
@@ -108,6 +128,14 @@ struct v4l2_m2m_ctx {
 	wait_queue_head_t		finished;
 
 	void				*priv;
+
+	/* internal use only */
+	struct list_head		ctx_list;
+	ktime_t				queued_at;
+	u64				max_latency_ns;
+	u64				jobs;
+	u64				wait_total_ns;
+	u64				wait_max_ns;
 };
 
 /**
@@ -334,6 +362,45 @@ struct v4l2_m2m_dev *v4l2_m2m_init(const struct v4l2_m2m_ops *m2m_ops);
  */
 void v4l2_m2m_release(struct v4l2_m2m_dev *m2m_dev);
 
+/* Most jobs a single device_run_batch() call is given */
+#define V4L2_M2M_MAX_BATCH	16
+
+/**
+ * v4l2_m2m_set_batch() - let the device run several jobs at once
+ *
+ * @m2m_dev: opaque pointer to the internal data to handle M2M context
+ * @max_jobs: most jobs to hand to &v4l2_m2m_ops->device_run_batch at once,
+ *	at most %V4L2_M2M_MAX_BATCH; 1 turns batching off again
+ *
+ * Each batch takes at most one job per context. Contexts that have waited
+ * longer than their limit (see v4l2_m2m_ctx_set_max_latency()) are taken
+ * first, the rest in the order they were queued in.
+ */
+void v4l2_m2m_set_batch(struct v4l2_m2m_dev *m2m_dev, unsigned int max_jobs);
+
+/**
+ * v4l2_m2m_ctx_set_max_latency() - set the queueing latency limit of a context
+ *
+ * @m2m_ctx: m2m context assigned to the instance given by struct &v4l2_m2m_ctx
+ * @latency_us: how long a job of the context may wait to be run before it
+ *	is given precedence over other contexts' jobs, or 0 for no limit
+ */
+void v4l2_m2m_ctx_set_max_latency(struct v4l2_m2m_ctx *m2m_ctx,
+				  u32 latency_us);
+
+/**
+ * v4l2_m2m_debugfs_create() - report per-context queueing latency in debugfs
+ *
+ * @m2m_dev: opaque pointer to the internal data to handle M2M context
+ * @parent: debugfs directory of the driver
+ *
+ * Creates a "jobs" file under @parent listing, for every open context, the
+ * number of jobs run and the average and longest time they spent waiting
+ * on the job queue. The file is removed by v4l2_m2m_release().
+ */
+void v4l2_m2m_debugfs_create(struct v4l2_m2m_dev *m2m_dev,
+			     struct dentry *parent);
+
 /**
  * v4l2_m2m_ctx_init() - allocate and initialize a m2m context
  *
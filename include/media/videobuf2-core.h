@@ -497,6 +497,9 @@ struct vb2_buf_ops {
  * @timeline:  monotonic timeline of Android sync that signals the release
  *     fences
  * @timeline_max: the timestamp of the most recent release fence
+ * @dmabuf_cache: dma-buf attachments kept after their buffer moved on to
+ *		another dma-buf, for reuse when that dma-buf is queued again
+ * @dmabuf_cache_count: number of entries in @dmabuf_cache
  */
 struct vb2_queue {
 	unsigned int			type;
@@ -552,6 +555,9 @@ struct vb2_queue {
 	struct sync_timeline		*timeline;
 	u32				timeline_max;
 
+	struct list_head		dmabuf_cache;
+	unsigned int			dmabuf_cache_count;
+
 #ifdef CONFIG_VIDEO_ADV_DEBUG
 	/*
 	 * Counters for how often these queue-related ops are
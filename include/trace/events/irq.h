@@ -159,6 +159,58 @@ DEFINE_EVENT(softirq, softirq_raise,
 	TP_ARGS(vec_nr)
 );
 
+/**
+ * irq_balance_move - called when the in-kernel balancer moves an irq
+ * @irq: irq number
+ * @name: name of the first action on @irq
+ * @src: cpu the irq was delivered to
+ * @dst: cpu the irq is moved to
+ * @rate: interrupts per second during the last sample interval
+ * @load: handler and softirq share of @src taken by @irq, 0..1024
+ * @src_load: busy share of @src during the last sample interval, 0..1024
+ * @dst_load: expected busy share of @dst once @irq is moved, 0..1024
+ * @reason: "load" when moved off a busy cpu, "pinned" when moved back
+ *          into the cpus declared for @irq
+ */
+TRACE_EVENT(irq_balance_move,
+
+	TP_PROTO(int irq, const char *name, int src, int dst,
+		 unsigned int rate, unsigned int load,
+		 unsigned int src_load, unsigned int dst_load,
+		 const char *reason),
+
+	TP_ARGS(irq, name, src, dst, rate, load, src_load, dst_load, reason),
+
+	TP_STRUCT__entry(
+		__field(	int,		irq		)
+		__string(	name,		name		)
+		__field(	int,		src		)
+		__field(	int,		dst		)
+		__field(	unsigned int,	rate		)
+		__field(	unsigned int,	load		)
+		__field(	unsigned int,	src_load	)
+		__field(	unsigned int,	dst_load	)
+		__string(	reason,		reason		)
+	),
+
+	TP_fast_assign(
+		__entry->irq		= irq;
+		__assign_str(name, name);
+		__entry->src		= src;
+		__entry->dst		= dst;
+		__entry->rate		= rate;
+		__entry->load		= load;
+		__entry->src_load	= src_load;
+		__entry->dst_load	= dst_load;
+		__assign_str(reason, reason);
+	),
+
+	TP_printk("irq=%d name=%s cpu=%d->%d rate=%u load=%u src_load=%u dst_load=%u reason=%s",
+		  __entry->irq, __get_str(name), __entry->src, __entry->dst,
+		  __entry->rate, __entry->load, __entry->src_load,
+		  __entry->dst_load, __get_str(reason))
+);
+
 #endif /*  _TRACE_IRQ_H */
 
 /* This part must be outside protection */
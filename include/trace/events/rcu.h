@@ -651,6 +651,63 @@ TRACE_EVENT(rcu_invoke_kfree_callback,
 		  __entry->rcuname, __entry->rhp, __entry->offset)
 );
 
+/*
+ * Tracepoint for handing a batch of kfree_rcu() objects over to a grace
+ * period.  The first argument is the RCU flavor, the second is the number
+ * of objects in the batch, and the third is how many of those could not
+ * be stored in a pointer array and were chained as callbacks instead.
+ */
+TRACE_EVENT(rcu_kfree_batch,
+
+	TP_PROTO(const char *rcuname, unsigned long nr_queued,
+		 unsigned long nr_fallback),
+
+	TP_ARGS(rcuname, nr_queued, nr_fallback),
+
+	TP_STRUCT__entry(
+		__field(const char *, rcuname)
+		__field(unsigned long, nr_queued)
+		__field(unsigned long, nr_fallback)
+	),
+
+	TP_fast_assign(
+		__entry->rcuname = rcuname;
+		__entry->nr_queued = nr_queued;
+		__entry->nr_fallback = nr_fallback;
+	),
+
+	TP_printk("%s nr_queued=%lu nr_fallback=%lu",
+		  __entry->rcuname, __entry->nr_queued, __entry->nr_fallback)
+);
+
+/*
+ * Tracepoint for the freeing of a pointer array of kfree_rcu() objects
+ * with kfree_bulk().  The first argument is the RCU flavor, the second
+ * argument is the number of objects in the array, and the third argument
+ * is the array itself.
+ */
+TRACE_EVENT(rcu_invoke_kfree_bulk_callback,
+
+	TP_PROTO(const char *rcuname, unsigned long nr_records, void **p),
+
+	TP_ARGS(rcuname, nr_records, p),
+
+	TP_STRUCT__entry(
+		__field(const char *, rcuname)
+		__field(unsigned long, nr_records)
+		__field(void **, p)
+	),
+
+	TP_fast_assign(
+		__entry->rcuname = rcuname;
+		__entry->nr_records = nr_records;
+		__entry->p = p;
+	),
+
+	TP_printk("%s bulk=0x%p nr_records=%lu",
+		  __entry->rcuname, __entry->p, __entry->nr_records)
+);
+
 /*
  * Tracepoint for exiting rcu_do_batch after RCU callbacks have been
  * invoked.  The first argument is the name of the RCU flavor,
@@ -803,6 +860,10 @@ TRACE_EVENT(rcu_barrier,
 	do { } while (0)
 #define trace_rcu_invoke_callback(rcuname, rhp) do { } while (0)
 #define trace_rcu_invoke_kfree_callback(rcuname, rhp, offset) do { } while (0)
+#define trace_rcu_kfree_batch(rcuname, nr_queued, nr_fallback) \
+	do { } while (0)
+#define trace_rcu_invoke_kfree_bulk_callback(rcuname, nr_records, p) \
+	do { } while (0)
 #define trace_rcu_batch_end(rcuname, callbacks_invoked, cb, nr, iit, risk) \
 	do { } while (0)
 #define trace_rcu_torture_read(rcutorturename, rhp, secs, c_old, c) \
@@ -0,0 +1,84 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM wbt
+
+#if !defined(_TRACE_WBT_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_WBT_H
+
+#include <linux/tracepoint.h>
+#include "../../../block/blk-wbt.h"
+
+/**
+ * wbt_stat - trace stats of a completed writeback throttling window
+ * @bdi: backing device the queue belongs to
+ * @nr_reads: reads completed in the window
+ * @read_min: minimum read latency in the window, in nsec
+ * @nr_writes: throttled writes completed in the window
+ */
+TRACE_EVENT(wbt_stat,
+
+	TP_PROTO(struct backing_dev_info *bdi, unsigned int nr_reads,
+		 u64 read_min, unsigned int nr_writes),
+
+	TP_ARGS(bdi, nr_reads, read_min, nr_writes),
+
+	TP_STRUCT__entry(
+		__array(char, name, 32)
+		__field(unsigned int, nr_reads)
+		__field(u64, read_min)
+		__field(unsigned int, nr_writes)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->name, bdi->dev ? dev_name(bdi->dev) : "",
+			32);
+		__entry->nr_reads	= nr_reads;
+		__entry->read_min	= read_min;
+		__entry->nr_writes	= nr_writes;
+	),
+
+	TP_printk("%s: reads=%u read_min=%llu writes=%u",
+		  __entry->name, __entry->nr_reads,
+		  (unsigned long long)__entry->read_min, __entry->nr_writes)
+);
+
+/**
+ * wbt_step - trace a change of the writeback throttling depth
+ * @bdi: backing device the queue belongs to
+ * @msg: reason for the change
+ * @rwb: throttling state after the change
+ */
+TRACE_EVENT(wbt_step,
+
+	TP_PROTO(struct backing_dev_info *bdi, const char *msg,
+		 struct rq_wb *rwb),
+
+	TP_ARGS(bdi, msg, rwb),
+
+	TP_STRUCT__entry(
+		__array(char, name, 32)
+		__field(const char *, msg)
+		__field(int, step)
+		__field(unsigned int, max)
+		__field(unsigned int, normal)
+		__field(unsigned int, bg)
+	),
+
+	TP_fast_assign(
+		strncpy(__entry->name, bdi->dev ? dev_name(bdi->dev) : "",
+			32);
+		__entry->msg	= msg;
+		__entry->step	= rwb->scale_step;
+		__entry->max	= rwb->max_depth;
+		__entry->normal	= rwb->wb_normal;
+		__entry->bg	= rwb->wb_background;
+	),
+
+	TP_printk("%s: %s step=%d max=%u normal=%u background=%u",
+		  __entry->name, __entry->msg, __entry->step,
+		  __entry->max, __entry->normal, __entry->bg)
+);
+
+#endif /* _TRACE_WBT_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
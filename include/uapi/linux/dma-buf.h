@@ -34,7 +34,20 @@ struct dma_buf_sync {
 #define DMA_BUF_SYNC_VALID_FLAGS_MASK \
 	(DMA_BUF_SYNC_RW | DMA_BUF_SYNC_END)
 
+/*
+ * Same as struct dma_buf_sync, for the part of the buffer that the CPU
+ * accesses: len bytes from offset. Exporters that cannot sync part of a
+ * buffer sync all of it.
+ */
+struct dma_buf_sync_partial {
+	__u64 flags;
+	__u32 offset;
+	__u32 len;
+};
+
 #define DMA_BUF_BASE		'b'
 #define DMA_BUF_IOCTL_SYNC	_IOW(DMA_BUF_BASE, 0, struct dma_buf_sync)
+#define DMA_BUF_IOCTL_SYNC_PARTIAL \
+	_IOW(DMA_BUF_BASE, 1, struct dma_buf_sync_partial)
 
 #endif
@@ -82,6 +82,8 @@
 #include <linux/io.h>
 #include <linux/kaiser.h>
 #include <linux/cache.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
 
 #include <asm/io.h>
 #include <asm/bugs.h>
@@ -970,8 +972,8 @@ static int __init_or_module do_one_initcall_debug(initcall_t fn)
 	rettime = ktime_get();
 	delta = ktime_sub(rettime, calltime);
 	duration = (unsigned long long) ktime_to_ns(delta) >> 10;
-	printk(KERN_DEBUG "initcall %pF returned %d after %lld usecs\n",
-		 fn, ret, duration);
+	printk(KERN_DEBUG "initcall %pF returned %d after %lld usecs @ %i\n",
+		 fn, ret, duration, task_pid_nr(current));
 
 	return ret;
 }
@@ -1042,10 +1044,305 @@ static char *initcall_level_names[] __initdata = {
 	"late",
 };
 
-static void __init do_initcall_level(int level)
+#ifdef CONFIG_PARALLEL_INITCALLS
+extern initcall_t __initcall0s_start[];
+extern initcall_t __initcall1s_start[];
+extern initcall_t __initcall2s_start[];
+extern initcall_t __initcall3s_start[];
+extern initcall_t __initcall4s_start[];
+extern initcall_t __initcall5s_start[];
+extern initcall_t __initcallrootfs_start[];
+extern initcall_t __initcall6s_start[];
+extern initcall_t __initcall7s_start[];
+extern initcall_t __initcall_serial_start[], __initcall_serial_end[];
+extern struct initcall_dep __initcall_deps_start[], __initcall_deps_end[];
+
+/* Sublevels that must not start before the previous one has finished */
+static initcall_t *initcall_barriers[] __initdata = {
+	__initcall0s_start,
+	__initcall1s_start,
+	__initcall2s_start,
+	__initcall3s_start,
+	__initcall4s_start,
+	__initcall5s_start,
+	__initcallrootfs_start,
+	__initcall6s_start,
+	__initcall7s_start,
+};
+
+#define INITCALL_MAX_DEPS	4
+
+struct initcall_work {
+	struct work_struct work;
+	initcall_t fn;
+	struct completion done;
+	unsigned int nr_deps;
+	struct initcall_work *deps[INITCALL_MAX_DEPS];
+	s64 duration;
+};
+
+static unsigned int initcall_workers __initdata;
+static struct workqueue_struct *initcall_wq __initdata;
+static atomic_t initcall_running __initdata;
+static atomic_t initcall_max_running __initdata;
+
+static int __init set_initcall_workers(char *str)
+{
+	if (kstrtouint(str, 0, &initcall_workers))
+		return 0;
+	return 1;
+}
+__setup("initcall_workers=", set_initcall_workers);
+
+static bool __init initcall_is_barrier(initcall_t *fn)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(initcall_barriers); i++)
+		if (fn == initcall_barriers[i])
+			return true;
+	return false;
+}
+
+static bool __init initcall_is_serial(initcall_t fn)
+{
+	initcall_t *s;
+
+	for (s = __initcall_serial_start; s < __initcall_serial_end; s++)
+		if (*s == fn)
+			return true;
+	return false;
+}
+
+/*
+ * Find the initcall of this level named @name.  Static initcalls of
+ * different files may share a name, so rather than looking the name up,
+ * match it against the initcalls of the level, and refuse to pick one of
+ * several.  Returns the index, -ENOENT or -EINVAL.
+ */
+static int __init initcall_find_work(struct initcall_work *works, int nr,
+				     const char *name)
+{
+	char buf[KSYM_NAME_LEN];
+	int i, found = -ENOENT;
+
+	for (i = 0; i < nr; i++) {
+		if (lookup_symbol_name((unsigned long)
+				dereference_function_descriptor(works[i].fn),
+				buf) || strcmp(buf, name))
+			continue;
+		if (found >= 0)
+			return -EINVAL;
+		found = i;
+	}
+	return found;
+}
+
+/*
+ * Resolve the initcall_depends() entries of works[idx] to earlier works of
+ * the same level.  Dependencies on initcalls of earlier levels are already
+ * satisfied.  Returns false if the dependencies can't be expressed, in
+ * which case the caller waits for all earlier initcalls instead.
+ */
+static bool __init initcall_resolve_deps(struct initcall_work *works,
+					 int nr, int idx)
+{
+	struct initcall_work *iw = &works[idx];
+	struct initcall_dep *d;
+	int i;
+
+	iw->nr_deps = 0;
+	for (d = __initcall_deps_start; d < __initcall_deps_end; d++) {
+		if (d->fn != iw->fn)
+			continue;
+
+		if (!IS_ENABLED(CONFIG_KALLSYMS))
+			return false;
+
+		i = initcall_find_work(works, nr, d->dep);
+		if (i == -EINVAL) {
+			pr_warn("initcall %pF depends on ambiguous %s\n",
+				iw->fn, d->dep);
+			return false;
+		}
+		if (i < 0) {
+			/* Not in this level: an earlier one, or a typo */
+			if (!kallsyms_lookup_name(d->dep)) {
+				pr_warn("initcall %pF depends on unknown %s\n",
+					iw->fn, d->dep);
+				return false;
+			}
+			continue;
+		}
+		if (i >= idx) {
+			pr_warn("initcall %pF depends on later initcall %s\n",
+				iw->fn, d->dep);
+			continue;
+		}
+
+		if (iw->nr_deps == INITCALL_MAX_DEPS)
+			return false;
+		iw->deps[iw->nr_deps++] = &works[i];
+	}
+
+	return true;
+}
+
+static void __init initcall_account_start(void)
+{
+	int running = atomic_inc_return(&initcall_running);
+	int max = atomic_read(&initcall_max_running);
+
+	while (running > max) {
+		int old = atomic_cmpxchg(&initcall_max_running, max, running);
+
+		if (old == max)
+			break;
+		max = old;
+	}
+}
+
+static void __init run_initcall_work(struct initcall_work *iw)
+{
+	ktime_t calltime;
+
+	initcall_account_start();
+	calltime = ktime_get();
+	do_one_initcall(iw->fn);
+	iw->duration = ktime_to_ns(ktime_sub(ktime_get(), calltime));
+	atomic_dec(&initcall_running);
+
+	complete_all(&iw->done);
+}
+
+static void __init initcall_work_fn(struct work_struct *work)
+{
+	struct initcall_work *iw = container_of(work, struct initcall_work,
+						work);
+	unsigned int i;
+
+	for (i = 0; i < iw->nr_deps; i++)
+		wait_for_completion(&iw->deps[i]->done);
+
+	run_initcall_work(iw);
+}
+
+/*
+ * Run the initcalls of a level on initcall_wq, in link order but without
+ * waiting for one to finish before starting the next.  Sublevel boundaries
+ * and initcall_serial() initcalls wait for everything queued before them.
+ * Returns false if the level has to be run serially.
+ */
+static bool __init do_initcall_level_parallel(int level)
+{
+	initcall_t *start = initcall_levels[level];
+	int nr = initcall_levels[level + 1] - start;
+	struct initcall_work *works;
+	unsigned int nr_serial = 0;
+	ktime_t calltime;
+	s64 total = 0;
+	int i;
+
+	if (!initcall_wq || !nr)
+		return false;
+
+	works = kcalloc(nr, sizeof(*works), GFP_KERNEL);
+	if (!works)
+		return false;
+
+	atomic_set(&initcall_max_running, 0);
+	calltime = ktime_get();
+
+	for (i = 0; i < nr; i++) {
+		struct initcall_work *iw = &works[i];
+
+		iw->fn = start[i];
+		init_completion(&iw->done);
+		INIT_WORK(&iw->work, initcall_work_fn);
+
+		if (initcall_is_barrier(&start[i]))
+			flush_workqueue(initcall_wq);
+
+		if (initcall_is_serial(iw->fn)) {
+			flush_workqueue(initcall_wq);
+			run_initcall_work(iw);
+			nr_serial++;
+			continue;
+		}
+
+		if (!initcall_resolve_deps(works, nr, i))
+			flush_workqueue(initcall_wq);
+
+		queue_work(initcall_wq, &iw->work);
+	}
+
+	flush_workqueue(initcall_wq);
+
+	if (initcall_debug) {
+		for (i = 0; i < nr; i++)
+			total += works[i].duration;
+		printk(KERN_DEBUG "initcall level %s: %d calls (%u serial), max %d concurrent, %lld usecs elapsed, %lld usecs in initcalls\n",
+		       initcall_level_names[level], nr, nr_serial,
+		       atomic_read(&initcall_max_running),
+		       ktime_to_ns(ktime_sub(ktime_get(), calltime)) >> 10,
+		       total >> 10);
+	}
+
+	kfree(works);
+	return true;
+}
+
+static void __init initcall_workers_init(void)
+{
+	if (!initcall_workers)
+		return;
+
+	initcall_workers = min_t(unsigned int, initcall_workers,
+				 WQ_UNBOUND_MAX_ACTIVE);
+	initcall_wq = alloc_workqueue("initcall", WQ_UNBOUND,
+				      initcall_workers);
+	if (!initcall_wq)
+		pr_warn("initcall: no workqueue, running initcalls serially\n");
+	else
+		pr_info("initcall: running initcalls with %u workers\n",
+			initcall_workers);
+}
+
+static void __init initcall_workers_exit(void)
+{
+	if (initcall_wq) {
+		destroy_workqueue(initcall_wq);
+		initcall_wq = NULL;
+	}
+}
+#else
+static inline bool do_initcall_level_parallel(int level)
+{
+	return false;
+}
+
+static inline void initcall_workers_init(void) { }
+static inline void initcall_workers_exit(void) { }
+#endif
+
+static void __init do_initcall_level_serial(int level)
 {
 	initcall_t *fn;
+	ktime_t calltime;
+
+	calltime = ktime_get();
+	for (fn = initcall_levels[level]; fn < initcall_levels[level+1]; fn++)
+		do_one_initcall(*fn);
+
+	if (initcall_debug)
+		printk(KERN_DEBUG "initcall level %s: %ld calls, %lld usecs elapsed\n",
+		       initcall_level_names[level],
+		       (long)(initcall_levels[level + 1] - initcall_levels[level]),
+		       ktime_to_ns(ktime_sub(ktime_get(), calltime)) >> 10);
+}
 
+static void __init do_initcall_level(int level)
+{
 	strcpy(initcall_command_line, saved_command_line);
 	parse_args(initcall_level_names[level],
 		   initcall_command_line, __start___param,
@@ -1053,8 +1350,8 @@ static void __init do_initcall_level(int level)
 		   level, level,
 		   NULL, &repair_env_string);
 
-	for (fn = initcall_levels[level]; fn < initcall_levels[level+1]; fn++)
-		do_one_initcall(*fn);
+	if (!do_initcall_level_parallel(level))
+		do_initcall_level_serial(level);
 
 #ifdef CONFIG_SEC_BOOTSTAT
 	sec_bootstat_add_initcall(initcall_level_names[level]);
@@ -1066,8 +1363,12 @@ static void __init do_initcalls(void)
 {
 	int level;
 
+	initcall_workers_init();
+
 	for (level = 0; level < ARRAY_SIZE(initcall_levels) - 1; level++)
 		do_initcall_level(level);
+
+	initcall_workers_exit();
 }
 
 /*
@@ -22,6 +22,7 @@
 #include <linux/freezer.h>
 #include <linux/seq_file.h>
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 
 /*
  * A cgroup is freezing if any FREEZING flags are set.  FREEZING_SELF is
@@ -43,10 +44,45 @@ enum freezer_state_flags {
 struct freezer {
 	struct cgroup_subsys_state	css;
 	unsigned int			state;
+
+	/* tasks sleeping in the refrigerator, see cgroup_freezer_park() */
+	spinlock_t			lock;
+	struct list_head		parked;
+
+	/*
+	 * Tasks in this cgroup and how many of them are frozen, protected
+	 * by @lock.  FROZEN is settled when the two match, without walking
+	 * the tasks.  Tasks in a freezable sleep (PF_FREEZER_SKIP) only
+	 * count once they get to the refrigerator; until then
+	 * update_if_frozen() on read is the fallback.
+	 */
+	unsigned int			nr_tasks;
+	unsigned int			nr_frozen;
+
+	/* tasks being migrated out, see freezer_can_attach() */
+	unsigned int			nr_leaving;
+	struct list_head		leaving_node;
+
+	/*
+	 * Kicking the tasks into the refrigerator and settling FROZEN are
+	 * done from @work, so writing "FROZEN" doesn't scale with the
+	 * number of tasks.  @need_kick is protected by freezer_mutex.
+	 */
+	struct work_struct		work;
+	bool				need_kick;
+
+	/* freezer.state, notified on FROZEN and THAWED transitions */
+	struct cgroup_file		state_file;
 };
 
 static DEFINE_MUTEX(freezer_mutex);
 
+/*
+ * Freezers the migration in progress takes tasks out of, protected by
+ * freezer_mutex.  Migrations are serialized by cgroup_mutex.
+ */
+static LIST_HEAD(freezer_leaving);
+
 static inline struct freezer *css_freezer(struct cgroup_subsys_state *css)
 {
 	return css ? container_of(css, struct freezer, css) : NULL;
@@ -82,6 +118,8 @@ static const char *freezer_state_strs(unsigned int state)
 	return "THAWED";
 };
 
+static void freezer_work_fn(struct work_struct *work);
+
 static struct cgroup_subsys_state *
 freezer_css_alloc(struct cgroup_subsys_state *parent_css)
 {
@@ -91,9 +129,21 @@ freezer_css_alloc(struct cgroup_subsys_state *parent_css)
 	if (!freezer)
 		return ERR_PTR(-ENOMEM);
 
+	spin_lock_init(&freezer->lock);
+	INIT_LIST_HEAD(&freezer->parked);
+	INIT_LIST_HEAD(&freezer->leaving_node);
+	INIT_WORK(&freezer->work, freezer_work_fn);
 	return &freezer->css;
 }
 
+/* the work item holds a css reference while it's pending */
+static void freezer_queue_work(struct freezer *freezer)
+{
+	css_get(&freezer->css);
+	if (!queue_work(system_wq, &freezer->work))
+		css_put(&freezer->css);
+}
+
 /**
  * freezer_css_online - commit creation of a freezer css
  * @css: css being created
@@ -131,6 +181,8 @@ static void freezer_css_offline(struct cgroup_subsys_state *css)
 {
 	struct freezer *freezer = css_freezer(css);
 
+	struct freezer *parent = parent_freezer(freezer);
+
 	mutex_lock(&freezer_mutex);
 
 	if (freezer->state & CGROUP_FREEZING)
@@ -138,6 +190,10 @@ static void freezer_css_offline(struct cgroup_subsys_state *css)
 
 	freezer->state = 0;
 
+	/* we may have been the last thing keeping @parent from FROZEN */
+	if (parent && (parent->state & CGROUP_FREEZING))
+		freezer_queue_work(parent);
+
 	mutex_unlock(&freezer_mutex);
 }
 
@@ -146,6 +202,127 @@ static void freezer_css_free(struct cgroup_subsys_state *css)
 	kfree(css_freezer(css));
 }
 
+/*
+ * Let freezer_work_fn() settle FROZEN once all tasks of @freezer are in
+ * the refrigerator.  Called with @freezer->lock held.
+ */
+static void freezer_check_frozen(struct freezer *freezer)
+{
+	unsigned int state = READ_ONCE(freezer->state);
+
+	lockdep_assert_held(&freezer->lock);
+
+	/* racy, freezer_work_fn() checks again under freezer_mutex */
+	if ((state & CGROUP_FREEZING) && !(state & CGROUP_FROZEN) &&
+	    freezer->nr_frozen == freezer->nr_tasks)
+		freezer_queue_work(freezer);
+}
+
+/* the root cgroup is non-freezable and doesn't keep count */
+static void freezer_count_tasks(struct freezer *freezer, int nr)
+{
+	if (!parent_freezer(freezer))
+		return;
+
+	spin_lock(&freezer->lock);
+	freezer->nr_tasks += nr;
+	freezer_check_frozen(freezer);
+	spin_unlock(&freezer->lock);
+}
+
+/*
+ * Stop counting the tasks that migrated out of the freezers on
+ * freezer_leaving.  Parked tasks that left are still counted as frozen
+ * there until they run again, so take them out of @nr_frozen as well.
+ */
+static void freezer_settle_leaving(void)
+{
+	struct freezer *freezer, *tmp;
+	struct freezer_parked *fp;
+
+	lockdep_assert_held(&freezer_mutex);
+
+	list_for_each_entry_safe(freezer, tmp, &freezer_leaving, leaving_node) {
+		spin_lock(&freezer->lock);
+		list_for_each_entry(fp, &freezer->parked, node) {
+			if (fp->frozen && task_freezer(fp->task) != freezer) {
+				fp->frozen = false;
+				freezer->nr_frozen--;
+			}
+		}
+		spin_unlock(&freezer->lock);
+
+		freezer_count_tasks(freezer, -(int)freezer->nr_leaving);
+		freezer->nr_leaving = 0;
+		list_del_init(&freezer->leaving_node);
+		css_put(&freezer->css);
+	}
+}
+
+static int freezer_can_attach(struct cgroup_taskset *tset)
+{
+	struct cgroup_subsys_state *dst_css;
+	struct task_struct *task;
+#ifdef CONFIG_SAMSUNG_FREECESS
+	const struct cred *cred = current_cred(), *tcred;
+
+	/*
+	 * Check if the task is allowed to be added to the freezer group
+	 * only the admin can add the task to the freezer group.
+	 */
+	cgroup_taskset_for_each(task, dst_css, tset) {
+		tcred = __task_cred(task);
+
+		//Only system process and root have the permission.
+		if ((current != task) && !(cred->euid.val == 1000 || capable(CAP_SYS_ADMIN))) {
+			pr_err("Permission problem\n");
+			return -EACCES;
+		}
+	}
+#endif
+
+	/*
+	 * Count the tasks on their new freezer right away, which can only
+	 * hold FROZEN back.  The old one keeps counting them until they
+	 * have actually left, see freezer_settle_leaving().  Tasks can
+	 * neither fork nor exit while they are being migrated.
+	 */
+	mutex_lock(&freezer_mutex);
+	cgroup_taskset_for_each(task, dst_css, tset) {
+		struct freezer *from = task_freezer(task);
+		struct freezer *to = css_freezer(dst_css);
+
+		if (from == to)
+			continue;
+		freezer_count_tasks(to, 1);
+		if (!from->nr_leaving++) {
+			css_get(&from->css);
+			list_add(&from->leaving_node, &freezer_leaving);
+		}
+	}
+	mutex_unlock(&freezer_mutex);
+	return 0;
+}
+
+static void freezer_cancel_attach(struct cgroup_taskset *tset)
+{
+	struct freezer *freezer, *tmp;
+	struct cgroup_subsys_state *dst_css;
+	struct task_struct *task;
+
+	mutex_lock(&freezer_mutex);
+	cgroup_taskset_for_each(task, dst_css, tset) {
+		if (task_freezer(task) != css_freezer(dst_css))
+			freezer_count_tasks(css_freezer(dst_css), -1);
+	}
+	list_for_each_entry_safe(freezer, tmp, &freezer_leaving, leaving_node) {
+		freezer->nr_leaving = 0;
+		list_del_init(&freezer->leaving_node);
+		css_put(&freezer->css);
+	}
+	mutex_unlock(&freezer_mutex);
+}
+
 /*
  * Tasks can be migrated into a different freezer anytime regardless of its
  * current state.  freezer_attach() is responsible for making new tasks
@@ -162,6 +339,8 @@ static void freezer_attach(struct cgroup_taskset *tset)
 
 	mutex_lock(&freezer_mutex);
 
+	freezer_settle_leaving();
+
 	/*
 	 * Make the new tasks conform to the current state of @new_css.
 	 * For simplicity, when migrating any task to a FROZEN cgroup, we
@@ -175,9 +354,13 @@ static void freezer_attach(struct cgroup_taskset *tset)
 	cgroup_taskset_for_each(task, new_css, tset) {
 		struct freezer *freezer = css_freezer(new_css);
 
-		if (!(freezer->state & CGROUP_FREEZING)) {
-			__thaw_task(task);
-		} else {
+		/*
+		 * A frozen task is parked on the freezer it was frozen in.
+		 * Wake it either way, so it leaves the refrigerator or parks
+		 * again on @new_css.
+		 */
+		__thaw_task(task);
+		if (freezer->state & CGROUP_FREEZING) {
 			freeze_task(task);
 			/* clear FROZEN and propagate upwards */
 			while (freezer && (freezer->state & CGROUP_FROZEN)) {
@@ -218,6 +401,7 @@ static void freezer_fork(struct task_struct *task)
 	rcu_read_lock();
 
 	freezer = task_freezer(task);
+	freezer_count_tasks(freezer, 1);
 	if (freezer->state & CGROUP_FREEZING)
 		freeze_task(task);
 
@@ -225,6 +409,39 @@ static void freezer_fork(struct task_struct *task)
 	mutex_unlock(&freezer_mutex);
 }
 
+/**
+ * freezer_exit - cgroup exit callback
+ * @task: a task which is exiting
+ *
+ * Stop counting @task, which may have been the last one keeping its
+ * cgroup from FROZEN.
+ */
+static void freezer_exit(struct task_struct *task)
+{
+	rcu_read_lock();
+	freezer_count_tasks(task_freezer(task), -1);
+	rcu_read_unlock();
+}
+
+/* are all (live) children frozen? */
+static bool freezer_children_frozen(struct cgroup_subsys_state *css)
+{
+	struct cgroup_subsys_state *pos;
+
+	rcu_read_lock();
+	css_for_each_child(pos, css) {
+		struct freezer *child = css_freezer(pos);
+
+		if ((child->state & CGROUP_FREEZER_ONLINE) &&
+		    !(child->state & CGROUP_FROZEN)) {
+			rcu_read_unlock();
+			return false;
+		}
+	}
+	rcu_read_unlock();
+	return true;
+}
+
 /**
  * update_if_frozen - update whether a cgroup finished freezing
  * @css: css of interest
@@ -244,7 +461,6 @@ static void freezer_fork(struct task_struct *task)
 static void update_if_frozen(struct cgroup_subsys_state *css)
 {
 	struct freezer *freezer = css_freezer(css);
-	struct cgroup_subsys_state *pos;
 	struct css_task_iter it;
 	struct task_struct *task;
 
@@ -254,18 +470,8 @@ static void update_if_frozen(struct cgroup_subsys_state *css)
 	    (freezer->state & CGROUP_FROZEN))
 		return;
 
-	/* are all (live) children frozen? */
-	rcu_read_lock();
-	css_for_each_child(pos, css) {
-		struct freezer *child = css_freezer(pos);
-
-		if ((child->state & CGROUP_FREEZER_ONLINE) &&
-		    !(child->state & CGROUP_FROZEN)) {
-			rcu_read_unlock();
-			return;
-		}
-	}
-	rcu_read_unlock();
+	if (!freezer_children_frozen(css))
+		return;
 
 	/* are all tasks frozen? */
 	css_task_iter_start(css, &it);
@@ -326,15 +532,146 @@ static void freeze_cgroup(struct freezer *freezer)
 	css_task_iter_end(&it);
 }
 
+/*
+ * Only the tasks sleeping in the refrigerator need a wakeup on thaw; the
+ * others see the cleared state the next time they check freezing().
+ */
 static void unfreeze_cgroup(struct freezer *freezer)
 {
-	struct css_task_iter it;
-	struct task_struct *task;
+	struct freezer_parked *fp;
 
-	css_task_iter_start(&freezer->css, &it);
-	while ((task = css_task_iter_next(&it)))
-		__thaw_task(task);
-	css_task_iter_end(&it);
+	spin_lock(&freezer->lock);
+	list_for_each_entry(fp, &freezer->parked, node)
+		wake_up_process(fp->task);
+	spin_unlock(&freezer->lock);
+}
+
+static bool freezer_tasks_frozen(struct freezer *freezer)
+{
+	bool ret;
+
+	spin_lock(&freezer->lock);
+	ret = freezer->nr_frozen == freezer->nr_tasks;
+	spin_unlock(&freezer->lock);
+
+	return ret;
+}
+
+/**
+ * freezer_update_frozen - settle FROZEN from @freezer upwards
+ * @freezer: freezer some of whose tasks may have finished freezing
+ *
+ * Set FROZEN on @freezer if it finished freezing, then on its ancestors
+ * for as long as they finish too, and wake up pollers of freezer.state on
+ * each one that did.  Only the task counts are looked at, not the tasks.
+ */
+static void freezer_update_frozen(struct freezer *freezer)
+{
+	lockdep_assert_held(&freezer_mutex);
+
+	for (; freezer; freezer = parent_freezer(freezer)) {
+		if (!(freezer->state & CGROUP_FREEZING) ||
+		    (freezer->state & CGROUP_FROZEN))
+			break;
+
+		if (!freezer_children_frozen(&freezer->css) ||
+		    !freezer_tasks_frozen(freezer))
+			break;
+
+		freezer->state |= CGROUP_FROZEN;
+		cgroup_file_notify(&freezer->state_file);
+	}
+}
+
+static void freezer_work_fn(struct work_struct *work)
+{
+	struct freezer *freezer = container_of(work, struct freezer, work);
+
+	mutex_lock(&freezer_mutex);
+
+	if (freezer->need_kick) {
+		freezer->need_kick = false;
+		if (freezer->state & CGROUP_FREEZING)
+			freeze_cgroup(freezer);
+	}
+	freezer_update_frozen(freezer);
+
+	mutex_unlock(&freezer_mutex);
+	css_put(&freezer->css);
+}
+
+/**
+ * cgroup_freezer_park - park %current on its freezer cgroup
+ * @fp: parking slot, on the stack of __refrigerator()
+ *
+ * Called from the refrigerator before testing freezing(), so that
+ * unfreeze_cgroup() either finds %current on the list or %current sees the
+ * cleared state.
+ */
+void cgroup_freezer_park(struct freezer_parked *fp)
+{
+	struct freezer *freezer;
+
+	fp->css = NULL;
+
+	rcu_read_lock();
+	freezer = task_freezer(current);
+	/* the root cgroup is non-freezable */
+	if (!parent_freezer(freezer)) {
+		rcu_read_unlock();
+		return;
+	}
+	css_get(&freezer->css);
+	rcu_read_unlock();
+
+	fp->task = current;
+	fp->css = &freezer->css;
+	fp->frozen = false;
+
+	spin_lock(&freezer->lock);
+	list_add_tail(&fp->node, &freezer->parked);
+	spin_unlock(&freezer->lock);
+}
+
+/**
+ * cgroup_freezer_frozen - %current is about to sleep in the refrigerator
+ * @fp: parking slot filled by cgroup_freezer_park()
+ *
+ * Count %current as frozen on the freezer it is parked on.  The last task
+ * to get there has the freezer settle FROZEN.
+ */
+void cgroup_freezer_frozen(struct freezer_parked *fp)
+{
+	struct freezer *freezer = css_freezer(fp->css);
+
+	if (!freezer)
+		return;
+
+	spin_lock(&freezer->lock);
+	/* unless migrated since, then freezer_attach() is about to wake us */
+	rcu_read_lock();
+	if (task_freezer(current) == freezer) {
+		fp->frozen = true;
+		freezer->nr_frozen++;
+		freezer_check_frozen(freezer);
+	}
+	rcu_read_unlock();
+	spin_unlock(&freezer->lock);
+}
+
+void cgroup_freezer_unpark(struct freezer_parked *fp)
+{
+	struct freezer *freezer = css_freezer(fp->css);
+
+	if (!freezer)
+		return;
+
+	spin_lock(&freezer->lock);
+	list_del(&fp->node);
+	if (fp->frozen)
+		freezer->nr_frozen--;
+	spin_unlock(&freezer->lock);
+	css_put(&freezer->css);
 }
 
 /**
@@ -359,7 +696,9 @@ static void freezer_apply_state(struct freezer *freezer, bool freeze,
 		if (!(freezer->state & CGROUP_FREEZING))
 			atomic_inc(&system_freezing_cnt);
 		freezer->state |= state;
-		freeze_cgroup(freezer);
+		/* tasks pick up the new state in freezing(), kick them async */
+		freezer->need_kick = true;
+		freezer_queue_work(freezer);
 	} else {
 		bool was_freezing = freezer->state & CGROUP_FREEZING;
 
@@ -370,6 +709,8 @@ static void freezer_apply_state(struct freezer *freezer, bool freeze,
 				atomic_dec(&system_freezing_cnt);
 			freezer->state &= ~CGROUP_FROZEN;
 			unfreeze_cgroup(freezer);
+			if (was_freezing)
+				cgroup_file_notify(&freezer->state_file);
 		}
 	}
 }
@@ -450,44 +791,11 @@ static u64 freezer_parent_freezing_read(struct cgroup_subsys_state *css,
 	return (bool)(freezer->state & CGROUP_FREEZING_PARENT);
 }
 
-#ifdef CONFIG_SAMSUNG_FREECESS
-/**
- * Check if the task is allowed to be added to the freezer group
- * only the admin can add the task to the freezer group.
- */
-static int freezer_can_attach(struct cgroup_taskset *tset)
-{
-	const struct cred *cred = current_cred(), *tcred;
-	struct task_struct *task;
-	struct cgroup_subsys_state *css;
-
-	cgroup_taskset_for_each(task, css, tset) {
-		tcred = __task_cred(task);
-
-		//Only system process and root have the permission.
-		if ((current != task) && !(cred->euid.val == 1000 || capable(CAP_SYS_ADMIN))) {
-			pr_err("Permission problem\n");
-			return -EACCES;
-		}
-	}
-
-	return 0;
-}
-
-/**
- * Cancel the attach action when it failed. It's usually used to restore the attach action.
- * But freezer attach just sends the signal, it will always success.
- * So, it doesn't need to restore any action.
- */
-static void freezer_cancel_attach(struct cgroup_taskset *tset)
-{
-}
-#endif
-
 static struct cftype files[] = {
 	{
 		.name = "state",
 		.flags = CFTYPE_NOT_ON_ROOT,
+		.file_offset = offsetof(struct freezer, state_file),
 		.seq_show = freezer_read,
 		.write = freezer_write,
 	},
@@ -509,11 +817,10 @@ struct cgroup_subsys freezer_cgrp_subsys = {
 	.css_online	= freezer_css_online,
 	.css_offline	= freezer_css_offline,
 	.css_free	= freezer_css_free,
+	.can_attach	= freezer_can_attach,
+	.cancel_attach	= freezer_cancel_attach,
 	.attach		= freezer_attach,
 	.fork		= freezer_fork,
+	.exit		= freezer_exit,
 	.legacy_cftypes	= files,
-#ifdef CONFIG_SAMSUNG_FREECESS
-	.can_attach   = freezer_can_attach,
-	.cancel_attach  = freezer_cancel_attach,
-#endif
 };
@@ -62,6 +62,7 @@ bool __refrigerator(bool check_kthr_stop)
 	   processes around? */
 	bool was_frozen = false;
 	long save = current->state;
+	struct freezer_parked fp;
 
 	might_sleep();
 
@@ -70,6 +71,14 @@ bool __refrigerator(bool check_kthr_stop)
 	for (;;) {
 		set_current_state(TASK_UNINTERRUPTIBLE);
 
+		/*
+		 * Park before testing freezing(), so that a cgroup thaw
+		 * either sees us on its list or we see it thawed.  Parking
+		 * again on every pass picks up a migration to another
+		 * freezer cgroup while we were asleep.
+		 */
+		cgroup_freezer_park(&fp);
+
 		spin_lock_irq(&freezer_lock);
 		current->flags |= PF_FROZEN;
 		if (!freezing(current) ||
@@ -77,10 +86,14 @@ bool __refrigerator(bool check_kthr_stop)
 			current->flags &= ~PF_FROZEN;
 		spin_unlock_irq(&freezer_lock);
 
-		if (!(current->flags & PF_FROZEN))
+		if (!(current->flags & PF_FROZEN)) {
+			cgroup_freezer_unpark(&fp);
 			break;
+		}
+		cgroup_freezer_frozen(&fp);
 		was_frozen = true;
 		schedule();
+		cgroup_freezer_unpark(&fp);
 	}
 
 	pr_debug("%s left refrigerator\n", current->comm);
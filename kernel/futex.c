@@ -65,6 +65,9 @@
 #include <linux/freezer.h>
 #include <linux/bootmem.h>
 #include <linux/fault-inject.h>
+#include <linux/vmalloc.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/futex.h>
 
@@ -261,17 +264,28 @@ struct futex_hash_bucket {
 	atomic_t waiters;
 	spinlock_t lock;
 	struct plist_head chain;
+#ifdef CONFIG_DEBUG_FS
+	/* lock acquisitions, and those that found it held; under ->lock */
+	unsigned long locked;
+	unsigned long contended;
+#endif
 } ____cacheline_aligned_in_smp;
 
 /*
+ * A hash table of futex buckets.  Shared futexes always live in the
+ * global one, private futexes in the table of their mm when
+ * CONFIG_FUTEX_PRIVATE_HASH is set.
+ *
  * The base of the bucket array and its size are always used together
  * (after initialization only in hash_futex()), so ensure that they
  * reside in the same cacheline.
  */
-static struct {
+struct futex_hash {
 	struct futex_hash_bucket *queues;
 	unsigned long            hashsize;
-} __futex_data __read_mostly __aligned(2*sizeof(long));
+} __aligned(2*sizeof(long));
+
+static struct futex_hash __futex_data __read_mostly;
 #define futex_queues   (__futex_data.queues)
 #define futex_hashsize (__futex_data.hashsize)
 
@@ -381,19 +395,134 @@ static inline int hb_waiters_pending(struct futex_hash_bucket *hb)
 #endif
 }
 
+static void futex_hash_init(struct futex_hash *fh)
+{
+	unsigned long i;
+
+	for (i = 0; i < fh->hashsize; i++) {
+		atomic_set(&fh->queues[i].waiters, 0);
+		plist_head_init(&fh->queues[i].chain);
+		spin_lock_init(&fh->queues[i].lock);
+#ifdef CONFIG_DEBUG_FS
+		fh->queues[i].locked = 0;
+		fh->queues[i].contended = 0;
+#endif
+	}
+}
+
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+/*
+ * Per process hash of the private futexes.  The table is set up by the
+ * first private futex operation of the mm, which is the first contended
+ * one as uncontended futexes never enter the kernel, and is never
+ * replaced afterwards: every private key of the mm hashes into the same
+ * table for the lifetime of the mm.  If it can't be allocated the mm
+ * keeps using the global hash.
+ */
+#define FUTEX_PRIVATE_HASH_MIN		16
+#define FUTEX_PRIVATE_HASH_MAX		1024
+
+static void futex_private_hash_alloc(struct mm_struct *mm)
+{
+	unsigned long hashsize, size;
+	unsigned int threads;
+	struct futex_hash *fh;
+
+	/* also covers CLONE_VM users that are not threads of current */
+	threads = max_t(unsigned int, get_nr_threads(current),
+			atomic_read(&mm->mm_users));
+	hashsize = roundup_pow_of_two(4 * max(threads, num_online_cpus()));
+	hashsize = clamp_t(unsigned long, hashsize, FUTEX_PRIVATE_HASH_MIN,
+			   min_t(unsigned long, futex_hashsize,
+				 FUTEX_PRIVATE_HASH_MAX));
+
+	size = ALIGN(sizeof(*fh), SMP_CACHE_BYTES) +
+	       hashsize * sizeof(struct futex_hash_bucket);
+	if (size <= PAGE_SIZE)
+		fh = kzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	else
+		fh = vzalloc(size);
+
+	if (fh) {
+		fh->queues = (void *)fh + ALIGN(sizeof(*fh), SMP_CACHE_BYTES);
+		fh->hashsize = hashsize;
+		futex_hash_init(fh);
+	} else {
+		fh = &__futex_data;
+	}
+
+	if (cmpxchg(&mm->futex_hash, NULL, fh) != NULL && fh != &__futex_data)
+		kvfree(fh);
+}
+
+static inline void futex_private_hash_prepare(struct mm_struct *mm)
+{
+	if (unlikely(mm && !READ_ONCE(mm->futex_hash)))
+		futex_private_hash_alloc(mm);
+}
+
+static inline struct futex_hash *futex_key_hash(union futex_key *key)
+{
+	struct futex_hash *fh;
+
+	if (key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED) ||
+	    !key->private.mm)
+		return &__futex_data;
+
+	/* set up by get_futex_key() before any private key is hashed */
+	fh = READ_ONCE(key->private.mm->futex_hash);
+	return fh ? fh : &__futex_data;
+}
+
+void futex_private_hash_free(struct mm_struct *mm)
+{
+	if (mm->futex_hash && mm->futex_hash != &__futex_data)
+		kvfree(mm->futex_hash);
+	mm->futex_hash = NULL;
+}
+#else
+static inline void futex_private_hash_prepare(struct mm_struct *mm)
+{
+}
+
+static inline struct futex_hash *futex_key_hash(union futex_key *key)
+{
+	return &__futex_data;
+}
+#endif /* CONFIG_FUTEX_PRIVATE_HASH */
+
 /**
- * hash_futex - Return the hash bucket in the global hash
+ * hash_futex - Return the hash bucket of a futex key
  * @key:	Pointer to the futex key for which the hash is calculated
  *
  * We hash on the keys returned from get_futex_key (see below) and return the
- * corresponding hash bucket in the global hash.
+ * corresponding hash bucket in the global hash, or in the private hash of
+ * the mm for process private futexes.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
+	struct futex_hash *fh = futex_key_hash(key);
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & (futex_hashsize - 1)];
+	return &fh->queues[hash & (fh->hashsize - 1)];
+}
+
+/*
+ * Take the bucket lock on the entry points of the futex operations,
+ * counting how often it was found held.
+ */
+static inline void hb_lock(struct futex_hash_bucket *hb)
+{
+#ifdef CONFIG_DEBUG_FS
+	if (!spin_trylock(&hb->lock)) {
+		spin_lock(&hb->lock);
+		hb->contended++;
+	}
+	hb->locked++;
+#else
+	spin_lock(&hb->lock);
+#endif
 }
 
 
@@ -527,6 +656,7 @@ get_futex_key(u32 __user *uaddr, int fshared, union futex_key *key, int rw)
 	if (!fshared) {
 		key->private.mm = mm;
 		key->private.address = address;
+		futex_private_hash_prepare(mm);
 		get_futex_key_refs(key);  /* implies smp_mb(); (B) */
 		return 0;
 	}
@@ -1389,11 +1519,11 @@ static inline void
 double_lock_hb(struct futex_hash_bucket *hb1, struct futex_hash_bucket *hb2)
 {
 	if (hb1 <= hb2) {
-		spin_lock(&hb1->lock);
+		hb_lock(hb1);
 		if (hb1 < hb2)
 			spin_lock_nested(&hb2->lock, SINGLE_DEPTH_NESTING);
 	} else { /* hb1 > hb2 */
-		spin_lock(&hb2->lock);
+		hb_lock(hb2);
 		spin_lock_nested(&hb1->lock, SINGLE_DEPTH_NESTING);
 	}
 }
@@ -1431,7 +1561,7 @@ futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 	if (!hb_waiters_pending(hb))
 		goto out_put_key;
 
-	spin_lock(&hb->lock);
+	hb_lock(hb);
 
 	plist_for_each_entry_safe(this, next, &hb->chain, list) {
 		if (match_futex (&this->key, &key)) {
@@ -2046,7 +2176,7 @@ static inline struct futex_hash_bucket *queue_lock(struct futex_q *q)
 
 	q->lock_ptr = &hb->lock;
 
-	spin_lock(&hb->lock); /* implies smp_mb(); (A) */
+	hb_lock(hb); /* implies smp_mb(); (A) */
 	return hb;
 }
 
@@ -2699,7 +2829,7 @@ retry:
 		return ret;
 
 	hb = hash_futex(&key);
-	spin_lock(&hb->lock);
+	hb_lock(hb);
 
 	/*
 	 * Check waiters first. We do not trust user space values at
@@ -3357,10 +3487,123 @@ static void __init futex_detect_cmpxchg(void)
 #endif
 }
 
+#ifdef CONFIG_DEBUG_FS
+/*
+ * <debugfs>/futex/global lists the buckets of the global hash that were
+ * locked at least once, <debugfs>/futex/private sums up the private hash
+ * of every process that has one.  Counters are read without the bucket
+ * locks and are approximate.
+ */
+static void futex_hash_sum(struct futex_hash *fh, unsigned long *locked,
+			   unsigned long *contended, unsigned long *max)
+{
+	unsigned long i;
+
+	*locked = *contended = *max = 0;
+	for (i = 0; i < fh->hashsize; i++) {
+		unsigned long c = READ_ONCE(fh->queues[i].contended);
+
+		*locked += READ_ONCE(fh->queues[i].locked);
+		*contended += c;
+		*max = max(*max, c);
+	}
+}
+
+static int futex_global_show(struct seq_file *m, void *v)
+{
+	unsigned long i;
+
+	seq_printf(m, "# hashsize %lu\n", futex_hashsize);
+	seq_puts(m, "# bucket locked contended waiters\n");
+	for (i = 0; i < futex_hashsize; i++) {
+		struct futex_hash_bucket *hb = &futex_queues[i];
+		unsigned long locked = READ_ONCE(hb->locked);
+
+		if (!locked)
+			continue;
+		seq_printf(m, "%lu %lu %lu %d\n", i, locked,
+			   READ_ONCE(hb->contended), atomic_read(&hb->waiters));
+	}
+
+	return 0;
+}
+
+static int futex_private_show(struct seq_file *m, void *v)
+{
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	struct task_struct *p;
+
+	seq_puts(m, "# pid comm hashsize locked contended max_contended\n");
+
+	rcu_read_lock();
+	for_each_process(p) {
+		unsigned long locked, contended, max;
+		struct mm_struct *mm;
+		struct futex_hash *fh;
+
+		mm = get_task_mm(p);
+		if (!mm)
+			continue;
+
+		fh = READ_ONCE(mm->futex_hash);
+		if (fh == &__futex_data)
+			seq_printf(m, "%d %s global\n", task_pid_nr(p), p->comm);
+		else if (fh) {
+			futex_hash_sum(fh, &locked, &contended, &max);
+			seq_printf(m, "%d %s %lu %lu %lu %lu\n", task_pid_nr(p),
+				   p->comm, fh->hashsize, locked, contended,
+				   max);
+		}
+		mmput_async(mm);
+	}
+	rcu_read_unlock();
+#endif
+	return 0;
+}
+
+static int futex_global_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, futex_global_show, NULL);
+}
+
+static int futex_private_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, futex_private_show, NULL);
+}
+
+static const struct file_operations futex_global_fops = {
+	.open		= futex_global_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static const struct file_operations futex_private_fops = {
+	.open		= futex_private_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init futex_debugfs_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("futex", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	debugfs_create_file("global", S_IRUSR, dir, NULL, &futex_global_fops);
+	debugfs_create_file("private", S_IRUSR, dir, NULL,
+			    &futex_private_fops);
+	return 0;
+}
+late_initcall(futex_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
+
 static int __init futex_init(void)
 {
 	unsigned int futex_shift;
-	unsigned long i;
 
 #if CONFIG_BASE_SMALL
 	futex_hashsize = 16;
@@ -3376,12 +3619,7 @@ static int __init futex_init(void)
 	futex_hashsize = 1UL << futex_shift;
 
 	futex_detect_cmpxchg();
-
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+	futex_hash_init(&__futex_data);
 
 	return 0;
 }
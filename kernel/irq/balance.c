@@ -0,0 +1,398 @@
+/*
+ * linux/kernel/irq/balance.c
+ *
+ * This file contains the in-kernel interrupt affinity balancer.
+ *
+ * Every interval the balancer samples the rate and the handler time of
+ * each interrupt, charges the softirq time of a cpu to the interrupts
+ * it handled in proportion to their handler time, and compares the
+ * busy share of each cpu weighted by its capacity. The heaviest
+ * interrupt of a busy cpu is moved to the cpu that would end up least
+ * busy, as long as that beats the source by a margin. Interrupts that
+ * declared a set of cpus (balance_cpus) are kept within it.
+ *
+ * Only interrupts whose affinity was left alone, or still points at
+ * the cpu the balancer chose, are considered, so affinity written by
+ * drivers or by user space always wins.
+ */
+
+#include <linux/irq.h>
+#include <linux/interrupt.h>
+#include <linux/kernel_stat.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+
+#include <trace/events/irq.h>
+
+#include "internals.h"
+
+#ifdef MODULE_PARAM_PREFIX
+#undef MODULE_PARAM_PREFIX
+#endif
+#define MODULE_PARAM_PREFIX "irq_balance."
+
+#ifndef arch_scale_cpu_capacity
+#define arch_scale_cpu_capacity(sd, cpu)	SCHED_CAPACITY_SCALE
+#endif
+
+/* Interrupts below ~0.5% of a cpu are not worth moving */
+#define IRQ_BALANCE_MIN_LOAD	5
+
+struct irq_balance_cpu {
+	u64			busy;		/* cputime at the last sample */
+	u64			softirq;	/* softirq cputime at the last sample */
+	u64			softirq_delta;	/* ns of softirq during the interval */
+	u64			irq_time;	/* ns of balanced handlers */
+	unsigned long		capacity;
+	unsigned int		load;		/* busy share, 0..1024 */
+	struct irq_desc		*heaviest;
+};
+
+static DEFINE_PER_CPU(struct irq_balance_cpu, irq_balance_cpus);
+
+DEFINE_STATIC_KEY_FALSE(irq_balance_key);
+
+static bool irq_balance_enable = true;
+static unsigned int irq_balance_interval_ms = 1000;
+static unsigned int irq_balance_busy_pct = 60;
+static unsigned int irq_balance_imbalance_pct = 25;
+static unsigned int irq_balance_cooldown_ms = 5000;
+
+static bool irq_balance_ready;
+static u64 irq_balance_last;
+static DEFINE_MUTEX(irq_balance_mutex);
+
+static void irq_balance_workfn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(irq_balance_work, irq_balance_workfn);
+
+static void irq_balance_sample_cpu(unsigned int cpu, u64 interval)
+{
+	struct irq_balance_cpu *bc = &per_cpu(irq_balance_cpus, cpu);
+	u64 *cpustat = kcpustat_cpu(cpu).cpustat;
+	u64 busy, softirq, delta;
+
+	busy = cpustat[CPUTIME_USER] + cpustat[CPUTIME_NICE] +
+	       cpustat[CPUTIME_SYSTEM] + cpustat[CPUTIME_IRQ] +
+	       cpustat[CPUTIME_SOFTIRQ] + cpustat[CPUTIME_STEAL];
+	softirq = cpustat[CPUTIME_SOFTIRQ];
+
+	delta = cputime_to_nsecs(busy - bc->busy);
+	bc->load = min_t(u64, div64_u64(delta << SCHED_CAPACITY_SHIFT,
+					interval), SCHED_CAPACITY_SCALE);
+	bc->softirq_delta = cputime_to_nsecs(softirq - bc->softirq);
+	bc->busy = busy;
+	bc->softirq = softirq;
+	bc->capacity = arch_scale_cpu_capacity(NULL, cpu);
+	bc->irq_time = 0;
+	bc->heaviest = NULL;
+}
+
+/*
+ * The balancer only touches an interrupt nobody else narrowed down:
+ * its affinity still covers the online default cpus, or it is still
+ * the single cpu the balancer picked last time.
+ */
+static bool irq_balance_owned(struct irq_desc *desc)
+{
+	const struct cpumask *aff = desc->irq_common_data.affinity;
+	unsigned int cpu;
+
+	if (desc->balance.cpu >= 0 &&
+	    cpumask_equal(aff, cpumask_of(desc->balance.cpu)))
+		return true;
+
+	for_each_cpu_and(cpu, irq_default_affinity, cpu_online_mask)
+		if (!cpumask_test_cpu(cpu, aff))
+			return false;
+	return true;
+}
+
+static bool irq_balance_sample_irq(struct irq_desc *desc, u64 interval)
+{
+	struct irq_data *data = &desc->irq_data;
+	struct irq_balance_stat *st = &desc->balance;
+	unsigned int count;
+	bool ret = false;
+	u64 time;
+
+	raw_spin_lock_irq(&desc->lock);
+
+	time = READ_ONCE(st->time);
+	count = desc->tot_count;
+	st->delta = time - st->last_time;
+	st->rate = div64_u64((u64)(count - st->last_count) * NSEC_PER_SEC,
+			     interval);
+	st->last_time = time;
+	st->last_count = count;
+	st->load = 0;
+
+	if (!desc->action || irqd_irq_disabled(data) ||
+	    !irqd_can_balance(data) || irqd_affinity_is_managed(data) ||
+	    !data->chip || !data->chip->irq_set_affinity ||
+	    !irq_balance_owned(desc))
+		goto out;
+
+	/* The GIC delivers to the first online cpu of the affinity mask */
+	st->cur = cpumask_first_and(desc->irq_common_data.affinity,
+				    cpu_online_mask);
+	ret = st->cur < nr_cpu_ids;
+out:
+	raw_spin_unlock_irq(&desc->lock);
+	return ret;
+}
+
+static const char *irq_balance_name(struct irq_desc *desc)
+{
+	if (desc->action && desc->action->name)
+		return desc->action->name;
+	return desc->name ? desc->name : "";
+}
+
+static int irq_balance_move(struct irq_desc *desc, int dst,
+			    unsigned int dst_load, const char *reason)
+{
+	struct irq_balance_stat *st = &desc->balance;
+	unsigned int irq = irq_desc_get_irq(desc);
+	int src = st->cur;
+	int ret;
+
+	ret = irq_set_affinity(irq, cpumask_of(dst));
+	if (ret)
+		return ret;
+
+	st->cpu = dst;
+	st->cur = dst;
+	st->moved = jiffies;
+	trace_irq_balance_move(irq, irq_balance_name(desc), src, dst,
+			       st->rate, st->load,
+			       per_cpu(irq_balance_cpus, src).load, dst_load,
+			       reason);
+	return 0;
+}
+
+/* Busy share of @dst once it also handles @load worth of @src's time */
+static unsigned int irq_balance_project(int src, int dst, unsigned int load)
+{
+	struct irq_balance_cpu *s = &per_cpu(irq_balance_cpus, src);
+	struct irq_balance_cpu *d = &per_cpu(irq_balance_cpus, dst);
+
+	return d->load + load * s->capacity / max(d->capacity, 1UL);
+}
+
+static int irq_balance_find_dst(struct irq_desc *desc, unsigned int *best_load)
+{
+	const struct cpumask *allowed = cpu_online_mask;
+	int cpu, best = -1;
+
+	if (!cpumask_empty(desc->balance_mask))
+		allowed = desc->balance_mask;
+
+	*best_load = UINT_MAX;
+	for_each_cpu_and(cpu, allowed, cpu_online_mask) {
+		unsigned int load;
+
+		if (cpu == desc->balance.cur)
+			continue;
+		load = irq_balance_project(desc->balance.cur, cpu,
+					   desc->balance.load);
+		if (load < *best_load) {
+			*best_load = load;
+			best = cpu;
+		}
+	}
+	return best;
+}
+
+static void irq_balance_account_move(struct irq_desc *desc, int src, int dst,
+				     unsigned int dst_load)
+{
+	struct irq_balance_cpu *s = &per_cpu(irq_balance_cpus, src);
+
+	s->load -= min(s->load, desc->balance.load);
+	per_cpu(irq_balance_cpus, dst).load = min_t(unsigned int, dst_load,
+						    SCHED_CAPACITY_SCALE);
+}
+
+static void irq_balance_pass(void)
+{
+	unsigned long cooldown = msecs_to_jiffies(irq_balance_cooldown_ms);
+	u64 now = ktime_get_ns();
+	u64 interval = now - irq_balance_last;
+	struct irq_desc *desc;
+	unsigned int load;
+	int cpu, dst, src;
+	unsigned int irq;
+
+	irq_balance_last = now;
+	if (!interval)
+		return;
+
+	for_each_online_cpu(cpu)
+		irq_balance_sample_cpu(cpu, interval);
+
+	irq_lock_sparse();
+
+	for_each_irq_desc(irq, desc) {
+		if (irq_balance_sample_irq(desc, interval))
+			per_cpu(irq_balance_cpus, desc->balance.cur).irq_time +=
+				desc->balance.delta;
+		else
+			desc->balance.cur = -1;
+	}
+
+	for_each_irq_desc(irq, desc) {
+		struct irq_balance_stat *st = &desc->balance;
+		struct irq_balance_cpu *bc;
+		u64 cost;
+
+		if (st->cur < 0)
+			continue;
+
+		bc = &per_cpu(irq_balance_cpus, st->cur);
+		cost = st->delta;
+		if (bc->irq_time)
+			cost += (bc->softirq_delta *
+				 div64_u64(st->delta << SCHED_CAPACITY_SHIFT,
+					   bc->irq_time)) >> SCHED_CAPACITY_SHIFT;
+		st->load = min_t(u64, div64_u64(cost << SCHED_CAPACITY_SHIFT,
+						interval), SCHED_CAPACITY_SCALE);
+
+		/* Declared cpus are not subject to hysteresis or cooldown */
+		if (!cpumask_empty(desc->balance_mask) &&
+		    !cpumask_test_cpu(st->cur, desc->balance_mask)) {
+			src = st->cur;
+			dst = irq_balance_find_dst(desc, &load);
+			if (dst >= 0 &&
+			    !irq_balance_move(desc, dst, load, "pinned"))
+				irq_balance_account_move(desc, src, dst, load);
+			continue;
+		}
+
+		if (st->load < IRQ_BALANCE_MIN_LOAD ||
+		    time_before(jiffies, st->moved + cooldown))
+			continue;
+		if (!bc->heaviest || st->load > bc->heaviest->balance.load)
+			bc->heaviest = desc;
+	}
+
+	/* At most one interrupt leaves each cpu per pass */
+	for_each_online_cpu(src) {
+		struct irq_balance_cpu *bc = &per_cpu(irq_balance_cpus, src);
+
+		desc = bc->heaviest;
+		if (!desc || desc->balance.cur != src ||
+		    bc->load * 100 < irq_balance_busy_pct * SCHED_CAPACITY_SCALE)
+			continue;
+
+		dst = irq_balance_find_dst(desc, &load);
+		if (dst < 0 ||
+		    load * (100 + irq_balance_imbalance_pct) >= bc->load * 100)
+			continue;
+
+		if (!irq_balance_move(desc, dst, load, "load"))
+			irq_balance_account_move(desc, src, dst, load);
+	}
+
+	irq_unlock_sparse();
+}
+
+static void irq_balance_workfn(struct work_struct *work)
+{
+	mutex_lock(&irq_balance_mutex);
+	if (irq_balance_enable) {
+		irq_balance_pass();
+		queue_delayed_work(system_power_efficient_wq, &irq_balance_work,
+			msecs_to_jiffies(max(irq_balance_interval_ms, 10U)));
+	}
+	mutex_unlock(&irq_balance_mutex);
+}
+
+static void irq_balance_start(void)
+{
+	unsigned int cpu;
+
+	mutex_lock(&irq_balance_mutex);
+	/* The first pass only takes the baseline */
+	irq_balance_last = ktime_get_ns();
+	for_each_online_cpu(cpu)
+		irq_balance_sample_cpu(cpu, 1);
+	static_branch_enable(&irq_balance_key);
+	queue_delayed_work(system_power_efficient_wq, &irq_balance_work,
+			   msecs_to_jiffies(max(irq_balance_interval_ms, 10U)));
+	mutex_unlock(&irq_balance_mutex);
+}
+
+static void irq_balance_stop(void)
+{
+	cancel_delayed_work_sync(&irq_balance_work);
+	static_branch_disable(&irq_balance_key);
+}
+
+static int irq_balance_set_enable(const char *val,
+				  const struct kernel_param *kp)
+{
+	bool old = irq_balance_enable;
+	int ret;
+
+	ret = param_set_bool(val, kp);
+	if (ret || !irq_balance_ready || old == irq_balance_enable)
+		return ret;
+
+	if (irq_balance_enable)
+		irq_balance_start();
+	else
+		irq_balance_stop();
+	return 0;
+}
+
+static const struct kernel_param_ops irq_balance_enable_ops = {
+	.set = irq_balance_set_enable,
+	.get = param_get_bool,
+};
+
+module_param_cb(enable, &irq_balance_enable_ops, &irq_balance_enable, 0644);
+MODULE_PARM_DESC(enable, "Balance interrupt affinity in the kernel");
+module_param_named(interval_ms, irq_balance_interval_ms, uint, 0644);
+MODULE_PARM_DESC(interval_ms, "Sample interval in milliseconds");
+module_param_named(busy_pct, irq_balance_busy_pct, uint, 0644);
+MODULE_PARM_DESC(busy_pct, "Busy share above which a cpu sheds an interrupt");
+module_param_named(imbalance_pct, irq_balance_imbalance_pct, uint, 0644);
+MODULE_PARM_DESC(imbalance_pct, "Margin by which the target must beat the source");
+module_param_named(cooldown_ms, irq_balance_cooldown_ms, uint, 0644);
+MODULE_PARM_DESC(cooldown_ms, "Minimum time between two moves of an interrupt");
+
+/**
+ * irq_set_balance_cpus - Declare the cpus an interrupt must stay on
+ * @irq:	Interrupt to set the cpus for
+ * @mask:	cpus the balancer may place @irq on, NULL or empty to clear
+ *
+ * For latency critical interrupts, e.g. touch, that need a given
+ * cluster. The balancer moves @irq into @mask on its next pass and
+ * then only balances it among those cpus.
+ */
+int irq_set_balance_cpus(unsigned int irq, const struct cpumask *mask)
+{
+	unsigned long flags;
+	struct irq_desc *desc = irq_get_desc_lock(irq, &flags,
+						  IRQ_GET_DESC_CHECK_GLOBAL);
+
+	if (!desc)
+		return -EINVAL;
+	if (mask)
+		cpumask_copy(desc->balance_mask, mask);
+	else
+		cpumask_clear(desc->balance_mask);
+	irq_put_desc_unlock(desc, flags);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(irq_set_balance_cpus);
+
+static int __init irq_balance_init(void)
+{
+	irq_balance_ready = true;
+	if (irq_balance_enable)
+		irq_balance_start();
+	return 0;
+}
+late_initcall(irq_balance_init);
@@ -184,8 +184,10 @@ irqreturn_t handle_irq_event_percpu(struct irq_desc *desc)
 {
 	irqreturn_t retval;
 	unsigned int flags = 0;
+	u64 start = irq_balance_clock();
 
 	retval = __handle_irq_event_percpu(desc, &flags);
+	irq_balance_account(desc, start);
 
 	add_interrupt_randomness(desc->irq_data.irq, flags);
 
@@ -8,6 +8,8 @@
 #include <linux/irqdesc.h>
 #include <linux/kernel_stat.h>
 #include <linux/pm_runtime.h>
+#include <linux/jump_label.h>
+#include <linux/sched.h>
 
 #ifdef CONFIG_SPARSE_IRQ
 # define IRQ_BITMAP_BITS	(NR_IRQS + 8196)
@@ -221,6 +223,25 @@ static inline int irq_desc_is_chained(struct irq_desc *desc)
 	return (desc->action && desc->action == &chained_action);
 }
 
+#ifdef CONFIG_IRQ_BALANCE
+DECLARE_STATIC_KEY_FALSE(irq_balance_key);
+
+/* Handler time is only worth two clock reads while the balancer runs */
+static inline u64 irq_balance_clock(void)
+{
+	return static_branch_unlikely(&irq_balance_key) ? local_clock() : 0;
+}
+
+static inline void irq_balance_account(struct irq_desc *desc, u64 start)
+{
+	if (start)
+		desc->balance.time += local_clock() - start;
+}
+#else
+static inline u64 irq_balance_clock(void) { return 0; }
+static inline void irq_balance_account(struct irq_desc *desc, u64 start) { }
+#endif
+
 #ifdef CONFIG_PM_SLEEP
 bool irq_pm_check_wakeup(struct irq_desc *desc);
 void irq_pm_install_action(struct irq_desc *desc, struct irqaction *action);
@@ -76,6 +76,15 @@ static int alloc_masks(struct irq_desc *desc, gfp_t gfp, int node)
 		free_cpumask_var(desc->irq_common_data.affinity);
 		return -ENOMEM;
 	}
+#endif
+#ifdef CONFIG_IRQ_BALANCE
+	if (!zalloc_cpumask_var_node(&desc->balance_mask, gfp, node)) {
+#ifdef CONFIG_GENERIC_PENDING_IRQ
+		free_cpumask_var(desc->pending_mask);
+#endif
+		free_cpumask_var(desc->irq_common_data.affinity);
+		return -ENOMEM;
+	}
 #endif
 	return 0;
 }
@@ -90,6 +99,11 @@ static void desc_smp_init(struct irq_desc *desc, int node,
 #ifdef CONFIG_GENERIC_PENDING_IRQ
 	cpumask_clear(desc->pending_mask);
 #endif
+#ifdef CONFIG_IRQ_BALANCE
+	memset(&desc->balance, 0, sizeof(desc->balance));
+	desc->balance.cpu = -1;
+	cpumask_clear(desc->balance_mask);
+#endif
 #ifdef CONFIG_NUMA
 	desc->irq_common_data.node = node;
 #endif
@@ -345,6 +359,9 @@ static void delete_irq_desc(unsigned int irq)
 #ifdef CONFIG_SMP
 static void free_masks(struct irq_desc *desc)
 {
+#ifdef CONFIG_IRQ_BALANCE
+	free_cpumask_var(desc->balance_mask);
+#endif
 #ifdef CONFIG_GENERIC_PENDING_IRQ
 	free_cpumask_var(desc->pending_mask);
 #endif
@@ -257,6 +257,59 @@ static const struct file_operations irq_node_proc_fops = {
 	.llseek		= seq_lseek,
 	.release	= single_release,
 };
+
+#ifdef CONFIG_IRQ_BALANCE
+static int irq_balance_cpus_proc_show(struct seq_file *m, void *v)
+{
+	struct irq_desc *desc = irq_to_desc((long)m->private);
+	unsigned long flags;
+	cpumask_var_t mask;
+
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	cpumask_copy(mask, desc->balance_mask);
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+
+	seq_printf(m, "%*pbl\n", cpumask_pr_args(mask));
+	free_cpumask_var(mask);
+
+	return 0;
+}
+
+static ssize_t irq_balance_cpus_proc_write(struct file *file,
+		const char __user *buffer, size_t count, loff_t *pos)
+{
+	unsigned int irq = (int)(long)PDE_DATA(file_inode(file));
+	cpumask_var_t new_value;
+	int err;
+
+	if (!alloc_cpumask_var(&new_value, GFP_KERNEL))
+		return -ENOMEM;
+
+	/* An empty list lets the balancer use every cpu again */
+	err = cpumask_parselist_user(buffer, count, new_value);
+	if (!err)
+		err = irq_set_balance_cpus(irq, new_value) ?: count;
+
+	free_cpumask_var(new_value);
+	return err;
+}
+
+static int irq_balance_cpus_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, irq_balance_cpus_proc_show, PDE_DATA(inode));
+}
+
+static const struct file_operations irq_balance_cpus_proc_fops = {
+	.open		= irq_balance_cpus_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+	.write		= irq_balance_cpus_proc_write,
+};
+#endif
 #endif
 
 static int irq_spurious_proc_show(struct seq_file *m, void *v)
@@ -364,6 +417,12 @@ void register_irq_proc(unsigned int irq, struct irq_desc *desc)
 
 	proc_create_data("node", 0444, desc->dir,
 			 &irq_node_proc_fops, (void *)(long)irq);
+
+#ifdef CONFIG_IRQ_BALANCE
+	/* create /proc/irq/<irq>/balance_cpus */
+	proc_create_data("balance_cpus", 0644, desc->dir,
+			 &irq_balance_cpus_proc_fops, (void *)(long)irq);
+#endif
 #endif
 
 	proc_create_data("spurious", 0444, desc->dir,
@@ -387,6 +446,9 @@ void unregister_irq_proc(unsigned int irq, struct irq_desc *desc)
 	remove_proc_entry("affinity_hint", desc->dir);
 	remove_proc_entry("smp_affinity_list", desc->dir);
 	remove_proc_entry("node", desc->dir);
+#ifdef CONFIG_IRQ_BALANCE
+	remove_proc_entry("balance_cpus", desc->dir);
+#endif
 #endif
 	remove_proc_entry("spurious", desc->dir);
 
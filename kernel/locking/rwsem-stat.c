@@ -0,0 +1,169 @@
+/*
+ * kernel/locking/rwsem-stat.c
+ *
+ * Per-class contention statistics for the xadd rwsem slowpaths.
+ *
+ * A class is identified by the call site of init_rwsem(), so all rwsems
+ * initialised at the same site (e.g. every mm's mmap_sem) share one entry,
+ * much as lockdep groups them. The lock_class_key can't be used for that:
+ * without lockdep it is an empty struct, and the keys of different sites
+ * need not have different addresses. The class table is a fixed size open
+ * addressed hash so that registering a class never allocates and is safe
+ * from any context. Statically initialised rwsems, and classes that don't
+ * fit in the table, are accounted to a catch-all entry.
+ *
+ * The statistics are exported in <debugfs>/rwsem_stat.
+ */
+#include <linux/atomic.h>
+#include <linux/debugfs.h>
+#include <linux/hash.h>
+#include <linux/init.h>
+#include <linux/rwsem.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+
+#include "rwsem.h"
+
+#define RWSEM_STAT_HASH_BITS	8
+#define RWSEM_STAT_HASH_SIZE	(1 << RWSEM_STAT_HASH_BITS)
+
+struct rwsem_stat_class {
+	unsigned long		ip;
+	const char		*name;
+	atomic_long_t		items[NR_RWSEM_STAT_ITEMS];
+	/* indexed by enum rwsem_waiter_type, in nanoseconds */
+	atomic64_t		wait_total[2];
+	atomic64_t		wait_max[2];
+};
+
+static struct rwsem_stat_class rwsem_stat_classes[RWSEM_STAT_HASH_SIZE];
+static struct rwsem_stat_class rwsem_stat_other = {
+	.name = "<other>",
+};
+
+/* @ip is the init_rwsem() call site, @name the lock's name there */
+struct rwsem_stat_class *rwsem_stat_class_get(unsigned long ip,
+					      const char *name)
+{
+	unsigned long idx = hash_long(ip, RWSEM_STAT_HASH_BITS);
+	int i;
+
+	if (!ip)
+		return &rwsem_stat_other;
+
+	for (i = 0; i < RWSEM_STAT_HASH_SIZE; i++) {
+		struct rwsem_stat_class *class;
+		unsigned long old;
+
+		class = &rwsem_stat_classes[(idx + i) & (RWSEM_STAT_HASH_SIZE - 1)];
+		old = READ_ONCE(class->ip);
+		if (!old) {
+			old = cmpxchg(&class->ip, 0UL, ip);
+			if (!old) {
+				WRITE_ONCE(class->name, name);
+				return class;
+			}
+		}
+		if (old == ip)
+			return class;
+	}
+
+	return &rwsem_stat_other;
+}
+
+static inline struct rwsem_stat_class *
+rwsem_stat_class(struct rw_semaphore *sem)
+{
+	return sem->stat_class ? : &rwsem_stat_other;
+}
+
+void rwsem_stat_inc(struct rw_semaphore *sem, enum rwsem_stat_item item)
+{
+	atomic_long_inc(&rwsem_stat_class(sem)->items[item]);
+}
+
+void rwsem_stat_wait(struct rw_semaphore *sem, enum rwsem_waiter_type type,
+		     u64 start)
+{
+	struct rwsem_stat_class *class = rwsem_stat_class(sem);
+	s64 delta = local_clock() - start;
+	s64 max;
+
+	if (delta <= 0)
+		return;
+
+	atomic64_add(delta, &class->wait_total[type]);
+
+	max = atomic64_read(&class->wait_max[type]);
+	while (delta > max) {
+		s64 old = atomic64_cmpxchg(&class->wait_max[type], max, delta);
+
+		if (old == max)
+			break;
+		max = old;
+	}
+}
+
+static void rwsem_stat_show_class(struct seq_file *m,
+				  struct rwsem_stat_class *class)
+{
+	long items[NR_RWSEM_STAT_ITEMS];
+	int i;
+
+	for (i = 0; i < NR_RWSEM_STAT_ITEMS; i++)
+		items[i] = atomic_long_read(&class->items[i]);
+
+	if (!items[RWSEM_STAT_READ_CONTENDED] &&
+	    !items[RWSEM_STAT_WRITE_CONTENDED])
+		return;
+
+	seq_printf(m, "%-40s %10ld %10ld %10ld %10ld %8ld %14lld %12lld %14lld %12lld  %pS\n",
+		   READ_ONCE(class->name) ? : "?",
+		   items[RWSEM_STAT_READ_CONTENDED],
+		   items[RWSEM_STAT_READ_SPIN],
+		   items[RWSEM_STAT_WRITE_CONTENDED],
+		   items[RWSEM_STAT_WRITE_SPIN],
+		   items[RWSEM_STAT_HANDOFF],
+		   (s64)atomic64_read(&class->wait_total[RWSEM_WAITING_FOR_READ]),
+		   (s64)atomic64_read(&class->wait_max[RWSEM_WAITING_FOR_READ]),
+		   (s64)atomic64_read(&class->wait_total[RWSEM_WAITING_FOR_WRITE]),
+		   (s64)atomic64_read(&class->wait_max[RWSEM_WAITING_FOR_WRITE]),
+		   (void *)class->ip);
+}
+
+static int rwsem_stat_show(struct seq_file *m, void *v)
+{
+	int i;
+
+	seq_printf(m, "%-40s %10s %10s %10s %10s %8s %14s %12s %14s %12s  %s\n",
+		   "class", "rd-cont", "rd-spin", "wr-cont", "wr-spin",
+		   "handoff", "rd-wait-ns", "rd-max-ns",
+		   "wr-wait-ns", "wr-max-ns", "site");
+
+	for (i = 0; i < RWSEM_STAT_HASH_SIZE; i++) {
+		if (READ_ONCE(rwsem_stat_classes[i].ip))
+			rwsem_stat_show_class(m, &rwsem_stat_classes[i]);
+	}
+	rwsem_stat_show_class(m, &rwsem_stat_other);
+
+	return 0;
+}
+
+static int rwsem_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, rwsem_stat_show, NULL);
+}
+
+static const struct file_operations rwsem_stat_fops = {
+	.open		= rwsem_stat_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init rwsem_stat_init(void)
+{
+	debugfs_create_file("rwsem_stat", 0444, NULL, NULL, &rwsem_stat_fops);
+	return 0;
+}
+late_initcall(rwsem_stat_init);
@@ -8,6 +8,9 @@
  *
  * Optimistic spinning by Tim Chen <tim.c.chen@intel.com>
  * and Davidlohr Bueso <davidlohr@hp.com>. Based on mutexes.
+ *
+ * Reader optimistic spinning and lock handoff modelled on the
+ * work by Waiman Long <longman@redhat.com>.
  */
 #include <linux/rwsem.h>
 #include <linux/sched.h>
@@ -85,15 +88,67 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	INIT_LIST_HEAD(&sem->wait_list);
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 	sem->owner = NULL;
+	sem->handoff = false;
 	osq_lock_init(&sem->osq);
 #endif
 #ifdef CONFIG_RWSEM_PRIO_AWARE
 	sem->m_count = 0;
 #endif
+#ifdef CONFIG_RWSEM_STAT
+	sem->stat_class = rwsem_stat_class_get(_RET_IP_, name);
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Lock handoff.
+ *
+ * Optimistic spinners may steal the lock from under a waiter that has just
+ * been woken, and under sustained load that can starve the head of the
+ * queue indefinitely. Once the head waiter has been waiting for longer than
+ * RWSEM_WAIT_TIMEOUT it sets sem->handoff, which stops spinners (and any
+ * queued writer that isn't at the head) from taking the lock, so the next
+ * grant is guaranteed to go to the head of the queue. The flag is only
+ * modified under the wait_lock and is cleared once the head waiter has
+ * been granted the lock or has left the queue.
+ */
+static inline void rwsem_set_handoff(struct rw_semaphore *sem,
+				     struct rwsem_waiter *waiter)
+{
+	if (!sem->handoff && time_after(jiffies, waiter->timeout)) {
+		WRITE_ONCE(sem->handoff, true);
+		rwsem_stat_inc(sem, RWSEM_STAT_HANDOFF);
+	}
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+	if (sem->handoff)
+		WRITE_ONCE(sem->handoff, false);
+}
+
+static inline bool rwsem_handoff_pending(struct rw_semaphore *sem)
+{
+	return READ_ONCE(sem->handoff);
+}
+#else
+static inline void rwsem_set_handoff(struct rw_semaphore *sem,
+				     struct rwsem_waiter *waiter)
+{
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+}
+
+static inline bool rwsem_handoff_pending(struct rw_semaphore *sem)
+{
+	return false;
+}
+#endif
+
 enum rwsem_wake_type {
 	RWSEM_WAKE_ANY,		/* Wake whatever's at head of wait list */
 	RWSEM_WAKE_READERS,	/* Wake readers only */
@@ -159,8 +214,15 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 			 * reader grant.
 			 */
 			if (atomic_long_add_return(-adjustment, &sem->count) <
-			    RWSEM_WAITING_BIAS)
+			    RWSEM_WAITING_BIAS) {
+				/*
+				 * The lock was stolen from under the head
+				 * reader; ask for a handoff if it has been
+				 * starved for too long.
+				 */
+				rwsem_set_handoff(sem, waiter);
 				return;
+			}
 
 			/* Last active locker left. Retry waking readers. */
 			goto try_reader_grant;
@@ -198,6 +260,9 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 	}
 	list_cut_before(&wlist, &sem->wait_list, &waiter->list);
 
+	/* The head of the queue has been granted the lock */
+	rwsem_clear_handoff(sem);
+
 	adjustment = woken * RWSEM_ACTIVE_READ_BIAS - adjustment;
 	if (list_empty(&sem->wait_list)) {
 		/* hit end of list above */
@@ -231,65 +296,13 @@ static void __rwsem_mark_wake(struct rw_semaphore *sem,
 	}
 }
 
-/*
- * Wait for the read lock to be granted
- */
-__visible
-struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
-{
-	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
-	struct rwsem_waiter waiter;
-	struct task_struct *tsk = current;
-        bool is_first_waiter = false;
-	DEFINE_WAKE_Q(wake_q);
-
-	waiter.task = tsk;
-	waiter.type = RWSEM_WAITING_FOR_READ;
-
-	raw_spin_lock_irq(&sem->wait_lock);
-	if (list_empty(&sem->wait_list))
-		adjustment += RWSEM_WAITING_BIAS;
-
-	/* is_first_waiter == true means we are first in the queue */
-	is_first_waiter = rwsem_list_add_per_prio(&waiter, sem);
-
-	/* we're now waiting on the lock, but no longer actively locking */
-	count = atomic_long_add_return(adjustment, &sem->count);
-
-	/*
-	 * If there are no active locks, wake the front queued process(es).
-	 *
-	 * If there are no writers and we are first in the queue,
-	 * wake our own waiter to join the existing active readers !
-	 */
-	if (count == RWSEM_WAITING_BIAS ||
-	    (count > RWSEM_WAITING_BIAS &&
-             (adjustment != -RWSEM_ACTIVE_READ_BIAS ||
-             is_first_waiter)))
-		__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
-
-	raw_spin_unlock_irq(&sem->wait_lock);
-	wake_up_q(&wake_q);
-
-	/* wait to be given the lock */
-	while (true) {
-		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
-		if (!waiter.task)
-			break;
-		schedule();
-	}
-
-	__set_task_state(tsk, TASK_RUNNING);
-	return sem;
-}
-EXPORT_SYMBOL(rwsem_down_read_failed);
-
 /*
  * This function must be called with the sem->wait_lock held to prevent
  * race conditions between checking the rwsem wait list and setting the
  * sem->count accordingly.
  */
-static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
+static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem,
+					struct rwsem_waiter *waiter)
 {
 	/*
 	 * Avoid trying to acquire write lock if count isn't RWSEM_WAITING_BIAS.
@@ -297,6 +310,14 @@ static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
 	if (count != RWSEM_WAITING_BIAS)
 		return false;
 
+	/*
+	 * If a handoff has been requested, only the head of the queue may
+	 * take the lock.
+	 */
+	if (rwsem_handoff_pending(sem) &&
+	    list_first_entry(&sem->wait_list, struct rwsem_waiter, list) != waiter)
+		return false;
+
 	/*
 	 * Acquire the lock by trying to set it to ACTIVE_WRITE_BIAS. If there
 	 * are other tasks on the wait list, we need to add on WAITING_BIAS.
@@ -308,6 +329,7 @@ static inline bool rwsem_try_write_lock(long count, struct rw_semaphore *sem)
 	if (atomic_long_cmpxchg_acquire(&sem->count, RWSEM_WAITING_BIAS, count)
 							== RWSEM_WAITING_BIAS) {
 		rwsem_set_owner(sem);
+		rwsem_clear_handoff(sem);
 		return true;
 	}
 
@@ -326,6 +348,10 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 		if (!(count == 0 || count == RWSEM_WAITING_BIAS))
 			return false;
 
+		/* Don't steal the lock from a starving waiter */
+		if (count && rwsem_handoff_pending(sem))
+			return false;
+
 		old = atomic_long_cmpxchg_acquire(&sem->count, count,
 				      count + RWSEM_ACTIVE_WRITE_BIAS);
 		if (old == count) {
@@ -337,21 +363,57 @@ static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
 	}
 }
 
-static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
+/*
+ * Try to acquire read lock before the reader has been put on wait queue.
+ * This only succeeds while nobody is queued, so spinning readers never
+ * jump ahead of waiters.
+ */
+static inline bool rwsem_try_read_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = atomic_long_read(&sem->count);
+
+	while (count >= 0) {
+		old = atomic_long_cmpxchg_acquire(&sem->count, count,
+				      count + RWSEM_ACTIVE_READ_BIAS);
+		if (old == count) {
+			rwsem_set_reader_owned(sem);
+			return true;
+		}
+
+		count = old;
+	}
+
+	return false;
+}
+
+/*
+ * A reader may spin on a reader owned rwsem as long as nobody is queued,
+ * since it will then be able to join the current readers right away.
+ */
+static inline bool rwsem_reader_can_join(struct rw_semaphore *sem)
+{
+	return atomic_long_read(&sem->count) >= 0;
+}
+
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem,
+					   enum rwsem_waiter_type type)
 {
 	struct task_struct *owner;
 	bool ret = true;
 
-	if (need_resched())
+	if (need_resched() || rwsem_handoff_pending(sem))
 		return false;
 
 	rcu_read_lock();
 	owner = READ_ONCE(sem->owner);
 	if (!rwsem_owner_is_writer(owner)) {
 		/*
-		 * Don't spin if the rwsem is readers owned.
+		 * Writers don't spin if the rwsem is readers owned, readers
+		 * only do if they can join the owning readers.
 		 */
-		ret = !rwsem_owner_is_reader(owner);
+		if (rwsem_owner_is_reader(owner))
+			ret = type == RWSEM_WAITING_FOR_READ &&
+			      rwsem_reader_can_join(sem);
 		goto done;
 	}
 
@@ -364,7 +426,8 @@ done:
 /*
  * Return true only if we can still spin on the owner field of the rwsem.
  */
-static noinline bool rwsem_spin_on_owner(struct rw_semaphore *sem)
+static noinline bool rwsem_spin_on_owner(struct rw_semaphore *sem,
+					 enum rwsem_waiter_type type)
 {
 	struct task_struct *owner = READ_ONCE(sem->owner);
 	int i = 0;
@@ -395,19 +458,25 @@ static noinline bool rwsem_spin_on_owner(struct rw_semaphore *sem)
 out:
 	/*
 	 * If there is a new owner or the owner is not set, we continue
-	 * spinning.
+	 * spinning. A reader owned rwsem is only worth spinning on for
+	 * another reader that can join it.
 	 */
-	return !rwsem_owner_is_reader(READ_ONCE(sem->owner));
+	if (rwsem_owner_is_reader(READ_ONCE(sem->owner)))
+		return type == RWSEM_WAITING_FOR_READ &&
+		       rwsem_reader_can_join(sem);
+
+	return true;
 }
 
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem,
+				  enum rwsem_waiter_type type)
 {
 	bool taken = false;
 
 	preempt_disable();
 
 	/* sem->wait_lock should not be held when doing optimistic spinning */
-	if (!rwsem_can_spin_on_owner(sem))
+	if (!rwsem_can_spin_on_owner(sem, type))
 		goto done;
 
 	if (!osq_lock(&sem->osq))
@@ -418,17 +487,24 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 	 * lock whenever the owner changes. Spinning will be stopped when:
 	 *  1) the owning writer isn't running; or
 	 *  2) readers own the lock as we can't determine if they are
-	 *     actively running or not.
+	 *     actively running or not, unless we are a reader that can
+	 *     share it; or
+	 *  3) a starving waiter has requested a lock handoff.
 	 */
-	while (rwsem_spin_on_owner(sem)) {
+	while (rwsem_spin_on_owner(sem, type)) {
 		/*
 		 * Try to acquire the lock
 		 */
-		if (rwsem_try_write_lock_unqueued(sem)) {
+		if (type == RWSEM_WAITING_FOR_READ ?
+		    rwsem_try_read_lock_unqueued(sem) :
+		    rwsem_try_write_lock_unqueued(sem)) {
 			taken = true;
 			break;
 		}
 
+		if (rwsem_handoff_pending(sem))
+			break;
+
 		/*
 		 * When there's no owner, we might have preempted between the
 		 * owner acquiring the lock and setting the owner field. If
@@ -438,6 +514,16 @@ static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
 		if (!sem->owner && (need_resched() || rt_task(current)))
 			break;
 
+		/*
+		 * A reader can't take the lock while others are queued, so
+		 * once the writer is gone and waiters remain, it has to
+		 * queue up behind them.
+		 */
+		if (type == RWSEM_WAITING_FOR_READ &&
+		    !rwsem_owner_is_writer(READ_ONCE(sem->owner)) &&
+		    !rwsem_reader_can_join(sem))
+			break;
+
 		/*
 		 * The cpu_relax() call is a compiler barrier which forces
 		 * everything in this loop to be re-loaded. We don't need
@@ -461,7 +547,14 @@ static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 }
 
 #else
-static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem,
+					   enum rwsem_waiter_type type)
+{
+	return false;
+}
+
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem,
+				  enum rwsem_waiter_type type)
 {
 	return false;
 }
@@ -472,6 +565,84 @@ static inline bool rwsem_has_spinner(struct rw_semaphore *sem)
 }
 #endif
 
+/*
+ * Wait for the read lock to be granted
+ */
+__visible
+struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
+{
+	long count, adjustment = -RWSEM_ACTIVE_READ_BIAS;
+	bool waiting = true; /* any queued threads before us */
+	struct rwsem_waiter waiter;
+	struct task_struct *tsk = current;
+        bool is_first_waiter = false;
+	u64 wait_start;
+	DEFINE_WAKE_Q(wake_q);
+
+	rwsem_stat_inc(sem, RWSEM_STAT_READ_CONTENDED);
+
+	/*
+	 * If the lock is held by a running writer, or by readers with
+	 * nobody queued, drop our read bias and spin for the lock instead
+	 * of sleeping behind the writer. Don't spin if dropping the bias
+	 * left the lock idle with waiters queued, those need waking below.
+	 */
+	if (rwsem_can_spin_on_owner(sem, RWSEM_WAITING_FOR_READ)) {
+		count = atomic_long_add_return(-RWSEM_ACTIVE_READ_BIAS,
+					       &sem->count);
+		adjustment = 0;
+		if (count != RWSEM_WAITING_BIAS &&
+		    rwsem_optimistic_spin(sem, RWSEM_WAITING_FOR_READ)) {
+			rwsem_stat_inc(sem, RWSEM_STAT_READ_SPIN);
+			return sem;
+		}
+	}
+
+	waiter.task = tsk;
+	waiter.type = RWSEM_WAITING_FOR_READ;
+	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
+	wait_start = rwsem_stat_clock();
+
+	raw_spin_lock_irq(&sem->wait_lock);
+	if (list_empty(&sem->wait_list)) {
+		waiting = false;
+		adjustment += RWSEM_WAITING_BIAS;
+	}
+
+	/* is_first_waiter == true means we are first in the queue */
+	is_first_waiter = rwsem_list_add_per_prio(&waiter, sem);
+
+	/* we're now waiting on the lock, but no longer actively locking */
+	count = atomic_long_add_return(adjustment, &sem->count);
+
+	/*
+	 * If there are no active locks, wake the front queued process(es).
+	 *
+	 * If there are no writers and we are first in the queue,
+	 * wake our own waiter to join the existing active readers !
+	 */
+	if (count == RWSEM_WAITING_BIAS ||
+	    (count > RWSEM_WAITING_BIAS &&
+             (!waiting || is_first_waiter)))
+		__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
+
+	raw_spin_unlock_irq(&sem->wait_lock);
+	wake_up_q(&wake_q);
+
+	/* wait to be given the lock */
+	while (true) {
+		set_task_state(tsk, TASK_UNINTERRUPTIBLE);
+		if (!waiter.task)
+			break;
+		schedule();
+	}
+
+	__set_task_state(tsk, TASK_RUNNING);
+	rwsem_stat_wait(sem, RWSEM_WAITING_FOR_READ, wait_start);
+	return sem;
+}
+EXPORT_SYMBOL(rwsem_down_read_failed);
+
 /*
  * Wait until we successfully acquire the write lock
  */
@@ -483,14 +654,19 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
         bool is_first_waiter = false;
 	struct rwsem_waiter waiter;
 	struct rw_semaphore *ret = sem;
+	u64 wait_start;
 	DEFINE_WAKE_Q(wake_q);
 
+	rwsem_stat_inc(sem, RWSEM_STAT_WRITE_CONTENDED);
+
 	/* undo write bias from down_write operation, stop active locking */
 	count = atomic_long_sub_return(RWSEM_ACTIVE_WRITE_BIAS, &sem->count);
 
 	/* do optimistic spinning and steal lock if possible */
-	if (rwsem_optimistic_spin(sem))
+	if (rwsem_optimistic_spin(sem, RWSEM_WAITING_FOR_WRITE)) {
+		rwsem_stat_inc(sem, RWSEM_STAT_WRITE_SPIN);
 		return sem;
+	}
 
 	/*
 	 * Optimistic spinning failed, proceed to the slowpath
@@ -498,6 +674,8 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	 */
 	waiter.task = current;
 	waiter.type = RWSEM_WAITING_FOR_WRITE;
+	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
+	wait_start = rwsem_stat_clock();
 
 	raw_spin_lock_irq(&sem->wait_lock);
 
@@ -540,10 +718,27 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	/* wait until we successfully acquire the lock */
 	set_current_state(state);
 	while (true) {
-		if (rwsem_try_write_lock(count, sem))
+		if (rwsem_try_write_lock(count, sem, &waiter))
 			break;
+
+		if (list_first_entry(&sem->wait_list, struct rwsem_waiter,
+				     list) == &waiter) {
+			/* Starving at the head of the queue? Ask for a handoff. */
+			rwsem_set_handoff(sem, &waiter);
+		} else if (count == RWSEM_WAITING_BIAS &&
+			   rwsem_handoff_pending(sem)) {
+			/*
+			 * The lock is free but reserved for the head of the
+			 * queue, make sure it is awake to take it.
+			 */
+			__rwsem_mark_wake(sem, RWSEM_WAKE_ANY, &wake_q);
+		}
 		raw_spin_unlock_irq(&sem->wait_lock);
 
+		/* reinitialized, out_nolock may still need the queue */
+		wake_up_q(&wake_q);
+		wake_q_init(&wake_q);
+
 		/* Block until there are no active lockers. */
 		do {
 			if (signal_pending_state(state, current))
@@ -558,12 +753,17 @@ __rwsem_down_write_failed_common(struct rw_semaphore *sem, int state)
 	__set_current_state(TASK_RUNNING);
 	list_del(&waiter.list);
 	raw_spin_unlock_irq(&sem->wait_lock);
+	rwsem_stat_wait(sem, RWSEM_WAITING_FOR_WRITE, wait_start);
 
 	return ret;
 
 out_nolock:
 	__set_current_state(TASK_RUNNING);
 	raw_spin_lock_irq(&sem->wait_lock);
+	/* A handoff requested by us must not outlive our wait */
+	if (list_first_entry(&sem->wait_list, struct rwsem_waiter,
+			     list) == &waiter)
+		rwsem_clear_handoff(sem);
 	list_del(&waiter.list);
 	if (list_empty(&sem->wait_list))
 		atomic_long_add(-RWSEM_WAITING_BIAS, &sem->count);
@@ -24,8 +24,53 @@ struct rwsem_waiter {
 	struct list_head list;
 	struct task_struct *task;
 	enum rwsem_waiter_type type;
+	unsigned long timeout;
 };
 
+/*
+ * A waiter at the head of the queue that has been waiting for longer than
+ * this (in jiffies) may request a lock handoff, see rwsem_set_handoff().
+ */
+#define RWSEM_WAIT_TIMEOUT	DIV_ROUND_UP(HZ, 250)
+
+enum rwsem_stat_item {
+	RWSEM_STAT_READ_CONTENDED,	/* down_read() hit the slowpath */
+	RWSEM_STAT_WRITE_CONTENDED,	/* down_write() hit the slowpath */
+	RWSEM_STAT_READ_SPIN,		/* reader acquired by spinning */
+	RWSEM_STAT_WRITE_SPIN,		/* writer acquired by spinning */
+	RWSEM_STAT_HANDOFF,		/* a starving waiter requested handoff */
+	NR_RWSEM_STAT_ITEMS
+};
+
+#ifdef CONFIG_RWSEM_STAT
+extern struct rwsem_stat_class *
+rwsem_stat_class_get(unsigned long ip, const char *name);
+extern void rwsem_stat_inc(struct rw_semaphore *sem,
+			   enum rwsem_stat_item item);
+extern void rwsem_stat_wait(struct rw_semaphore *sem,
+			    enum rwsem_waiter_type type, u64 start);
+
+static inline u64 rwsem_stat_clock(void)
+{
+	return local_clock();
+}
+#else
+static inline void rwsem_stat_inc(struct rw_semaphore *sem,
+				  enum rwsem_stat_item item)
+{
+}
+
+static inline void rwsem_stat_wait(struct rw_semaphore *sem,
+				   enum rwsem_waiter_type type, u64 start)
+{
+}
+
+static inline u64 rwsem_stat_clock(void)
+{
+	return 0;
+}
+#endif
+
 #ifdef CONFIG_RWSEM_SPIN_ON_OWNER
 /*
  * All writes to owner are protected by WRITE_ONCE() to make sure that
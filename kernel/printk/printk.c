@@ -42,6 +42,7 @@
 #include <linux/rculist.h>
 #include <linux/poll.h>
 #include <linux/irq_work.h>
+#include <linux/kthread.h>
 #include <linux/utsname.h>
 #include <linux/ctype.h>
 #include <linux/uio.h>
@@ -260,6 +261,76 @@ EXPORT_SYMBOL(console_set_on_cmdline);
 /* Flag: console code may call schedule() */
 static int console_may_schedule;
 
+/*
+ * Asynchronous console printing.
+ *
+ * With printk.async=1, printk() only stores the message in the log buffer
+ * and wakes printk_kthread, which then writes it to the consoles on the
+ * caller's behalf in time slices of at most PRINTK_KTHREAD_SLICE_MS. A
+ * task that happens to log a burst of messages therefore no longer pays
+ * for pushing them all through a slow serial console. Output is printed
+ * directly again as soon as an oops or panic is in progress, or once the
+ * system is going down.
+ */
+static bool __read_mostly printk_async;
+module_param_named(async, printk_async, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(async, "offload console output to a printing kthread");
+
+#define PRINTK_KTHREAD_SLICE_MS	10
+
+static struct task_struct *printk_kthread;
+
+/*
+ * Longest time a task other than printk_kthread spent printing to the
+ * consoles in one console_unlock() call, in nanoseconds. Writable so that
+ * it can be reset.
+ */
+static unsigned long long console_max_stall_ns;
+module_param(console_max_stall_ns, ullong, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(console_max_stall_ns,
+		 "max time a caller spent in console output (ns)");
+
+/*
+ * printk() may be called with scheduler locks held, so printk_kthread
+ * is woken from irq_work rather than directly.
+ */
+static void printk_kthread_wake(struct irq_work *irq_work)
+{
+	wake_up_process(printk_kthread);
+}
+
+static DEFINE_PER_CPU(struct irq_work, printk_kthread_work) = {
+	.func = printk_kthread_wake,
+};
+
+static inline bool printk_async_enabled(void)
+{
+	return printk_async && printk_kthread && !oops_in_progress &&
+	       system_state == SYSTEM_RUNNING;
+}
+
+/*
+ * Get pending log buffer content out to the consoles, either from the
+ * current context or by handing the job to printk_kthread.
+ */
+static void console_flush_or_offload(void)
+{
+	if (printk_async_enabled()) {
+		preempt_disable();
+		irq_work_queue(this_cpu_ptr(&printk_kthread_work));
+		preempt_enable();
+		return;
+	}
+
+	/*
+	 * Try to acquire and then immediately release the console
+	 * semaphore.  The release will print out buffers and wake up
+	 * /dev/kmsg and syslog() users.
+	 */
+	if (console_trylock())
+		console_unlock();
+}
+
 /*
  * The printk log buffer consists of a chain of concatenated variable
  * length records. Every record starts with a record header, containing
@@ -2034,13 +2105,7 @@ asmlinkage int vprintk_emit(int facility, int level,
 	/* If called from the scheduler, we can not call up(). */
 	if (!in_sched) {
 		lockdep_off();
-		/*
-		 * Try to acquire and then immediately release the console
-		 * semaphore.  The release will print out buffers and wake up
-		 * /dev/kmsg and syslog() users.
-		 */
-		if (console_trylock())
-			console_unlock();
+		console_flush_or_offload();
 		lockdep_on();
 	}
 
@@ -2307,6 +2372,8 @@ void resume_console(void)
 	down_console_sem();
 	console_suspended = 0;
 	console_unlock();
+	if (printk_kthread)
+		wake_up_process(printk_kthread);
 }
 
 /**
@@ -2480,6 +2547,9 @@ void console_unlock(void)
 	unsigned long flags;
 	bool wake_klogd = false;
 	bool do_cond_resched, retry;
+	bool is_printk_kthread = current == printk_kthread;
+	unsigned long slice_end;
+	u64 start = 0;
 
 	if (console_suspended) {
 		up_console_sem();
@@ -2501,6 +2571,9 @@ void console_unlock(void)
 	 * and cleared after the the "again" goto label.
 	 */
 	do_cond_resched = console_may_schedule;
+	slice_end = jiffies + msecs_to_jiffies(PRINTK_KTHREAD_SLICE_MS);
+	if (!is_printk_kthread)
+		start = local_clock();
 again:
 	console_may_schedule = 0;
 
@@ -2512,7 +2585,7 @@ again:
 	if (!can_use_console()) {
 		console_locked = 0;
 		up_console_sem();
-		return;
+		goto out;
 	}
 
 	/* flush buffered message fragment immediately to console */
@@ -2544,6 +2617,14 @@ skip:
 		if (console_seq == log_next_seq)
 			break;
 
+		/*
+		 * The printing kthread gives up the console once its time
+		 * slice is used up and is woken again below, so that a long
+		 * backlog doesn't monopolize the console_sem.
+		 */
+		if (is_printk_kthread && time_after(jiffies, slice_end))
+			break;
+
 		msg = log_from_idx(console_idx);
 		level = msg->level;
 		if ((msg->flags & LOG_NOCONS) ||
@@ -2606,11 +2687,22 @@ skip:
 	retry = console_seq != log_next_seq;
 	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
 
-	if (retry && console_trylock())
+	/*
+	 * The printing kthread comes back for the rest by itself, after
+	 * giving others a chance to run.
+	 */
+	if (retry && !is_printk_kthread && console_trylock())
 		goto again;
 
 	if (wake_klogd)
 		wake_up_klogd();
+out:
+	if (!is_printk_kthread) {
+		u64 delta = local_clock() - start;
+
+		if (delta > READ_ONCE(console_max_stall_ns))
+			WRITE_ONCE(console_max_stall_ns, delta);
+	}
 }
 EXPORT_SYMBOL(console_unlock);
 
@@ -2950,6 +3042,65 @@ int unregister_console(struct console *console)
 }
 EXPORT_SYMBOL(unregister_console);
 
+static bool printk_kthread_pending(void)
+{
+	unsigned long flags;
+	bool pending;
+
+	raw_spin_lock_irqsave(&logbuf_lock, flags);
+	pending = console_seq != log_next_seq;
+	raw_spin_unlock_irqrestore(&logbuf_lock, flags);
+
+	return pending;
+}
+
+static int printk_kthread_func(void *data)
+{
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!printk_kthread_pending())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		/*
+		 * console_lock() allows console_unlock() to reschedule
+		 * between records, and the time slice check in there makes
+		 * us drop the console_sem every PRINTK_KTHREAD_SLICE_MS.
+		 */
+		console_lock();
+		if (console_suspended) {
+			/*
+			 * Nothing can be printed until resume_console(),
+			 * which wakes us. Go to sleep before dropping the
+			 * console_sem so that wakeup can't be missed.
+			 */
+			set_current_state(TASK_INTERRUPTIBLE);
+			up_console_sem();
+			schedule();
+			continue;
+		}
+		console_unlock();
+		cond_resched();
+	}
+
+	return 0;
+}
+
+static void __init printk_kthread_init(void)
+{
+	struct task_struct *tsk;
+
+	if (!IS_ENABLED(CONFIG_PRINTK))
+		return;
+
+	tsk = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(tsk)) {
+		pr_err("printk: failed to start printing kthread, printing synchronously\n");
+		return;
+	}
+	printk_kthread = tsk;
+}
+
 /*
  * Some boot consoles access data that is in the init section and which will
  * be discarded after the initcalls have been run. To make sure that no code
@@ -2983,6 +3134,7 @@ static int __init printk_late_init(void)
 		}
 	}
 	hotcpu_notifier(console_cpu_notify, 0);
+	printk_kthread_init();
 	return 0;
 }
 late_initcall(printk_late_init);
@@ -3002,8 +3154,7 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
 		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
-			console_unlock();
+		console_flush_or_offload();
 	}
 
 	if (pending & PRINTK_PENDING_WAKEUP)
@@ -55,6 +55,8 @@
 #include <linux/random.h>
 #include <linux/trace_events.h>
 #include <linux/suspend.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
 #include <linux/exynos-ss.h>
 
 #include "tree.h"
@@ -3223,19 +3225,311 @@ void call_rcu_bh(struct rcu_head *head, rcu_callback_t func)
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
 /*
- * Queue an RCU callback for lazy invocation after a grace period.
- * This will likely be later named something like "call_rcu_lazy()",
- * but this change will require some way of tagging the lazy RCU
- * callbacks in the list of pending callbacks. Until then, this
- * function may only be called from __kfree_rcu().
+ * Batched kfree_rcu().
+ *
+ * Rather than queueing every kfree_rcu() object as an individual lazy
+ * callback, kfree_call_rcu() stashes the object pointers in per-CPU
+ * page-sized arrays.  Every KFREE_DRAIN_JIFFIES the accumulated arrays are
+ * handed to one of KFREE_N_BATCHES "channels", which waits for a single
+ * grace period on behalf of the whole batch and then releases it from
+ * process context with kfree_bulk().  If no page can be allocated for an
+ * array, the rcu_head is chained on a per-CPU list instead and freed the
+ * classic way once the batch's grace period has elapsed.
+ */
+
+/* Maximum number of jiffies to wait before draining a batch. */
+#define KFREE_DRAIN_JIFFIES (HZ / 50)
+#define KFREE_N_BATCHES 2
+
+/*
+ * A page-sized array of pointers to objects waiting to be kfree()d.
+ */
+struct kfree_rcu_bulk_data {
+	unsigned long nr_records;
+	struct kfree_rcu_bulk_data *next;
+	void *records[];
+};
+
+#define KFREE_BULK_MAX_ENTR \
+	((PAGE_SIZE - sizeof(struct kfree_rcu_bulk_data)) / sizeof(void *))
+
+/*
+ * One batch of objects in flight: waiting for its grace period or for
+ * the work that frees it.  A channel is free again once both of its
+ * lists have been taken by kfree_rcu_work().
+ */
+struct kfree_rcu_cpu_work {
+	struct rcu_head rcu;
+	struct work_struct work;
+	struct kfree_rcu_bulk_data *bhead_free;
+	struct rcu_head *head_free;
+	struct kfree_rcu_cpu *krcp;
+};
+
+/*
+ * Per-CPU batching state.  @bhead and @head accumulate new objects,
+ * @bcached keeps one spare array page around so that a steady stream of
+ * kfree_rcu() calls doesn't keep going back to the page allocator.
+ * @nr_queued and @nr_fallback count the objects in the current batch,
+ * and how many of those had to be chained on @head.
+ */
+struct kfree_rcu_cpu {
+	struct rcu_head *head;
+	struct kfree_rcu_bulk_data *bhead;
+	struct kfree_rcu_bulk_data *bcached;
+	struct kfree_rcu_cpu_work krw_arr[KFREE_N_BATCHES];
+	spinlock_t lock;
+	struct delayed_work monitor_work;
+	unsigned long nr_queued;
+	unsigned long nr_fallback;
+	bool monitor_todo;
+	bool initialized;
+};
+
+static DEFINE_PER_CPU(struct kfree_rcu_cpu, krc);
+
+/*
+ * Invoked in process context once a batch's grace period has elapsed.
+ */
+static void kfree_rcu_work(struct work_struct *work)
+{
+	unsigned long flags;
+	struct rcu_head *head, *next;
+	struct kfree_rcu_bulk_data *bhead, *bnext;
+	struct kfree_rcu_cpu_work *krwp;
+	struct kfree_rcu_cpu *krcp;
+
+	krwp = container_of(work, struct kfree_rcu_cpu_work, work);
+	krcp = krwp->krcp;
+	spin_lock_irqsave(&krcp->lock, flags);
+	head = krwp->head_free;
+	krwp->head_free = NULL;
+	bhead = krwp->bhead_free;
+	krwp->bhead_free = NULL;
+	spin_unlock_irqrestore(&krcp->lock, flags);
+
+	/* Release the pointer arrays first, recycling one of the pages. */
+	for (; bhead; bhead = bnext) {
+		bnext = bhead->next;
+
+		rcu_lock_acquire(&rcu_callback_map);
+		trace_rcu_invoke_kfree_bulk_callback(rcu_state_p->name,
+						     bhead->nr_records,
+						     bhead->records);
+		kfree_bulk(bhead->nr_records, bhead->records);
+		rcu_lock_release(&rcu_callback_map);
+
+		bhead->nr_records = 0;
+		bhead->next = NULL;
+		if (cmpxchg(&krcp->bcached, NULL, bhead))
+			free_page((unsigned long)bhead);
+
+		cond_resched();
+	}
+
+	/* Then the objects that could not be put in an array. */
+	for (; head; head = next) {
+		next = head->next;
+		debug_rcu_head_unqueue(head);
+		__rcu_reclaim(rcu_state_p->name, head);
+		cond_resched();
+	}
+}
+
+/*
+ * Grace-period callback for a batch: defer the actual freeing to process
+ * context so that large batches don't bloat RCU softirq time.
+ */
+static void kfree_rcu_batch_gp_done(struct rcu_head *rhp)
+{
+	struct kfree_rcu_cpu_work *krwp =
+		container_of(rhp, struct kfree_rcu_cpu_work, rcu);
+
+	queue_work(system_wq, &krwp->work);
+}
+
+/*
+ * Hand the accumulated objects over to a free channel and start a grace
+ * period for them.  Returns false if every channel is still busy with an
+ * earlier batch, in which case the caller must retry later.  Called with
+ * krcp->lock held.
+ */
+static bool queue_kfree_rcu_work(struct kfree_rcu_cpu *krcp)
+{
+	struct kfree_rcu_cpu_work *krwp;
+	int i;
+
+	lockdep_assert_held(&krcp->lock);
+
+	for (i = 0; i < KFREE_N_BATCHES; i++) {
+		krwp = &krcp->krw_arr[i];
+
+		if (krwp->bhead_free || krwp->head_free)
+			continue;
+
+		krwp->bhead_free = krcp->bhead;
+		krcp->bhead = NULL;
+		krwp->head_free = krcp->head;
+		krcp->head = NULL;
+
+		trace_rcu_kfree_batch(rcu_state_p->name, krcp->nr_queued,
+				      krcp->nr_fallback);
+		krcp->nr_queued = 0;
+		krcp->nr_fallback = 0;
+
+		call_rcu(&krwp->rcu, kfree_rcu_batch_gp_done);
+		return true;
+	}
+
+	return false;
+}
+
+static inline void kfree_rcu_drain_unlock(struct kfree_rcu_cpu *krcp,
+					  unsigned long flags)
+{
+	/* Attempt to start a new batch. */
+	krcp->monitor_todo = false;
+	if (queue_kfree_rcu_work(krcp)) {
+		/* Success! Our job is done here. */
+		spin_unlock_irqrestore(&krcp->lock, flags);
+		return;
+	}
+
+	/* Previous batches still in progress, try again later. */
+	krcp->monitor_todo = true;
+	schedule_delayed_work(&krcp->monitor_work, KFREE_DRAIN_JIFFIES);
+	spin_unlock_irqrestore(&krcp->lock, flags);
+}
+
+/*
+ * Periodically drain the per-CPU batch so that objects don't wait for
+ * longer than KFREE_DRAIN_JIFFIES before their grace period starts.
+ */
+static void kfree_rcu_monitor(struct work_struct *work)
+{
+	unsigned long flags;
+	struct kfree_rcu_cpu *krcp = container_of(work, struct kfree_rcu_cpu,
+						 monitor_work.work);
+
+	spin_lock_irqsave(&krcp->lock, flags);
+	if (krcp->monitor_todo)
+		kfree_rcu_drain_unlock(krcp, flags);
+	else
+		spin_unlock_irqrestore(&krcp->lock, flags);
+}
+
+/*
+ * Try to record @ptr in the current pointer array, starting a new array
+ * if needed.  Returns false if no array page could be had, in which case
+ * the caller falls back to chaining the rcu_head.
+ */
+static inline bool kfree_call_rcu_add_ptr_to_bulk(struct kfree_rcu_cpu *krcp,
+						  void *ptr)
+{
+	struct kfree_rcu_bulk_data *bnode;
+
+	if (!krcp->bhead || krcp->bhead->nr_records == KFREE_BULK_MAX_ENTR) {
+		bnode = xchg(&krcp->bcached, NULL);
+		if (!bnode)
+			bnode = (struct kfree_rcu_bulk_data *)
+				__get_free_page(GFP_NOWAIT | __GFP_NOWARN);
+		if (!bnode)
+			return false;
+
+		bnode->nr_records = 0;
+		bnode->next = krcp->bhead;
+		krcp->bhead = bnode;
+	}
+
+	krcp->bhead->records[krcp->bhead->nr_records++] = ptr;
+	return true;
+}
+
+/*
+ * Queue an object for kfree() after a grace period.  The object is added
+ * to the current CPU's batch, which is drained at most KFREE_DRAIN_JIFFIES
+ * later, so a whole batch shares one grace period and one kfree_bulk().
+ * This function may only be called from __kfree_rcu().
  */
 void kfree_call_rcu(struct rcu_head *head,
 		    rcu_callback_t func)
 {
-	__call_rcu(head, func, rcu_state_p, -1, 1);
+	unsigned long flags;
+	struct kfree_rcu_cpu *krcp;
+	void *ptr = (void *)head - (unsigned long)func;
+
+	local_irq_save(flags);	/* For safely calling this_cpu_ptr(). */
+	krcp = this_cpu_ptr(&krc);
+	if (unlikely(!READ_ONCE(krcp->initialized))) {
+		/* Too early in boot for batching, queue a lazy callback. */
+		local_irq_restore(flags);
+		__call_rcu(head, func, rcu_state_p, -1, 1);
+		return;
+	}
+	spin_lock(&krcp->lock);
+
+	if (debug_rcu_head_queue(head)) {
+		/* Probable double kfree_rcu(), so leak the object. */
+		WARN_ONCE(1, "kfree_call_rcu(): Leaked duplicate callback\n");
+		goto unlock_return;
+	}
+
+	if (!kfree_call_rcu_add_ptr_to_bulk(krcp, ptr)) {
+		head->func = func;
+		head->next = krcp->head;
+		krcp->head = head;
+		krcp->nr_fallback++;
+	} else {
+		/* The rcu_head itself is freed along with the object. */
+		debug_rcu_head_unqueue(head);
+	}
+
+	krcp->nr_queued++;
+
+	/* Schedule the drain of this batch if that isn't pending already. */
+	if (!krcp->monitor_todo) {
+		krcp->monitor_todo = true;
+		schedule_delayed_work(&krcp->monitor_work, KFREE_DRAIN_JIFFIES);
+	}
+
+unlock_return:
+	spin_unlock(&krcp->lock);
+	local_irq_restore(flags);
 }
 EXPORT_SYMBOL_GPL(kfree_call_rcu);
 
+static void __init kfree_rcu_batch_init(void)
+{
+	int cpu;
+	int i;
+
+	for_each_possible_cpu(cpu) {
+		struct kfree_rcu_cpu *krcp = per_cpu_ptr(&krc, cpu);
+
+		spin_lock_init(&krcp->lock);
+		for (i = 0; i < KFREE_N_BATCHES; i++) {
+			INIT_WORK(&krcp->krw_arr[i].work, kfree_rcu_work);
+			krcp->krw_arr[i].krcp = krcp;
+		}
+		INIT_DELAYED_WORK(&krcp->monitor_work, kfree_rcu_monitor);
+	}
+}
+
+/*
+ * Batching needs workqueues to schedule the drain, which rcu_init() runs
+ * too early for.  Until this is invoked, kfree_call_rcu() falls back to
+ * queueing a callback.
+ */
+static int __init kfree_rcu_batch_enable(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		WRITE_ONCE(per_cpu_ptr(&krc, cpu)->initialized, true);
+	return 0;
+}
+early_initcall(kfree_rcu_batch_enable);
+
 /*
  * Because a context switch is a grace period for RCU-sched and RCU-bh,
  * any blocking grace-period wait automatically implies a grace period
@@ -3716,6 +4010,40 @@ static void _rcu_barrier(struct rcu_state *rsp)
 	mutex_unlock(&rsp->barrier_mutex);
 }
 
+/*
+ * Wait for an RCU grace period and for every object queued with
+ * kfree_call_rcu() before the call to have been freed, so that
+ * rcu_barrier() keeps covering kfree_rcu() the way it did when each
+ * object was an individual callback.  Two rounds are needed: objects
+ * left behind in the first one because every channel was still busy
+ * are guaranteed to find a free channel in the second.
+ */
+static void kfree_rcu_barrier(struct rcu_state *rsp)
+{
+	struct kfree_rcu_cpu *krcp;
+	int cpu, i, pass;
+
+	for (pass = 0; pass < 2; pass++) {
+		for_each_possible_cpu(cpu) {
+			krcp = per_cpu_ptr(&krc, cpu);
+			if (!READ_ONCE(krcp->initialized))
+				continue;
+			mod_delayed_work(system_wq, &krcp->monitor_work, 0);
+			flush_delayed_work(&krcp->monitor_work);
+		}
+
+		_rcu_barrier(rsp);
+
+		for_each_possible_cpu(cpu) {
+			krcp = per_cpu_ptr(&krc, cpu);
+			if (!READ_ONCE(krcp->initialized))
+				continue;
+			for (i = 0; i < KFREE_N_BATCHES; i++)
+				flush_work(&krcp->krw_arr[i].work);
+		}
+	}
+}
+
 /**
  * rcu_barrier_bh - Wait until all in-flight call_rcu_bh() callbacks complete.
  */
@@ -4262,6 +4590,8 @@ void __init rcu_init(void)
 		rcutree_prepare_cpu(cpu);
 		rcu_cpu_starting(cpu);
 	}
+
+	kfree_rcu_batch_init();
 }
 
 #include "tree_exp.h"
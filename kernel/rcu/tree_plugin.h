@@ -692,10 +692,12 @@ EXPORT_SYMBOL_GPL(synchronize_rcu);
  * to complete.  For example, if there are no RCU callbacks queued anywhere
  * in the system, then rcu_barrier() is within its rights to return
  * immediately, without waiting for anything, much less an RCU grace period.
+ * Objects passed to kfree_rcu() before the call are freed by the time it
+ * returns.
  */
 void rcu_barrier(void)
 {
-	_rcu_barrier(rcu_state_p);
+	kfree_rcu_barrier(rcu_state_p);
 }
 EXPORT_SYMBOL_GPL(rcu_barrier);
 
@@ -810,11 +812,11 @@ static void rcu_preempt_check_callbacks(void)
 
 /*
  * Because preemptible RCU does not exist, rcu_barrier() is just
- * another name for rcu_barrier_sched().
+ * rcu_barrier_sched() that also waits for batched kfree_rcu() objects.
  */
 void rcu_barrier(void)
 {
-	rcu_barrier_sched();
+	kfree_rcu_barrier(rcu_state_p);
 }
 EXPORT_SYMBOL_GPL(rcu_barrier);
 
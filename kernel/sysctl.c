@@ -66,6 +66,7 @@
 #include <linux/kexec.h>
 #include <linux/bpf.h>
 #include <linux/mount.h>
+#include <linux/pte_share.h>
 
 #include <linux/uaccess.h>
 #include <asm/processor.h>
@@ -1551,6 +1552,15 @@ static struct ctl_table vm_table[] = {
 		.proc_handler	= proc_dointvec_minmax,
 		.extra1		= &zero,
 	},
+#endif
+#ifdef CONFIG_FORK_SHARE_PTE
+	{
+		.procname	= "fork_share_pte_kb",
+		.data		= &sysctl_fork_share_pte_kb,
+		.maxlen		= sizeof(sysctl_fork_share_pte_kb),
+		.mode		= 0644,
+		.proc_handler	= proc_doulongvec_minmax,
+	},
 #endif
 	{
 		.procname	= "laptop_mode",
@@ -51,6 +51,7 @@
 #include <asm/io.h>
 
 #include "tick-internal.h"
+#include "timer_migration.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/timer.h>
@@ -178,18 +179,22 @@ EXPORT_SYMBOL(jiffies_64);
 #define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
 
 /*
- * The resulting wheel size. If NOHZ is configured we allocate two
- * wheels so we have a separate storage for the deferrable timers.
+ * The resulting wheel size. If NOHZ is configured we allocate three
+ * wheels: pinned timers, the global ones that an idle CPU may leave to
+ * another CPU to expire (see timer_migration.c), and a separate storage
+ * for the deferrable timers.
  */
 #define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
 
 #ifdef CONFIG_NO_HZ_COMMON
-# define NR_BASES	2
-# define BASE_STD	0
-# define BASE_DEF	1
+# define NR_BASES	3
+# define BASE_LOCAL	0
+# define BASE_GLOBAL	1
+# define BASE_DEF	2
 #else
 # define NR_BASES	1
-# define BASE_STD	0
+# define BASE_LOCAL	0
+# define BASE_GLOBAL	0
 # define BASE_DEF	0
 #endif
 
@@ -218,19 +223,33 @@ void timers_update_migration(bool update_nohz)
 	unsigned int cpu;
 
 	/* Avoid the loop, if nothing to update */
-	if (this_cpu_read(timer_bases[BASE_STD].migration_enabled) == on)
+	if (this_cpu_read(timer_bases[BASE_LOCAL].migration_enabled) == on)
 		return;
 
 	for_each_possible_cpu(cpu) {
-		per_cpu(timer_bases[BASE_STD].migration_enabled, cpu) = on;
+		per_cpu(timer_bases[BASE_LOCAL].migration_enabled, cpu) = on;
+		per_cpu(timer_bases[BASE_GLOBAL].migration_enabled, cpu) = on;
 		per_cpu(timer_bases[BASE_DEF].migration_enabled, cpu) = on;
 		per_cpu(hrtimer_bases.migration_enabled, cpu) = on;
 		if (!update_nohz)
 			continue;
-		per_cpu(timer_bases[BASE_STD].nohz_active, cpu) = true;
+		per_cpu(timer_bases[BASE_LOCAL].nohz_active, cpu) = true;
+		per_cpu(timer_bases[BASE_GLOBAL].nohz_active, cpu) = true;
 		per_cpu(timer_bases[BASE_DEF].nohz_active, cpu) = true;
 		per_cpu(hrtimer_bases.nohz_active, cpu) = true;
 	}
+
+	/*
+	 * CPUs that went idle with migration on left their global timers
+	 * to the last active CPU, which no longer looks after them. Kick
+	 * them out of idle so that they take their timers back.
+	 */
+	if (!on) {
+		preempt_disable();
+		for_each_online_cpu(cpu)
+			wake_up_nohz_cpu(cpu);
+		preempt_enable();
+	}
 }
 
 int timer_migration_handler(struct ctl_table *table, int write,
@@ -845,30 +864,26 @@ static int detach_if_pending(struct timer_list *timer, struct timer_base *base,
 	return 1;
 }
 
-static inline struct timer_base *get_timer_cpu_base(u32 tflags, u32 cpu)
+static inline unsigned int get_timer_base_index(u32 tflags)
 {
-	struct timer_base *base = per_cpu_ptr(&timer_bases[BASE_STD], cpu);
-
 	/*
 	 * If the timer is deferrable and NO_HZ_COMMON is set then we need
-	 * to use the deferrable base.
+	 * to use the deferrable base. Otherwise pinned timers go to the
+	 * local base, and all others to the global one.
 	 */
 	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && (tflags & TIMER_DEFERRABLE))
-		base = per_cpu_ptr(&timer_bases[BASE_DEF], cpu);
-	return base;
+		return BASE_DEF;
+	return tflags & TIMER_PINNED ? BASE_LOCAL : BASE_GLOBAL;
 }
 
-static inline struct timer_base *get_timer_this_cpu_base(u32 tflags)
+static inline struct timer_base *get_timer_cpu_base(u32 tflags, u32 cpu)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	return per_cpu_ptr(&timer_bases[get_timer_base_index(tflags)], cpu);
+}
 
-	/*
-	 * If the timer is deferrable and NO_HZ_COMMON is set then we need
-	 * to use the deferrable base.
-	 */
-	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && (tflags & TIMER_DEFERRABLE))
-		base = this_cpu_ptr(&timer_bases[BASE_DEF]);
-	return base;
+static inline struct timer_base *get_timer_this_cpu_base(u32 tflags)
+{
+	return this_cpu_ptr(&timer_bases[get_timer_base_index(tflags)]);
 }
 
 static inline struct timer_base *get_timer_base(u32 tflags)
@@ -1134,6 +1149,9 @@ EXPORT_SYMBOL(add_timer);
  * @timer: the timer to be added
  * @cpu: the CPU to start it on
  *
+ * The timer is marked TIMER_PINNED, so that it is expired by @cpu even
+ * when @cpu is idle.
+ *
  * This is not very scalable on SMP. Double adds are not possible.
  */
 void add_timer_on(struct timer_list *timer, int cpu)
@@ -1144,7 +1162,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	timer_stats_timer_set_start_info(timer);
 	BUG_ON(timer_pending(timer) || !timer->function);
 
-	new_base = get_timer_cpu_base(timer->flags, cpu);
+	new_base = get_timer_cpu_base(timer->flags | TIMER_PINNED, cpu);
 
 	/*
 	 * If @timer was on a different CPU, it should be migrated with the
@@ -1159,7 +1177,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 		base = new_base;
 		spin_lock(&base->lock);
 		WRITE_ONCE(timer->flags,
-			   (timer->flags & ~TIMER_BASEMASK) | cpu);
+			   (timer->flags & ~TIMER_BASEMASK) | cpu | TIMER_PINNED);
 	}
 	forward_timer_base(base);
 
@@ -1507,6 +1525,37 @@ static u64 cmp_next_hrtimer_event(u64 basem, u64 expires)
 	return DIV_ROUND_UP_ULL(nextevt, TICK_NSEC) * TICK_NSEC;
 }
 
+/*
+ * Find the next expiry of @base, store it in base->next_expiry and forward
+ * base->clk if possible. Returns it in clock monotonic, or KTIME_MAX if no
+ * timer is pending. Caller must hold base->lock.
+ */
+static u64 next_timer_base(struct timer_base *base, unsigned long basej,
+			   u64 basem)
+{
+	unsigned long nextevt = __next_timer_interrupt(base);
+	bool is_max_delta = (nextevt == base->clk + NEXT_TIMER_MAX_DELTA);
+
+	base->next_expiry = nextevt;
+	/*
+	 * We have a fresh next event. Check whether we can forward the
+	 * base. We can only do that when @basej is past base->clk
+	 * otherwise we might rewind base->clk.
+	 */
+	if (time_after(basej, base->clk)) {
+		if (time_after(nextevt, basej))
+			base->clk = basej;
+		else if (time_after(nextevt, base->clk))
+			base->clk = nextevt;
+	}
+
+	if (time_before_eq(nextevt, basej))
+		return basem;
+	if (is_max_delta)
+		return KTIME_MAX;
+	return basem + (u64)(nextevt - basej) * TICK_NSEC;
+}
+
 /**
  * get_next_timer_interrupt - return the time (clock mono) of the next timer
  * @basej:	base time jiffies
@@ -1517,53 +1566,56 @@ static u64 cmp_next_hrtimer_event(u64 basem, u64 expires)
  */
 u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
-	u64 expires = KTIME_MAX;
-	unsigned long nextevt;
-	bool is_max_delta;
+	struct timer_base *base_local = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
+	struct timer_base *base_global = this_cpu_ptr(&timer_bases[BASE_GLOBAL]);
+	u64 expires, expires_global;
 
 	/*
 	 * Pretend that there is no timer pending if the cpu is offline.
 	 * Possible pending timers will be migrated later to an active cpu.
 	 */
 	if (cpu_is_offline(smp_processor_id()))
-		return expires;
+		return KTIME_MAX;
 
-	spin_lock(&base->lock);
-	nextevt = __next_timer_interrupt(base);
-	is_max_delta = (nextevt == base->clk + NEXT_TIMER_MAX_DELTA);
-	base->next_expiry = nextevt;
-	/*
-	 * We have a fresh next event. Check whether we can forward the
-	 * base. We can only do that when @basej is past base->clk
-	 * otherwise we might rewind base->clk.
-	 */
-	if (time_after(basej, base->clk)) {
-		if (time_after(nextevt, basej))
-			base->clk = basej;
-		else if (time_after(nextevt, base->clk))
-			base->clk = nextevt;
-	}
+	spin_lock(&base_local->lock);
+	spin_lock_nested(&base_global->lock, SINGLE_DEPTH_NESTING);
+
+	expires = next_timer_base(base_local, basej, basem);
+	expires_global = next_timer_base(base_global, basej, basem);
 
-	if (time_before_eq(nextevt, basej)) {
+	if (min(expires, expires_global) == basem) {
 		expires = basem;
-		base->is_idle = false;
-	} else {
-		if (!is_max_delta)
-			expires = basem + (u64)(nextevt - basej) * TICK_NSEC;
+		base_local->is_idle = false;
+		base_global->is_idle = false;
+	} else if (min(expires, expires_global) - basem > TICK_NSEC) {
 		/*
-		 * If we expect to sleep more than a tick, mark the base idle.
-		 * Also the tick is stopped so any added timer must forward
-		 * the base clk itself to keep granularity small. This idle
-		 * logic is only maintained for the BASE_STD base, deferrable
-		 * timers may still see large granularity skew (by design).
+		 * If we expect to sleep more than a tick, mark the bases
+		 * idle. Also the tick is stopped so any added timer must
+		 * forward the base clk itself to keep granularity small.
+		 * This idle logic is only maintained for the local and
+		 * global bases, deferrable timers may still see large
+		 * granularity skew (by design).
 		 */
-		if ((expires - basem) > TICK_NSEC) {
-			base->must_forward_clk = true;
-			base->is_idle = true;
-		}
+		base_local->must_forward_clk = true;
+		base_local->is_idle = true;
+		base_global->must_forward_clk = true;
+		base_global->is_idle = true;
+
+		/*
+		 * Unless this is the last active CPU, the global timers are
+		 * left to an active one, and only the pinned timers need to
+		 * wake this CPU up. The last one wakes up for everybody's.
+		 * With timer migration disabled, each CPU keeps to its own.
+		 */
+		if (base_global->migration_enabled)
+			expires_global = tmigr_cpu_deactivate(basem,
+							      expires_global);
+		expires = min(expires, expires_global);
+	} else {
+		expires = min(expires, expires_global);
 	}
-	spin_unlock(&base->lock);
+	spin_unlock(&base_global->lock);
+	spin_unlock(&base_local->lock);
 
 	return cmp_next_hrtimer_event(basem, expires);
 }
@@ -1575,15 +1627,16 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
  */
 void timer_clear_idle(void)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
-
 	/*
 	 * We do this unlocked. The worst outcome is a remote enqueue sending
 	 * a pointless IPI, but taking the lock would just make the window for
 	 * sending the IPI a few instructions smaller for the cost of taking
 	 * the lock in the exit from idle path.
 	 */
-	base->is_idle = false;
+	__this_cpu_write(timer_bases[BASE_LOCAL].is_idle, false);
+	__this_cpu_write(timer_bases[BASE_GLOBAL].is_idle, false);
+
+	tmigr_cpu_activate();
 }
 
 static int collect_expired_timers(struct timer_base *base,
@@ -1642,24 +1695,40 @@ void update_process_times(int user_tick)
 }
 
 /**
- * __run_timers - run all expired timers (if any) on this CPU.
+ * __run_timers - run all expired timers (if any) of a CPU.
  * @base: the timer vector to be processed.
+ *
+ * This is normally the running CPU's, but can be the global base of an
+ * idle CPU, see timer_expire_remote(). Returns whether any timer expired.
  */
-static inline void __run_timers(struct timer_base *base)
+static inline bool __run_timers(struct timer_base *base)
 {
 	struct hlist_head heads[LVL_DEPTH];
+	bool expired = false;
 	int levels;
 
 	if (!time_after_eq(jiffies, base->clk))
-		return;
+		return false;
 
 	spin_lock_irq(&base->lock);
 
+	/*
+	 * Another CPU is already running the timers of this base: it is
+	 * either the owner coming out of idle or the CPU expiring them on
+	 * the owner's behalf. Leave it to that one, it rechecks jiffies
+	 * before it is done and running_timer must stay accurate for
+	 * del_timer_sync().
+	 */
+	if (base->running_timer) {
+		spin_unlock_irq(&base->lock);
+		return false;
+	}
+
 	/*
 	 * timer_base::must_forward_clk must be cleared before running
 	 * timers so that any timer functions that call mod_timer() will
 	 * not try to forward the base. Idle tracking / clock forwarding
-	 * logic is only used with BASE_STD timers.
+	 * logic is only used with the local and global bases.
 	 *
 	 * The must_forward_clk flag is cleared unconditionally also for
 	 * the deferrable base. The deferrable base is not affected by idle
@@ -1675,24 +1744,59 @@ static inline void __run_timers(struct timer_base *base)
 
 		levels = collect_expired_timers(base, heads);
 		base->clk++;
+		if (levels)
+			expired = true;
 
 		while (levels--)
 			expire_timers(base, heads + levels);
 	}
 	base->running_timer = NULL;
 	spin_unlock_irq(&base->lock);
+
+	return expired;
+}
+
+#if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON)
+/**
+ * timer_expire_remote - run the expired global timers of an idle CPU
+ * @cpu:	the idle CPU
+ *
+ * Called from the timer softirq of the CPU that expires global timers on
+ * behalf of @cpu. Returns the next expiry of the global timers of @cpu
+ * in clock monotonic, or KTIME_MAX if none is pending. @expired is set
+ * to whether any of them actually ran here.
+ */
+u64 timer_expire_remote(unsigned int cpu, bool *expired)
+{
+	struct timer_base *base = per_cpu_ptr(&timer_bases[BASE_GLOBAL], cpu);
+	unsigned long basej;
+	u64 basem, expires;
+
+	*expired = __run_timers(base);
+
+	spin_lock_irq(&base->lock);
+	/* @cpu is still idle, keep forwarding the clock on enqueue */
+	base->must_forward_clk = base->is_idle;
+	basej = jiffies;
+	basem = ktime_get_ns();
+	expires = next_timer_base(base, basej, basem);
+	spin_unlock_irq(&base->lock);
+
+	return expires;
 }
+#endif
 
 /*
  * This function runs timers and the timer-tq in bottom half context.
  */
 static __latent_entropy void run_timer_softirq(struct softirq_action *h)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
-
-	__run_timers(base);
-	if (IS_ENABLED(CONFIG_NO_HZ_COMMON))
+	__run_timers(this_cpu_ptr(&timer_bases[BASE_LOCAL]));
+	if (IS_ENABLED(CONFIG_NO_HZ_COMMON)) {
+		__run_timers(this_cpu_ptr(&timer_bases[BASE_GLOBAL]));
 		__run_timers(this_cpu_ptr(&timer_bases[BASE_DEF]));
+		tmigr_handle_remote();
+	}
 }
 
 /*
@@ -1700,19 +1804,23 @@ static __latent_entropy void run_timer_softirq(struct softirq_action *h)
  */
 void run_local_timers(void)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_LOCAL]);
+	int b;
 
 	hrtimer_run_queues();
-	/* Raise the softirq only if required. */
-	if (time_before(jiffies, base->clk)) {
-		if (!IS_ENABLED(CONFIG_NO_HZ_COMMON))
-			return;
-		/* CPU is awake, so check the deferrable base. */
-		base++;
-		if (time_before(jiffies, base->clk))
+	/*
+	 * Raise the softirq only if required. The CPU is awake, so this
+	 * includes the deferrable base, and the global timers of idle CPUs
+	 * it is in charge of.
+	 */
+	for (b = 0; b < NR_BASES; b++, base++) {
+		if (time_after_eq(jiffies, base->clk)) {
+			raise_softirq(TIMER_SOFTIRQ);
 			return;
+		}
 	}
-	raise_softirq(TIMER_SOFTIRQ);
+	if (tmigr_requires_handle_remote())
+		raise_softirq(TIMER_SOFTIRQ);
 }
 
 #ifdef __ARCH_WANT_SYS_ALARM
@@ -0,0 +1,548 @@
+/*
+ * Pull model for the expiry of the global timers of idle CPUs
+ *
+ * Timers that are not pinned to a CPU ("global" timers) are kept in their
+ * own wheel. A CPU going idle does not have to wake up for them as long as
+ * another CPU of its group (the CPUs of a cluster) is active: one of the
+ * active CPUs, the group's migrator, expires them on its behalf from its
+ * own tick. Once all CPUs of a cluster are idle, the migrator of the top
+ * level, a CPU in a cluster that is still active, takes over, so that the
+ * idle cluster is not woken up at all. Only the last active CPU in the
+ * system takes the earliest global timer of everyone into account when it
+ * goes idle itself.
+ *
+ * Pinned timers, and deferrable ones, are still expired by their own CPU.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/cpuhotplug.h>
+#include <linux/cpumask.h>
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/rculist.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/topology.h>
+
+#include "timer_migration.h"
+
+/**
+ * struct tmigr_group - a cluster of CPUs, or the top level of clusters
+ * @lock:	protects the fields below, and the idle state of the children
+ * @list:	entry in the children of the top level
+ * @children:	the clusters, for the top level
+ * @cpus:	the online CPUs, for a cluster
+ * @id:		physical package id of a cluster
+ * @num_active:	children that are not idle
+ * @migrator:	active CPU expiring the global timers of the idle children,
+ *		or -1. Written with both the group and the top level lock
+ *		held, so holding either is enough to read it.
+ * @idle:	all CPUs of the cluster are idle
+ * @next_expiry: first global timer of the idle children, in clock
+ *		monotonic, or KTIME_MAX
+ * @idle_since:	when the cluster went idle
+ * @idle_ns:	time the cluster spent idle, not counting the current period
+ * @idle_count:	how often the cluster went idle
+ * @wakeups_saved: global timers of the idle cluster expired by another one
+ */
+struct tmigr_group {
+	raw_spinlock_t		lock;
+	struct list_head	list;
+	struct list_head	children;
+	struct cpumask		cpus;
+	int			id;
+	unsigned int		num_active;
+	int			migrator;
+	bool			idle;
+	u64			next_expiry;
+	u64			idle_since;
+	u64			idle_ns;
+	unsigned long		idle_count;
+	unsigned long		wakeups_saved;
+};
+
+/**
+ * struct tmigr_cpu - per CPU state, protected by the lock of its cluster
+ * @group:	the cluster of the CPU
+ * @online:	the CPU takes part; until then it expires its own timers
+ * @idle:	the CPU is idle, and its global timers are left to others
+ * @seq:	bumped whenever the CPU updates @wakeup itself
+ * @wakeup:	first global timer of the idle CPU, in clock monotonic
+ * @idle_since:	when the CPU went idle
+ * @idle_ns:	time the CPU spent idle, not counting the current period
+ * @wakeups_saved: global timers of the idle CPU expired by another one
+ */
+struct tmigr_cpu {
+	struct tmigr_group	*group;
+	bool			online;
+	bool			idle;
+	unsigned int		seq;
+	u64			wakeup;
+	u64			idle_since;
+	u64			idle_ns;
+	unsigned long		wakeups_saved;
+};
+
+static DEFINE_PER_CPU(struct tmigr_cpu, tmigr_cpu);
+
+static struct tmigr_group tmigr_root = {
+	.lock		= __RAW_SPIN_LOCK_UNLOCKED(tmigr_root.lock),
+	.children	= LIST_HEAD_INIT(tmigr_root.children),
+	.migrator	= -1,
+	.next_expiry	= KTIME_MAX,
+};
+
+/* Serializes the creation of clusters */
+static DEFINE_MUTEX(tmigr_mutex);
+
+/* Caller holds group->lock */
+static void tmigr_group_update(struct tmigr_group *group)
+{
+	u64 next = KTIME_MAX;
+	int cpu;
+
+	for_each_cpu(cpu, &group->cpus) {
+		struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+		if (tmc->idle)
+			next = min(next, tmc->wakeup);
+	}
+	WRITE_ONCE(group->next_expiry, next);
+}
+
+/*
+ * Caller holds tmigr_root.lock. The clusters' next_expiry is read without
+ * their lock, but a cluster that changes it while idle updates the top
+ * level afterwards.
+ */
+static void tmigr_root_update(void)
+{
+	struct tmigr_group *group;
+	u64 next = KTIME_MAX;
+
+	list_for_each_entry(group, &tmigr_root.children, list) {
+		if (group->idle)
+			next = min(next, READ_ONCE(group->next_expiry));
+	}
+	WRITE_ONCE(tmigr_root.next_expiry, next);
+}
+
+/* Caller holds group->lock */
+static int tmigr_group_pick(struct tmigr_group *group)
+{
+	int cpu;
+
+	for_each_cpu(cpu, &group->cpus) {
+		if (!per_cpu(tmigr_cpu, cpu).idle)
+			return cpu;
+	}
+	return -1;
+}
+
+/* Caller holds tmigr_root.lock */
+static int tmigr_root_pick(void)
+{
+	struct tmigr_group *group;
+
+	list_for_each_entry(group, &tmigr_root.children, list) {
+		if (!group->idle && group->migrator >= 0)
+			return group->migrator;
+	}
+	return -1;
+}
+
+/*
+ * Bring the cluster and the top level up to date after @cpu went idle or
+ * offline. Caller holds group->lock, and has updated the CPU's state.
+ * Returns with tmigr_root.lock held.
+ */
+static void tmigr_leave(struct tmigr_group *group, int cpu, u64 now)
+{
+	raw_spin_lock(&tmigr_root.lock);
+	if (group->migrator == cpu)
+		WRITE_ONCE(group->migrator, tmigr_group_pick(group));
+	if (!group->num_active && !group->idle) {
+		WRITE_ONCE(group->idle, true);
+		group->idle_since = now;
+		group->idle_count++;
+		tmigr_root.num_active--;
+	}
+	if (tmigr_root.migrator == cpu)
+		WRITE_ONCE(tmigr_root.migrator, tmigr_root_pick());
+	tmigr_root_update();
+}
+
+/**
+ * tmigr_cpu_deactivate - hand the global timers of this CPU over
+ * @now:	current time in clock monotonic
+ * @nextexp:	first global timer of this CPU, or KTIME_MAX
+ *
+ * Called with interrupts disabled when the CPU is about to stop its tick.
+ * May be called again, without tmigr_cpu_activate() in between, when the
+ * CPU re-evaluates its next event while idle.
+ *
+ * Returns when the CPU has to wake up for global timers: KTIME_MAX unless
+ * it is the last active CPU, in which case it is the first global timer of
+ * all idle CPUs.
+ */
+u64 tmigr_cpu_deactivate(u64 now, u64 nextexp)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *group = tmc->group;
+	int cpu = smp_processor_id();
+	u64 ret = KTIME_MAX;
+
+	if (!tmc->online)
+		return nextexp;
+
+	raw_spin_lock(&group->lock);
+	tmc->wakeup = nextexp;
+	tmc->seq++;
+	if (!tmc->idle) {
+		WRITE_ONCE(tmc->idle, true);
+		tmc->idle_since = now;
+		group->num_active--;
+	}
+	tmigr_group_update(group);
+
+	/*
+	 * Unless this CPU was the migrator or the last active CPU of the
+	 * cluster, the cluster's migrator now covers it and nothing changes
+	 * further up.
+	 */
+	if (group->migrator == cpu || !group->num_active) {
+		tmigr_leave(group, cpu, now);
+		if (!tmigr_root.num_active)
+			ret = tmigr_root.next_expiry;
+		raw_spin_unlock(&tmigr_root.lock);
+	}
+	raw_spin_unlock(&group->lock);
+
+	return ret;
+}
+
+/**
+ * tmigr_cpu_activate - take the global timers of this CPU back
+ *
+ * Called with interrupts disabled when the CPU leaves idle. The first
+ * active CPU of a cluster becomes its migrator, the first active cluster
+ * provides the migrator of the top level.
+ */
+void tmigr_cpu_activate(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *group = tmc->group;
+	int cpu = smp_processor_id();
+	u64 now;
+
+	if (!tmc->online || !tmc->idle)
+		return;
+
+	now = ktime_get_ns();
+
+	raw_spin_lock(&group->lock);
+	WRITE_ONCE(tmc->idle, false);
+	tmc->seq++;
+	tmc->idle_ns += now - tmc->idle_since;
+	group->num_active++;
+	tmigr_group_update(group);
+
+	if (group->idle) {
+		raw_spin_lock(&tmigr_root.lock);
+		WRITE_ONCE(group->migrator, cpu);
+		WRITE_ONCE(group->idle, false);
+		group->idle_ns += now - group->idle_since;
+		tmigr_root.num_active++;
+		if (tmigr_root.migrator < 0)
+			WRITE_ONCE(tmigr_root.migrator, cpu);
+		tmigr_root_update();
+		raw_spin_unlock(&tmigr_root.lock);
+	}
+	raw_spin_unlock(&group->lock);
+}
+
+/*
+ * Whether this CPU expires the global timers of the idle CPUs of its
+ * cluster, and of the idle clusters. When nobody is active, whichever CPU
+ * woke up does.
+ */
+static bool tmigr_is_migrator(struct tmigr_group *group, int cpu)
+{
+	return READ_ONCE(group->migrator) == cpu ||
+	       READ_ONCE(group->num_active) == 0;
+}
+
+static bool tmigr_is_root_migrator(int cpu)
+{
+	return READ_ONCE(tmigr_root.migrator) == cpu ||
+	       READ_ONCE(tmigr_root.num_active) == 0;
+}
+
+/**
+ * tmigr_requires_handle_remote - check for expired timers of idle CPUs
+ *
+ * Called from the tick. Only reads the clock when this CPU is in charge of
+ * idle CPUs that have global timers pending.
+ */
+bool tmigr_requires_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	int cpu = smp_processor_id();
+	u64 next = KTIME_MAX;
+
+	if (!tmc->online)
+		return false;
+
+	if (tmigr_is_migrator(tmc->group, cpu))
+		next = READ_ONCE(tmc->group->next_expiry);
+	if (tmigr_is_root_migrator(cpu))
+		next = min(next, READ_ONCE(tmigr_root.next_expiry));
+
+	return next != KTIME_MAX && next <= ktime_get_ns();
+}
+
+static void tmigr_update_wakeup(struct tmigr_cpu *tmc, unsigned int seq,
+				u64 wakeup, bool expired, bool cluster_idle)
+{
+	struct tmigr_group *group = tmc->group;
+
+	raw_spin_lock_irq(&group->lock);
+	if (expired) {
+		tmc->wakeups_saved++;
+		if (cluster_idle)
+			group->wakeups_saved++;
+	}
+	/* Unless the CPU has been there in the meantime, and knows better */
+	if (tmc->idle && tmc->seq == seq) {
+		tmc->wakeup = wakeup;
+		tmigr_group_update(group);
+		if (group->idle) {
+			raw_spin_lock(&tmigr_root.lock);
+			tmigr_root_update();
+			raw_spin_unlock(&tmigr_root.lock);
+		}
+	}
+	raw_spin_unlock_irq(&group->lock);
+}
+
+static void tmigr_handle_group(struct tmigr_group *group, u64 now,
+			       bool cluster_idle)
+{
+	int cpu;
+
+	if (READ_ONCE(group->next_expiry) > now)
+		return;
+
+	for_each_cpu(cpu, &group->cpus) {
+		struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+		unsigned int seq = READ_ONCE(tmc->seq);
+		bool expired;
+		u64 wakeup;
+
+		if (!READ_ONCE(tmc->idle) || READ_ONCE(tmc->wakeup) > now)
+			continue;
+
+		wakeup = timer_expire_remote(cpu, &expired);
+		tmigr_update_wakeup(tmc, seq, wakeup, expired, cluster_idle);
+	}
+}
+
+/**
+ * tmigr_handle_remote - expire the due global timers of idle CPUs
+ *
+ * Called from the timer softirq.
+ */
+void tmigr_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	int cpu = smp_processor_id();
+	struct tmigr_group *group;
+	u64 now;
+
+	if (!tmc->online)
+		return;
+
+	now = ktime_get_ns();
+
+	if (tmigr_is_migrator(tmc->group, cpu))
+		tmigr_handle_group(tmc->group, now, false);
+
+	if (!tmigr_is_root_migrator(cpu) ||
+	    READ_ONCE(tmigr_root.next_expiry) > now)
+		return;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(group, &tmigr_root.children, list) {
+		if (READ_ONCE(group->idle))
+			tmigr_handle_group(group, now, true);
+	}
+	rcu_read_unlock();
+}
+
+static struct tmigr_group *tmigr_get_group(int id)
+{
+	struct tmigr_group *group;
+
+	list_for_each_entry(group, &tmigr_root.children, list) {
+		if (group->id == id)
+			return group;
+	}
+
+	group = kzalloc(sizeof(*group), GFP_KERNEL);
+	if (!group)
+		return NULL;
+
+	raw_spin_lock_init(&group->lock);
+	group->id = id;
+	group->migrator = -1;
+	group->idle = true;
+	group->next_expiry = KTIME_MAX;
+	group->idle_since = ktime_get_ns();
+
+	raw_spin_lock_irq(&tmigr_root.lock);
+	list_add_tail_rcu(&group->list, &tmigr_root.children);
+	raw_spin_unlock_irq(&tmigr_root.lock);
+
+	return group;
+}
+
+static int tmigr_cpu_online(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+	struct tmigr_group *group;
+
+	mutex_lock(&tmigr_mutex);
+	group = tmigr_get_group(topology_physical_package_id(cpu));
+	mutex_unlock(&tmigr_mutex);
+	if (!group)
+		return -ENOMEM;
+
+	raw_spin_lock_irq(&group->lock);
+	tmc->group = group;
+	tmc->idle = false;
+	cpumask_set_cpu(cpu, &group->cpus);
+	group->num_active++;
+
+	raw_spin_lock(&tmigr_root.lock);
+	if (group->idle) {
+		WRITE_ONCE(group->migrator, cpu);
+		WRITE_ONCE(group->idle, false);
+		group->idle_ns += ktime_get_ns() - group->idle_since;
+		tmigr_root.num_active++;
+	}
+	if (tmigr_root.migrator < 0)
+		WRITE_ONCE(tmigr_root.migrator, group->migrator);
+	tmigr_root_update();
+	raw_spin_unlock(&tmigr_root.lock);
+
+	/* From here on, other CPUs may expire its global timers */
+	tmc->online = true;
+	raw_spin_unlock_irq(&group->lock);
+
+	return 0;
+}
+
+static int tmigr_cpu_offline(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+	struct tmigr_group *group = tmc->group;
+
+	raw_spin_lock_irq(&group->lock);
+	tmc->online = false;
+	if (!tmc->idle)
+		group->num_active--;
+	WRITE_ONCE(tmc->idle, false);
+	cpumask_clear_cpu(cpu, &group->cpus);
+	tmigr_group_update(group);
+	tmigr_leave(group, cpu, ktime_get_ns());
+	raw_spin_unlock(&tmigr_root.lock);
+	raw_spin_unlock_irq(&group->lock);
+
+	return 0;
+}
+
+static int __init tmigr_init(void)
+{
+	int ret;
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "timers/migration:online",
+				tmigr_cpu_online, tmigr_cpu_offline);
+	return ret < 0 ? ret : 0;
+}
+early_initcall(tmigr_init);
+
+#ifdef CONFIG_DEBUG_FS
+static u64 tmigr_residency_ms(u64 idle_ns, bool idle, u64 idle_since, u64 now)
+{
+	if (idle)
+		idle_ns += now - idle_since;
+	return div_u64(idle_ns, NSEC_PER_MSEC);
+}
+
+static int tmigr_debug_show(struct seq_file *m, void *v)
+{
+	struct tmigr_group *group;
+	u64 now = ktime_get_ns();
+	int cpu;
+
+	seq_printf(m, "active clusters: %u, top level migrator: %d\n",
+		   READ_ONCE(tmigr_root.num_active),
+		   READ_ONCE(tmigr_root.migrator));
+
+	mutex_lock(&tmigr_mutex);
+	list_for_each_entry(group, &tmigr_root.children, list) {
+		seq_printf(m, "\ncluster %d: cpus %*pbl, active %u, migrator %d\n",
+			   group->id, cpumask_pr_args(&group->cpus),
+			   READ_ONCE(group->num_active),
+			   READ_ONCE(group->migrator));
+		seq_printf(m, "  idle %lu times, %llu ms, wakeups saved %lu\n",
+			   group->idle_count,
+			   tmigr_residency_ms(group->idle_ns,
+					      READ_ONCE(group->idle),
+					      group->idle_since, now),
+			   group->wakeups_saved);
+
+		for_each_cpu(cpu, &group->cpus) {
+			struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+
+			seq_printf(m, "  cpu %d: %s, idle %llu ms, wakeups saved %lu\n",
+				   cpu, READ_ONCE(tmc->idle) ? "idle" : "active",
+				   tmigr_residency_ms(tmc->idle_ns,
+						      READ_ONCE(tmc->idle),
+						      tmc->idle_since, now),
+				   tmc->wakeups_saved);
+		}
+	}
+	mutex_unlock(&tmigr_mutex);
+
+	return 0;
+}
+
+static int tmigr_debug_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, tmigr_debug_show, NULL);
+}
+
+static const struct file_operations tmigr_debug_fops = {
+	.open		= tmigr_debug_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init tmigr_debug_init(void)
+{
+	debugfs_create_file("timer_migration", 0444, NULL, NULL,
+			    &tmigr_debug_fops);
+	return 0;
+}
+late_initcall(tmigr_debug_init);
+#endif
@@ -0,0 +1,24 @@
+#ifndef _KERNEL_TIME_TIMER_MIGRATION_H
+#define _KERNEL_TIME_TIMER_MIGRATION_H
+
+#if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON)
+extern u64 timer_expire_remote(unsigned int cpu, bool *expired);
+
+extern u64 tmigr_cpu_deactivate(u64 now, u64 nextexp);
+extern void tmigr_cpu_activate(void);
+extern bool tmigr_requires_handle_remote(void);
+extern void tmigr_handle_remote(void);
+#else
+static inline u64 tmigr_cpu_deactivate(u64 now, u64 nextexp)
+{
+	return nextexp;
+}
+static inline void tmigr_cpu_activate(void) { }
+static inline bool tmigr_requires_handle_remote(void)
+{
+	return false;
+}
+static inline void tmigr_handle_remote(void) { }
+#endif
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ * Test cases and throughput figures for csum_partial() and
+ * csum_partial_copy_nocheck(), for architectures that provide their
+ * own versions. The results are checked against a plain C reference
+ * on random buffers, lengths and alignments.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <net/checksum.h>
+
+#define TEST_BUF_LEN		(64 * 1024)
+#define TEST_RANDOM_ROUNDS	10000
+
+static const unsigned int bench_lens[] = { 64, 256, 576, 1500, 4096, 65535 };
+
+static unsigned int bench_bytes = 64 << 20;
+module_param(bench_bytes, uint, 0444);
+MODULE_PARM_DESC(bench_bytes, "Bytes to checksum per benchmark (0 to skip)");
+
+static u8 *src, *dst;
+
+/* The generic algorithm: 16-bit words in memory order, end-around carry */
+static __sum16 csum_ref(const u8 *buf, unsigned int len, __wsum wsum)
+{
+	u64 sum = (__force u32)wsum;
+	unsigned int i;
+
+	for (i = 0; i + 1 < len; i += 2)
+#ifdef __BIG_ENDIAN
+		sum += (buf[i] << 8) | buf[i + 1];
+#else
+		sum += buf[i] | (buf[i + 1] << 8);
+#endif
+	if (len & 1)
+#ifdef __BIG_ENDIAN
+		sum += buf[len - 1] << 8;
+#else
+		sum += buf[len - 1];
+#endif
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return (__force __sum16)~sum;
+}
+
+static int __init test_csum_one(unsigned int soff, unsigned int doff,
+				unsigned int len, __wsum wsum)
+{
+	__sum16 want = csum_ref(src + soff, len, wsum);
+	__sum16 got;
+
+	got = csum_fold(csum_partial(src + soff, len, wsum));
+	if (got != want) {
+		pr_err("csum_partial(off %u, len %u, sum %08x): %04x, expected %04x\n",
+		       soff, len, (__force u32)wsum, (__force u16)got,
+		       (__force u16)want);
+		return -EINVAL;
+	}
+
+	memset(dst, 0x5a, TEST_BUF_LEN);
+	got = csum_fold(csum_partial_copy_nocheck(src + soff, dst + doff, len,
+						  wsum));
+	if (got != want) {
+		pr_err("csum_partial_copy_nocheck(off %u/%u, len %u, sum %08x): %04x, expected %04x\n",
+		       soff, doff, len, (__force u32)wsum, (__force u16)got,
+		       (__force u16)want);
+		return -EINVAL;
+	}
+	if (memcmp(dst + doff, src + soff, len) ||
+	    (doff && dst[doff - 1] != 0x5a) ||
+	    (doff + len < TEST_BUF_LEN && dst[doff + len] != 0x5a)) {
+		pr_err("csum_partial_copy_nocheck(off %u/%u, len %u): bad copy\n",
+		       soff, doff, len);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int __init test_csum_correctness(void)
+{
+	unsigned int i, len;
+	int err;
+
+	get_random_bytes(src, TEST_BUF_LEN);
+
+	/* Every short length at every alignment, across the fast path cutoff */
+	for (len = 0; len <= 1024; len++) {
+		for (i = 0; i < 16; i++) {
+			err = test_csum_one(i, 15 - i, len, 0);
+			if (err)
+				return err;
+		}
+	}
+
+	/* Carries out of every lane */
+	memset(src, 0xff, TEST_BUF_LEN);
+	err = test_csum_one(0, 0, TEST_BUF_LEN - 16, (__force __wsum)~0U) ?:
+	      test_csum_one(1, 0, TEST_BUF_LEN - 16, (__force __wsum)~0U);
+	if (err)
+		return err;
+
+	get_random_bytes(src, TEST_BUF_LEN);
+	for (i = 0; i < TEST_RANDOM_ROUNDS; i++) {
+		unsigned int soff = prandom_u32_max(16);
+		unsigned int doff = prandom_u32_max(16);
+
+		len = prandom_u32_max(TEST_BUF_LEN - 16);
+		err = test_csum_one(soff, doff, len,
+				    (__force __wsum)prandom_u32());
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+static u64 __init bench_mbps(unsigned int bytes, s64 ns)
+{
+	return ns > 0 ? div64_u64((u64)bytes * 1000, ns) : 0;
+}
+
+static void __init test_csum_bench(void)
+{
+	unsigned int i, n, iters;
+	__wsum sum = 0;
+	ktime_t start;
+	s64 t_csum, t_copy, t_ref;
+
+	for (i = 0; i < ARRAY_SIZE(bench_lens); i++) {
+		unsigned int len = bench_lens[i];
+
+		iters = max(bench_bytes / len, 1U);
+
+		start = ktime_get();
+		for (n = 0; n < iters; n++)
+			sum = csum_partial(src, len, sum);
+		t_csum = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		start = ktime_get();
+		for (n = 0; n < iters; n++)
+			sum = csum_partial_copy_nocheck(src, dst, len, sum);
+		t_copy = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		start = ktime_get();
+		for (n = 0; n < iters; n++)
+			sum = (__force __wsum)csum_ref(src, len, sum);
+		t_ref = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+		pr_info("len %5u: csum_partial %5llu MB/s, copy+csum %5llu MB/s, reference %5llu MB/s\n",
+			len, bench_mbps(iters * len, t_csum),
+			bench_mbps(iters * len, t_copy),
+			bench_mbps(iters * len, t_ref));
+		cond_resched();
+	}
+
+	/* Keep the loops from being optimised away */
+	pr_debug("sum %08x\n", (__force u32)sum);
+}
+
+static int __init test_csum_init(void)
+{
+	int err;
+
+	src = kmalloc(TEST_BUF_LEN, GFP_KERNEL);
+	dst = kmalloc(TEST_BUF_LEN, GFP_KERNEL);
+	if (!src || !dst) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	err = test_csum_correctness();
+	if (err)
+		goto out;
+	pr_info("all tests passed\n");
+
+	if (bench_bytes)
+		test_csum_bench();
+out:
+	kfree(src);
+	kfree(dst);
+	return err;
+}
+
+static void __exit test_csum_exit(void)
+{
+}
+
+module_init(test_csum_init);
+module_exit(test_csum_exit);
+
+MODULE_DESCRIPTION("Test cases and benchmark for the checksum helpers");
+MODULE_LICENSE("GPL");
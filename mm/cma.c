@@ -35,13 +35,14 @@
 #include <linux/cma.h>
 #include <linux/highmem.h>
 #include <linux/io.h>
+#include <linux/ktime.h>
+#include <linux/wait.h>
 #include <trace/events/cma.h>
 
 #include "cma.h"
 
 struct cma cma_areas[MAX_CMA_AREAS];
 unsigned cma_area_count;
-static DEFINE_MUTEX(cma_mutex);
 static DEFINE_MUTEX(rbin_mutex);
 
 phys_addr_t cma_get_base(const struct cma *cma)
@@ -92,9 +93,82 @@ static void cma_clear_bitmap(struct cma *cma, unsigned long pfn,
 	mutex_unlock(&cma->lock);
 }
 
+/*
+ * alloc_contig_range() isolates whole blocks of this order around the
+ * requested range, and two callers must never isolate the same block.
+ * Areas are aligned to these blocks, so allocations from different
+ * areas never conflict. Within an area, cma->isolating tracks the
+ * blocks taken by allocations in flight.
+ */
+static unsigned int cma_isolate_order(void)
+{
+	return max_t(unsigned int, MAX_ORDER - 1, pageblock_order);
+}
+
+static bool cma_isolate_busy(struct cma *cma, unsigned long pfn, size_t count)
+{
+	unsigned long start = (pfn - cma->base_pfn) >> cma_isolate_order();
+	unsigned long end = ((pfn + count - 1 - cma->base_pfn) >>
+			     cma_isolate_order()) + 1;
+
+	return find_next_bit(cma->isolating, end, start) < end;
+}
+
+/* Called with cma->lock held */
+static bool cma_isolate_begin(struct cma *cma, unsigned long pfn, size_t count)
+{
+	unsigned long start = (pfn - cma->base_pfn) >> cma_isolate_order();
+	unsigned long end = ((pfn + count - 1 - cma->base_pfn) >>
+			     cma_isolate_order()) + 1;
+
+	if (cma_isolate_busy(cma, pfn, count))
+		return false;
+	bitmap_set(cma->isolating, start, end - start);
+	return true;
+}
+
+static void cma_isolate_end(struct cma *cma, unsigned long pfn, size_t count)
+{
+	unsigned long start = (pfn - cma->base_pfn) >> cma_isolate_order();
+	unsigned long end = ((pfn + count - 1 - cma->base_pfn) >>
+			     cma_isolate_order()) + 1;
+
+	mutex_lock(&cma->lock);
+	bitmap_clear(cma->isolating, start, end - start);
+	mutex_unlock(&cma->lock);
+	wake_up_all(&cma->isolate_wq);
+}
+
+#ifdef CONFIG_CMA_DEBUGFS
+static void cma_account_alloc(struct cma *cma, struct page *page,
+			      ktime_t start, unsigned long isolate_retry,
+			      unsigned long busy_retry)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	mutex_lock(&cma->lock);
+	if (page) {
+		cma->nr_alloc++;
+		cma->alloc_time_ns += ns;
+		cma->alloc_time_max_ns = max(cma->alloc_time_max_ns, ns);
+	} else {
+		cma->nr_fail++;
+	}
+	cma->nr_isolate_retry += isolate_retry;
+	cma->nr_busy_retry += busy_retry;
+	mutex_unlock(&cma->lock);
+}
+#else
+static inline void cma_account_alloc(struct cma *cma, struct page *page,
+				     ktime_t start, unsigned long isolate_retry,
+				     unsigned long busy_retry) { }
+#endif
+
 static int __init cma_activate_area(struct cma *cma)
 {
 	int bitmap_size = BITS_TO_LONGS(cma_bitmap_maxno(cma)) * sizeof(long);
+	int isolating_size = BITS_TO_LONGS(cma->count >> cma_isolate_order()) *
+			     sizeof(long);
 	unsigned long base_pfn = cma->base_pfn, pfn = base_pfn;
 	unsigned i = cma->count >> pageblock_order;
 	struct zone *zone;
@@ -105,8 +179,11 @@ static int __init cma_activate_area(struct cma *cma)
 #endif
 
 	cma->bitmap = kzalloc(bitmap_size, GFP_KERNEL);
+	cma->isolating = kzalloc(isolating_size, GFP_KERNEL);
 
-	if (!cma->bitmap) {
+	if (!cma->bitmap || !cma->isolating) {
+		kfree(cma->bitmap);
+		kfree(cma->isolating);
 		cma->count = 0;
 		return -ENOMEM;
 	}
@@ -133,6 +210,7 @@ static int __init cma_activate_area(struct cma *cma)
 	} while (--i);
 
 	mutex_init(&cma->lock);
+	init_waitqueue_head(&cma->isolate_wq);
 
 #ifdef CONFIG_CMA_DEBUGFS
 	INIT_HLIST_HEAD(&cma->mem_head);
@@ -147,6 +225,7 @@ static int __init cma_activate_area(struct cma *cma)
 
 err:
 	kfree(cma->bitmap);
+	kfree(cma->isolating);
 	cma->count = 0;
 	return -EINVAL;
 }
@@ -397,7 +476,9 @@ err:
  * @align: Requested alignment of pages (in PAGE_SIZE order).
  *
  * This function allocates part of contiguous memory on specific
- * contiguous memory area.
+ * contiguous memory area. Allocations from different areas, and from
+ * blocks of the same area that alloc_contig_range() isolates separately,
+ * run concurrently.
  */
 struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align)
 {
@@ -405,7 +486,9 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align)
 	unsigned long pfn = -1;
 	unsigned long start = 0;
 	unsigned long bitmap_maxno, bitmap_no, bitmap_count;
+	unsigned long isolate_retry = 0, busy_retry = 0;
 	struct page *page = NULL;
+	ktime_t start_time;
 #ifdef CONFIG_RBIN
 	bool is_rbin = cma ? cma->is_rbin : false;
 	bool need_mutex = (align < (MAX_ORDER - 1)) ? true : false;
@@ -431,6 +514,7 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align)
 	if (bitmap_count > bitmap_maxno)
 		return NULL;
 
+	start_time = ktime_get();
 	for (;;) {
 		mutex_lock(&cma->lock);
 		bitmap_no = bitmap_find_next_zero_area_off(cma->bitmap,
@@ -441,6 +525,21 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align)
 			break;
 		}
 		bitmap_set(cma->bitmap, bitmap_no, bitmap_count);
+		pfn = cma->base_pfn + (bitmap_no << cma->order_per_bit);
+
+		/*
+		 * Another allocation is isolating a block our range falls
+		 * in. The range is ours, so wait for that one to finish
+		 * and retry it rather than give it up.
+		 */
+		while (!cma_isolate_begin(cma, pfn, count)) {
+			mutex_unlock(&cma->lock);
+			isolate_retry++;
+			wait_event(cma->isolate_wq,
+				   !cma_isolate_busy(cma, pfn, count));
+			mutex_lock(&cma->lock);
+		}
+
 		/*
 		 * It's safe to drop the lock here. We've marked this region for
 		 * our exclusive use. If the migration fails we will take the
@@ -448,11 +547,8 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align)
 		 */
 		mutex_unlock(&cma->lock);
 
-		pfn = cma->base_pfn + (bitmap_no << cma->order_per_bit);
 		if (!is_rbin) {
-			mutex_lock(&cma_mutex);
 			ret = alloc_contig_range(pfn, pfn + count, MIGRATE_CMA);
-			mutex_unlock(&cma_mutex);
 		}
 #ifdef CONFIG_RBIN
 		else {
@@ -464,6 +560,7 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align)
 				mutex_unlock(&rbin_mutex);
 		}
 #endif
+		cma_isolate_end(cma, pfn, count);
 		if (ret == 0) {
 			page = pfn_to_page(pfn);
 			break;
@@ -475,10 +572,12 @@ struct page *cma_alloc(struct cma *cma, size_t count, unsigned int align)
 
 		pr_debug("%s(): memory range at %p is busy, retrying\n",
 			 __func__, pfn_to_page(pfn));
+		busy_retry++;
 		/* try again with a bit different memory target */
 		start = bitmap_no + mask + 1;
 	}
 
+	cma_account_alloc(cma, page, start_time, isolate_retry, busy_retry);
 	trace_cma_alloc(pfn, page, count, align);
 
 	pr_debug("%s(): returned %p\n", __func__, page);
@@ -10,10 +10,18 @@ struct cma {
 	unsigned long   *bitmap;
 	unsigned int order_per_bit; /* Order of pages represented by one bit */
 	struct mutex    lock;
+	unsigned long	*isolating; /* Blocks under alloc_contig_range() */
+	wait_queue_head_t isolate_wq;
 #ifdef CONFIG_CMA_DEBUGFS
 	const char	*name;
 	struct hlist_head mem_head;
 	spinlock_t mem_head_lock;
+	unsigned long	nr_alloc;
+	unsigned long	nr_fail;
+	unsigned long	nr_isolate_retry; /* Waits for an overlapping allocation */
+	unsigned long	nr_busy_retry; /* Ranges given up on -EBUSY */
+	u64		alloc_time_ns;
+	u64		alloc_time_max_ns;
 #endif
 };
 
@@ -69,6 +69,33 @@ static int cma_maxchunk_get(void *data, u64 *val)
 }
 DEFINE_SIMPLE_ATTRIBUTE(cma_maxchunk_fops, cma_maxchunk_get, NULL, "%llu\n");
 
+static int cma_latency_avg_get(void *data, u64 *val)
+{
+	struct cma *cma = data;
+
+	mutex_lock(&cma->lock);
+	*val = cma->nr_alloc ? div64_u64(cma->alloc_time_ns, cma->nr_alloc) : 0;
+	mutex_unlock(&cma->lock);
+	*val = div_u64(*val, NSEC_PER_USEC);
+
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(cma_latency_avg_fops, cma_latency_avg_get, NULL,
+			"%llu\n");
+
+static int cma_latency_max_get(void *data, u64 *val)
+{
+	struct cma *cma = data;
+
+	mutex_lock(&cma->lock);
+	*val = div_u64(cma->alloc_time_max_ns, NSEC_PER_USEC);
+	mutex_unlock(&cma->lock);
+
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(cma_latency_max_fops, cma_latency_max_get, NULL,
+			"%llu\n");
+
 static void cma_add_to_cma_mem_list(struct cma *cma, struct cma_mem *mem)
 {
 	spin_lock(&cma->mem_head_lock);
@@ -190,6 +217,19 @@ static void cma_debugfs_add_one(struct cma *cma, int idx)
 	debugfs_create_file("used", S_IRUGO, tmp, cma, &cma_used_fops);
 	debugfs_create_file("maxchunk", S_IRUGO, tmp, cma, &cma_maxchunk_fops);
 
+	debugfs_create_file("alloc_count", S_IRUGO, tmp,
+				&cma->nr_alloc, &cma_debugfs_fops);
+	debugfs_create_file("alloc_fail", S_IRUGO, tmp,
+				&cma->nr_fail, &cma_debugfs_fops);
+	debugfs_create_file("isolate_retry", S_IRUGO, tmp,
+				&cma->nr_isolate_retry, &cma_debugfs_fops);
+	debugfs_create_file("busy_retry", S_IRUGO, tmp,
+				&cma->nr_busy_retry, &cma_debugfs_fops);
+	debugfs_create_file("latency_avg_us", S_IRUGO, tmp, cma,
+				&cma_latency_avg_fops);
+	debugfs_create_file("latency_max_us", S_IRUGO, tmp, cma,
+				&cma_latency_max_fops);
+
 	u32s = DIV_ROUND_UP(cma_bitmap_maxno(cma), BITS_PER_BYTE * sizeof(u32));
 	debugfs_create_u32_array("bitmap", S_IRUGO, tmp, (u32*)cma->bitmap, u32s);
 }
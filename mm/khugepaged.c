@@ -15,6 +15,7 @@
 #include <linux/page_idle.h>
 #include <linux/swapops.h>
 #include <linux/shmem_fs.h>
+#include <linux/pte_share.h>
 
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
@@ -45,6 +46,7 @@ enum scan_result {
 	SCAN_CGROUP_CHARGE_FAIL,
 	SCAN_EXCEED_SWAP_PTE,
 	SCAN_TRUNCATED,
+	SCAN_PTE_SHARED,
 };
 
 #define CREATE_TRACE_POINTS
@@ -987,6 +989,13 @@ static void collapse_huge_page(struct mm_struct *mm,
 		up_read(&mm->mmap_sem);
 		goto out_nolock;
 	}
+	/* Swapin below must not fault into a table shared across fork */
+	if (pte_table_shared(pmd)) {
+		result = SCAN_PTE_SHARED;
+		mem_cgroup_cancel_charge(new_page, memcg, true);
+		up_read(&mm->mmap_sem);
+		goto out_nolock;
+	}
 
 	/*
 	 * __collapse_huge_page_swapin always returns with mmap_sem locked.
@@ -1015,6 +1024,10 @@ static void collapse_huge_page(struct mm_struct *mm,
 	/* check if the pmd is still valid */
 	if (mm_find_pmd(mm, address) != pmd)
 		goto out;
+	if (pte_table_shared(pmd)) {
+		result = SCAN_PTE_SHARED;
+		goto out;
+	}
 
 	vm_write_begin(vma);
 	anon_vma_lock_write(vma->anon_vma);
@@ -1124,6 +1137,10 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 		result = SCAN_PMD_NULL;
 		goto out;
 	}
+	if (pte_table_shared(pmd)) {
+		result = SCAN_PTE_SHARED;
+		goto out;
+	}
 
 	memset(khugepaged_node_load, 0, sizeof(khugepaged_node_load));
 	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
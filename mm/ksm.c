@@ -37,6 +37,7 @@
 #include <linux/freezer.h>
 #include <linux/oom.h>
 #include <linux/numa.h>
+#include <linux/pte_share.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -169,6 +170,8 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	unsigned char age;		/* scans since last merge */
+	unsigned char remaining_skips;	/* scans left to skip this page */
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -226,6 +229,31 @@ static unsigned int ksm_thread_sleep_millisecs = 1500;
 /* Boolean to indicate whether to use deferred timer or not */
 static bool use_deferred_timer = true;
 
+/* Skip pages that keep failing to merge, with exponential backoff */
+static bool ksm_smart_scan = true;
+
+/* If set, microseconds ksmd scans per batch instead of pages_to_scan */
+static unsigned int ksm_scan_budget_usecs;
+
+/* The number of pages checksummed or compared by ksmd */
+static unsigned long ksm_pages_scanned;
+
+/* The number of pages ksmd passed over because of smart scanning */
+static unsigned long ksm_pages_skipped;
+
+/* The number of times a page was added to the stable tree */
+static unsigned long ksm_pages_merged;
+
+/*
+ * A page is scanned on its first KSM_SKIP_MIN_AGE scans without merging,
+ * then skipped for 1, 2, 4... up to 1 << KSM_SKIP_MAX_SHIFT scans between
+ * attempts.  A vma that merged within the last KSM_MERGE_HISTORY full
+ * scans is likely to merge again: its pages skip at most one scan.
+ */
+#define KSM_SKIP_MIN_AGE	3
+#define KSM_SKIP_MAX_SHIFT	3
+#define KSM_MERGE_HISTORY	4
+
 #ifdef CONFIG_NUMA
 /* Zeroed when merging across nodes is not allowed */
 static unsigned int ksm_merge_across_nodes = 1;
@@ -875,6 +903,10 @@ static int write_protect_page(struct vm_area_struct *vma, struct page *page,
 	if (!ptep)
 		goto out_mn;
 
+	/* Other mms map the page through this table, leave it alone */
+	if (pte_table_shared_ptep(ptep))
+		goto out_unlock;
+
 	if (pte_write(*ptep) || pte_dirty(*ptep)) {
 		pte_t entry;
 
@@ -1073,6 +1105,8 @@ static int try_to_merge_with_ksm_page(struct rmap_item *rmap_item,
 	if (err)
 		goto out;
 
+	vma->ksm_merge_seqnr = ksm_scan.seqnr + 1;
+
 	/* Unstable nid is in union with stable anon_vma: remove first */
 	remove_rmap_item_from_tree(rmap_item);
 
@@ -1393,7 +1427,10 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 {
 	rmap_item->head = stable_node;
 	rmap_item->address |= STABLE_FLAG;
+	rmap_item->age = 0;
+	rmap_item->remaining_skips = 0;
 	hlist_add_head(&rmap_item->hlist, &stable_node->hlist);
+	ksm_pages_merged++;
 
 	if (rmap_item->hlist.next)
 		ksm_pages_sharing++;
@@ -1558,6 +1595,48 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
+static bool vma_merged_recently(struct vm_area_struct *vma)
+{
+	return vma->ksm_merge_seqnr &&
+	       ksm_scan.seqnr + 1 - vma->ksm_merge_seqnr <= KSM_MERGE_HISTORY;
+}
+
+/*
+ * Called for every page the scan comes across: returns true if the page
+ * has been failing to merge for a while and should be passed over this
+ * time.  KSM pages are never skipped.
+ */
+static bool should_skip_rmap_item(struct vm_area_struct *vma,
+				  struct page *page,
+				  struct rmap_item *rmap_item)
+{
+	unsigned int age, skips;
+
+	if (!ksm_smart_scan || PageKsm(page))
+		return false;
+
+	age = rmap_item->age;
+	if (age != U8_MAX)
+		rmap_item->age++;
+	if (age < KSM_SKIP_MIN_AGE)
+		return false;
+
+	if (!rmap_item->remaining_skips) {
+		skips = 1U << min_t(unsigned int, age - KSM_SKIP_MIN_AGE,
+					  KSM_SKIP_MAX_SHIFT);
+		if (vma_merged_recently(vma))
+			skips = 1;
+		rmap_item->remaining_skips = skips;
+		return false;
+	}
+
+	rmap_item->remaining_skips--;
+	ksm_pages_skipped++;
+	/* It is not in this scan's unstable tree for others to find */
+	remove_rmap_item_from_tree(rmap_item);
+	return true;
+}
+
 static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 {
 	struct mm_struct *mm;
@@ -1653,6 +1732,12 @@ next_mm:
 					ksm_scan.rmap_list =
 							&rmap_item->rmap_list;
 					ksm_scan.address += PAGE_SIZE;
+					if (should_skip_rmap_item(vma, *page,
+								  rmap_item)) {
+						put_page(*page);
+						cond_resched();
+						continue;
+					}
 				} else
 					put_page(*page);
 				up_read(&mm->mmap_sem);
@@ -1719,11 +1804,20 @@ next_mm:
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
  * @scan_npages - number of pages we want to scan before we return.
+ *
+ * With a scan_budget_usecs set, scan for that long instead.
  */
 static void ksm_do_scan(unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item;
 	struct page *uninitialized_var(page);
+	unsigned int budget = READ_ONCE(ksm_scan_budget_usecs);
+	u64 deadline = 0;
+
+	if (budget) {
+		deadline = local_clock() + (u64)budget * NSEC_PER_USEC;
+		scan_npages = UINT_MAX;
+	}
 
 	while (scan_npages-- && likely(!freezing(current))) {
 		cond_resched();
@@ -1732,6 +1826,9 @@ static void ksm_do_scan(unsigned int scan_npages)
 			return;
 		cmp_and_merge_page(page, rmap_item);
 		put_page(page);
+		ksm_pages_scanned++;
+		if (deadline && local_clock() >= deadline)
+			return;
 	}
 }
 
@@ -2265,6 +2362,52 @@ static ssize_t deferred_timer_store(struct kobject *kobj,
 }
 KSM_ATTR(deferred_timer);
 
+static ssize_t smart_scan_show(struct kobject *kobj,
+			       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_smart_scan);
+}
+
+static ssize_t smart_scan_store(struct kobject *kobj,
+				struct kobj_attribute *attr,
+				const char *buf, size_t count)
+{
+	bool enable;
+	int err;
+
+	err = kstrtobool(buf, &enable);
+	if (err)
+		return -EINVAL;
+
+	ksm_smart_scan = enable;
+
+	return count;
+}
+KSM_ATTR(smart_scan);
+
+static ssize_t scan_budget_usecs_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_scan_budget_usecs);
+}
+
+static ssize_t scan_budget_usecs_store(struct kobject *kobj,
+				       struct kobj_attribute *attr,
+				       const char *buf, size_t count)
+{
+	unsigned long usecs;
+	int err;
+
+	err = kstrtoul(buf, 10, &usecs);
+	if (err || usecs > USEC_PER_SEC)
+		return -EINVAL;
+
+	ksm_scan_budget_usecs = usecs;
+
+	return count;
+}
+KSM_ATTR(scan_budget_usecs);
+
 #ifdef CONFIG_NUMA
 static ssize_t merge_across_nodes_show(struct kobject *kobj,
 				struct kobj_attribute *attr, char *buf)
@@ -2368,6 +2511,38 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t pages_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_skipped);
+}
+KSM_ATTR_RO(pages_skipped);
+
+static ssize_t pages_merged_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_merged);
+}
+KSM_ATTR_RO(pages_merged);
+
+static ssize_t scans_per_merge_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	unsigned long merged = READ_ONCE(ksm_pages_merged);
+
+	if (!merged)
+		return sprintf(buf, "0\n");
+	return sprintf(buf, "%lu\n", READ_ONCE(ksm_pages_scanned) / merged);
+}
+KSM_ATTR_RO(scans_per_merge);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -2378,6 +2553,12 @@ static struct attribute *ksm_attrs[] = {
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
 	&deferred_timer_attr.attr,
+	&smart_scan_attr.attr,
+	&scan_budget_usecs_attr.attr,
+	&pages_scanned_attr.attr,
+	&pages_skipped_attr.attr,
+	&pages_merged_attr.attr,
+	&scans_per_merge_attr.attr,
 #ifdef CONFIG_NUMA
 	&merge_across_nodes_attr.attr,
 #endif
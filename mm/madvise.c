@@ -21,6 +21,7 @@
 #include <linux/swap.h>
 #include <linux/swapops.h>
 #include <linux/mmu_notifier.h>
+#include <linux/pte_share.h>
 #include "internal.h"
 
 #include <asm/tlb.h>
@@ -284,6 +285,13 @@ static int madvise_free_pte_range(pmd_t *pmd, unsigned long addr,
 	if (pmd_trans_unstable(pmd))
 		return 0;
 
+	if (pte_table_shared(pmd)) {
+		int err = pte_table_unshare(vma, pmd, addr);
+
+		if (err)
+			return err;
+	}
+
 	orig_pte = pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
 	flush_tlb_batched_pending(mm);
 	arch_enter_lazy_mmu_mode();
@@ -396,7 +404,7 @@ next:
 	return 0;
 }
 
-static void madvise_free_page_range(struct mmu_gather *tlb,
+static int madvise_free_page_range(struct mmu_gather *tlb,
 			     struct vm_area_struct *vma,
 			     unsigned long addr, unsigned long end)
 {
@@ -405,12 +413,14 @@ static void madvise_free_page_range(struct mmu_gather *tlb,
 		.mm = vma->vm_mm,
 		.private = tlb,
 	};
+	int err;
 
 	vm_write_begin(vma);
 	tlb_start_vma(tlb, vma);
-	walk_page_range(addr, end, &free_walk);
+	err = walk_page_range(addr, end, &free_walk);
 	tlb_end_vma(tlb, vma);
 	vm_write_end(vma);
+	return err;
 }
 
 static int madvise_free_single_vma(struct vm_area_struct *vma,
@@ -419,6 +429,7 @@ static int madvise_free_single_vma(struct vm_area_struct *vma,
 	unsigned long start, end;
 	struct mm_struct *mm = vma->vm_mm;
 	struct mmu_gather tlb;
+	int err;
 
 	if (vma->vm_flags & (VM_LOCKED|VM_HUGETLB|VM_PFNMAP))
 		return -EINVAL;
@@ -439,11 +450,11 @@ static int madvise_free_single_vma(struct vm_area_struct *vma,
 	update_hiwater_rss(mm);
 
 	mmu_notifier_invalidate_range_start(mm, start, end);
-	madvise_free_page_range(&tlb, vma, start, end);
+	err = madvise_free_page_range(&tlb, vma, start, end);
 	mmu_notifier_invalidate_range_end(mm, start, end);
 	tlb_finish_mmu(&tlb, start, end);
 
-	return 0;
+	return err;
 }
 
 static long madvise_free(struct vm_area_struct *vma,
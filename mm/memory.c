@@ -64,6 +64,7 @@
 #include <linux/debugfs.h>
 #include <linux/userfaultfd_k.h>
 #include <linux/dax.h>
+#include <linux/pte_share.h>
 
 #include <asm/io.h>
 #include <asm/mmu_context.h>
@@ -1025,6 +1026,9 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 		}
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
+		if (!pte_table_share(dst_mm, src_mm, dst_pmd, src_pmd,
+						vma, addr, next))
+			continue;
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
 						vma, addr, next))
 			return -ENOMEM;
@@ -1264,6 +1268,9 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		 */
 		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			goto next;
+		if (pte_table_shared(pmd) &&
+		    pte_table_zap_shared(tlb, vma, pmd, addr, next))
+			goto next;
 		next = zap_pte_range(tlb, vma, pmd, addr, next, details);
 next:
 		cond_resched();
@@ -1994,6 +2001,17 @@ int apply_to_page_range(struct mm_struct *mm, unsigned long addr,
 EXPORT_SYMBOL_GPL(apply_to_page_range);
 
 #ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Called with the ptl held: the PTE table may have been unshared, or be
+ * shared with another mm, since the speculative walk looked at it.
+ */
+static inline bool spf_pte_table_changed(struct fault_env *fe)
+{
+	return IS_ENABLED(CONFIG_FORK_SHARE_PTE) &&
+	       (!pmd_same(READ_ONCE(*fe->pmd), fe->orig_pmd) ||
+		pte_table_shared(fe->pmd));
+}
+
 static bool pte_spinlock(struct mm_struct *mm,
 			struct fault_env *fe)
 {
@@ -2039,6 +2057,12 @@ static bool pte_spinlock(struct mm_struct *mm,
 		goto out;
 	}
 
+	if (spf_pte_table_changed(fe)) {
+		spin_unlock(fe->ptl);
+		trace_spf_pmd_changed(_RET_IP_, fe->vma, fe->address);
+		goto out;
+	}
+
 	ret = true;
 out:
 	local_irq_enable();
@@ -2107,6 +2131,12 @@ static bool pte_map_lock(struct mm_struct *mm,
 		goto out;
 	}
 
+	if (spf_pte_table_changed(fe)) {
+		pte_unmap_unlock(pte, ptl);
+		trace_spf_pmd_changed(_RET_IP_, fe->vma, fe->address);
+		goto out;
+	}
+
 	fe->pte = pte;
 	fe->ptl = ptl;
 	ret = true;
@@ -3871,6 +3901,9 @@ static int __handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 		}
 	}
 
+	if (pte_table_shared(fe.pmd) && pte_table_unshare(vma, fe.pmd, address))
+		return VM_FAULT_OOM;
+
 	return handle_pte_fault(&fe);
 }
 
@@ -4026,6 +4059,10 @@ int __handle_speculative_fault(struct mm_struct *mm, unsigned long address,
 		     pmd_none(fe.orig_pmd) || pmd_trans_huge(fe.orig_pmd)))
 		goto out_walk;
 
+	/* A PTE table shared with another mm is only touched under mmap_sem */
+	if (unlikely(pte_table_shared(fe.pmd)))
+		goto out_walk;
+
 	/*
 	 * The above does not allocate/instantiate page-tables because doing so
 	 * would lead to the possibility of instantiating page-tables after
@@ -26,6 +26,7 @@
 #include <linux/pkeys.h>
 #include <linux/ksm.h>
 #include <linux/uaccess.h>
+#include <linux/pte_share.h>
 #include <asm/pgtable.h>
 #include <asm/cacheflush.h>
 #include <asm/mmu_context.h>
@@ -183,6 +184,12 @@ static inline unsigned long change_pmd_range(struct vm_area_struct *vma,
 			}
 			/* fall through, the trans huge pmd just split */
 		}
+		/*
+		 * mprotect_fixup() has unshared the range; NUMA hinting leaves
+		 * tables shared with other mms alone.
+		 */
+		if (pte_table_shared(pmd))
+			continue;
 		this_pages = change_pte_range(vma, pmd, addr, next, newprot,
 				 dirty_accountable, prot_numa);
 		pages += this_pages;
@@ -326,6 +333,11 @@ mprotect_fixup(struct vm_area_struct *vma, struct vm_area_struct **pprev,
 			return error;
 	}
 
+	/* The new protection must not apply to other holders of a table */
+	error = pte_table_unshare_range(vma, start, end);
+	if (error)
+		return error;
+
 	/*
 	 * If we make a private mapping writable we increase our commit;
 	 * but (without finer accounting) cannot reduce our commit if we
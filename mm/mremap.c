@@ -22,6 +22,7 @@
 #include <linux/mmu_notifier.h>
 #include <linux/uaccess.h>
 #include <linux/mm-arch-hooks.h>
+#include <linux/pte_share.h>
 
 #include <asm/cacheflush.h>
 #include <asm/tlbflush.h>
@@ -229,6 +230,9 @@ unsigned long move_page_tables(struct vm_area_struct *vma,
 			if (pmd_trans_unstable(old_pmd))
 				continue;
 		}
+		if (pte_table_shared(old_pmd) &&
+		    pte_table_unshare(vma, old_pmd, old_addr))
+			break;
 		if (pte_alloc(new_vma->vm_mm, new_pmd, new_addr))
 			break;
 		next = (new_addr + PMD_SIZE) & PMD_MASK;
@@ -0,0 +1,479 @@
+/*
+ *  mm/pte_share.c
+ *
+ *  Sharing of PTE tables between parent and child across fork().
+ *
+ *  When vm.fork_share_pte_kb is set, fork() does not copy a PTE table
+ *  that lies entirely within a private anonymous mapping of at least that
+ *  size.  The parent's entries are write protected as copy_one_pte()
+ *  would do and the child's pmd is pointed at the same table.  A holder
+ *  gets its own copy of the table the first time it faults on it or has
+ *  to modify it otherwise; when it unmaps all of it or exits, it just
+ *  drops its reference.
+ *
+ *  A page mapped through a shared table is refcounted and mapcounted
+ *  once, however many mms hold the table.  rmap walkers that modify the
+ *  table (reclaim, migration) reach it through any of the holders, so
+ *  they leave the rss counters alone and flush the TLBs of all holders.
+ *  Every holder is charged the rss the table had when it was first
+ *  shared, and the difference to what it maps is settled when the holder
+ *  gets a private table.
+ *
+ *  fork() sets aside an empty table for each new holder, as THP deposits
+ *  one for splitting a huge pmd, so getting a private table never has to
+ *  allocate one.  It can only fail when copying a swap entry needs a
+ *  swap count continuation.
+ *
+ *  Everything else that changes a shared table must first call
+ *  pte_table_unshare() with mmap_sem held.
+ */
+
+#include <linux/mm.h>
+#include <linux/pte_share.h>
+#include <linux/rmap.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/slab.h>
+#include <linux/mmu_notifier.h>
+#include <linux/userfaultfd_k.h>
+
+#include <asm/pgalloc.h>
+#include <asm/tlb.h>
+#include <asm/tlbflush.h>
+
+#include "internal.h"
+
+unsigned long sysctl_fork_share_pte_kb __read_mostly;
+
+static bool vma_can_share_pte(struct vm_area_struct *vma,
+			      unsigned long addr, unsigned long end)
+{
+	unsigned long min_kb = READ_ONCE(sysctl_fork_share_pte_kb);
+
+	/* Holders serialise on the table's ptl, not on their own mm's. */
+	if (!USE_SPLIT_PTE_PTLOCKS || !min_kb)
+		return false;
+	if ((addr & ~PMD_MASK) || end - addr != PMD_SIZE)
+		return false;
+	if (!vma_is_anonymous(vma) || !vma->anon_vma)
+		return false;
+	if (vma->vm_flags & (VM_SHARED | VM_LOCKED | VM_HUGETLB | VM_IO |
+			     VM_PFNMAP | VM_MIXEDMAP))
+		return false;
+	if (userfaultfd_armed(vma))
+		return false;
+	return (vma->vm_end - vma->vm_start) >> 10 >= min_kb;
+}
+
+/* Account what the table mapping [addr, addr + PMD_SIZE) holds. */
+static void pte_table_rss(struct vm_area_struct *vma, pte_t *pte,
+			  unsigned long addr, long *rss)
+{
+	int i;
+
+	for (i = 0; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE) {
+		pte_t ptent = pte[i];
+		swp_entry_t entry;
+		struct page *page;
+
+		if (pte_none(ptent))
+			continue;
+		if (pte_present(ptent)) {
+			page = vm_normal_page(vma, addr, ptent);
+			if (page)
+				rss[mm_counter(page)]++;
+			continue;
+		}
+		entry = pte_to_swp_entry(ptent);
+		if (!non_swap_entry(entry))
+			rss[MM_SWAPENTS]++;
+		else if (is_migration_entry(entry))
+			rss[mm_counter(migration_entry_to_page(entry))]++;
+	}
+}
+
+/* COW mappings require pages in both parent and child to be read-only. */
+static void pte_table_wrprotect(struct mm_struct *mm, pte_t *pte,
+				unsigned long addr)
+{
+	int i;
+
+	for (i = 0; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE) {
+		pte_t ptent = pte[i];
+		swp_entry_t entry;
+
+		if (pte_none(ptent))
+			continue;
+		if (pte_present(ptent)) {
+			if (pte_write(ptent))
+				ptep_set_wrprotect(mm, addr, &pte[i]);
+			continue;
+		}
+		entry = pte_to_swp_entry(ptent);
+		if (is_write_migration_entry(entry)) {
+			make_migration_entry_read(&entry);
+			ptent = swp_entry_to_pte(entry);
+			if (pte_swp_soft_dirty(pte[i]))
+				ptent = pte_swp_mksoft_dirty(ptent);
+			set_pte_at(mm, addr, &pte[i], ptent);
+		}
+	}
+}
+
+/* Drop what pte_table_copy() took for the first @nr entries of @dst. */
+static void pte_table_uncopy(struct vm_area_struct *vma, pte_t *dst,
+			     unsigned long addr, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++, addr += PAGE_SIZE) {
+		pte_t ptent = ptep_get_and_clear(vma->vm_mm, addr, &dst[i]);
+		swp_entry_t entry;
+		struct page *page;
+
+		if (pte_none(ptent))
+			continue;
+		if (pte_present(ptent)) {
+			page = vm_normal_page(vma, addr, ptent);
+			if (page) {
+				page_remove_rmap(page, false);
+				put_page(page);
+			}
+			continue;
+		}
+		entry = pte_to_swp_entry(ptent);
+		if (!non_swap_entry(entry))
+			swap_free(entry);
+	}
+}
+
+/*
+ * Copy the shared table @src into @dst as copy_one_pte() would, except
+ * that the entries are already write protected.  Returns the swap entry
+ * that needs a count continuation, with @dst left empty, or 0.
+ */
+static unsigned long pte_table_copy(struct vm_area_struct *vma, pte_t *dst,
+				    pte_t *src, unsigned long addr, long *rss)
+{
+	unsigned long start = addr;
+	int i;
+
+	for (i = 0; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE) {
+		pte_t ptent = src[i];
+		swp_entry_t entry;
+		struct page *page;
+
+		if (pte_none(ptent))
+			continue;
+		if (pte_present(ptent)) {
+			page = vm_normal_page(vma, addr, ptent);
+			if (page) {
+				get_page(page);
+				page_dup_rmap(page, false);
+				rss[mm_counter(page)]++;
+			}
+		} else {
+			entry = pte_to_swp_entry(ptent);
+			if (!non_swap_entry(entry)) {
+				if (swap_duplicate(entry) < 0) {
+					pte_table_uncopy(vma, dst, start, i);
+					return entry.val;
+				}
+				rss[MM_SWAPENTS]++;
+			} else if (is_migration_entry(entry)) {
+				page = migration_entry_to_page(entry);
+				rss[mm_counter(page)]++;
+			}
+		}
+		set_pte_at(vma->vm_mm, addr, &dst[i], ptent);
+	}
+	return 0;
+}
+
+/* swapoff finds swap entries through the mmlist, so all holders must be on it. */
+static void pte_share_add_mmlist(struct mm_struct *src_mm,
+				 struct mm_struct *dst_mm)
+{
+	if (!list_empty(&dst_mm->mmlist))
+		return;
+
+	spin_lock(&mmlist_lock);
+	if (list_empty(&src_mm->mmlist))
+		list_add(&src_mm->mmlist, &init_mm.mmlist);
+	if (list_empty(&dst_mm->mmlist))
+		list_add(&dst_mm->mmlist, &src_mm->mmlist);
+	spin_unlock(&mmlist_lock);
+}
+
+/*
+ * Called by fork, with the parent's mmap_sem held for write, instead of
+ * copying the table @src_pmd points to.  Returns 0 if @dst_pmd now maps
+ * the same table, or an error if the range has to be copied.
+ */
+int pte_table_share(struct mm_struct *dst_mm, struct mm_struct *src_mm,
+		    pmd_t *dst_pmd, pmd_t *src_pmd, struct vm_area_struct *vma,
+		    unsigned long addr, unsigned long end)
+{
+	struct page *table = pmd_pgtable(*src_pmd);
+	struct pte_share_holder *holder, *src_holder;
+	struct pte_share *share, *new;
+	long rss[NR_MM_COUNTERS];
+	pgtable_t spare;
+	spinlock_t *ptl;
+	pte_t *pte;
+	int i;
+
+	if (!vma_can_share_pte(vma, addr, end))
+		return -EINVAL;
+
+	/*
+	 * The table might stop being shared by the time we hold its ptl, so
+	 * be ready to share it for the first time either way.
+	 */
+	spare = pte_alloc_one(dst_mm, addr);
+	if (!spare)
+		return -ENOMEM;
+	holder = kmalloc(sizeof(*holder), GFP_KERNEL);
+	src_holder = kmalloc(sizeof(*src_holder), GFP_KERNEL);
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!holder || !src_holder || !new) {
+		kfree(new);
+		kfree(src_holder);
+		kfree(holder);
+		pte_free(dst_mm, spare);
+		return -ENOMEM;
+	}
+
+	pte = pte_offset_map_lock(src_mm, src_pmd, addr, &ptl);
+	share = table->pte_share;
+	if (!share) {
+		share = new;
+		new = NULL;
+		INIT_LIST_HEAD(&share->mms);
+		INIT_LIST_HEAD(&share->spare);
+		/* The parent's TLB is flushed by dup_mmap() */
+		pte_table_wrprotect(src_mm, pte, addr);
+		pte_table_rss(vma, pte, addr, share->charged);
+		src_holder->mm = src_mm;
+		list_add(&src_holder->list, &share->mms);
+		src_holder = NULL;
+		share->holders = 1;
+		WRITE_ONCE(table->pte_share, share);
+	}
+	share->holders++;
+	holder->mm = dst_mm;
+	list_add(&holder->list, &share->mms);
+	list_add(&spare->lru, &share->spare);
+	memcpy(rss, share->charged, sizeof(rss));
+	pte_unmap_unlock(pte, ptl);
+	kfree(src_holder);
+	kfree(new);
+
+	pte_share_add_mmlist(src_mm, dst_mm);
+
+	ptl = pmd_lock(dst_mm, dst_pmd);
+	VM_BUG_ON(!pmd_none(*dst_pmd));
+	mm_inc_nr_ptes(dst_mm);
+	pmd_populate(dst_mm, dst_pmd, table);
+	spin_unlock(ptl);
+
+	for (i = 0; i < NR_MM_COUNTERS; i++)
+		if (rss[i])
+			add_mm_counter(dst_mm, i, rss[i]);
+	return 0;
+}
+
+/* Caller holds the table's ptl */
+static struct pte_share_holder *pte_share_del_holder(struct pte_share *share,
+						     struct mm_struct *mm)
+{
+	struct pte_share_holder *holder;
+
+	list_for_each_entry(holder, &share->mms, list) {
+		if (holder->mm == mm) {
+			list_del(&holder->list);
+			return holder;
+		}
+	}
+	WARN_ON_ONCE(1);
+	return NULL;
+}
+
+/* Caller holds the table's ptl */
+static pgtable_t pte_share_withdraw(struct pte_share *share)
+{
+	pgtable_t table = list_first_entry(&share->spare, struct page, lru);
+
+	list_del(&table->lru);
+	/* page->pte_share overlays page->lru */
+	table->pte_share = NULL;
+	return table;
+}
+
+/*
+ * Give @vma's mm a private table for the pmd mapping @addr, either a copy
+ * of the shared one or, if @copy is false, an empty one.  If this mm is
+ * the last holder it simply keeps the table.  @gfp is for the swap count
+ * continuations a copy may need.
+ */
+static int __pte_table_unshare(struct vm_area_struct *vma, pmd_t *pmd,
+			       unsigned long addr, bool copy, bool flush,
+			       gfp_t gfp)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long haddr = addr & PMD_MASK;
+	struct pte_share_holder *holder = NULL;
+	struct pte_share *share, *free = NULL;
+	long rss[NR_MM_COUNTERS];
+	spinlock_t *pmd_ptl, *ptl;
+	struct page *table;
+	swp_entry_t entry;
+	pgtable_t new;
+	pmd_t pmdval;
+	pte_t *pte;
+	int i;
+
+again:
+	pmd_ptl = pmd_lock(mm, pmd);
+	pmdval = *pmd;
+	if (pmd_none(pmdval) || pmd_bad(pmdval))
+		goto out_unlock_pmd;
+	table = pmd_pgtable(pmdval);
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock_nested(ptl, SINGLE_DEPTH_NESTING);
+	share = table->pte_share;
+	if (!share)
+		goto out_unlock;
+
+	memset(rss, 0, sizeof(rss));
+	pte = pte_offset_map(pmd, haddr);
+	if (share->holders == 1) {
+		VM_BUG_ON(!list_empty(&share->spare));
+		pte_table_rss(vma, pte, haddr, rss);
+		WRITE_ONCE(table->pte_share, NULL);
+		free = share;
+	} else if (copy) {
+		new = list_first_entry(&share->spare, struct page, lru);
+		entry.val = pte_table_copy(vma, page_address(new), pte,
+					   haddr, rss);
+		if (entry.val) {
+			pte_unmap(pte);
+			spin_unlock(ptl);
+			spin_unlock(pmd_ptl);
+			if (add_swap_count_continuation(entry, gfp) < 0)
+				return -ENOMEM;
+			goto again;
+		}
+	}
+	pte_unmap(pte);
+
+	for (i = 0; i < NR_MM_COUNTERS; i++)
+		if (rss[i] != share->charged[i])
+			add_mm_counter(mm, i, rss[i] - share->charged[i]);
+
+	holder = pte_share_del_holder(share, mm);
+	if (!free) {
+		share->holders--;
+		new = pte_share_withdraw(share);
+		/*
+		 * Either the new table maps exactly what the old one does or
+		 * the caller is about to zap the range, so there is no need
+		 * to break before make; the flush drops the old walk cache
+		 * and TLB entries of this mm.
+		 */
+		smp_wmb(); /* See comment in __pte_alloc() */
+		pmd_populate(mm, pmd, new);
+		if (flush)
+			flush_tlb_range(vma, haddr, haddr + PMD_SIZE);
+	}
+out_unlock:
+	spin_unlock(ptl);
+out_unlock_pmd:
+	spin_unlock(pmd_ptl);
+	kfree(holder);
+	kfree(free);
+	return 0;
+}
+
+/**
+ * pte_table_unshare - give this mm a private copy of a shared PTE table
+ * @vma: vma the fault or modification is for
+ * @pmd: pmd that maps the table
+ * @addr: address within the range of @pmd
+ *
+ * Must be called with mmap_sem held.  Returns 0, or -ENOMEM if a swap
+ * count continuation for the copy could not be allocated.
+ */
+int pte_table_unshare(struct vm_area_struct *vma, pmd_t *pmd,
+		      unsigned long addr)
+{
+	return __pte_table_unshare(vma, pmd, addr, true, true, GFP_KERNEL);
+}
+
+/* Unshare all tables mapping [start, end) of @vma. */
+int pte_table_unshare_range(struct vm_area_struct *vma,
+			    unsigned long start, unsigned long end)
+{
+	unsigned long addr;
+	pmd_t *pmd;
+	int err;
+
+	for (addr = start & PMD_MASK; addr < end; addr += PMD_SIZE) {
+		pmd = mm_find_pmd(vma->vm_mm, addr);
+		if (!pmd || !pte_table_shared(pmd))
+			continue;
+		err = pte_table_unshare(vma, pmd, addr);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+/*
+ * Called from zap_pmd_range() for a shared table.  Returns true if the
+ * table must be skipped, otherwise the pmd maps a private table that is
+ * zapped as usual.  A table zapped in full is swapped for an empty one,
+ * not copied; the pmd is never cleared here as rmap walkers may still be
+ * looking at it.
+ */
+bool pte_table_zap_shared(struct mmu_gather *tlb, struct vm_area_struct *vma,
+			  pmd_t *pmd, unsigned long addr, unsigned long end)
+{
+	bool whole = tlb->fullmm ||
+		     (!(addr & ~PMD_MASK) && end - addr == PMD_SIZE);
+
+	/*
+	 * The oom reaper must not wait for memory, and dropping this mm's
+	 * reference frees nothing while others hold the table.
+	 */
+	if (!tlb->fullmm && test_bit(MMF_UNSTABLE, &tlb->mm->flags))
+		return true;
+
+	/*
+	 * Zapping cannot fail. Only a partial zap copies, and the rare swap
+	 * count continuation it may need is a single page.
+	 */
+	__pte_table_unshare(vma, pmd, addr, !whole, !tlb->fullmm,
+			    GFP_KERNEL | __GFP_NOFAIL);
+	return false;
+}
+
+/*
+ * Called by rmap with the table's ptl held, after clearing the entry that
+ * maps @addr in a shared table through @mm.  The other holders may still
+ * have it cached in their TLBs and secondary MMUs.
+ */
+void pte_table_flush_holders(struct mm_struct *mm, pte_t *ptep,
+			     unsigned long addr)
+{
+	struct pte_share *share = virt_to_page(ptep)->pte_share;
+	struct pte_share_holder *holder;
+
+	list_for_each_entry(holder, &share->mms, list) {
+		if (holder->mm == mm)
+			continue;
+		flush_tlb_mm(holder->mm);
+		mmu_notifier_invalidate_range(holder->mm, addr,
+					      addr + PAGE_SIZE);
+	}
+}
@@ -61,6 +61,7 @@
 #include <linux/hugetlb.h>
 #include <linux/backing-dev.h>
 #include <linux/page_idle.h>
+#include <linux/pte_share.h>
 
 #include <asm/tlbflush.h>
 
@@ -759,7 +760,7 @@ out:
 pte_t *__page_check_address(struct page *page, struct mm_struct *mm,
 			  unsigned long address, spinlock_t **ptlp, int sync)
 {
-	pmd_t *pmd;
+	pmd_t *pmd = NULL;
 	pte_t *pte;
 	spinlock_t *ptl;
 
@@ -787,10 +788,14 @@ pte_t *__page_check_address(struct page *page, struct mm_struct *mm,
 	ptl = pte_lockptr(mm, pmd);
 check:
 	spin_lock(ptl);
+	/* A shared PTE table may have been unshared since we looked */
+	if (pmd && unlikely(pte_table_stale(pmd, pte)))
+		goto out_unlock;
 	if (pte_present(*pte) && page_to_pfn(page) == pte_pfn(*pte)) {
 		*ptlp = ptl;
 		return pte;
 	}
+out_unlock:
 	pte_unmap_unlock(pte, ptl);
 	return NULL;
 }
@@ -1484,6 +1489,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	unsigned long spmd_start, spmd_end;
 	struct rmap_private *rp = arg;
 	enum ttu_flags flags = rp->flags;
+	bool shared;
 
 	/* munlock has nothing to gain from examining un-locked vmas */
 	if ((flags & TTU_MUNLOCK) && !(vma->vm_flags & VM_LOCKED))
@@ -1528,6 +1534,13 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	if (!pte)
 		goto out;
 
+	/*
+	 * A PTE table shared across fork is reached through every holder's
+	 * vma but maps the page once: the rss counters are settled when the
+	 * table is unshared, and the TLBs of all holders have to be flushed.
+	 */
+	shared = !PageHuge(page) && pte_table_shared_ptep(pte);
+
 	/*
 	 * If the page is mlock()d, we cannot swap it out.
 	 * If it's recently referenced (perhaps page_referenced
@@ -1585,7 +1598,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 
 	/* Nuke the page table entry. */
 	flush_cache_page(vma, address, page_to_pfn(page));
-	if (should_defer_flush(mm, flags)) {
+	if (!shared && should_defer_flush(mm, flags)) {
 		/*
 		 * We clear the PTE but do not flush so potentially a remote
 		 * CPU could still be writing to the page. If the entry was
@@ -1598,6 +1611,8 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		set_tlb_ubc_flush_pending(mm, page, pte_dirty(pteval));
 	} else {
 		pteval = ptep_clear_flush(vma, address, pte);
+		if (shared)
+			pte_table_flush_holders(mm, pte, address);
 	}
 
 	/* Move the dirty bit to the physical page now the pte is gone. */
@@ -1610,7 +1625,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	if (PageHWPoison(page) && !(flags & TTU_IGNORE_HWPOISON)) {
 		if (PageHuge(page)) {
 			hugetlb_count_sub(1 << compound_order(page), mm);
-		} else {
+		} else if (!shared) {
 			dec_mm_counter(mm, mm_counter(page));
 		}
 #ifdef CONFIG_RKP_DMAP_PROT
@@ -1624,7 +1639,8 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		 * interest anymore. Simply discard the pte, vmscan
 		 * will take care of the rest.
 		 */
-		dec_mm_counter(mm, mm_counter(page));
+		if (!shared)
+			dec_mm_counter(mm, mm_counter(page));
 	} else if (IS_ENABLED(CONFIG_MIGRATION) && (flags & TTU_MIGRATION)) {
 		swp_entry_t entry;
 		pte_t swp_pte;
@@ -1652,7 +1668,8 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 
 		if (!PageDirty(page) && (flags & TTU_LZFREE)) {
 			/* It's a freeable page by MADV_FREE */
-			dec_mm_counter(mm, MM_ANONPAGES);
+			if (!shared)
+				dec_mm_counter(mm, MM_ANONPAGES);
 			rp->lazyfreed++;
 			goto discard;
 		}
@@ -1671,8 +1688,10 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 				list_add(&mm->mmlist, &init_mm.mmlist);
 			spin_unlock(&mmlist_lock);
 		}
-		dec_mm_counter(mm, MM_ANONPAGES);
-		inc_mm_counter(mm, MM_SWAPENTS);
+		if (!shared) {
+			dec_mm_counter(mm, MM_ANONPAGES);
+			inc_mm_counter(mm, MM_SWAPENTS);
+		}
 		swp_pte = swp_entry_to_pte(entry);
 		if (pte_soft_dirty(pteval))
 			swp_pte = pte_swp_mksoft_dirty(swp_pte);
@@ -1680,7 +1699,7 @@ static int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		dmap_prot((u64)pte_val(swp_pte),0,0);
 #endif
 		set_pte_at(mm, address, pte, swp_pte);
-	} else
+	} else if (!shared)
 		dec_mm_counter(mm, mm_counter_file(page));
 
 discard:
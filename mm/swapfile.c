@@ -40,6 +40,7 @@
 #include <asm/tlbflush.h>
 #include <linux/swapops.h>
 #include <linux/swap_cgroup.h>
+#include <linux/pte_share.h>
 
 static bool swap_count_continued(struct swap_info_struct *, pgoff_t,
 				 unsigned char);
@@ -1532,6 +1533,11 @@ static int unuse_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
 		 */
 		if (unlikely(pte_same_as_swp(*pte, swp_pte))) {
 			pte_unmap(pte);
+			if (pte_table_shared(pmd)) {
+				ret = pte_table_unshare(vma, pmd, addr);
+				if (ret)
+					goto out;
+			}
 			ret = unuse_pte(vma, pmd, addr, entry, page);
 			if (ret)
 				goto out;
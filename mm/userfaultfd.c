@@ -14,6 +14,7 @@
 #include <linux/swapops.h>
 #include <linux/userfaultfd_k.h>
 #include <linux/mmu_notifier.h>
+#include <linux/pte_share.h>
 #include <asm/tlbflush.h>
 #include "internal.h"
 
@@ -239,6 +240,12 @@ retry:
 		BUG_ON(pmd_none(*dst_pmd));
 		BUG_ON(pmd_trans_huge(*dst_pmd));
 
+		if (unlikely(pte_table_shared(dst_pmd)) &&
+		    pte_table_unshare(dst_vma, dst_pmd, dst_addr)) {
+			err = -ENOMEM;
+			break;
+		}
+
 		if (!zeropage)
 			err = mcopy_atomic_pte(dst_mm, dst_pmd, dst_vma,
 					       dst_addr, src_addr, &page);
@@ -6,11 +6,19 @@
  * as published by the Free Software Foundation.
 */
 
+#include <linux/dcache.h>
 #include <linux/file.h>
+#include <linux/fs_struct.h>
+#include <linux/hash.h>
+#include <linux/path.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/string.h>
 #include <linux/types.h>
 #include <linux/unistd.h>
 #include <linux/spinlock.h>
 #include "include/defex_caches.h"
+#include "../../../fs/mount.h"
 
 static struct defex_file_cache_list file_cache;
 
@@ -175,3 +183,136 @@ struct file *defex_file_cache_find(int pid)
 
 	return (!cache_found)?NULL:current_entry->file_addr;
 }
+
+/*
+ * Each entry has its own seqlock, so lookups run without taking a lock
+ * and updates only serialize against users of the same slot.
+ */
+static struct defex_path_cache_entry path_cache[PATH_CACHE_SIZE] = {
+	[0 ... PATH_CACHE_SIZE - 1] = {
+		.lock = __SEQLOCK_UNLOCKED(path_cache.lock),
+	},
+};
+static DEFINE_PER_CPU(struct defex_path_cache_stats, path_cache_stats);
+
+void defex_path_cache_init(void)
+{
+	struct defex_path_cache_entry *current_entry;
+	int i;
+
+	for (i = 0; i < PATH_CACHE_SIZE; i++) {
+		current_entry = &path_cache[i];
+		write_seqlock(&current_entry->lock);
+		current_entry->dentry = NULL;
+		write_sequnlock(&current_entry->lock);
+	}
+}
+
+/*
+ * Any rename or mount table change may give a cached dentry a different
+ * path name, so both invalidate the whole cache.
+ */
+unsigned int defex_path_cache_seq(void)
+{
+	return read_seqbegin(&rename_lock) + read_seqbegin(&mount_lock);
+}
+
+static void get_current_root(struct path *root)
+{
+	struct fs_struct *fs = current->fs;
+
+	spin_lock(&fs->lock);
+	*root = fs->root;
+	spin_unlock(&fs->lock);
+}
+
+static struct defex_path_cache_entry *path_cache_entry(const struct path *dpath, int attribute)
+{
+	return &path_cache[hash_long((unsigned long)dpath->dentry ^ attribute, PATH_CACHE_BITS)];
+}
+
+/*
+ * The cached pointers are never dereferenced, only compared. The inode
+ * number and generation catch a dentry and inode that were freed and
+ * reused for a different file.
+ */
+static bool path_cache_match(const struct defex_path_cache_entry *current_entry,
+			     const struct path *dpath, int attribute, unsigned int seq,
+			     const struct path *root)
+{
+	const struct inode *inode = d_backing_inode(dpath->dentry);
+
+	return current_entry->seq == seq &&
+		current_entry->attribute == attribute &&
+		current_entry->dentry == dpath->dentry &&
+		current_entry->mnt == dpath->mnt &&
+		current_entry->parent == dpath->dentry->d_parent &&
+		current_entry->inode == inode &&
+		inode &&
+		current_entry->ino == inode->i_ino &&
+		current_entry->generation == inode->i_generation &&
+		path_equal(&current_entry->root, root);
+}
+
+int defex_path_cache_find(const struct path *dpath, int attribute, unsigned int seq, int *result)
+{
+	struct defex_path_cache_entry *current_entry;
+	struct path root;
+	unsigned int entry_seq;
+	int cache_found;
+
+	get_current_root(&root);
+
+	current_entry = path_cache_entry(dpath, attribute);
+	do {
+		entry_seq = read_seqbegin(&current_entry->lock);
+		cache_found = path_cache_match(current_entry, dpath, attribute, seq, &root);
+		if (cache_found)
+			*result = current_entry->result;
+	} while (read_seqretry(&current_entry->lock, entry_seq));
+
+	if (cache_found)
+		this_cpu_inc(path_cache_stats.hits);
+	else
+		this_cpu_inc(path_cache_stats.misses);
+
+	return cache_found;
+}
+
+void defex_path_cache_add(const struct path *dpath, int attribute, unsigned int seq, int result)
+{
+	struct defex_path_cache_entry *current_entry;
+	struct inode *inode = d_backing_inode(dpath->dentry);
+	struct path root;
+
+	/* Raced with a rename or mount, the result may already be stale */
+	if (defex_path_cache_seq() != seq || !inode)
+		return;
+
+	get_current_root(&root);
+
+	current_entry = path_cache_entry(dpath, attribute);
+	write_seqlock(&current_entry->lock);
+	current_entry->mnt = dpath->mnt;
+	current_entry->dentry = dpath->dentry;
+	current_entry->parent = dpath->dentry->d_parent;
+	current_entry->inode = inode;
+	current_entry->ino = inode->i_ino;
+	current_entry->generation = inode->i_generation;
+	current_entry->root = root;
+	current_entry->seq = seq;
+	current_entry->attribute = attribute;
+	current_entry->result = result;
+	write_sequnlock(&current_entry->lock);
+}
+
+void defex_path_cache_get_stats(struct defex_path_cache_stats *stats)
+{
+	int cpu;
+
+	memset(stats, 0, sizeof(*stats));
+	for_each_possible_cpu(cpu) {
+		stats->hits += per_cpu(path_cache_stats, cpu).hits;
+		stats->misses += per_cpu(path_cache_stats, cpu).misses;
+	}
+}
@@ -7,6 +7,8 @@
 */
 
 #include <linux/cred.h>
+#include <linux/file.h>
+#include <linux/fs.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/kobject.h>
@@ -14,10 +16,13 @@
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/sysfs.h>
+#include "include/defex_caches.h"
 #include "include/defex_debug.h"
 #include "include/defex_internal.h"
+#include "include/defex_rules.h"
 
 static int last_cmd;
+static int last_lookup;
 
 static int set_user(struct cred *new_cred)
 {
@@ -86,6 +91,40 @@ do_abort:
 	return -EPERM;
 }
 
+/*
+ * Returns the rule features the file matches, as rules_lookup() sees
+ * them, for testing the rules and their caching from userspace.
+ */
+static int lookup_file(const char *name)
+{
+	static const int attributes[] = {
+		feature_ped_exception,
+		feature_safeplace_path,
+		feature_immutable_path_open,
+		feature_immutable_path_write,
+		feature_immutable_src_exception
+	};
+	struct file *f;
+	char *path;
+	int i;
+
+	path = kstrdup(name, GFP_KERNEL);
+	if (!path)
+		return -ENOMEM;
+	f = filp_open(strim(path), O_RDONLY, 0);
+	kfree(path);
+	if (IS_ERR(f))
+		return PTR_ERR(f);
+
+	last_lookup = 0;
+	for (i = 0; i < ARRAY_SIZE(attributes); i++) {
+		if (rules_lookup(&f->f_path, attributes[i], f))
+			last_lookup |= attributes[i];
+	}
+	filp_close(f, NULL);
+	return 0;
+}
+
 static ssize_t debug_store(struct kobject *kobj, struct kobj_attribute *attr, const char *buf, size_t count)
 {
 	struct task_struct *p = current;
@@ -95,7 +134,8 @@ static ssize_t debug_store(struct kobject *kobj, struct kobj_attribute *attr, co
 	static const char *prefix[] = {
 		"uid=",
 		"fsuid=",
-		"gid="
+		"gid=",
+		"lookup="
 	};
 
 	if (!buf || !p)
@@ -116,6 +156,9 @@ static ssize_t debug_store(struct kobject *kobj, struct kobj_attribute *attr, co
 			return -EINVAL;
 		ret = set_cred(i, new_val);
 		break;
+	case DBG_LOOKUP:
+		ret = lookup_file(buf + l);
+		break;
 	default:
 		break;
 	}
@@ -141,6 +184,19 @@ static ssize_t debug_show(struct kobject *kobj, struct kobj_attribute *attr, cha
 			uid_get_value(p->cred->euid),
 			uid_get_value(p->cred->egid));
 		break;
+	case DBG_LOOKUP:
+#ifdef DEFEX_CACHES_ENABLE
+	{
+		struct defex_path_cache_stats stats;
+
+		defex_path_cache_get_stats(&stats);
+		res = snprintf(buf, MAX_LEN + 1, "features=%d\ncache_hits=%lu\ncache_misses=%lu\n",
+			last_lookup, stats.hits, stats.misses);
+	}
+#else
+		res = snprintf(buf, MAX_LEN + 1, "features=%d\n", last_lookup);
+#endif /* DEFEX_CACHES_ENABLE */
+		break;
 	}
 
 	return res;
@@ -36,6 +36,9 @@ static DEFINE_SPINLOCK(creds_hash_update_lock);
 static struct proc_cred_data *creds_fast_hash[MAX_PID_32 + 1];
 static int creds_fast_hash_ready;
 
+/* Bumped when a stored reference changes, drops the cached verdicts */
+atomic_t creds_hash_gen = ATOMIC_INIT(1);
+
 void creds_fast_hash_init(void)
 {
 	unsigned int i;
@@ -51,6 +54,22 @@ int is_task_creds_ready(void)
 }
 
 #ifdef DEFEX_PED_ENABLE
+/*
+ * Called under creds_hash_update_lock: a reader that sees the new
+ * generation before taking the lock also sees the new values.
+ */
+static inline void creds_hash_update(struct proc_cred_data *cred_data,
+	unsigned int uid, unsigned int fsuid, unsigned int egid, unsigned int p_root)
+{
+	if (cred_data->uid != uid || cred_data->fsuid != fsuid ||
+			cred_data->egid != egid || cred_data->p_root != p_root)
+		atomic_inc(&creds_hash_gen);
+	cred_data->uid = uid;
+	cred_data->fsuid = fsuid;
+	cred_data->egid = egid;
+	cred_data->p_root = p_root;
+}
+
 void get_task_creds(int pid, unsigned int *uid_ptr, unsigned int *fsuid_ptr, unsigned int *egid_ptr, unsigned int *p_root_ptr)
 {
 	struct proc_cred_struct *obj;
@@ -94,7 +113,7 @@ int set_task_creds(int pid, unsigned int uid, unsigned int fsuid, unsigned int e
 alloc_obj:;
 	if (pid <= MAX_PID_32) {
 		if (!creds_fast_hash[pid]) {
-			tmp_data = kmalloc(sizeof(struct proc_cred_data), GFP_ATOMIC);
+			tmp_data = kzalloc(sizeof(struct proc_cred_data), GFP_ATOMIC);
 			if (!tmp_data)
 				return -1;
 		}
@@ -112,10 +131,7 @@ alloc_obj:;
 			creds_fast_hash[pid] = cred_data;
 			tmp_data = NULL;
 		}
-		cred_data->uid = uid;
-		cred_data->fsuid = fsuid;
-		cred_data->egid = egid;
-		cred_data->p_root = p_root;
+		creds_hash_update(cred_data, uid, fsuid, egid, p_root);
 		spin_unlock_irqrestore(&creds_hash_update_lock, flags);
 		if (tmp_data)
 			kfree(tmp_data);
@@ -124,10 +140,7 @@ alloc_obj:;
 
 	spin_lock_irqsave(&creds_hash_update_lock, flags);
 	hash_for_each_possible(creds_hash, obj, node, pid) {
-		obj->cred_data.uid = uid;
-		obj->cred_data.fsuid = fsuid;
-		obj->cred_data.egid = egid;
-		obj->cred_data.p_root = p_root;
+		creds_hash_update(&obj->cred_data, uid, fsuid, egid, p_root);
 		spin_unlock_irqrestore(&creds_hash_update_lock, flags);
 		return 0;
 	}
@@ -144,6 +157,7 @@ alloc_obj:;
 #endif /* DEFEX_PED_BASED_ON_TGID_ENABLE */
 	spin_lock_irqsave(&creds_hash_update_lock, flags);
 	hash_add(creds_hash, &obj->node, pid);
+	atomic_inc(&creds_hash_gen);
 	spin_unlock_irqrestore(&creds_hash_update_lock, flags);
 	return 0;
 }
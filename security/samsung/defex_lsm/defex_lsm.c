@@ -56,6 +56,7 @@ static int __init defex_lsm_init(void)
 
 #ifdef DEFEX_CACHES_ENABLE
 	defex_file_cache_init();
+	defex_path_cache_init();
 #endif /* DEFEX_CACHES_ENABLE */
 	creds_fast_hash_init();
 
@@ -79,6 +79,7 @@ ssize_t task_defex_privesc_store_status(struct defex_privesc *privesc_obj,
 	if (ret != 0 || status > 2)
 		return -EINVAL;
 	privesc_obj->status = status;
+	atomic_inc(&creds_hash_gen);
 
 	return count;
 }
@@ -279,6 +279,40 @@ skip_secured:
 #endif /* DEFEX_PED_ENABLE */
 
 #ifdef DEFEX_PED_ENABLE
+/*
+ * Per-task cache of the last PED verdict that allowed the task.  It holds
+ * as long as the credential ids, the executable and the stored reference
+ * creds (creds_hash_gen) are all unchanged.  The ids are compared by value
+ * and not by the cred pointer: an in-place overwrite of the cred is what
+ * PED is there to catch.
+ */
+static inline const void *task_defex_exe(struct task_struct *p)
+{
+	return READ_ONCE(p->mm->exe_file);
+}
+
+static bool task_defex_verdict_cached(struct task_struct *p)
+{
+	const struct cred *cred = p->cred;
+
+	return p == current &&
+		p->defex_gen == atomic_read(&creds_hash_gen) &&
+		!memcmp(p->defex_ids, &cred->uid, sizeof(p->defex_ids)) &&
+		p->defex_exe == task_defex_exe(p);
+}
+
+static void task_defex_verdict_cache(struct task_struct *p, unsigned int gen)
+{
+	BUILD_BUG_ON(offsetof(struct cred, fsgid) - offsetof(struct cred, uid) !=
+		sizeof(p->defex_ids) - sizeof(p->defex_ids[0]));
+
+	if (p != current || !is_task_creds_ready())
+		return;
+	memcpy(p->defex_ids, &p->cred->uid, sizeof(p->defex_ids));
+	p->defex_exe = task_defex_exe(p);
+	p->defex_gen = gen;
+}
+
 static int at_same_group(unsigned int uid1, unsigned int uid2)
 {
 	static const unsigned int lod_base = 0x61A8;
@@ -670,6 +704,12 @@ int task_defex_enforce(struct task_struct *p, struct file *f, int syscall)
 	if (!p || p->pid == 1 || !p->mm)
 		return ret;
 
+#ifdef DEFEX_PED_ENABLE
+	/* Without a file only PED applies: skip it if nothing has changed */
+	if (!f && task_defex_verdict_cached(p))
+		return ret;
+#endif /* DEFEX_PED_ENABLE */
+
 	if (syscall < 0) {
 		item = get_local_syscall(-syscall);
 		if (!item)
@@ -683,11 +723,16 @@ int task_defex_enforce(struct task_struct *p, struct file *f, int syscall)
 #ifdef DEFEX_PED_ENABLE
 	/* Credential escalation feature */
 	if (feature_flag & FEATURE_CHECK_CREDS)	{
+		/* Read before the stored creds, see creds_hash_update() */
+		unsigned int gen = atomic_read_acquire(&creds_hash_gen);
+
 #ifndef DEFEX_DSMS_ENABLE
 		ret = task_defex_check_creds(p);
 #else
 		ret = task_defex_check_creds(p, syscall);
 #endif /* DEFEX_DSMS_ENABLE */
+		if (!ret)
+			task_defex_verdict_cache(p, gen);
 		if (ret) {
 			if (!(feature_flag & FEATURE_CHECK_CREDS_SOFT)) {
 				kill_process_group(p, p->tgid, p->pid);
@@ -744,6 +789,10 @@ int task_defex_zero_creds(struct task_struct *tsk)
 		put_task_struct(tsk);
 		return 0;
 	}
+#ifdef DEFEX_PED_ENABLE
+	/* A child must not inherit the parent's verdict */
+	tsk->defex_gen = 0;
+#endif /* DEFEX_PED_ENABLE */
 	if (is_task_creds_ready()) {
 #ifdef DEFEX_PED_BASED_ON_TGID_ENABLE
 		is_fork = ((tsk->flags & PF_FORKNOEXEC) && (!READ_ONCE(tsk->on_rq)));
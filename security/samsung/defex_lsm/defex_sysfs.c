@@ -21,6 +21,7 @@
 #include <linux/syscalls.h>
 #include <linux/sysfs.h>
 #include <linux/version.h>
+#include "include/defex_caches.h"
 #include "include/defex_debug.h"
 #include "include/defex_internal.h"
 #include "include/defex_rules.h"
@@ -311,7 +312,7 @@ static struct rule_item_struct *lookup_dir(struct rule_item_struct *base, const
 	return NULL;
 }
 
-static int lookup_tree(const char *file_path, int attribute, struct file *f)
+static int lookup_tree(const char *file_path, int attribute, struct file *f, int *cacheable)
 {
 	const char *ptr, *next_separator;
 	struct rule_item_struct *base, *cur_item = NULL;
@@ -350,6 +351,9 @@ static int lookup_tree(const char *file_path, int attribute, struct file *f)
 #ifdef DEFEX_INTEGRITY_ENABLE
 			/* Integrity acceptable only for files */
 			if (cur_item->feature_type & feature_is_file) {
+				/* File contents may change, don't cache the result */
+				if (memchr_inv(cur_item->integrity, 0, INTEGRITY_LENGTH))
+					*cacheable = 0;
 				if (defex_integrity_default(file_path)
 					&& defex_check_integrity(f, cur_item->integrity))
 					return DEFEX_INTEGRITY_FAIL;
@@ -378,10 +382,19 @@ int rules_lookup(const struct path *dpath, int attribute, struct file *f)
 #if (defined(DEFEX_SAFEPLACE_ENABLE) || defined(DEFEX_IMMUTABLE_ENABLE) || defined(DEFEX_PED_ENABLE))
 	static const char system_root_txt[] = "/system_root";
 	char *target_file, *buff;
+#if defined(DEFEX_USE_PACKED_RULES) || defined(DEFEX_CACHES_ENABLE)
+	int cacheable = 1;
+#endif
 #ifndef DEFEX_USE_PACKED_RULES
 	int i, count, end;
 	const struct static_rule *current_rule;
 #endif
+#ifdef DEFEX_CACHES_ENABLE
+	unsigned int seq = defex_path_cache_seq();
+
+	if (defex_path_cache_find(dpath, attribute, seq, &ret))
+		return ret;
+#endif /* DEFEX_CACHES_ENABLE */
 	buff = kzalloc(PATH_MAX, GFP_ATOMIC);
 	if (!buff)
 		return ret;
@@ -395,7 +408,7 @@ int rules_lookup(const struct path *dpath, int attribute, struct file *f)
 		target_file += (sizeof(system_root_txt) - 1);
 
 #ifdef DEFEX_USE_PACKED_RULES
-	ret = lookup_tree(target_file, attribute, f);
+	ret = lookup_tree(target_file, attribute, f, &cacheable);
 #else
 	for (i = 0; i < static_rule_count; i++) {
 		current_rule = &defex_static_rules[i];
@@ -415,6 +428,10 @@ int rules_lookup(const struct path *dpath, int attribute, struct file *f)
 	}
 #endif /* DEFEX_USE_PACKED_RULES */
 	kfree(buff);
+#ifdef DEFEX_CACHES_ENABLE
+	if (cacheable)
+		defex_path_cache_add(dpath, attribute, seq, ret);
+#endif /* DEFEX_CACHES_ENABLE */
 #endif
 	return ret;
 }
@@ -543,5 +560,9 @@ void __init defex_load_rules(void)
 		panic("[DEFEX] Signature mismatch.\n");
 #endif
 	}
+#ifdef DEFEX_CACHES_ENABLE
+	/* Drop the results looked up before the rules were loaded */
+	defex_path_cache_init();
+#endif /* DEFEX_CACHES_ENABLE */
 #endif /* DEFEX_RAMDISK_ENABLE */
 }
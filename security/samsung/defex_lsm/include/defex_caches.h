@@ -9,10 +9,13 @@
 #ifndef __DEFEX_CACHES_H
 #define __DEFEX_CACHES_H
 
+#include <linux/seqlock.h>
 #include "defex_config.h"
 #include "defex_internal.h"
 
 #define FILE_CACHE_SIZE 0x40
+#define PATH_CACHE_BITS 8
+#define PATH_CACHE_SIZE (1 << PATH_CACHE_BITS)
 
 struct defex_file_cache_entry {
 	int prev_entry;
@@ -27,10 +30,39 @@ struct defex_file_cache_list {
 	int last_entry;
 };
 
+/*
+ * rules_lookup() result for a path, valid while no rename or mount has
+ * happened since (seq) and for tasks with the same root directory.
+ */
+struct defex_path_cache_entry {
+	seqlock_t lock;
+	const struct vfsmount *mnt;
+	const struct dentry *dentry;
+	const struct dentry *parent;
+	const struct inode *inode;
+	unsigned long ino;
+	u32 generation;
+	struct path root;
+	unsigned int seq;
+	int attribute;
+	int result;
+};
+
+struct defex_path_cache_stats {
+	unsigned long hits;
+	unsigned long misses;
+};
+
 void defex_file_cache_init(void);
 void defex_file_cache_add(int pid, struct file *file_addr);
 void defex_file_cache_update(struct file *file_addr);
 void defex_file_cache_delete(int pid);
 struct file *defex_file_cache_find(int pid);
 
+void defex_path_cache_init(void);
+unsigned int defex_path_cache_seq(void);
+int defex_path_cache_find(const struct path *dpath, int attribute, unsigned int seq, int *result);
+void defex_path_cache_add(const struct path *dpath, int attribute, unsigned int seq, int result);
+void defex_path_cache_get_stats(struct defex_path_cache_stats *stats);
+
 #endif /* __DEFEX_CACHES_H */
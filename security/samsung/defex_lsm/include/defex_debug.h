@@ -12,6 +12,7 @@
 #define DBG_SETUID		0
 #define DBG_SET_FSUID		1
 #define DBG_SETGID		2
+#define DBG_LOOKUP		3
 
 int defex_create_debug(struct kset *defex_kset);
 
@@ -57,6 +57,7 @@
 /* Hash tables */
 /* -------------------------------------------------------------------------- */
 extern DECLARE_HASHTABLE(creds_hash, 15);
+extern atomic_t creds_hash_gen;
 void creds_fast_hash_init(void);
 
 /* -------------------------------------------------------------------------- */
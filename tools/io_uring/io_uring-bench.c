@@ -0,0 +1,440 @@
+/*
+ * Random read microbenchmark comparing io_uring against Linux aio
+ * (io_submit/io_getevents) and plain synchronous pread(2).
+ *
+ * Reads -n blocks of -b bytes at random block aligned offsets of a file or
+ * block device, keeping -q reads in flight for the asynchronous engines, and
+ * reports IOPS, bandwidth and the number of system calls issued per I/O.
+ *
+ * Examples:
+ *	io_uring-bench -e uring -q 32 /data/file	buffered, page cache
+ *	io_uring-bench -e uring -d -f -q 32 /dev/sda	O_DIRECT, fixed buffers
+ *	io_uring-bench -e aio -d -q 32 /dev/sda
+ *	io_uring-bench -e sync /data/file
+ *
+ * Build with "make headers_install" done in the top level directory first.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include <linux/aio_abi.h>
+#include <linux/fs.h>
+#include <linux/io_uring.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup	425
+#define __NR_io_uring_enter	426
+#define __NR_io_uring_register	427
+#endif
+
+#define MAX_DEPTH	4096
+
+enum engine { ENGINE_URING, ENGINE_AIO, ENGINE_SYNC };
+
+static const char *engine_names[] = { "uring", "aio", "sync" };
+
+static int depth = 32;
+static unsigned int bs = 4096;
+static unsigned long nr_ios = 100000;
+static int o_direct;
+static int fixed;
+
+static int fd;
+static unsigned long long nr_blocks;
+static void **bufs;
+static unsigned long nr_syscalls;
+
+struct ring {
+	int fd;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	unsigned sq_entries;
+};
+
+static unsigned long long now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static off_t random_offset(void)
+{
+	unsigned long long r = ((unsigned long long)random() << 31) ^ random();
+
+	return (off_t)(r % nr_blocks) * bs;
+}
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+	nr_syscalls++;
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int ring_fd, unsigned to_submit,
+			  unsigned min_complete, unsigned flags)
+{
+	nr_syscalls++;
+	return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static int io_uring_register(int ring_fd, unsigned opcode, void *arg,
+			     unsigned nr_args)
+{
+	nr_syscalls++;
+	return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+static int ring_setup(struct ring *r)
+{
+	struct io_uring_params p;
+	void *ptr;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = io_uring_setup(depth, &p);
+	if (r->fd < 0) {
+		perror("io_uring_setup");
+		return -1;
+	}
+	r->sq_entries = p.sq_entries;
+
+	ptr = mmap(NULL, p.sq_off.array + p.sq_entries * sizeof(unsigned),
+		   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		   r->fd, IORING_OFF_SQ_RING);
+	if (ptr == MAP_FAILED)
+		goto err;
+	r->sq_head = ptr + p.sq_off.head;
+	r->sq_tail = ptr + p.sq_off.tail;
+	r->sq_mask = ptr + p.sq_off.ring_mask;
+	r->sq_array = ptr + p.sq_off.array;
+
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+		       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		       r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto err;
+
+	ptr = mmap(NULL, p.cq_off.cqes +
+		   p.cq_entries * sizeof(struct io_uring_cqe),
+		   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		   r->fd, IORING_OFF_CQ_RING);
+	if (ptr == MAP_FAILED)
+		goto err;
+	r->cq_head = ptr + p.cq_off.head;
+	r->cq_tail = ptr + p.cq_off.tail;
+	r->cq_mask = ptr + p.cq_off.ring_mask;
+	r->cqes = ptr + p.cq_off.cqes;
+
+	if (fixed) {
+		struct iovec iovs[MAX_DEPTH];
+		int i;
+
+		for (i = 0; i < depth; i++) {
+			iovs[i].iov_base = bufs[i];
+			iovs[i].iov_len = bs;
+		}
+		if (io_uring_register(r->fd, IORING_REGISTER_BUFFERS,
+				      iovs, depth) < 0) {
+			perror("IORING_REGISTER_BUFFERS");
+			return -1;
+		}
+		if (io_uring_register(r->fd, IORING_REGISTER_FILES,
+				      &fd, 1) < 0) {
+			perror("IORING_REGISTER_FILES");
+			return -1;
+		}
+	}
+	return 0;
+err:
+	perror("mmap");
+	return -1;
+}
+
+static void ring_prep(struct ring *r, struct iovec *iov, int slot)
+{
+	unsigned tail = *r->sq_tail;
+	unsigned index = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->off = random_offset();
+	sqe->user_data = slot;
+	if (fixed) {
+		sqe->opcode = IORING_OP_READ_FIXED;
+		sqe->flags = IOSQE_FIXED_FILE;
+		sqe->fd = 0;
+		sqe->addr = (unsigned long)bufs[slot];
+		sqe->len = bs;
+		sqe->buf_index = slot;
+	} else {
+		iov->iov_base = bufs[slot];
+		iov->iov_len = bs;
+		sqe->opcode = IORING_OP_READV;
+		sqe->fd = fd;
+		sqe->addr = (unsigned long)iov;
+		sqe->len = 1;
+	}
+	r->sq_array[index] = index;
+	/* order the sqe stores with the tail update */
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+static int run_uring(void)
+{
+	struct iovec iovs[MAX_DEPTH];
+	int free_slots[MAX_DEPTH], nr_free = depth;
+	unsigned long submitted = 0, done = 0;
+	struct ring r;
+	int i;
+
+	if (ring_setup(&r))
+		return -1;
+	if ((unsigned)depth > r.sq_entries)
+		depth = r.sq_entries;
+	for (i = 0; i < depth; i++)
+		free_slots[i] = i;
+
+	while (done < nr_ios) {
+		unsigned to_submit = 0, head, tail;
+		int ret;
+
+		while (nr_free && submitted < nr_ios) {
+			int slot = free_slots[--nr_free];
+
+			ring_prep(&r, &iovs[slot], slot);
+			submitted++;
+			to_submit++;
+		}
+
+		ret = io_uring_enter(r.fd, to_submit, 1,
+				     IORING_ENTER_GETEVENTS);
+		if (ret < 0) {
+			perror("io_uring_enter");
+			return -1;
+		}
+
+		head = *r.cq_head;
+		tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+
+			if (cqe->res != (int)bs) {
+				fprintf(stderr, "read: %s\n",
+					cqe->res < 0 ? strerror(-cqe->res) :
+					"short read");
+				return -1;
+			}
+			free_slots[nr_free++] = cqe->user_data;
+			done++;
+		}
+		__atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	close(r.fd);
+	return 0;
+}
+
+static int run_aio(void)
+{
+	struct iocb iocbs[MAX_DEPTH], *iocbps[MAX_DEPTH];
+	struct io_event events[MAX_DEPTH];
+	int free_slots[MAX_DEPTH], nr_free = depth;
+	unsigned long submitted = 0, done = 0;
+	aio_context_t ctx = 0;
+	int i;
+
+	nr_syscalls++;
+	if (syscall(__NR_io_setup, depth, &ctx) < 0) {
+		perror("io_setup");
+		return -1;
+	}
+	for (i = 0; i < depth; i++)
+		free_slots[i] = i;
+
+	while (done < nr_ios) {
+		int nr = 0, ret;
+
+		while (nr_free && submitted < nr_ios) {
+			int slot = free_slots[--nr_free];
+			struct iocb *cb = &iocbs[slot];
+
+			memset(cb, 0, sizeof(*cb));
+			cb->aio_data = slot;
+			cb->aio_lio_opcode = IOCB_CMD_PREAD;
+			cb->aio_fildes = fd;
+			cb->aio_buf = (unsigned long)bufs[slot];
+			cb->aio_nbytes = bs;
+			cb->aio_offset = random_offset();
+			iocbps[nr++] = cb;
+			submitted++;
+		}
+		if (nr) {
+			nr_syscalls++;
+			ret = syscall(__NR_io_submit, ctx, nr, iocbps);
+			if (ret != nr) {
+				perror("io_submit");
+				return -1;
+			}
+		}
+
+		nr_syscalls++;
+		ret = syscall(__NR_io_getevents, ctx, 1, depth, events, NULL);
+		if (ret < 0) {
+			perror("io_getevents");
+			return -1;
+		}
+		for (i = 0; i < ret; i++) {
+			if (events[i].res != bs) {
+				fprintf(stderr, "read: %s\n",
+					(long long)events[i].res < 0 ?
+					strerror(-events[i].res) :
+					"short read");
+				return -1;
+			}
+			free_slots[nr_free++] = events[i].data;
+			done++;
+		}
+	}
+
+	syscall(__NR_io_destroy, ctx);
+	return 0;
+}
+
+static int run_sync(void)
+{
+	unsigned long i;
+
+	for (i = 0; i < nr_ios; i++) {
+		nr_syscalls++;
+		if (pread(fd, bufs[0], bs, random_offset()) != bs) {
+			perror("pread");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [-e uring|aio|sync] [-d] [-f] [-q depth] [-b bs] [-n ios] file\n"
+		"  -e  I/O engine (default uring)\n"
+		"  -d  open with O_DIRECT\n"
+		"  -f  use registered files and buffers (uring only)\n"
+		"  -q  number of reads in flight (default 32)\n"
+		"  -b  block size in bytes (default 4096)\n"
+		"  -n  number of reads (default 100000)\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	enum engine engine = ENGINE_URING;
+	unsigned long long start, ns, size;
+	struct stat st;
+	int opt, i, ret;
+
+	while ((opt = getopt(argc, argv, "e:dfq:b:n:")) != -1) {
+		switch (opt) {
+		case 'e':
+			for (i = 0; i < 3; i++)
+				if (!strcmp(optarg, engine_names[i]))
+					break;
+			if (i == 3)
+				usage(argv[0]);
+			engine = i;
+			break;
+		case 'd':
+			o_direct = 1;
+			break;
+		case 'f':
+			fixed = 1;
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		case 'b':
+			bs = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			nr_ios = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || depth < 1 || depth > MAX_DEPTH || !bs)
+		usage(argv[0]);
+	if (engine == ENGINE_SYNC)
+		depth = 1;
+
+	fd = open(argv[optind], O_RDONLY | (o_direct ? O_DIRECT : 0));
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+	size = st.st_size;
+	if (S_ISBLK(st.st_mode) && ioctl(fd, BLKGETSIZE64, &size) < 0) {
+		perror("BLKGETSIZE64");
+		return 1;
+	}
+	nr_blocks = size / bs;
+	if (!nr_blocks) {
+		fprintf(stderr, "%s: smaller than one block\n", argv[optind]);
+		return 1;
+	}
+
+	bufs = calloc(depth, sizeof(*bufs));
+	for (i = 0; i < depth; i++) {
+		if (posix_memalign(&bufs[i], 4096, bs)) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+		/* fault in, so registration and the first reads don't */
+		memset(bufs[i], 0, bs);
+	}
+
+	srandom(getpid());
+	start = now_ns();
+	switch (engine) {
+	case ENGINE_URING:
+		ret = run_uring();
+		break;
+	case ENGINE_AIO:
+		ret = run_aio();
+		break;
+	default:
+		ret = run_sync();
+		break;
+	}
+	ns = now_ns() - start;
+	if (ret)
+		return 1;
+
+	printf("%s%s%s: %lu reads of %u bytes, depth %d: %llu IOPS, %llu MB/s, %.2f syscalls/IO\n",
+	       engine_names[engine], o_direct ? " direct" : "",
+	       fixed ? " fixed" : "", nr_ios, bs, depth,
+	       nr_ios * 1000000000ULL / (ns ? ns : 1),
+	       (unsigned long long)nr_ios * bs * 1000 / (ns ? ns : 1),
+	       (double)nr_syscalls / nr_ios);
+	return 0;
+}
@@ -0,0 +1,101 @@
+#!/bin/bash
+# Allocates from every CMA area in parallel, with several workers per
+# area, through the cma debugfs interface. Checks that the areas end up
+# as used as they started and prints their latency and retry counters.
+
+cma_debugfs=/sys/kernel/debug/cma
+workers=${WORKERS:-4}
+rounds=${ROUNDS:-50}
+pages=${PAGES:-256}
+
+check_prereqs()
+{
+	local msg="skip all tests:"
+
+	if [ $UID != 0 ]; then
+		echo $msg must be run as root >&2
+		exit 0
+	fi
+
+	if [ ! -d $cma_debugfs ]; then
+		echo $msg $cma_debugfs not found, needs CONFIG_CMA_DEBUGFS >&2
+		exit 0
+	fi
+}
+
+# Allocate and free $pages pages $rounds times, print the failures
+worker()
+{
+	local area="$1"
+	local fail=0
+	local i
+
+	for ((i = 0; i < rounds; i++)); do
+		if echo $pages > $area/alloc 2>/dev/null; then
+			echo $pages > $area/free
+		else
+			fail=$((fail + 1))
+		fi
+	done
+	echo $fail
+}
+
+check_prereqs
+
+areas=()
+for area in $cma_debugfs/*; do
+	[ -w $area/alloc ] || continue
+	# Leave room for the area's own users
+	[ $(cat $area/count) -ge $((2 * workers * pages)) ] || continue
+	areas+=($area)
+done
+
+if [ ${#areas[@]} -eq 0 ]; then
+	echo "skip all tests: no CMA area large enough" >&2
+	exit 0
+fi
+
+tmp=$(mktemp -d)
+trap "rm -rf $tmp" EXIT
+
+declare -A used
+for area in ${areas[@]}; do
+	used[$area]=$(cat $area/used)
+done
+
+start=$(date +%s%N)
+for area in ${areas[@]}; do
+	for ((w = 0; w < workers; w++)); do
+		worker $area > $tmp/$(basename $area).$w &
+	done
+done
+wait
+elapsed=$((($(date +%s%N) - start) / 1000000))
+
+rc=0
+echo "${#areas[@]} areas, $workers workers each, $rounds x $pages pages: ${elapsed} ms"
+for area in ${areas[@]}; do
+	name=$(basename $area)
+	fail=$(awk '{ s += $1 } END { print s }' $tmp/$name.*)
+
+	printf "%-16s fail %3d/%d  latency avg %6d us max %8d us  retries isolate %d busy %d\n" \
+		$name $fail $((workers * rounds)) \
+		$(cat $area/latency_avg_us) $(cat $area/latency_max_us) \
+		$(cat $area/isolate_retry) $(cat $area/busy_retry)
+
+	if [ $(cat $area/used) -ne ${used[$area]} ]; then
+		echo "$name: $(cat $area/used) pages used, expected ${used[$area]}"
+		rc=1
+	fi
+	if [ $fail -eq $((workers * rounds)) ]; then
+		echo "$name: every allocation failed"
+		rc=1
+	fi
+done
+
+if [ $rc -ne 0 ]; then
+	echo "cma_stress: [FAIL]"
+else
+	echo "cma_stress: [PASS]"
+fi
+exit $rc
@@ -0,0 +1,177 @@
+/*
+ * Check DEFEX rule lookups and their per-path result cache through the
+ * debug interface (userdebug kernels only), and measure lookup rate.
+ *
+ * usage: defex_rules_test [path:features ...]
+ *
+ * Each argument names a file and the rule features (decimal, see
+ * enum feature_types) it is expected to match.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEBUG_FILE "/sys/defex/debug"
+#define ITERATIONS 100000
+
+struct lookup {
+	int features;
+	unsigned long hits;
+	unsigned long misses;
+};
+
+static int do_lookup(const char *path, struct lookup *res)
+{
+	char buf[256];
+	int fd, len;
+
+	fd = open(DEBUG_FILE, O_RDWR);
+	if (fd < 0)
+		return -1;
+	len = snprintf(buf, sizeof(buf), "lookup=%s", path);
+	if (write(fd, buf, len) != len) {
+		close(fd);
+		return -1;
+	}
+	memset(buf, 0, sizeof(buf));
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	close(fd);
+	if (len <= 0)
+		return -1;
+
+	memset(res, 0, sizeof(*res));
+	if (sscanf(buf, "features=%d\ncache_hits=%lu\ncache_misses=%lu",
+		   &res->features, &res->hits, &res->misses) < 1)
+		return -1;
+	return 0;
+}
+
+/* A repeated lookup must come from the cache and agree with the first */
+static int check_cached(const char *path)
+{
+	struct lookup first, second;
+
+	if (do_lookup(path, &first) || do_lookup(path, &second)) {
+		printf("%s: lookup failed: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (first.features != second.features) {
+		printf("%s: cached features %d, looked up %d\n",
+		       path, second.features, first.features);
+		return -1;
+	}
+	if (second.hits <= first.hits) {
+		printf("%s: repeated lookup missed the cache\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+/* A renamed file must be looked up again under its new name */
+static int check_rename(void)
+{
+	char dir[] = "/data/local/tmp/defex.XXXXXX";
+	char from[64], to[64];
+	struct lookup before, after;
+	int fd, ret = -1;
+
+	if (!mkdtemp(dir)) {
+		strcpy(dir, "/tmp/defex.XXXXXX");
+		if (!mkdtemp(dir))
+			return 0;
+	}
+	snprintf(from, sizeof(from), "%s/a", dir);
+	snprintf(to, sizeof(to), "%s/b", dir);
+
+	fd = open(from, O_CREAT | O_WRONLY, 0600);
+	if (fd < 0)
+		goto out;
+	close(fd);
+
+	if (do_lookup(from, &before) || do_lookup(from, &before))
+		goto out;
+	if (rename(from, to))
+		goto out;
+	if (do_lookup(to, &after))
+		goto out;
+	if (after.misses == before.misses) {
+		printf("rename: stale cache entry used\n");
+		goto out;
+	}
+	ret = 0;
+out:
+	unlink(from);
+	unlink(to);
+	rmdir(dir);
+	return ret;
+}
+
+static int check_expected(const char *arg)
+{
+	char path[256], *sep;
+	struct lookup res;
+	int expected;
+
+	snprintf(path, sizeof(path), "%s", arg);
+	sep = strrchr(path, ':');
+	if (!sep)
+		return -1;
+	*sep = 0;
+	expected = atoi(sep + 1);
+
+	if (do_lookup(path, &res) || res.features != expected) {
+		printf("%s: features %d, expected %d\n",
+		       path, res.features, expected);
+		return -1;
+	}
+	return check_cached(path);
+}
+
+static void measure(const char *path)
+{
+	struct timespec start, end;
+	struct lookup res;
+	double ns;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < ITERATIONS; i++)
+		do_lookup(path, &res);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+	printf("%s: %.0f ns per lookup (5 features, incl. sysfs I/O)\n",
+	       path, ns / ITERATIONS);
+}
+
+int main(int argc, char **argv)
+{
+	static const char * const paths[] = {
+		"/system/bin/sh", "/system/bin/app_process64", "/init", "/",
+	};
+	int i, failed = 0;
+
+	if (access(DEBUG_FILE, W_OK)) {
+		printf("%s not available, skipping\n", DEBUG_FILE);
+		return 0;
+	}
+
+	for (i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+		if (!access(paths[i], F_OK) && check_cached(paths[i]))
+			failed++;
+	for (i = 1; i < argc; i++)
+		if (check_expected(argv[i]))
+			failed++;
+	if (check_rename())
+		failed++;
+
+	measure("/system/bin/sh");
+
+	printf("%s\n", failed ? "[FAIL]" : "[PASS]");
+	return failed ? 1 : 0;
+}
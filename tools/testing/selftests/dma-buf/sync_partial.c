@@ -0,0 +1,225 @@
+/*
+ * Checks DMA_BUF_IOCTL_SYNC_PARTIAL on a cached ION buffer, and compares
+ * the cost of syncing part of the buffer with syncing all of it.
+ *
+ * Usage: sync_partial [-m heap_id_mask] [-s buffer_size] [-n iterations]
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/dma-buf.h>
+#include "ion.h"
+
+#define KSFT_SKIP	4
+
+static unsigned int heap_mask = 1 << ION_HEAP_TYPE_SYSTEM;
+static size_t buf_size = 8 << 20;
+static unsigned int iterations = 1000;
+
+static int alloc_dmabuf(int ion_fd, size_t len)
+{
+	struct ion_allocation_data alloc = {
+		.len = len,
+		.align = 0,
+		.heap_id_mask = heap_mask,
+		.flags = ION_FLAG_CACHED,
+	};
+	struct ion_fd_data share;
+	struct ion_handle_data free_data;
+
+	if (ioctl(ion_fd, ION_IOC_ALLOC, &alloc) < 0)
+		return -errno;
+
+	share.handle = alloc.handle;
+	if (ioctl(ion_fd, ION_IOC_SHARE, &share) < 0)
+		share.fd = -errno;
+
+	/* The dma-buf keeps the buffer alive */
+	free_data.handle = alloc.handle;
+	ioctl(ion_fd, ION_IOC_FREE, &free_data);
+
+	return share.fd;
+}
+
+static int sync_partial(int fd, __u64 flags, __u32 offset, __u32 len)
+{
+	struct dma_buf_sync_partial sync = {
+		.flags = flags,
+		.offset = offset,
+		.len = len,
+	};
+
+	return ioctl(fd, DMA_BUF_IOCTL_SYNC_PARTIAL, &sync) < 0 ? -errno : 0;
+}
+
+static int check_ranges(int fd, unsigned char *map)
+{
+	static const struct {
+		__u32 offset, len;
+		int expected;
+	} cases[] = {
+		{ 0, 1, 0 },
+		{ 4095, 2, 0 },
+		{ 0, 0, -EINVAL },
+		{ 0, UINT32_MAX, -EINVAL },
+		{ UINT32_MAX, 1, -EINVAL },
+	};
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		ret = sync_partial(fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_RW,
+				   cases[i].offset, cases[i].len);
+		if (ret != cases[i].expected) {
+			printf("sync of %u bytes at %u: %d, expected %d\n",
+			       cases[i].len, cases[i].offset, ret,
+			       cases[i].expected);
+			return -1;
+		}
+		if (!ret)
+			sync_partial(fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_RW,
+				     cases[i].offset, cases[i].len);
+	}
+
+	/* The last byte of the buffer, written between START and END */
+	ret = sync_partial(fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_WRITE,
+			   buf_size - 1, 1);
+	if (!ret) {
+		map[buf_size - 1] = 0xa5;
+		ret = sync_partial(fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_WRITE,
+				   buf_size - 1, 1);
+	}
+	if (ret) {
+		printf("sync of the last byte failed: %d\n", ret);
+		return -1;
+	}
+
+	if (sync_partial(fd, DMA_BUF_SYNC_START, 0, 1) != -EINVAL) {
+		printf("sync without a direction was accepted\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* One cpu access: invalidate before, write, clean after */
+static double bench_partial(int fd, unsigned char *map, __u32 len)
+{
+	double start = now_us();
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++) {
+		sync_partial(fd, DMA_BUF_SYNC_START | DMA_BUF_SYNC_RW, 0, len);
+		map[0] = i;
+		sync_partial(fd, DMA_BUF_SYNC_END | DMA_BUF_SYNC_RW, 0, len);
+	}
+
+	return (now_us() - start) / iterations;
+}
+
+static double bench_full(int ion_fd, int fd, unsigned char *map)
+{
+	struct ion_fd_data data = { .fd = fd };
+	double start = now_us();
+	unsigned int i;
+
+	for (i = 0; i < iterations; i++) {
+		map[0] = i;
+		ioctl(ion_fd, ION_IOC_SYNC, &data);
+	}
+
+	return (now_us() - start) / iterations;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned char *map;
+	int ion_fd, fd, opt;
+	size_t len;
+
+	while ((opt = getopt(argc, argv, "m:s:n:")) != -1) {
+		switch (opt) {
+		case 'm':
+			heap_mask = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			buf_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			iterations = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-m heap_id_mask] [-s size] [-n iterations]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	if (buf_size < 4096 || !iterations) {
+		fprintf(stderr, "buffer or iteration count too small\n");
+		return 1;
+	}
+
+	ion_fd = open("/dev/ion", O_RDONLY);
+	if (ion_fd < 0) {
+		printf("sync_partial: no /dev/ion [SKIP]\n");
+		return KSFT_SKIP;
+	}
+
+	fd = alloc_dmabuf(ion_fd, buf_size);
+	if (fd < 0) {
+		printf("sync_partial: cannot allocate from heaps %#x: %s [SKIP]\n",
+		       heap_mask, strerror(-fd));
+		return KSFT_SKIP;
+	}
+
+	map = mmap(NULL, buf_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	if (check_ranges(fd, map)) {
+		printf("sync_partial: [FAIL]\n");
+		return 1;
+	}
+
+	printf("%-24s %14s\n", "synced", "us per access");
+	for (len = 4096; len < buf_size; len *= 4)
+		printf("%-18zu bytes %14.2f\n", len,
+		       bench_partial(fd, map, len));
+	printf("%-18zu bytes %14.2f\n", buf_size,
+	       bench_partial(fd, map, buf_size));
+	printf("%-24s %14.2f\n", "all, with ION_IOC_SYNC",
+	       bench_full(ion_fd, fd, map));
+
+	munmap(map, buf_size);
+	close(fd);
+	close(ion_fd);
+
+	printf("sync_partial: [PASS]\n");
+	return 0;
+}
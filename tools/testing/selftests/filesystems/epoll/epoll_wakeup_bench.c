@@ -0,0 +1,211 @@
+/*
+ * epoll wakeup scalability benchmark.
+ *
+ * A set of eventfds is registered in a single epoll instance.  Writer
+ * threads signal their share of the eventfds in a loop, each write
+ * ending up in ep_poll_callback(), while consumer threads drain the set
+ * with epoll_wait() and read().  The rate of writes is reported, run it
+ * with increasing -w to see how wakeups from many CPUs scale.
+ *
+ * Once the writers stop, every value written must be read back through
+ * the epoll set, otherwise an event was lost and the test fails.
+ *
+ * Usage: epoll_wakeup_bench [-w writers] [-c consumers] [-f fds] [-s secs]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define MAX_EVENTS	64
+
+static int nr_writers = 4;
+static int nr_consumers = 1;
+static int nr_fds = 256;
+static int seconds = 5;
+
+static int epfd;
+static int *fds;
+static volatile int stop_writers;
+static volatile int stop_consumers;
+
+struct thread_data {
+	pthread_t thread;
+	int id;
+	uint64_t count;
+};
+
+static void *writer(void *arg)
+{
+	struct thread_data *td = arg;
+	uint64_t one = 1;
+	int i = td->id;
+
+	while (!stop_writers) {
+		if (write(fds[i], &one, sizeof(one)) != sizeof(one)) {
+			perror("write");
+			exit(1);
+		}
+		td->count++;
+		i += nr_writers;
+		if (i >= nr_fds)
+			i = td->id;
+	}
+
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	struct thread_data *td = arg;
+	struct epoll_event events[MAX_EVENTS];
+
+	while (!stop_consumers) {
+		int i, n;
+
+		n = epoll_wait(epfd, events, MAX_EVENTS, 100);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("epoll_wait");
+			exit(1);
+		}
+
+		for (i = 0; i < n; i++) {
+			uint64_t val;
+
+			/* another consumer may have drained it already */
+			if (read(events[i].data.fd, &val, sizeof(val)) ==
+			    sizeof(val))
+				__atomic_add_fetch(&td->count, val,
+						   __ATOMIC_RELAXED);
+		}
+	}
+
+	return NULL;
+}
+
+static uint64_t sum(struct thread_data *td, int nr)
+{
+	uint64_t total = 0;
+	int i;
+
+	for (i = 0; i < nr; i++)
+		total += __atomic_load_n(&td[i].count, __ATOMIC_RELAXED);
+
+	return total;
+}
+
+int main(int argc, char **argv)
+{
+	struct thread_data *writers, *consumers;
+	uint64_t written, consumed;
+	int i, opt, waited;
+
+	while ((opt = getopt(argc, argv, "w:c:f:s:")) != -1) {
+		switch (opt) {
+		case 'w':
+			nr_writers = atoi(optarg);
+			break;
+		case 'c':
+			nr_consumers = atoi(optarg);
+			break;
+		case 'f':
+			nr_fds = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-w writers] [-c consumers] "
+				"[-f fds] [-s secs]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (nr_writers < 1 || nr_consumers < 1 || nr_fds < nr_writers) {
+		fprintf(stderr, "need at least one writer and consumer, and "
+			"one fd per writer\n");
+		return 1;
+	}
+
+	epfd = epoll_create1(0);
+	if (epfd < 0) {
+		perror("epoll_create1");
+		return 1;
+	}
+
+	fds = calloc(nr_fds, sizeof(*fds));
+	writers = calloc(nr_writers, sizeof(*writers));
+	consumers = calloc(nr_consumers, sizeof(*consumers));
+	if (!fds || !writers || !consumers) {
+		perror("calloc");
+		return 1;
+	}
+
+	for (i = 0; i < nr_fds; i++) {
+		struct epoll_event ev = { .events = EPOLLIN };
+
+		fds[i] = eventfd(0, EFD_NONBLOCK);
+		if (fds[i] < 0) {
+			perror("eventfd");
+			return 1;
+		}
+		ev.data.fd = fds[i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev)) {
+			perror("epoll_ctl");
+			return 1;
+		}
+	}
+
+	for (i = 0; i < nr_consumers; i++) {
+		consumers[i].id = i;
+		pthread_create(&consumers[i].thread, NULL, consumer,
+			       &consumers[i]);
+	}
+	for (i = 0; i < nr_writers; i++) {
+		writers[i].id = i;
+		pthread_create(&writers[i].thread, NULL, writer, &writers[i]);
+	}
+
+	sleep(seconds);
+	stop_writers = 1;
+	for (i = 0; i < nr_writers; i++)
+		pthread_join(writers[i].thread, NULL);
+
+	written = sum(writers, nr_writers);
+
+	/* give the consumers up to 5s to pick up what is left */
+	for (waited = 0; waited < 50; waited++) {
+		if (sum(consumers, nr_consumers) == written)
+			break;
+		usleep(100000);
+	}
+
+	stop_consumers = 1;
+	for (i = 0; i < nr_consumers; i++)
+		pthread_join(consumers[i].thread, NULL);
+
+	consumed = sum(consumers, nr_consumers);
+
+	printf("writers %d consumers %d fds %d: %llu wakeups/s\n",
+	       nr_writers, nr_consumers, nr_fds,
+	       (unsigned long long)(written / seconds));
+
+	if (consumed != written) {
+		printf("[FAIL] wrote %llu, read back %llu\n",
+		       (unsigned long long)written,
+		       (unsigned long long)consumed);
+		return 1;
+	}
+
+	printf("[PASS]\n");
+	return 0;
+}
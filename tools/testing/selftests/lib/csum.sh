@@ -0,0 +1,15 @@
+#!/bin/sh
+# Runs checksum tests and benchmark using test_csum kernel module
+
+if ! /sbin/modprobe -q -n test_csum; then
+	echo "csum: [SKIP]"
+	exit 77
+fi
+
+if /sbin/modprobe -q test_csum; then
+	/sbin/modprobe -q -r test_csum
+	echo "csum: ok"
+else
+	echo "csum: [FAIL]"
+	exit 1
+fi
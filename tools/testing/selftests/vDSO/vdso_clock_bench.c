@@ -0,0 +1,109 @@
+/*
+ * Compare clock_gettime() through the vDSO with the plain system call,
+ * for each clock the vDSO handles, and check that both agree. Meant to
+ * be built for AArch32 as well, to measure the compat vDSO on arm64:
+ *
+ *	arm-linux-gnueabihf-gcc -O2 -static -o vdso_clock_bench vdso_clock_bench.c
+ *
+ * usage: vdso_clock_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/auxv.h>
+#include <sys/syscall.h>
+
+#ifndef CLOCK_BOOTTIME
+#define CLOCK_BOOTTIME 7
+#endif
+
+static const struct {
+	clockid_t id;
+	const char *name;
+} clocks[] = {
+	{ CLOCK_REALTIME,		"CLOCK_REALTIME" },
+	{ CLOCK_MONOTONIC,		"CLOCK_MONOTONIC" },
+	{ CLOCK_REALTIME_COARSE,	"CLOCK_REALTIME_COARSE" },
+	{ CLOCK_MONOTONIC_COARSE,	"CLOCK_MONOTONIC_COARSE" },
+	{ CLOCK_BOOTTIME,		"CLOCK_BOOTTIME" },
+};
+
+static long long ts_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static int sys_clock_gettime(clockid_t id, struct timespec *ts)
+{
+	return syscall(SYS_clock_gettime, id, ts);
+}
+
+static double measure(int (*gettime)(clockid_t, struct timespec *),
+		      clockid_t id, long iterations)
+{
+	struct timespec start, end, ts;
+	long i;
+
+	sys_clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++)
+		gettime(id, &ts);
+	sys_clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (double)(ts_ns(&end) - ts_ns(&start)) / iterations;
+}
+
+/* The vDSO time must fall between two syscall readings around it */
+static int check(clockid_t id, int coarse)
+{
+	struct timespec before, vdso, after;
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		sys_clock_gettime(id, &before);
+		clock_gettime(id, &vdso);
+		sys_clock_gettime(id, &after);
+
+		if (vdso.tv_nsec < 0 || vdso.tv_nsec >= 1000000000L)
+			return -1;
+		/* Coarse clocks may legitimately lag by up to a tick */
+		if (!coarse && (ts_ns(&vdso) < ts_ns(&before) ||
+				ts_ns(&vdso) > ts_ns(&after)))
+			return -1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	long iterations = argc > 1 ? atol(argv[1]) : 1000000;
+	int failed = 0;
+	unsigned int i;
+
+	if (iterations <= 0)
+		iterations = 1;
+
+	printf("%d-bit process, vDSO %s\n", (int)sizeof(long) * 8,
+	       getauxval(AT_SYSINFO_EHDR) ? "mapped" : "not mapped");
+
+	for (i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++) {
+		int coarse = clocks[i].id == CLOCK_REALTIME_COARSE ||
+			     clocks[i].id == CLOCK_MONOTONIC_COARSE;
+		double sys_ns, vdso_ns;
+
+		if (check(clocks[i].id, coarse)) {
+			printf("%-24s vDSO and syscall disagree\n",
+			       clocks[i].name);
+			failed++;
+			continue;
+		}
+		sys_ns = measure(sys_clock_gettime, clocks[i].id, iterations);
+		vdso_ns = measure(clock_gettime, clocks[i].id, iterations);
+		printf("%-24s syscall %8.1f ns  vDSO %8.1f ns\n",
+		       clocks[i].name, sys_ns, vdso_ns);
+	}
+
+	printf("%s\n", failed ? "[FAIL]" : "[PASS]");
+	return failed ? 1 : 0;
+}
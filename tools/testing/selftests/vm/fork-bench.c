@@ -0,0 +1,201 @@
+/*
+ * Measure fork() latency against the resident set size of the parent,
+ * with and without PTE table sharing (vm.fork_share_pte_kb), and check
+ * that parent and child still see private copies of their memory.
+ *
+ * usage: fork-bench [max size in MB] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define SYSCTL "/proc/sys/vm/fork_share_pte_kb"
+#define MB (1UL << 20)
+
+static long page_size;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int read_sysctl(unsigned long *val)
+{
+	FILE *f = fopen(SYSCTL, "r");
+	int ret;
+
+	if (!f)
+		return -1;
+	ret = fscanf(f, "%lu", val) == 1 ? 0 : -1;
+	fclose(f);
+	return ret;
+}
+
+static int write_sysctl(unsigned long val)
+{
+	FILE *f = fopen(SYSCTL, "w");
+	int ret;
+
+	if (!f)
+		return -1;
+	ret = fprintf(f, "%lu\n", val) > 0 ? 0 : -1;
+	if (fclose(f))
+		ret = -1;
+	return ret;
+}
+
+static void fill(char *buf, size_t len, char val)
+{
+	size_t off;
+
+	for (off = 0; off < len; off += page_size)
+		buf[off] = val;
+}
+
+static int check(char *buf, size_t len, char val)
+{
+	size_t off;
+
+	for (off = 0; off < len; off += page_size)
+		if (buf[off] != val)
+			return -1;
+	return 0;
+}
+
+/*
+ * The child writes its half of the buffer, the parent the other one
+ * while the child runs, and both check that they only see their own
+ * writes.
+ */
+static int check_private(char *buf, size_t len)
+{
+	int status;
+	pid_t pid;
+
+	fill(buf, len, 1);
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (!pid) {
+		fill(buf, len / 2, 2);
+		usleep(100000);
+		_exit(check(buf, len / 2, 2) ||
+		      check(buf + len / 2, len / 2, 1));
+	}
+	fill(buf + len / 2, len / 2, 3);
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+	    WEXITSTATUS(status)) {
+		fprintf(stderr, "child saw the parent's writes\n");
+		return -1;
+	}
+	if (check(buf, len / 2, 1) || check(buf + len / 2, len / 2, 3)) {
+		fprintf(stderr, "parent saw the child's writes\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int run(size_t len, int iterations)
+{
+	double fork_us = 0, fault_us = 0, start;
+	int i, status;
+	pid_t pid;
+	char *buf;
+	int pipefd[2];
+
+	buf = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	/* PTE tables are what we are after, not huge pmds */
+	madvise(buf, len, MADV_NOHUGEPAGE);
+	fill(buf, len, 1);
+
+	for (i = 0; i < iterations; i++) {
+		double child_us;
+
+		if (pipe(pipefd)) {
+			perror("pipe");
+			return -1;
+		}
+		start = now_us();
+		pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return -1;
+		}
+		if (!pid) {
+			/* First write fault in the child, one per table */
+			child_us = now_us();
+			buf[0] = 2;
+			child_us = now_us() - child_us;
+			if (write(pipefd[1], &child_us, sizeof(child_us)) < 0)
+				_exit(1);
+			_exit(0);
+		}
+		fork_us += now_us() - start;
+		if (read(pipefd[0], &child_us, sizeof(child_us)) ==
+		    sizeof(child_us))
+			fault_us += child_us;
+		waitpid(pid, &status, 0);
+		close(pipefd[0]);
+		close(pipefd[1]);
+	}
+
+	printf("%8zu MB  fork %10.1f us  first write fault %8.1f us\n",
+	       len / MB, fork_us / iterations, fault_us / iterations);
+
+	i = check_private(buf, len);
+	munmap(buf, len);
+	return i;
+}
+
+static int run_sizes(size_t max_mb, int iterations)
+{
+	size_t mb;
+
+	for (mb = 16; mb <= max_mb; mb *= 2)
+		if (run(mb * MB, iterations))
+			return -1;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	size_t max_mb = argc > 1 ? strtoul(argv[1], NULL, 0) : 1024;
+	int iterations = argc > 2 ? atoi(argv[2]) : 10;
+	unsigned long saved;
+	int ret;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (iterations <= 0)
+		iterations = 1;
+
+	if (read_sysctl(&saved) || write_sysctl(0)) {
+		printf("%s not available, measuring plain fork only\n",
+		       SYSCTL);
+		return run_sizes(max_mb, iterations) ? 1 : 0;
+	}
+
+	printf("copying page tables:\n");
+	ret = run_sizes(max_mb, iterations);
+	if (!ret) {
+		printf("sharing page tables:\n");
+		ret = write_sysctl(1024) ?: run_sizes(max_mb, iterations);
+	}
+
+	write_sysctl(saved);
+	return ret ? 1 : 0;
+}